@@ -0,0 +1,186 @@
+/*
+ * Host calibration.
+ *
+ * Measures this host's JPEG decoders and every connected camera (or the
+ * given devices), prints the recommended source settings with the latency
+ * and CPU to expect, and merges them into the host profile the plugin
+ * loads at startup. The cameras must not be open in OBS meanwhile.
+ *
+ *   ./canon-eos-calibrate
+ *   ./canon-eos-calibrate --device usb:001,004 --device usb:001,005 --seconds 5
+ */
+
+#include <util/base.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "canon-camera.h"
+#include "camera-detector.h"
+#include "host-calibration.h"
+
+typedef struct {
+    const char *devices[HOST_CALIBRATION_MAX_CAMERAS];
+    uint32_t device_count;
+    const char *profile;
+    double seconds;
+    bool validate;
+    bool write;
+    bool verbose;
+} calibrate_options_t;
+
+static bool g_verbose = false;
+
+static void log_handler(int level, const char *format, va_list args, void *param)
+{
+    UNUSED_PARAMETER(param);
+    if (level <= LOG_WARNING || g_verbose) {
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+    }
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [options]\n"
+           "  --device PATH     camera to calibrate, repeatable (default: all connected)\n"
+           "  --seconds N       fetch and validation time per camera (default 3)\n"
+           "  --profile PATH    host profile to update (default CANON_EOS_HOST_PROFILE or\n"
+           "                    ~/.config/obs-canon-eos/host-profile.conf)\n"
+           "  --no-validate     skip the run with all cameras at the recommended settings\n"
+           "  --no-write        print the report only\n"
+           "  --verbose         show plugin log output\n",
+           argv0);
+}
+
+static bool parse_options(int argc, char **argv, calibrate_options_t *options)
+{
+    static const struct option long_options[] = {
+        {"device", required_argument, NULL, 'd'},
+        {"seconds", required_argument, NULL, 's'},
+        {"profile", required_argument, NULL, 'p'},
+        {"no-validate", no_argument, NULL, 'V'},
+        {"no-write", no_argument, NULL, 'W'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    memset(options, 0, sizeof(*options));
+    options->seconds = 3.0;
+    options->validate = true;
+    options->write = true;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'd':
+                if (options->device_count == HOST_CALIBRATION_MAX_CAMERAS) {
+                    fprintf(stderr, "At most %d cameras\n", HOST_CALIBRATION_MAX_CAMERAS);
+                    return false;
+                }
+                options->devices[options->device_count++] = optarg;
+                break;
+            case 's': options->seconds = atof(optarg); break;
+            case 'p': options->profile = optarg; break;
+            case 'V': options->validate = false; break;
+            case 'W': options->write = false; break;
+            case 'v': options->verbose = true; break;
+            default:
+                usage(argv[0]);
+                return false;
+        }
+    }
+
+    if (options->seconds <= 0.0) {
+        usage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    calibrate_options_t options;
+    if (!parse_options(argc, argv, &options)) {
+        return 2;
+    }
+
+    g_verbose = options.verbose;
+    base_set_log_handler(log_handler, NULL);
+
+    if (canon_camera_init_library() != CANON_SUCCESS) {
+        fprintf(stderr, "Failed to initialize the camera library\n");
+        return 1;
+    }
+
+    // The detector enumerates the cameras that are already connected when it starts
+    camera_info_t *cameras = NULL;
+    int camera_count = 0;
+    if (options.device_count == 0) {
+        camera_detector_t *detector = camera_detector_create();
+        if (detector && camera_detector_start(detector) == CANON_SUCCESS) {
+            camera_count = camera_detector_list_devices(detector, &cameras);
+            camera_detector_stop(detector);
+        }
+        camera_detector_destroy(detector);
+
+        for (int i = 0; i < camera_count && i < HOST_CALIBRATION_MAX_CAMERAS; i++) {
+            options.devices[options.device_count++] = cameras[i].device_path;
+        }
+    }
+
+    if (options.device_count == 0) {
+        fprintf(stderr, "No cameras found, connect one or pass --device\n");
+        canon_camera_cleanup_library();
+        return 1;
+    }
+
+    host_calibration_report_t *report = calloc(1, sizeof(host_calibration_report_t));
+    if (!report) {
+        camera_detector_free_list(cameras, camera_count);
+        canon_camera_cleanup_library();
+        return 1;
+    }
+
+    printf("Calibrating %u camera%s, %.0f s each%s...\n", options.device_count,
+           options.device_count == 1 ? "" : "s", options.seconds,
+           options.validate ? " plus a run with all of them" : "");
+
+    host_calibration_options_t calibration = {
+        .seconds = options.seconds,
+        .validate = options.validate
+    };
+    canon_error_t err = host_calibration_run(options.devices, options.device_count,
+                                             &calibration, report);
+
+    char text[8192];
+    host_calibration_format(report, text, sizeof(text));
+    fputs(text, stdout);
+
+    int status = 0;
+    if (err != CANON_SUCCESS) {
+        fprintf(stderr, "Calibration failed: %s\n", canon_error_string(err));
+        status = 1;
+    } else if (options.write) {
+        char path[512];
+        if (options.profile) {
+            snprintf(path, sizeof(path), "%s", options.profile);
+        } else if (!host_calibration_profile_path(path, sizeof(path))) {
+            path[0] = '\0';
+        }
+
+        if (path[0] && host_calibration_write_profile(report, path) == CANON_SUCCESS) {
+            printf("Host profile: %s\n", path);
+        } else {
+            fprintf(stderr, "Could not write the host profile%s%s\n", path[0] ? " " : "", path);
+            status = 1;
+        }
+    }
+
+    free(report);
+    camera_detector_free_list(cameras, camera_count);
+    canon_camera_cleanup_library();
+    return status;
+}
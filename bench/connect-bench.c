@@ -0,0 +1,204 @@
+/*
+ * Camera connect benchmark.
+ *
+ * Measures what a source pays before its first preview fetch: setting up
+ * the camera library, loading libgphoto2's camera and port driver lists,
+ * and canon_camera_connect()/disconnect() cycles against the first (or the
+ * given) USB camera. The first list load and the first connect of the
+ * process are reported separately, since later ones find the drivers in
+ * the page cache. Without a camera the connects fail after the driver
+ * lists are loaded, and the list timings still apply.
+ *
+ * Run once as is and once with CANON_EOS_CAMLIBS=all to compare the ptp2
+ * driver set with every driver libgphoto2 ships. For a cold start, drop the
+ * page cache first (echo 3 > /proc/sys/vm/drop_caches).
+ */
+
+#include <util/base.h>
+#include <util/platform.h>
+#include <gphoto2/gphoto2.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "canon-camera.h"
+#include "camera-drivers.h"
+#include "utils/latency-histogram.h"
+
+typedef struct {
+    const char *device;
+    uint32_t cycles;
+    bool verbose;
+} connect_options_t;
+
+static bool g_verbose = false;
+
+static void log_handler(int level, const char *format, va_list args, void *param)
+{
+    UNUSED_PARAMETER(param);
+    if (level <= LOG_WARNING || g_verbose) {
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+    }
+}
+
+static long read_rss_kb(void)
+{
+    long pages_total = 0;
+    long pages_resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file) {
+        return -1;
+    }
+    if (fscanf(file, "%ld %ld", &pages_total, &pages_resident) != 2) {
+        pages_resident = -1;
+    }
+    fclose(file);
+    return pages_resident < 0 ? -1 : pages_resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [options]\n"
+           "  --device PATH   camera to connect, /dev/bus/usb/BBB/DDD\n"
+           "                  (default: the first one libgphoto2 detects)\n"
+           "  --cycles N      connect/disconnect cycles after the first (default 10)\n"
+           "  --verbose       show plugin log output\n", argv0);
+}
+
+static bool parse_options(int argc, char **argv, connect_options_t *options)
+{
+    static const struct option long_options[] = {
+        {"device", required_argument, NULL, 'd'},
+        {"cycles", required_argument, NULL, 'n'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    options->device = "usb";
+    options->cycles = 10;
+    options->verbose = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'd': options->device = optarg; break;
+            case 'n': options->cycles = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'v': options->verbose = true; break;
+            default:
+                usage(argv[0]);
+                return false;
+        }
+    }
+    return true;
+}
+
+/* One connect/disconnect cycle; returns the connect time in ns */
+static uint64_t connect_cycle(const connect_options_t *options, canon_error_t *result)
+{
+    canon_config_t config = {
+        .width = 1920,
+        .height = 1080,
+        .fps = 30,
+        .auto_focus = false,
+        .live_view = true
+    };
+
+    canon_camera_t *camera = canon_camera_create();
+    if (!camera) {
+        *result = CANON_ERROR_MEMORY;
+        return 0;
+    }
+
+    uint64_t start = os_gettime_ns();
+    *result = canon_camera_connect(camera, options->device, &config);
+    uint64_t elapsed = os_gettime_ns() - start;
+
+    canon_camera_disconnect(camera);
+    canon_camera_destroy(camera);
+    return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    connect_options_t options;
+    if (!parse_options(argc, argv, &options)) {
+        return 2;
+    }
+
+    g_verbose = options.verbose;
+    base_set_log_handler(log_handler, NULL);
+
+    long rss_start = read_rss_kb();
+
+    uint64_t start = os_gettime_ns();
+    canon_camera_init_library();
+    uint64_t init_ns = os_gettime_ns() - start;
+
+    printf("Drivers: %s\n", camera_drivers_restricted() ? "ptp2 camlib only"
+                                                        : "all libgphoto2 drivers");
+    printf("  library init         %8.2f ms\n", (double)init_ns / 1e6);
+
+    // The lists canon_camera_connect() loads, timed on their own
+    GPContext *context = gp_context_new();
+    CameraAbilitiesList *abilities = NULL;
+    GPPortInfoList *ports = NULL;
+    gp_abilities_list_new(&abilities);
+    gp_port_info_list_new(&ports);
+
+    start = os_gettime_ns();
+    int ret = camera_drivers_load_abilities(abilities, context);
+    uint64_t abilities_ns = os_gettime_ns() - start;
+
+    start = os_gettime_ns();
+    if (ret >= GP_OK) {
+        ret = gp_port_info_list_load(ports);
+    }
+    uint64_t ports_ns = os_gettime_ns() - start;
+    long rss_loaded = read_rss_kb();
+
+    if (ret < GP_OK) {
+        fprintf(stderr, "Failed to load driver lists: %s\n", gp_result_as_string(ret));
+        return 1;
+    }
+
+    printf("  camera list load     %8.2f ms  (%d models)\n", (double)abilities_ns / 1e6,
+           gp_abilities_list_count(abilities));
+    printf("  port list load       %8.2f ms  (%d ports)\n", (double)ports_ns / 1e6,
+           gp_port_info_list_count(ports));
+    printf("  RSS after lists      %8.1f MB  (+%.1f MB)\n", (double)rss_loaded / 1024.0,
+           (double)(rss_loaded - rss_start) / 1024.0);
+
+    gp_port_info_list_free(ports);
+    gp_abilities_list_free(abilities);
+    gp_context_unref(context);
+
+    canon_error_t result;
+    uint64_t first_ns = connect_cycle(&options, &result);
+    printf("  first connect        %8.2f ms  (%s)\n", (double)first_ns / 1e6,
+           canon_error_string(result));
+
+    latency_histogram_t connects;
+    latency_histogram_reset(&connects);
+    uint32_t failures = result == CANON_SUCCESS ? 0 : 1;
+    for (uint32_t i = 0; i < options.cycles; i++) {
+        latency_histogram_record(&connects, connect_cycle(&options, &result));
+        failures += result == CANON_SUCCESS ? 0 : 1;
+    }
+
+    if (connects.total > 0) {
+        printf("  later connects       %8.2f ms mean, %.2f ms p50, %.2f ms max (%llu)\n",
+               latency_histogram_mean(&connects) / 1e6,
+               (double)latency_histogram_percentile(&connects, 50.0) / 1e6,
+               (double)connects.max / 1e6, (unsigned long long)connects.total);
+    }
+    printf("  RSS after connects   %8.1f MB\n", (double)read_rss_kb() / 1024.0);
+    if (failures > 0) {
+        printf("%u of %u connects failed; list timings only\n", failures, options.cycles + 1);
+    }
+
+    canon_camera_cleanup_library();
+    return 0;
+}
@@ -0,0 +1,406 @@
+/*
+ * Decode throughput benchmark.
+ *
+ * Feeds preview JPEGs from the replay backend (synthetic pattern or a
+ * directory of recorded frames) through each JPEG decoder backend, both as
+ * full-frame decodes and through the restart-interval band path used by the
+ * video source. With --crop, also times the region decode used for host-side
+ * crops; --scale N decodes at 1/N size as auto resolution does. Also serves
+ * as the training workload for PGO builds.
+ */
+
+#include <util/base.h>
+#include <util/platform.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "camera-replay.h"
+#include "frame-delta.h"
+#include "jpeg-decoder.h"
+#include "utils/latency-histogram.h"
+
+#define MAX_JPEG_SIZE (4 * 1024 * 1024)
+#define MAX_NV12_SIZE (3840 * 2160 * 3 / 2)
+
+typedef struct {
+    const char *device;
+    const char *decoder;
+    uint32_t frames;
+    uint32_t warmup;
+    bool full;
+    bool incremental;
+    bool verbose;
+    uint32_t scale;             // DCT scaling denominator, 1 = full size
+    bool crop;
+    float crop_x;               // Fractions of the frame
+    float crop_y;
+    float crop_width;
+    float crop_height;
+} decode_options_t;
+
+static bool g_verbose = false;
+
+static void log_handler(int level, const char *format, va_list args, void *param)
+{
+    UNUSED_PARAMETER(param);
+    if (level <= LOG_WARNING || g_verbose) {
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+    }
+}
+
+/**
+ * Band-decode one frame into current, copying unchanged bands from previous.
+ * Mirrors decode_frame() in video-source.c.
+ */
+static canon_error_t decode_incremental(const jpeg_decoder_backend_t *backend, void *ctx,
+                                        frame_delta_t *delta, const uint8_t *jpeg, size_t size,
+                                        uint8_t *current, const uint8_t *previous,
+                                        uint32_t *width, uint32_t *height)
+{
+    frame_delta_mode_t mode = frame_delta_prepare(delta, jpeg, size);
+
+    if (mode == FRAME_DELTA_INCREMENTAL && *width > 0 && *height > 0) {
+        uint32_t w = *width;
+        uint8_t *uv_plane = current + w * *height;
+        const uint8_t *prev_uv = previous + w * *height;
+        canon_error_t err = CANON_SUCCESS;
+        frame_band_t band;
+
+        while (err == CANON_SUCCESS && frame_delta_next_band(delta, &band)) {
+            uint32_t uv_y = band.y / 2;
+            uint32_t uv_rows = (band.y + band.height + 1) / 2 - uv_y;
+
+            if (!band.changed) {
+                memcpy(current + band.y * w, previous + band.y * w, band.height * w);
+                memcpy(uv_plane + uv_y * w, prev_uv + uv_y * w, uv_rows * w);
+                continue;
+            }
+
+            nv12_target_t target = {
+                .y = current + band.y * w,
+                .uv = uv_plane + uv_y * w,
+                .linesize = w,
+                .max_height = band.height
+            };
+            uint32_t band_width, band_height;
+            err = backend->decode(ctx, band.jpeg, band.jpeg_size, &target,
+                                  &band_width, &band_height);
+        }
+
+        if (err == CANON_SUCCESS) {
+            frame_delta_commit(delta);
+        }
+        return err;
+    }
+
+    nv12_target_t target = {
+        .y = current,
+        .capacity = MAX_NV12_SIZE
+    };
+    canon_error_t err = backend->decode(ctx, jpeg, size, &target, width, height);
+    if (err == CANON_SUCCESS) {
+        frame_delta_commit(delta);
+    } else {
+        frame_delta_reset(delta);
+    }
+    return err;
+}
+
+static bool run_backend(const decode_options_t *options, const jpeg_decoder_backend_t *backend,
+                        bool incremental, uint8_t *buffers[2], uint8_t *jpeg)
+{
+    camera_replay_t *replay = NULL;
+    if (camera_replay_open(options->device, &replay) != CANON_SUCCESS) {
+        fprintf(stderr, "Cannot open %s\n", options->device);
+        return false;
+    }
+
+    void *ctx = backend->create ? backend->create() : NULL;
+    frame_delta_t *delta = incremental ? frame_delta_create() : NULL;
+
+    latency_histogram_t hist;
+    latency_histogram_reset(&hist);
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint64_t pixels = 0;
+    uint64_t elapsed = 0;
+    bool ok = true;
+
+    for (uint32_t i = 0; i < options->warmup + options->frames; i++) {
+        size_t size = 0;
+        if (camera_replay_next_frame(replay, jpeg, MAX_JPEG_SIZE, &size) != CANON_SUCCESS) {
+            continue;
+        }
+
+        uint8_t *current = buffers[i & 1];
+        const uint8_t *previous = buffers[(i + 1) & 1];
+        canon_error_t err;
+
+        uint64_t start = os_gettime_ns();
+        if (incremental) {
+            err = decode_incremental(backend, ctx, delta, jpeg, size, current, previous,
+                                     &width, &height);
+        } else {
+            nv12_target_t target = {
+                .y = current,
+                .capacity = MAX_NV12_SIZE,
+                .scale = options->scale
+            };
+            err = backend->decode(ctx, jpeg, size, &target, &width, &height);
+        }
+        uint64_t duration = os_gettime_ns() - start;
+
+        if (err != CANON_SUCCESS) {
+            fprintf(stderr, "%s: %s\n", backend->name, canon_error_string(err));
+            ok = false;
+            break;
+        }
+
+        if (i >= options->warmup) {
+            latency_histogram_record(&hist, duration);
+            elapsed += duration;
+            pixels += (uint64_t)width * height;
+        }
+    }
+
+    if (ok && hist.total > 0) {
+        double mean_ms = latency_histogram_mean(&hist) / 1e6;
+        char mode[16];
+        if (incremental || options->scale <= 1) {
+            snprintf(mode, sizeof(mode), "%s", incremental ? "incremental" : "full");
+        } else {
+            snprintf(mode, sizeof(mode), "scaled 1/%u", options->scale);
+        }
+        printf("%-12s %-12s %5ux%-5u %8.3f %8.3f %8.3f %9.1f\n",
+               backend->name, mode, width, height, mean_ms,
+               (double)latency_histogram_percentile(&hist, 50.0) / 1e6,
+               (double)latency_histogram_percentile(&hist, 99.0) / 1e6,
+               (double)pixels / ((double)elapsed / 1e9) / 1e6);
+    }
+
+    frame_delta_destroy(delta);
+    if (backend->destroy) {
+        backend->destroy(ctx);
+    }
+    camera_replay_close(replay);
+    return ok;
+}
+
+/**
+ * Decode only the crop region of each frame, as video-source.c does for
+ * crop modes.
+ */
+static bool run_region(const decode_options_t *options, uint8_t *buffer, uint8_t *jpeg)
+{
+    camera_replay_t *replay = NULL;
+    if (camera_replay_open(options->device, &replay) != CANON_SUCCESS) {
+        fprintf(stderr, "Cannot open %s\n", options->device);
+        return false;
+    }
+
+    latency_histogram_t hist;
+    latency_histogram_reset(&hist);
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint64_t pixels = 0;
+    uint64_t elapsed = 0;
+    bool ok = true;
+
+    for (uint32_t i = 0; i < options->warmup + options->frames; i++) {
+        size_t size = 0;
+        uint32_t frame_width, frame_height;
+        if (camera_replay_next_frame(replay, jpeg, MAX_JPEG_SIZE, &size) != CANON_SUCCESS ||
+            !jpeg_decoder_probe(jpeg, size, &frame_width, &frame_height)) {
+            continue;
+        }
+
+        jpeg_region_t region = {
+            .x = (uint32_t)(options->crop_x * (float)frame_width),
+            .y = (uint32_t)(options->crop_y * (float)frame_height),
+            .width = (uint32_t)(options->crop_width * (float)frame_width + 0.5f),
+            .height = (uint32_t)(options->crop_height * (float)frame_height + 0.5f)
+        };
+        nv12_target_t target = {
+            .y = buffer,
+            .capacity = MAX_NV12_SIZE,
+            .scale = options->scale
+        };
+
+        uint64_t start = os_gettime_ns();
+        canon_error_t err = jpeg_decoder_decode_region(jpeg, size, &region, &target,
+                                                       &width, &height);
+        uint64_t duration = os_gettime_ns() - start;
+
+        if (err != CANON_SUCCESS) {
+            fprintf(stderr, "region: %s\n", canon_error_string(err));
+            ok = false;
+            break;
+        }
+
+        if (i >= options->warmup) {
+            latency_histogram_record(&hist, duration);
+            elapsed += duration;
+            pixels += (uint64_t)width * height;
+        }
+    }
+
+    if (ok && hist.total > 0) {
+        printf("%-12s %-12s %5ux%-5u %8.3f %8.3f %8.3f %9.1f\n",
+               "libjpeg", "region", width, height, latency_histogram_mean(&hist) / 1e6,
+               (double)latency_histogram_percentile(&hist, 50.0) / 1e6,
+               (double)latency_histogram_percentile(&hist, 99.0) / 1e6,
+               (double)pixels / ((double)elapsed / 1e9) / 1e6);
+    }
+
+    camera_replay_close(replay);
+    return ok;
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [options]\n"
+           "  --device PATH     synthetic://WxH[?opts] or replay:DIR (default synthetic://1024x576?frames=120)\n"
+           "  --decoder NAME    backend to run, or 'all' (default all)\n"
+           "  --frames N        measured frames per run (default 2000)\n"
+           "  --warmup N        unmeasured frames per run (default 50)\n"
+           "  --full-only       skip the incremental band path\n"
+           "  --incremental-only  skip full-frame decodes\n"
+           "  --crop X,Y,W,H    also time a region decode of this crop, in %% of the frame\n"
+           "  --scale N         decode at 1/N size (2, 4 or 8; skips the incremental path)\n"
+           "  --verbose         show plugin info logs\n",
+           argv0);
+}
+
+static bool parse_options(int argc, char **argv, decode_options_t *options)
+{
+    static const struct option long_options[] = {
+        {"device", required_argument, NULL, 'd'},
+        {"decoder", required_argument, NULL, 'D'},
+        {"frames", required_argument, NULL, 'n'},
+        {"warmup", required_argument, NULL, 'w'},
+        {"full-only", no_argument, NULL, 'f'},
+        {"incremental-only", no_argument, NULL, 'i'},
+        {"crop", required_argument, NULL, 'c'},
+        {"scale", required_argument, NULL, 's'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    options->device = "synthetic://1024x576?frames=120";
+    options->decoder = "all";
+    options->frames = 2000;
+    options->warmup = 50;
+    options->full = true;
+    options->incremental = true;
+    options->verbose = false;
+    options->scale = 1;
+    options->crop = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'd': options->device = optarg; break;
+            case 'D': options->decoder = optarg; break;
+            case 'n': options->frames = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'w': options->warmup = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'f': options->incremental = false; break;
+            case 'i': options->full = false; break;
+            case 'c': {
+                float x, y, w, h;
+                if (sscanf(optarg, "%f,%f,%f,%f", &x, &y, &w, &h) != 4 || w <= 0 || h <= 0) {
+                    usage(argv[0]);
+                    return false;
+                }
+                options->crop = true;
+                options->crop_x = x / 100.0f;
+                options->crop_y = y / 100.0f;
+                options->crop_width = w / 100.0f;
+                options->crop_height = h / 100.0f;
+                break;
+            }
+            case 's':
+                options->scale = (uint32_t)strtoul(optarg, NULL, 10);
+                if (options->scale != 1 && options->scale != 2 &&
+                    options->scale != 4 && options->scale != 8) {
+                    usage(argv[0]);
+                    return false;
+                }
+                break;
+            case 'v': options->verbose = true; break;
+            default:
+                usage(argv[0]);
+                return false;
+        }
+    }
+
+    // Band geometry is in full-size rows, as in the video source
+    if (options->scale > 1) {
+        options->incremental = false;
+    }
+
+    if (options->frames == 0 || (!options->full && !options->incremental)) {
+        usage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    decode_options_t options;
+    if (!parse_options(argc, argv, &options)) {
+        return 2;
+    }
+
+    g_verbose = options.verbose;
+    base_set_log_handler(log_handler, NULL);
+
+    int only = -1;
+    if (strcmp(options.decoder, "all") != 0) {
+        only = jpeg_decoder_backend_find(options.decoder);
+        if (only < 0) {
+            fprintf(stderr, "Unknown decoder '%s'\n", options.decoder);
+            return 2;
+        }
+    }
+
+    uint8_t *buffers[2] = {malloc(MAX_NV12_SIZE), malloc(MAX_NV12_SIZE)};
+    uint8_t *jpeg = malloc(MAX_JPEG_SIZE);
+    if (!buffers[0] || !buffers[1] || !jpeg) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    printf("%-12s %-12s %11s %8s %8s %8s %9s\n", "decoder", "mode", "size",
+           "mean_ms", "p50_ms", "p99_ms", "Mpix/s");
+
+    bool ok = true;
+    for (size_t i = 0; i < jpeg_decoder_backend_count(); i++) {
+        if (only >= 0 && (size_t)only != i) {
+            continue;
+        }
+
+        const jpeg_decoder_backend_t *backend = jpeg_decoder_backend_get(i);
+        if (options.full) {
+            ok = run_backend(&options, backend, false, buffers, jpeg) && ok;
+        }
+        if (options.incremental) {
+            ok = run_backend(&options, backend, true, buffers, jpeg) && ok;
+        }
+    }
+
+    if (options.crop) {
+        ok = run_region(&options, buffers[0], jpeg) && ok;
+    }
+
+    free(buffers[0]);
+    free(buffers[1]);
+    free(jpeg);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,333 @@
+/*
+ * Multicam grid benchmark.
+ *
+ * Shows N synthetic or replayed cameras two ways: as N async sources
+ * (full-size decode per camera, every frame copied into a per-source cache
+ * as obs_source_output_video() does) and as one grid source (each camera
+ * decoded at 1/4 or 1/8 scale into its tile, one frame copied per tick).
+ * Reports per-camera frame rates, plugin CPU from the thread registry, and
+ * the bytes handed to OBS per second, which OBS then uploads.
+ *
+ *   ./canon-eos-grid --cameras 4 --scale 4
+ */
+
+#include <util/base.h>
+#include <util/platform.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capture-pipeline.h"
+#include "multicam-grid.h"
+#include "video-source.h"
+#include "utils/latency-histogram.h"
+#include "utils/thread-registry.h"
+
+typedef struct {
+    const char *device;
+    const char *decoder;
+    const char *mode;
+    uint32_t cameras;
+    uint32_t scale;
+    uint32_t fps;
+    double seconds;
+    bool verbose;
+} grid_options_t;
+
+/**
+ * @brief Stand-in for one OBS async frame cache
+ */
+typedef struct {
+    uint8_t *data;
+    size_t capacity;
+    uint64_t frames;
+    uint64_t bytes;
+    uint32_t width;
+    uint32_t height;
+} frame_cache_t;
+
+/**
+ * @brief Readings of one run
+ */
+typedef struct {
+    double seconds;
+    uint64_t cpu_ns;
+    uint64_t frames_out;        // Frames handed to "OBS"
+    uint64_t bytes_out;
+    uint64_t camera_frames;     // Camera frames decoded, all cameras
+    latency_histogram_t decode;
+    uint32_t width;             // Last frame handed out (first source in separate mode)
+    uint32_t height;
+} run_result_t;
+
+static bool g_verbose = false;
+
+static void log_handler(int level, const char *format, va_list args, void *param)
+{
+    UNUSED_PARAMETER(param);
+    if (level <= LOG_WARNING || g_verbose) {
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+    }
+}
+
+/* Copies the NV12 planes like obs_source_output_video() copies into its cache */
+static void cache_frame(struct obs_source_frame *frame, void *user_data)
+{
+    frame_cache_t *cache = user_data;
+    size_t y_size = (size_t)frame->linesize[0] * frame->height;
+    size_t uv_size = (size_t)frame->linesize[1] * ((frame->height + 1) / 2);
+
+    if (y_size + uv_size > cache->capacity) {
+        free(cache->data);
+        cache->data = malloc(y_size + uv_size);
+        cache->capacity = cache->data ? y_size + uv_size : 0;
+    }
+    if (!cache->data) {
+        return;
+    }
+
+    memcpy(cache->data, frame->data[0], y_size);
+    memcpy(cache->data + y_size, frame->data[1], uv_size);
+    cache->frames++;
+    cache->bytes += y_size + uv_size;
+    cache->width = frame->width;
+    cache->height = frame->height;
+}
+
+static void sum_counters(capture_pipeline_t *pipeline, run_result_t *result)
+{
+    video_source_counters_t counters;
+    video_source_read_counters(capture_pipeline_get_video(pipeline), &counters);
+    result->camera_frames += counters.frames_delivered;
+    latency_histogram_merge(&result->decode, &counters.decode);
+}
+
+static bool run_separate(const grid_options_t *options, run_result_t *result)
+{
+    capture_pipeline_t *pipelines[MULTICAM_GRID_MAX_CAMERAS] = {0};
+    frame_cache_t caches[MULTICAM_GRID_MAX_CAMERAS] = {{0}};
+    bool ok = true;
+
+    for (uint32_t i = 0; i < options->cameras && ok; i++) {
+        pipelines[i] = capture_pipeline_create(cache_frame, &caches[i]);
+        if (!pipelines[i]) {
+            ok = false;
+            break;
+        }
+        capture_pipeline_settings_t settings = {
+            .device_path = options->device,
+            .width = 1920,
+            .height = 1080,
+            .fps = options->fps,
+            .decoder = options->decoder
+        };
+        capture_pipeline_update(pipelines[i], &settings);
+    }
+
+    uint64_t cpu_start = thread_registry_total_ns();
+    uint64_t start = os_gettime_ns();
+    for (uint32_t i = 0; i < options->cameras && ok; i++) {
+        capture_pipeline_activate(pipelines[i]);
+        ok = capture_pipeline_is_running(pipelines[i]);
+    }
+    if (ok) {
+        os_sleepto_ns(start + (uint64_t)(options->seconds * 1e9));
+    }
+    for (uint32_t i = 0; i < options->cameras; i++) {
+        capture_pipeline_deactivate(pipelines[i]);
+    }
+    result->seconds = (double)(os_gettime_ns() - start) / 1e9;
+    result->cpu_ns = thread_registry_total_ns() - cpu_start;
+
+    for (uint32_t i = 0; i < options->cameras; i++) {
+        if (pipelines[i]) {
+            sum_counters(pipelines[i], result);
+            capture_pipeline_destroy(pipelines[i]);
+        }
+        result->frames_out += caches[i].frames;
+        result->bytes_out += caches[i].bytes;
+        free(caches[i].data);
+    }
+    result->width = caches[0].width;
+    result->height = caches[0].height;
+    return ok;
+}
+
+static bool run_grid(const grid_options_t *options, run_result_t *result)
+{
+    frame_cache_t cache = {0};
+    multicam_grid_t *grid = multicam_grid_create(cache_frame, &cache);
+    if (!grid) {
+        return false;
+    }
+
+    multicam_grid_settings_t settings = {
+        .scale = options->scale,
+        .fps = options->fps,
+        .decoder = options->decoder
+    };
+    for (uint32_t i = 0; i < options->cameras; i++) {
+        settings.devices[i] = options->device;
+    }
+    multicam_grid_update(grid, &settings);
+
+    uint64_t cpu_start = thread_registry_total_ns();
+    uint64_t start = os_gettime_ns();
+    multicam_grid_activate(grid);
+    os_sleepto_ns(start + (uint64_t)(options->seconds * 1e9));
+    multicam_grid_deactivate(grid);
+    result->seconds = (double)(os_gettime_ns() - start) / 1e9;
+    result->cpu_ns = thread_registry_total_ns() - cpu_start;
+
+    bool ok = true;
+    for (uint32_t i = 0; i < options->cameras; i++) {
+        capture_pipeline_t *pipeline = multicam_grid_get_pipeline(grid, i);
+        ok = ok && pipeline;
+        if (pipeline) {
+            sum_counters(pipeline, result);
+        }
+    }
+
+    multicam_grid_stats_t stats;
+    multicam_grid_get_stats(grid, &stats);
+    if (options->verbose) {
+        printf("  grid: %llu frames, %llu tiles decoded, %llu reused, %llu errors, "
+               "%llu relayouts, compose %.2f ms p50\n",
+               (unsigned long long)stats.frames, (unsigned long long)stats.tiles_decoded,
+               (unsigned long long)stats.tiles_reused, (unsigned long long)stats.decode_errors,
+               (unsigned long long)stats.relayouts,
+               (double)latency_histogram_percentile(&stats.compose, 50.0) / 1e6);
+    }
+
+    multicam_grid_destroy(grid);
+
+    result->frames_out = cache.frames;
+    result->bytes_out = cache.bytes;
+    result->width = cache.width;
+    result->height = cache.height;
+    free(cache.data);
+    return ok && cache.frames > 0;
+}
+
+static void print_result(const char *name, const grid_options_t *options,
+                         const run_result_t *result)
+{
+    double seconds = result->seconds > 0.0 ? result->seconds : 1.0;
+    printf("%-9s %6.1f %9.1f %8.2f %8.1f %9.1f %10.1f  %ux%u\n", name,
+           (double)result->camera_frames / seconds / options->cameras,
+           (double)result->frames_out / seconds,
+           (double)latency_histogram_percentile(&result->decode, 50.0) / 1e6,
+           thread_registry_percent(result->cpu_ns, (uint64_t)(seconds * 1e9)),
+           result->camera_frames > 0
+               ? (double)result->cpu_ns / 1e6 / (double)result->camera_frames : 0.0,
+           (double)result->bytes_out / seconds / 1e6,
+           result->width, result->height);
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [options]\n"
+           "  --cameras N       cameras shown (1-%d, default 4)\n"
+           "  --device PATH     camera device for all of them\n"
+           "                    (default synthetic://1024x576?frames=90)\n"
+           "  --scale N         grid tile scale, 4 or 8 (default 4)\n"
+           "  --mode MODE       separate, grid or both (default both)\n"
+           "  --decoder NAME    JPEG decoder backend (default auto)\n"
+           "  --seconds N       run time per mode (default 10)\n"
+           "  --fps N           requested frame rate (default 30)\n"
+           "  --verbose         show plugin log output and grid counters\n",
+           argv0, MULTICAM_GRID_MAX_CAMERAS);
+}
+
+static bool parse_options(int argc, char **argv, grid_options_t *options)
+{
+    static const struct option long_options[] = {
+        {"cameras", required_argument, NULL, 'n'},
+        {"device", required_argument, NULL, 'd'},
+        {"scale", required_argument, NULL, 'S'},
+        {"mode", required_argument, NULL, 'm'},
+        {"decoder", required_argument, NULL, 'D'},
+        {"seconds", required_argument, NULL, 's'},
+        {"fps", required_argument, NULL, 'f'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    options->device = "synthetic://1024x576?frames=90";
+    options->decoder = "auto";
+    options->mode = "both";
+    options->cameras = 4;
+    options->scale = 4;
+    options->fps = 30;
+    options->seconds = 10.0;
+    options->verbose = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'n': options->cameras = (uint32_t)atoi(optarg); break;
+            case 'd': options->device = optarg; break;
+            case 'S': options->scale = (uint32_t)atoi(optarg); break;
+            case 'm': options->mode = optarg; break;
+            case 'D': options->decoder = optarg; break;
+            case 's': options->seconds = atof(optarg); break;
+            case 'f': options->fps = (uint32_t)atoi(optarg); break;
+            case 'v': options->verbose = true; break;
+            default:
+                usage(argv[0]);
+                return false;
+        }
+    }
+
+    if (options->cameras < 1 || options->cameras > MULTICAM_GRID_MAX_CAMERAS ||
+        (options->scale != 4 && options->scale != 8) || options->fps == 0 ||
+        (strcmp(options->mode, "separate") != 0 && strcmp(options->mode, "grid") != 0 &&
+         strcmp(options->mode, "both") != 0)) {
+        usage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    grid_options_t options;
+    if (!parse_options(argc, argv, &options)) {
+        return 2;
+    }
+
+    g_verbose = options.verbose;
+    base_set_log_handler(log_handler, NULL);
+
+    bool separate = strcmp(options.mode, "grid") != 0;
+    bool grid = strcmp(options.mode, "separate") != 0;
+
+    printf("%u cameras on %s at %u fps, grid tiles 1/%u, %.0f s per mode, %u CPUs\n",
+           options.cameras, options.device, options.fps, options.scale, options.seconds,
+           thread_registry_cpu_count());
+    printf("%-9s %6s %9s %8s %8s %9s %10s  %s\n", "mode", "fps/cam", "frames/s",
+           "dec_ms", "cpu%", "cpu_ms/f", "MB/s_out", "frame");
+
+    int status = 0;
+    if (separate) {
+        run_result_t result = {0};
+        if (!run_separate(&options, &result)) {
+            fprintf(stderr, "Separate sources did not start on %s\n", options.device);
+            status = 1;
+        }
+        print_result("separate", &options, &result);
+    }
+    if (grid) {
+        run_result_t result = {0};
+        if (!run_grid(&options, &result)) {
+            fprintf(stderr, "Grid delivered no frames on %s\n", options.device);
+            status = 1;
+        }
+        print_result("grid", &options, &result);
+    }
+
+    return status;
+}
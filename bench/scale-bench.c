@@ -0,0 +1,576 @@
+/*
+ * Many-camera scaling benchmark.
+ *
+ * Runs 1, 2, 4, ... capture pipelines side by side (one per OBS source,
+ * each with its own capture and output threads and frame pool) against
+ * synthetic cameras, and reports how delivered frame rate, delivery
+ * latency, CPU, memory and thread count scale with the number of sources.
+ * CPU is read per camera from the thread registry's thread clocks, and the
+ * plugin's share of the machine is checked against the PRD's NFR-002.
+ * Every step starts from freshly created pipelines. With --sync all
+ * sources share a capture sync group and the inter-camera skew is reported.
+ * With --refresh-us the synthetic cameras refresh on their own clock and
+ * the frame age, duplicate and missed-refresh rates are reported, for
+ * free-running or (--phase-lock) phase-locked polling.
+ */
+
+#include <util/base.h>
+#include <util/platform.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "camera-replay.h"
+#include "capture-pipeline.h"
+#include "capture-sync.h"
+#include "video-source.h"
+#include "utils/latency-histogram.h"
+#include "utils/mem-accounting.h"
+#include "utils/thread-registry.h"
+
+#define MAX_SOURCES 64
+#define MAX_STEPS 16
+
+typedef struct {
+    uint32_t counts[MAX_STEPS];
+    uint32_t steps;
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+    uint32_t fetch_us;
+    uint32_t fetch_spread_us;
+    uint32_t refresh_us;
+    bool sync;
+    bool phase_lock;
+    const char *decoder;
+    double warmup_s;
+    double measure_s;
+    const char *csv;
+    bool verbose;
+} scale_options_t;
+
+/**
+ * @brief Counters of all pipelines at one point in time
+ */
+typedef struct {
+    uint32_t ids[MAX_SOURCES];
+    uint64_t delivered[MAX_SOURCES];
+    uint64_t cpu[MAX_SOURCES];
+    uint32_t sources;
+    uint64_t captured;
+    uint64_t dropped;
+    uint64_t errors;
+    uint64_t accounted;
+    latency_histogram_t latency;
+    latency_histogram_t skew;
+    latency_histogram_t phase_error;
+    uint64_t late;
+    camera_replay_totals_t camera;
+    uint64_t time_ns;
+    uint64_t cpu_ns;
+    uint64_t plugin_cpu_ns;
+    long rss_kb;
+    long threads;
+} scale_sample_t;
+
+/**
+ * @brief Result of one step
+ */
+typedef struct {
+    uint32_t sources;
+    uint32_t running;
+    double fps_mean;
+    double fps_min;
+    double drop_rate;
+    double p50_ms;
+    double p99_ms;
+    double cpu_per_source;
+    double cpu_max_source;
+    double cpu_ms_per_frame;
+    double cpu_total;
+    double plugin_cpu_machine;
+    double rss_mb;
+    double accounted_mb;
+    long threads;
+    uint64_t errors;
+    double skew_p50_ms;
+    double skew_p99_ms;
+    uint64_t late;
+    double age_ms;
+    double duplicate_rate;
+    double missed_rate;
+    double phase_p50_ms;
+    double phase_p99_ms;
+} scale_result_t;
+
+static bool g_verbose = false;
+
+static void log_handler(int level, const char *format, va_list args, void *param)
+{
+    UNUSED_PARAMETER(param);
+    if (level <= LOG_WARNING || g_verbose) {
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+    }
+}
+
+static void discard_frame(struct obs_source_frame *frame, void *data)
+{
+    UNUSED_PARAMETER(frame);
+    UNUSED_PARAMETER(data);
+}
+
+static long read_rss_kb(void)
+{
+    long pages_total = 0;
+    long pages_resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file) {
+        return -1;
+    }
+    if (fscanf(file, "%ld %ld", &pages_total, &pages_resident) != 2) {
+        pages_resident = -1;
+    }
+    fclose(file);
+    return pages_resident < 0 ? -1 : pages_resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static long count_threads(void)
+{
+    char line[256];
+    long threads = -1;
+    FILE *file = fopen("/proc/self/status", "r");
+    if (!file) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "Threads: %ld", &threads) == 1) {
+            break;
+        }
+    }
+    fclose(file);
+    return threads;
+}
+
+static uint64_t process_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void visit_pipeline(const capture_pipeline_info_t *info, void *user_data)
+{
+    scale_sample_t *sample = user_data;
+    const video_source_counters_t *counters = &info->counters;
+
+    if (sample->sources < MAX_SOURCES) {
+        sample->ids[sample->sources] = info->id;
+        sample->delivered[sample->sources] = counters->frames_delivered;
+        sample->cpu[sample->sources] = info->cpu.total_ns;
+        sample->sources++;
+    }
+
+    sample->captured += counters->frames_captured;
+    sample->dropped += counters->drops_queue_full + counters->drops_superseded +
+                       counters->decode_errors;
+    sample->errors += counters->capture_timeouts + counters->capture_disconnects +
+                      counters->capture_failures;
+    sample->accounted += info->memory.total;
+    latency_histogram_merge(&sample->latency, &counters->latency);
+    latency_histogram_merge(&sample->phase_error, &counters->phase_error);
+}
+
+static void take_sample(scale_sample_t *sample)
+{
+    memset(sample, 0, sizeof(scale_sample_t));
+    latency_histogram_reset(&sample->latency);
+    latency_histogram_reset(&sample->phase_error);
+
+    capture_pipeline_foreach(visit_pipeline, sample);
+    camera_replay_get_totals(&sample->camera);
+
+    capture_sync_stats_t groups[CAPTURE_SYNC_MAX_GROUP];
+    size_t count = capture_sync_get_all(groups, CAPTURE_SYNC_MAX_GROUP);
+    latency_histogram_reset(&sample->skew);
+    for (size_t i = 0; i < count && i < CAPTURE_SYNC_MAX_GROUP; i++) {
+        latency_histogram_merge(&sample->skew, &groups[i].skew);
+        sample->late += groups[i].late;
+    }
+
+    sample->time_ns = os_gettime_ns();
+    sample->cpu_ns = process_cpu_ns();
+    sample->plugin_cpu_ns = thread_registry_total_ns();
+    sample->rss_kb = read_rss_kb();
+    sample->threads = count_threads();
+}
+
+static void sleep_seconds(double seconds)
+{
+    uint64_t end = os_gettime_ns() + (uint64_t)(seconds * 1e9);
+    uint64_t now;
+    while ((now = os_gettime_ns()) < end) {
+        uint64_t left_us = (end - now) / 1000;
+        usleep(left_us > 100000 ? 100000 : (useconds_t)left_us + 1);
+    }
+}
+
+static bool run_step(const scale_options_t *options, uint32_t sources, scale_result_t *result)
+{
+    capture_pipeline_t *pipelines[MAX_SOURCES] = {NULL};
+    char device[128];
+    bool ok = true;
+
+    capture_pipeline_settings_t settings = {
+        .device_path = device,
+        .width = 1920,
+        .height = 1080,
+        .fps = options->fps,
+        .decoder = options->decoder,
+        .sync_group = options->sync ? 1 : 0,
+        .phase_lock = options->phase_lock
+    };
+
+    memset(result, 0, sizeof(scale_result_t));
+    result->sources = sources;
+
+    for (uint32_t i = 0; i < sources; i++) {
+        pipelines[i] = capture_pipeline_create(discard_frame, NULL);
+        if (!pipelines[i]) {
+            fprintf(stderr, "Failed to create pipeline %u\n", i + 1);
+            ok = false;
+            break;
+        }
+
+        // Fetch times spread evenly from fetch_us to fetch_us + spread
+        uint32_t fetch_us = options->fetch_us;
+        if (sources > 1) {
+            fetch_us += (uint32_t)((uint64_t)options->fetch_spread_us * i / (sources - 1));
+        }
+        snprintf(device, sizeof(device), "synthetic://%ux%u?delay_us=%u&refresh_us=%u",
+                 options->width, options->height, fetch_us, options->refresh_us);
+
+        capture_pipeline_update(pipelines[i], &settings);
+        capture_pipeline_activate(pipelines[i]);
+        if (capture_pipeline_is_running(pipelines[i])) {
+            result->running++;
+        }
+    }
+
+    if (ok) {
+        sleep_seconds(options->warmup_s);
+
+        scale_sample_t start;
+        scale_sample_t end;
+        take_sample(&start);
+        sleep_seconds(options->measure_s);
+        take_sample(&end);
+
+        double seconds = (double)(end.time_ns - start.time_ns) / 1e9;
+        double cpu_seconds = (double)(end.cpu_ns - start.cpu_ns) / 1e9;
+        uint64_t delivered_total = 0;
+        uint64_t source_cpu_total = 0;
+
+        result->fps_min = -1.0;
+        for (uint32_t i = 0; i < end.sources; i++) {
+            uint64_t before = 0;
+            uint64_t cpu_before = 0;
+            for (uint32_t j = 0; j < start.sources; j++) {
+                if (start.ids[j] == end.ids[i]) {
+                    before = start.delivered[j];
+                    cpu_before = start.cpu[j];
+                }
+            }
+
+            double fps = (double)(end.delivered[i] - before) / seconds;
+            delivered_total += end.delivered[i] - before;
+            if (result->fps_min < 0.0 || fps < result->fps_min) {
+                result->fps_min = fps;
+            }
+
+            double cpu = thread_registry_percent(end.cpu[i] - cpu_before,
+                                                 end.time_ns - start.time_ns);
+            source_cpu_total += end.cpu[i] - cpu_before;
+            if (cpu > result->cpu_max_source) {
+                result->cpu_max_source = cpu;
+            }
+        }
+        if (result->fps_min < 0.0) {
+            result->fps_min = 0.0;
+        }
+        result->fps_mean = sources ? (double)delivered_total / seconds / sources : 0.0;
+
+        uint64_t captured = end.captured - start.captured;
+        uint64_t dropped = end.dropped - start.dropped;
+        result->drop_rate = captured + dropped ? (double)dropped / (double)(captured + dropped)
+                                               : 0.0;
+
+        latency_histogram_t window;
+        latency_histogram_subtract(&window, &end.latency, &start.latency);
+        result->p50_ms = (double)latency_histogram_percentile(&window, 50.0) / 1e6;
+        result->p99_ms = (double)latency_histogram_percentile(&window, 99.0) / 1e6;
+
+        result->cpu_total = 100.0 * cpu_seconds / seconds;
+        result->cpu_per_source = sources ? thread_registry_percent(source_cpu_total,
+                                                                   end.time_ns - start.time_ns) /
+                                           sources : 0.0;
+        result->cpu_ms_per_frame = delivered_total ? (double)source_cpu_total / 1e6 /
+                                                     (double)delivered_total : 0.0;
+        result->plugin_cpu_machine = thread_registry_percent(end.plugin_cpu_ns - start.plugin_cpu_ns,
+                                                             end.time_ns - start.time_ns) /
+                                     (double)thread_registry_cpu_count();
+        result->rss_mb = (double)end.rss_kb / 1024.0;
+        result->accounted_mb = (double)end.accounted / 1048576.0;
+        result->threads = end.threads;
+        result->errors = end.errors - start.errors;
+
+        latency_histogram_t skew;
+        latency_histogram_subtract(&skew, &end.skew, &start.skew);
+        result->skew_p50_ms = (double)latency_histogram_percentile(&skew, 50.0) / 1e6;
+        result->skew_p99_ms = (double)latency_histogram_percentile(&skew, 99.0) / 1e6;
+        result->late = end.late - start.late;
+
+        uint64_t fetches = end.camera.fetches - start.camera.fetches;
+        uint64_t duplicates = end.camera.duplicates - start.camera.duplicates;
+        uint64_t missed = end.camera.missed - start.camera.missed;
+        uint64_t frames = fetches - duplicates;
+        result->age_ms = frames ? (double)(end.camera.frame_age_ns - start.camera.frame_age_ns) /
+                                  (double)frames / 1e6 : 0.0;
+        result->duplicate_rate = fetches ? (double)duplicates / (double)fetches : 0.0;
+        result->missed_rate = frames + missed ? (double)missed / (double)(frames + missed) : 0.0;
+
+        latency_histogram_t phase;
+        latency_histogram_subtract(&phase, &end.phase_error, &start.phase_error);
+        result->phase_p50_ms = (double)latency_histogram_percentile(&phase, 50.0) / 1e6;
+        result->phase_p99_ms = (double)latency_histogram_percentile(&phase, 99.0) / 1e6;
+    }
+
+    for (uint32_t i = 0; i < sources; i++) {
+        capture_pipeline_destroy(pipelines[i]);
+    }
+    return ok;
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [options]\n"
+           "  --counts LIST       comma-separated source counts (default 1,2,4,8,16,32)\n"
+           "  --size WxH          synthetic preview size (default 1024x576)\n"
+           "  --fps N             frame rate of each source (default 30)\n"
+           "  --fetch-us US       simulated USB time per preview fetch (default 0)\n"
+           "  --fetch-spread-us US  give the sources fetch times spread over this range\n"
+           "  --sync              put all sources in one capture sync group\n"
+           "  --refresh-us US     camera live view refresh interval (default 0 = every fetch)\n"
+           "  --phase-lock        time fetches to the camera refresh\n"
+           "  --decoder NAME      JPEG decoder backend (default auto)\n"
+           "  --warmup-s S        seconds before measuring each step (default 2)\n"
+           "  --measure-s S       measured seconds per step (default 5)\n"
+           "  --csv PATH          also write the results as CSV\n"
+           "  --verbose           show plugin log output\n", argv0);
+}
+
+static bool parse_counts(const char *list, scale_options_t *options)
+{
+    options->steps = 0;
+    while (*list) {
+        char *end;
+        unsigned long count = strtoul(list, &end, 10);
+        if (end == list || count == 0 || count > MAX_SOURCES || options->steps >= MAX_STEPS) {
+            return false;
+        }
+        options->counts[options->steps++] = (uint32_t)count;
+        list = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') {
+            return false;
+        }
+    }
+    return options->steps > 0;
+}
+
+static bool parse_options(int argc, char **argv, scale_options_t *options)
+{
+    static const struct option long_options[] = {
+        {"counts", required_argument, NULL, 'c'},
+        {"size", required_argument, NULL, 's'},
+        {"fps", required_argument, NULL, 'f'},
+        {"fetch-us", required_argument, NULL, 'u'},
+        {"fetch-spread-us", required_argument, NULL, 'U'},
+        {"sync", no_argument, NULL, 'S'},
+        {"refresh-us", required_argument, NULL, 'r'},
+        {"phase-lock", no_argument, NULL, 'P'},
+        {"decoder", required_argument, NULL, 'D'},
+        {"warmup-s", required_argument, NULL, 'w'},
+        {"measure-s", required_argument, NULL, 'm'},
+        {"csv", required_argument, NULL, 'o'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    parse_counts("1,2,4,8,16,32", options);
+    options->width = 1024;
+    options->height = 576;
+    options->fps = 30;
+    options->fetch_us = 0;
+    options->fetch_spread_us = 0;
+    options->sync = false;
+    options->refresh_us = 0;
+    options->phase_lock = false;
+    options->decoder = "auto";
+    options->warmup_s = 2.0;
+    options->measure_s = 5.0;
+    options->csv = NULL;
+    options->verbose = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'c':
+                if (!parse_counts(optarg, options)) {
+                    fprintf(stderr, "Invalid --counts '%s' (1 to %d sources per step)\n",
+                            optarg, MAX_SOURCES);
+                    return false;
+                }
+                break;
+            case 's':
+                if (sscanf(optarg, "%ux%u", &options->width, &options->height) != 2) {
+                    usage(argv[0]);
+                    return false;
+                }
+                break;
+            case 'f': options->fps = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'u': options->fetch_us = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'U': options->fetch_spread_us = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'S': options->sync = true; break;
+            case 'r': options->refresh_us = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'P': options->phase_lock = true; break;
+            case 'D': options->decoder = optarg; break;
+            case 'w': options->warmup_s = strtod(optarg, NULL); break;
+            case 'm': options->measure_s = strtod(optarg, NULL); break;
+            case 'o': options->csv = optarg; break;
+            case 'v': options->verbose = true; break;
+            default:
+                usage(argv[0]);
+                return false;
+        }
+    }
+
+    if (options->fps == 0 || options->measure_s <= 0.0 ||
+        options->width == 0 || options->height == 0) {
+        usage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    scale_options_t options;
+    if (!parse_options(argc, argv, &options)) {
+        return 2;
+    }
+
+    g_verbose = options.verbose;
+    base_set_log_handler(log_handler, NULL);
+
+    scale_result_t results[MAX_STEPS];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    printf("Scaling: synthetic %ux%u at %u fps, %.0f s per step, %ld CPUs%s%s\n",
+           options.width, options.height, options.fps, options.measure_s, cpus,
+           options.sync ? ", capture sync on" : "",
+           options.phase_lock ? ", phase-locked polling" : "");
+    printf("%7s %8s %8s %7s %8s %8s %8s %8s %8s %8s %8s %8s %8s %7s", "sources", "fps_mean",
+           "fps_min", "drop%", "p50_ms", "p99_ms", "cpu%/src", "cpu%max", "cpu_ms/f", "cpu%",
+           "plugin%", "rss_mb", "acct_mb", "threads");
+    if (options.sync) {
+        printf(" %8s %8s %6s", "skew_p50", "skew_p99", "late");
+    }
+    if (options.refresh_us) {
+        printf(" %7s %6s %6s %9s %9s", "age_ms", "dup%", "miss%", "phase_p50", "phase_p99");
+    }
+    printf("\n");
+
+    int failures = 0;
+    for (uint32_t step = 0; step < options.steps; step++) {
+        scale_result_t *r = &results[step];
+        if (!run_step(&options, options.counts[step], r)) {
+            return 1;
+        }
+
+        printf("%7u %8.1f %8.1f %7.2f %8.2f %8.2f %8.1f %8.1f %8.2f %8.1f %8.1f %8.1f %8.1f %7ld",
+               r->sources, r->fps_mean, r->fps_min, r->drop_rate * 100.0, r->p50_ms,
+               r->p99_ms, r->cpu_per_source, r->cpu_max_source, r->cpu_ms_per_frame,
+               r->cpu_total, r->plugin_cpu_machine, r->rss_mb, r->accounted_mb, r->threads);
+        if (options.sync) {
+            printf(" %8.2f %8.2f %6llu", r->skew_p50_ms, r->skew_p99_ms,
+                   (unsigned long long)r->late);
+        }
+        if (options.refresh_us) {
+            printf(" %7.2f %6.2f %6.2f %9.2f %9.2f", r->age_ms, r->duplicate_rate * 100.0,
+                   r->missed_rate * 100.0, r->phase_p50_ms, r->phase_p99_ms);
+        }
+        printf("\n");
+        fflush(stdout);
+
+        if (r->running < r->sources) {
+            fprintf(stderr, "  %u of %u pipelines did not start\n",
+                    r->sources - r->running, r->sources);
+            failures++;
+        }
+        if (r->errors > 0) {
+            fprintf(stderr, "  %llu capture errors\n", (unsigned long long)r->errors);
+        }
+    }
+
+    if (options.csv) {
+        FILE *file = fopen(options.csv, "w");
+        if (!file) {
+            fprintf(stderr, "Failed to write %s\n", options.csv);
+            return 1;
+        }
+        fprintf(file, "sources,fps_mean,fps_min,drop_rate,p50_ms,p99_ms,cpu_per_source,"
+                "cpu_max_source,cpu_ms_per_frame,cpu_total,plugin_cpu_machine,rss_mb,"
+                "accounted_mb,threads,skew_p50_ms,skew_p99_ms,age_ms,duplicate_rate,"
+                "missed_rate,phase_p50_ms,phase_p99_ms\n");
+        for (uint32_t step = 0; step < options.steps; step++) {
+            const scale_result_t *r = &results[step];
+            fprintf(file, "%u,%.2f,%.2f,%.4f,%.3f,%.3f,%.2f,%.2f,%.3f,%.2f,%.2f,%.1f,%.1f,%ld,"
+                    "%.3f,%.3f,%.3f,%.4f,%.4f,%.3f,%.3f\n",
+                    r->sources, r->fps_mean, r->fps_min, r->drop_rate, r->p50_ms, r->p99_ms,
+                    r->cpu_per_source, r->cpu_max_source, r->cpu_ms_per_frame, r->cpu_total,
+                    r->plugin_cpu_machine, r->rss_mb, r->accounted_mb, r->threads,
+                    r->skew_p50_ms, r->skew_p99_ms, r->age_ms, r->duplicate_rate,
+                    r->missed_rate, r->phase_p50_ms, r->phase_p99_ms);
+        }
+        fclose(file);
+    }
+
+    // PRD NFR-002: the plugin below 15% of the machine
+    for (uint32_t step = 0; step < options.steps; step++) {
+        if (results[step].plugin_cpu_machine >= THREAD_REGISTRY_CPU_BUDGET) {
+            printf("\nFirst step over the NFR-002 CPU budget (%.0f%% of %u CPUs): %u sources\n",
+                   THREAD_REGISTRY_CPU_BUDGET, thread_registry_cpu_count(),
+                   results[step].sources);
+            break;
+        }
+        if (step + 1 == options.steps) {
+            printf("\nAll steps within the NFR-002 CPU budget (%.0f%% of %u CPUs)\n",
+                   THREAD_REGISTRY_CPU_BUDGET, thread_registry_cpu_count());
+        }
+    }
+
+    // Where the per-source model stops keeping up
+    for (uint32_t step = 0; step < options.steps; step++) {
+        if (results[step].fps_min < 0.9 * options.fps) {
+            printf("\nFirst step below 90%% of %u fps on every source: %u sources\n",
+                   options.fps, results[step].sources);
+            break;
+        }
+    }
+
+    return failures > 0 ? 1 : 0;
+}
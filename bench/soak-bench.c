@@ -0,0 +1,522 @@
+/*
+ * Accelerated soak benchmark for the capture pipeline.
+ *
+ * Drives capture_pipeline_t (the code behind each OBS source) against a
+ * synthetic or replay camera at a multiple of real time, with periodic
+ * activate/deactivate churn, device switches and injected disconnects.
+ * Every simulated window it samples RSS, open fds, thread count, latency
+ * percentiles and drop rate, and fails if any regression threshold is hit.
+ *
+ * Simulated time assumes the camera's nominal 30 fps live view.
+ */
+
+#include <util/base.h>
+#include <util/platform.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "capture-pipeline.h"
+#include "video-source.h"
+#include "utils/latency-histogram.h"
+#include "utils/lock-profiler.h"
+
+#define NOMINAL_FPS 30
+#define STALL_TIMEOUT_NS (10ULL * 1000000000ULL)
+#define POLL_INTERVAL_US 5000
+#define LOCK_SITES_SHOWN 8
+
+typedef struct {
+    const char *device;
+    const char *alt_device;
+    const char *decoder;
+    double hours;
+    uint32_t speed;
+    double window_minutes;
+    uint64_t churn_every;
+    uint64_t switch_every;
+    bool direct;
+    uint32_t tick_rate;
+    bool verbose;
+
+    double max_rss_growth_mb;
+    long max_fd_growth;
+    long max_thread_growth;
+    double max_p99_drift;
+    double p99_floor_ms;
+    double max_drop_rate;
+} soak_options_t;
+
+typedef struct {
+    uint64_t frames_output;
+    uint64_t frames_captured;
+    uint64_t frames_delivered;
+    uint64_t frames_dropped;
+    uint64_t capture_errors;
+    uint64_t page_faults;
+    long rss_kb;
+    long fds;
+    long threads;
+    latency_histogram_t latency;
+} soak_sample_t;
+
+static bool g_verbose = false;
+static uint64_t g_frames_output = 0;
+
+static void log_handler(int level, const char *format, va_list args, void *param)
+{
+    UNUSED_PARAMETER(param);
+    if (level <= LOG_WARNING || g_verbose) {
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+    }
+}
+
+static void count_frame(struct obs_source_frame *frame, void *data)
+{
+    UNUSED_PARAMETER(frame);
+    UNUSED_PARAMETER(data);
+    __atomic_add_fetch(&g_frames_output, 1, __ATOMIC_RELAXED);
+}
+
+static long read_rss_kb(void)
+{
+    long pages_total = 0;
+    long pages_resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file) {
+        return -1;
+    }
+    if (fscanf(file, "%ld %ld", &pages_total, &pages_resident) != 2) {
+        pages_resident = -1;
+    }
+    fclose(file);
+    return pages_resident < 0 ? -1 : pages_resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static long count_fds(void)
+{
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir) {
+        return -1;
+    }
+    long count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count - 1;  // The directory stream itself
+}
+
+static long count_threads(void)
+{
+    char line[256];
+    long threads = -1;
+    FILE *file = fopen("/proc/self/status", "r");
+    if (!file) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "Threads: %ld", &threads) == 1) {
+            break;
+        }
+    }
+    fclose(file);
+    return threads;
+}
+
+static void take_sample(capture_pipeline_t *pipeline, soak_sample_t *sample)
+{
+    video_source_metrics_t metrics;
+    video_source_counters_t counters;
+    video_source_get_metrics(capture_pipeline_get_video(pipeline), &metrics);
+    video_source_read_counters(capture_pipeline_get_video(pipeline), &counters);
+
+    sample->frames_output = __atomic_load_n(&g_frames_output, __ATOMIC_RELAXED);
+    sample->frames_captured = metrics.frames_captured;
+    sample->frames_delivered = counters.frames_delivered;
+    sample->frames_dropped = metrics.frames_dropped;
+    sample->capture_errors = metrics.capture_errors;
+    sample->page_faults = counters.page_faults_minor + counters.page_faults_major;
+    sample->latency = metrics.latency;
+    sample->rss_kb = read_rss_kb();
+    sample->fds = count_fds();
+    sample->threads = count_threads();
+}
+
+/**
+ * Direct-upload sources have no output thread; emulate video_tick by
+ * polling for the newest frame at the capture rate.
+ */
+static void poll_direct(capture_pipeline_t *pipeline)
+{
+    struct obs_source_frame frame = {0};
+    video_source_t *video = capture_pipeline_get_video(pipeline);
+
+    if (video_source_get_latest_frame(video, &frame) == CANON_SUCCESS) {
+        video_source_release_frame(video, &frame);
+        count_frame(&frame, NULL);
+    }
+}
+
+/**
+ * With CANON_EOS_LOCK_PROFILE=1, list the call sites that waited longest.
+ */
+static void print_lock_profile(void)
+{
+    lock_stats_t stats[LOCK_SITES_SHOWN];
+
+    if (!lock_profiler_enabled()) {
+        return;
+    }
+
+    size_t count = lock_profiler_get_stats(stats, LOCK_SITES_SHOWN, LOCK_STATS_BY_SITE);
+    printf("\nLock wait by call site:\n");
+    printf("  %-18s %-38s %10s %8s %10s %10s %10s\n", "lock", "site", "acquired",
+           "cont%", "wait_ms", "wait_p99", "hold_p99");
+    for (size_t i = 0; i < count && i < LOCK_SITES_SHOWN; i++) {
+        const char *file = strrchr(stats[i].file, '/');
+        char site[64];
+        snprintf(site, sizeof(site), "%s:%d", file ? file + 1 : stats[i].file, stats[i].line);
+        printf("  %-18s %-38s %10llu %7.2f%% %10.1f %10.3f %10.3f\n", stats[i].name, site,
+               (unsigned long long)stats[i].acquisitions,
+               stats[i].acquisitions ? 100.0 * (double)stats[i].contended /
+                                       (double)stats[i].acquisitions : 0.0,
+               (double)stats[i].wait.sum / 1e6,
+               (double)latency_histogram_percentile(&stats[i].wait, 99.0) / 1e6,
+               (double)latency_histogram_percentile(&stats[i].hold, 99.0) / 1e6);
+    }
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [options]\n"
+           "  --device PATH             camera device (default synthetic://1024x576?disconnect_every=20000)\n"
+           "  --alt-device PATH         device used for switches (default synthetic://1024x576?frames=90)\n"
+           "  --decoder NAME            JPEG decoder backend (default auto)\n"
+           "  --hours H                 simulated duration at 30 fps (default 2)\n"
+           "  --speed FPS               capture rate driving the simulation (default 300)\n"
+           "  --window-minutes M        simulated minutes per sample (default 10)\n"
+           "  --churn-every N           frames between deactivate/activate (default 5000, 0 = off)\n"
+           "  --switch-every N          frames between device switches (default 25000, 0 = off)\n"
+           "  --direct                  consume frames like the direct upload source\n"
+           "  --tick-rate FPS           direct polls per second (default the --speed rate)\n"
+           "  --max-rss-growth-mb MB    (default 16)\n"
+           "  --max-fd-growth N         (default 2)\n"
+           "  --max-thread-growth N     (default 0)\n"
+           "  --max-p99-drift RATIO     window p99 / first window p99 (default 2.0)\n"
+           "  --p99-floor-ms MS         windows with a lower p99 never count as drift (default 5)\n"
+           "  --max-drop-rate FRACTION  dropped / fetched frames (default 0.05)\n"
+           "  --verbose                 show plugin info logs\n",
+           argv0);
+}
+
+static bool parse_options(int argc, char **argv, soak_options_t *options)
+{
+    static const struct option long_options[] = {
+        {"device", required_argument, NULL, 'd'},
+        {"alt-device", required_argument, NULL, 'a'},
+        {"decoder", required_argument, NULL, 'D'},
+        {"hours", required_argument, NULL, 'H'},
+        {"speed", required_argument, NULL, 's'},
+        {"window-minutes", required_argument, NULL, 'w'},
+        {"churn-every", required_argument, NULL, 'c'},
+        {"switch-every", required_argument, NULL, 'S'},
+        {"direct", no_argument, NULL, 'x'},
+        {"tick-rate", required_argument, NULL, 'T'},
+        {"max-rss-growth-mb", required_argument, NULL, 'r'},
+        {"max-fd-growth", required_argument, NULL, 'f'},
+        {"max-thread-growth", required_argument, NULL, 't'},
+        {"max-p99-drift", required_argument, NULL, 'p'},
+        {"p99-floor-ms", required_argument, NULL, 'P'},
+        {"max-drop-rate", required_argument, NULL, 'R'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    options->device = "synthetic://1024x576?disconnect_every=20000";
+    options->alt_device = "synthetic://1024x576?frames=90";
+    options->decoder = "auto";
+    options->hours = 2.0;
+    options->speed = 300;
+    options->window_minutes = 10.0;
+    options->churn_every = 5000;
+    options->switch_every = 25000;
+    options->direct = false;
+    options->tick_rate = 0;
+    options->verbose = false;
+    options->max_rss_growth_mb = 16.0;
+    options->max_fd_growth = 2;
+    options->max_thread_growth = 0;
+    options->max_p99_drift = 2.0;
+    options->p99_floor_ms = 5.0;
+    options->max_drop_rate = 0.05;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'd': options->device = optarg; break;
+            case 'a': options->alt_device = optarg; break;
+            case 'D': options->decoder = optarg; break;
+            case 'H': options->hours = atof(optarg); break;
+            case 's': options->speed = (uint32_t)atoi(optarg); break;
+            case 'w': options->window_minutes = atof(optarg); break;
+            case 'c': options->churn_every = strtoull(optarg, NULL, 10); break;
+            case 'S': options->switch_every = strtoull(optarg, NULL, 10); break;
+            case 'x': options->direct = true; break;
+            case 'T': options->tick_rate = (uint32_t)atoi(optarg); break;
+            case 'r': options->max_rss_growth_mb = atof(optarg); break;
+            case 'f': options->max_fd_growth = atol(optarg); break;
+            case 't': options->max_thread_growth = atol(optarg); break;
+            case 'p': options->max_p99_drift = atof(optarg); break;
+            case 'P': options->p99_floor_ms = atof(optarg); break;
+            case 'R': options->max_drop_rate = atof(optarg); break;
+            case 'v': options->verbose = true; break;
+            default:
+                usage(argv[0]);
+                return false;
+        }
+    }
+
+    if (options->speed == 0 || options->hours <= 0.0 || options->window_minutes <= 0.0) {
+        usage(argv[0]);
+        return false;
+    }
+    if (options->tick_rate == 0) {
+        options->tick_rate = options->speed;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    soak_options_t options;
+    if (!parse_options(argc, argv, &options)) {
+        return 2;
+    }
+
+    g_verbose = options.verbose;
+    base_set_log_handler(log_handler, NULL);
+
+    uint64_t total_frames = (uint64_t)(options.hours * 3600.0 * NOMINAL_FPS);
+    uint64_t window_frames = (uint64_t)(options.window_minutes * 60.0 * NOMINAL_FPS);
+    if (window_frames == 0) {
+        window_frames = 1;
+    }
+
+    capture_pipeline_t *pipeline = capture_pipeline_create(options.direct ? NULL : count_frame, NULL);
+    if (!pipeline) {
+        fprintf(stderr, "Failed to create pipeline\n");
+        return 1;
+    }
+    video_source_set_decode_ahead(capture_pipeline_get_video(pipeline), options.direct);
+
+    capture_pipeline_settings_t settings = {
+        .device_path = options.device,
+        .width = 1920,
+        .height = 1080,
+        .fps = options.speed,
+        .decoder = options.decoder
+    };
+    capture_pipeline_update(pipeline, &settings);
+    capture_pipeline_activate(pipeline);
+
+    if (!capture_pipeline_is_running(pipeline)) {
+        fprintf(stderr, "Pipeline did not start on %s\n", options.device);
+        capture_pipeline_destroy(pipeline);
+        return 1;
+    }
+
+    printf("Soak: %.1f simulated hours (%llu frames) at %u fps (%.0fx real time), %s output\n",
+           options.hours, (unsigned long long)total_frames, options.speed,
+           (double)options.speed / NOMINAL_FPS, options.direct ? "direct" : "async");
+    printf("%9s %10s %8s %5s %7s %8s %8s %7s %7s %6s %8s\n", "sim_min", "frames", "rss_mb",
+           "fds", "threads", "p50_ms", "p99_ms", "drop%", "errors", "churn", "flt/fr");
+
+    soak_sample_t baseline = {0};
+    soak_sample_t previous = {0};
+    take_sample(pipeline, &previous);
+
+    bool have_baseline = false;
+    double baseline_p99 = 0.0;
+    double worst_drift = 0.0;
+    double worst_drop = 0.0;
+    int failures = 0;
+
+    uint64_t next_window = window_frames;
+    uint64_t next_churn = options.churn_every;
+    uint64_t next_switch = options.switch_every;
+    uint64_t churns = 0;
+    uint64_t switches = 0;
+    bool on_alt = false;
+
+    uint64_t last_progress_frames = 0;
+    uint64_t last_progress_time = os_gettime_ns();
+
+    // Like video_tick, direct polls run on a fixed clock
+    uint64_t tick_interval = 1000000000ULL / options.tick_rate;
+    uint64_t next_tick = os_gettime_ns();
+
+    for (;;) {
+        if (options.direct) {
+            poll_direct(pipeline);
+            next_tick += tick_interval;
+            if (!os_sleepto_ns(next_tick)) {
+                next_tick = os_gettime_ns();
+            }
+        } else {
+            usleep(POLL_INTERVAL_US);
+        }
+
+        uint64_t frames = __atomic_load_n(&g_frames_output, __ATOMIC_RELAXED);
+        uint64_t now = os_gettime_ns();
+
+        if (frames != last_progress_frames) {
+            last_progress_frames = frames;
+            last_progress_time = now;
+        } else if (now - last_progress_time > STALL_TIMEOUT_NS) {
+            printf("FAIL: pipeline stalled at frame %llu\n", (unsigned long long)frames);
+            failures++;
+            break;
+        }
+
+        if (options.churn_every && frames >= next_churn) {
+            capture_pipeline_deactivate(pipeline);
+            capture_pipeline_activate(pipeline);
+            next_churn += options.churn_every;
+            churns++;
+        }
+
+        if (options.switch_every && frames >= next_switch) {
+            on_alt = !on_alt;
+            settings.device_path = on_alt ? options.alt_device : options.device;
+            capture_pipeline_update(pipeline, &settings);
+            next_switch += options.switch_every;
+            switches++;
+        }
+
+        if (frames < next_window && frames < total_frames) {
+            continue;
+        }
+        next_window += window_frames;
+
+        soak_sample_t sample;
+        take_sample(pipeline, &sample);
+
+        latency_histogram_t window;
+        latency_histogram_subtract(&window, &sample.latency, &previous.latency);
+        double p50 = (double)latency_histogram_percentile(&window, 50.0) / 1e6;
+        double p99 = (double)latency_histogram_percentile(&window, 99.0) / 1e6;
+
+        uint64_t fetched = (sample.frames_captured - previous.frames_captured) +
+                           (sample.frames_dropped - previous.frames_dropped);
+        double drop_rate = fetched ? (double)(sample.frames_dropped - previous.frames_dropped) /
+                                     (double)fetched : 0.0;
+
+        uint64_t captured = sample.frames_captured - previous.frames_captured;
+        double faults_per_frame = captured ? (double)(sample.page_faults - previous.page_faults) /
+                                             (double)captured : 0.0;
+
+        printf("%9.1f %10llu %8.1f %5ld %7ld %8.2f %8.2f %7.2f %7llu %6llu %8.2f\n",
+               (double)frames / NOMINAL_FPS / 60.0, (unsigned long long)frames,
+               (double)sample.rss_kb / 1024.0, sample.fds, sample.threads, p50, p99,
+               drop_rate * 100.0,
+               (unsigned long long)(sample.capture_errors - previous.capture_errors),
+               (unsigned long long)churns, faults_per_frame);
+        fflush(stdout);
+
+        // The first window absorbs warm-up (decoder calibration, allocations)
+        if (!have_baseline) {
+            baseline = sample;
+            baseline_p99 = p99;
+            have_baseline = true;
+        } else {
+            // Sub-millisecond tails are dominated by host scheduling noise
+            if (baseline_p99 > 0.0 && p99 >= options.p99_floor_ms &&
+                p99 / baseline_p99 > worst_drift) {
+                worst_drift = p99 / baseline_p99;
+            }
+            if (drop_rate > worst_drop) {
+                worst_drop = drop_rate;
+            }
+        }
+
+        previous = sample;
+
+        if (frames >= total_frames) {
+            break;
+        }
+    }
+
+    soak_sample_t final_sample;
+    take_sample(pipeline, &final_sample);
+
+    mem_account_stats_t memory;
+    capture_pipeline_get_memory(pipeline, &memory);
+    capture_pipeline_destroy(pipeline);
+
+    double rss_growth_mb = (double)(final_sample.rss_kb - baseline.rss_kb) / 1024.0;
+    long fd_growth = final_sample.fds - baseline.fds;
+    long thread_growth = final_sample.threads - baseline.threads;
+
+    printf("\nSummary: %llu frames, %llu churns, %llu device switches, %llu capture errors\n",
+           (unsigned long long)final_sample.frames_output, (unsigned long long)churns,
+           (unsigned long long)switches, (unsigned long long)final_sample.capture_errors);
+    printf("  RSS growth:    %.1f MB (limit %.1f)\n", rss_growth_mb, options.max_rss_growth_mb);
+    printf("  fd growth:     %ld (limit %ld)\n", fd_growth, options.max_fd_growth);
+    printf("  thread growth: %ld (limit %ld)\n", thread_growth, options.max_thread_growth);
+    uint64_t steady_frames = final_sample.frames_captured - baseline.frames_captured;
+    printf("  page faults:   %llu during warm-up, %.2f per frame after\n",
+           (unsigned long long)baseline.page_faults,
+           steady_frames ? (double)(final_sample.page_faults - baseline.page_faults) /
+                           (double)steady_frames : 0.0);
+    // Frames decoded but never handed out, e.g. superseded by a newer one
+    uint64_t wasted = final_sample.frames_captured > final_sample.frames_delivered
+                      ? final_sample.frames_captured - final_sample.frames_delivered : 0;
+    printf("  decodes:       %llu, %llu never delivered (%.2f%%)\n",
+           (unsigned long long)final_sample.frames_captured, (unsigned long long)wasted,
+           final_sample.frames_captured ? 100.0 * (double)wasted /
+                                          (double)final_sample.frames_captured : 0.0);
+    printf("  p99 drift:     %.2fx (limit %.2fx)\n", worst_drift, options.max_p99_drift);
+    printf("  worst drop:    %.2f%% (limit %.2f%%)\n", worst_drop * 100.0,
+           options.max_drop_rate * 100.0);
+    printf("  accounted:     %.1f MB, by category (current/peak MB):", (double)memory.total / 1048576.0);
+    for (int c = 0; c < MEM_CATEGORY_COUNT; c++) {
+        printf("%s %s %.1f/%.1f", c ? "," : "", mem_category_name((mem_category_t)c),
+               (double)memory.current[c] / 1048576.0, (double)memory.peak[c] / 1048576.0);
+    }
+    printf("\n");
+
+    if (rss_growth_mb > options.max_rss_growth_mb) {
+        printf("FAIL: RSS grew by %.1f MB\n", rss_growth_mb);
+        failures++;
+    }
+    if (fd_growth > options.max_fd_growth) {
+        printf("FAIL: %ld file descriptors leaked\n", fd_growth);
+        failures++;
+    }
+    if (thread_growth > options.max_thread_growth) {
+        printf("FAIL: %ld threads leaked\n", thread_growth);
+        failures++;
+    }
+    if (worst_drift > options.max_p99_drift) {
+        printf("FAIL: p99 latency drifted %.2fx\n", worst_drift);
+        failures++;
+    }
+    if (worst_drop > options.max_drop_rate) {
+        printf("FAIL: drop rate reached %.2f%%\n", worst_drop * 100.0);
+        failures++;
+    }
+
+    print_lock_profile();
+
+    printf("%s\n", failures ? "SOAK FAILED" : "SOAK PASSED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,375 @@
+/*
+ * Scene-switch latency benchmark.
+ *
+ * Scripts activate/deactivate cycles through capture_pipeline_t, which is
+ * what the source's activate and deactivate callbacks call, against a
+ * synthetic or replay camera. For every transition it measures how long the
+ * activate call blocks, the time to the first frame, and how long deactivate
+ * takes to release the camera, and counts the threads each transition
+ * spawns and joins. Some cycles are aborted before the first frame arrives,
+ * like a scene cut that is reverted mid-transition.
+ */
+
+#include <util/base.h>
+#include <util/platform.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "capture-pipeline.h"
+#include "video-source.h"
+#include "utils/latency-histogram.h"
+#include "utils/trace-recorder.h"
+
+#define MAX_TRACKED_THREADS 256
+#define POLL_INTERVAL_US 200
+
+typedef struct {
+    const char *device;
+    const char *decoder;
+    uint32_t cycles;
+    uint32_t warmup;
+    uint32_t dwell_ms;
+    uint32_t gap_ms;
+    uint32_t abort_every;
+    uint32_t timeout_ms;
+    const char *trace;
+    bool direct;
+    bool verbose;
+} switch_options_t;
+
+/**
+ * @brief Thread ids of the process at one point in time
+ */
+typedef struct {
+    long tids[MAX_TRACKED_THREADS];
+    size_t count;
+} thread_set_t;
+
+static bool g_verbose = false;
+static uint64_t g_first_frame_ns = 0;
+
+static void log_handler(int level, const char *format, va_list args, void *param)
+{
+    UNUSED_PARAMETER(param);
+    if (level <= LOG_WARNING || g_verbose) {
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+    }
+}
+
+static void mark_frame(struct obs_source_frame *frame, void *data)
+{
+    UNUSED_PARAMETER(frame);
+    UNUSED_PARAMETER(data);
+
+    uint64_t expected = 0;
+    __atomic_compare_exchange_n(&g_first_frame_ns, &expected, os_gettime_ns(), false,
+                                __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+static void read_threads(thread_set_t *set)
+{
+    set->count = 0;
+
+    DIR *dir = opendir("/proc/self/task");
+    if (!dir) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && set->count < MAX_TRACKED_THREADS) {
+        if (entry->d_name[0] != '.') {
+            set->tids[set->count++] = strtol(entry->d_name, NULL, 10);
+        }
+    }
+    closedir(dir);
+}
+
+/* Threads in b that are not in a */
+static size_t count_new_threads(const thread_set_t *a, const thread_set_t *b)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < b->count; i++) {
+        bool found = false;
+        for (size_t j = 0; j < a->count && !found; j++) {
+            found = a->tids[j] == b->tids[i];
+        }
+        count += found ? 0 : 1;
+    }
+    return count;
+}
+
+/**
+ * Direct-upload sources have no output thread; emulate video_tick by
+ * polling for the newest frame.
+ */
+static void poll_direct(capture_pipeline_t *pipeline)
+{
+    struct obs_source_frame frame = {0};
+    video_source_t *video = capture_pipeline_get_video(pipeline);
+
+    if (video_source_get_latest_frame(video, &frame) == CANON_SUCCESS) {
+        video_source_release_frame(video, &frame);
+        mark_frame(&frame, NULL);
+    }
+}
+
+static bool wait_first_frame(capture_pipeline_t *pipeline, const switch_options_t *options,
+                             uint64_t deadline)
+{
+    while (os_gettime_ns() < deadline) {
+        if (options->direct) {
+            poll_direct(pipeline);
+        }
+        if (__atomic_load_n(&g_first_frame_ns, __ATOMIC_ACQUIRE) != 0) {
+            return true;
+        }
+        usleep(POLL_INTERVAL_US);
+    }
+    return false;
+}
+
+static void print_row(const char *label, const latency_histogram_t *hist)
+{
+    if (hist->total == 0) {
+        printf("  %-16s %8s\n", label, "-");
+        return;
+    }
+    printf("  %-16s %8llu %9.2f %9.2f %9.2f %9.2f %9.2f\n", label,
+           (unsigned long long)hist->total,
+           latency_histogram_mean(hist) / 1e6,
+           (double)latency_histogram_percentile(hist, 50.0) / 1e6,
+           (double)latency_histogram_percentile(hist, 90.0) / 1e6,
+           (double)latency_histogram_percentile(hist, 99.0) / 1e6,
+           (double)hist->max / 1e6);
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [options]\n"
+           "  --device PATH       camera device (default synthetic://1024x576)\n"
+           "  --decoder NAME      JPEG decoder backend (default auto)\n"
+           "  --cycles N          measured activate/deactivate cycles (default 200)\n"
+           "  --warmup N          unmeasured cycles first (default 3)\n"
+           "  --dwell-ms MS       time shown after the first frame (default 100)\n"
+           "  --gap-ms MS         time hidden between cycles (default 50)\n"
+           "  --abort-every N     deactivate before the first frame every Nth cycle\n"
+           "                      (default 10, 0 = never)\n"
+           "  --timeout-ms MS     give up waiting for a first frame (default 5000)\n"
+           "  --trace PATH        record a Chrome trace of the measured cycles\n"
+           "  --direct            pull frames like the direct upload source\n"
+           "  --verbose           show plugin log output\n", argv0);
+}
+
+static bool parse_options(int argc, char **argv, switch_options_t *options)
+{
+    static const struct option long_options[] = {
+        {"device", required_argument, NULL, 'd'},
+        {"decoder", required_argument, NULL, 'D'},
+        {"cycles", required_argument, NULL, 'n'},
+        {"warmup", required_argument, NULL, 'w'},
+        {"dwell-ms", required_argument, NULL, 's'},
+        {"gap-ms", required_argument, NULL, 'g'},
+        {"abort-every", required_argument, NULL, 'a'},
+        {"timeout-ms", required_argument, NULL, 't'},
+        {"trace", required_argument, NULL, 'T'},
+        {"direct", no_argument, NULL, 'x'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    options->device = "synthetic://1024x576";
+    options->decoder = "auto";
+    options->cycles = 200;
+    options->warmup = 3;
+    options->dwell_ms = 100;
+    options->gap_ms = 50;
+    options->abort_every = 10;
+    options->timeout_ms = 5000;
+    options->trace = NULL;
+    options->direct = false;
+    options->verbose = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'd': options->device = optarg; break;
+            case 'D': options->decoder = optarg; break;
+            case 'n': options->cycles = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'w': options->warmup = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 's': options->dwell_ms = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'g': options->gap_ms = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'a': options->abort_every = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 't': options->timeout_ms = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'T': options->trace = optarg; break;
+            case 'x': options->direct = true; break;
+            case 'v': options->verbose = true; break;
+            default:
+                usage(argv[0]);
+                return false;
+        }
+    }
+
+    if (options->cycles == 0 || options->timeout_ms == 0) {
+        usage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    switch_options_t options;
+    if (!parse_options(argc, argv, &options)) {
+        return 2;
+    }
+
+    g_verbose = options.verbose;
+    base_set_log_handler(log_handler, NULL);
+
+    capture_pipeline_t *pipeline = capture_pipeline_create(options.direct ? NULL : mark_frame, NULL);
+    if (!pipeline) {
+        fprintf(stderr, "Failed to create pipeline\n");
+        return 1;
+    }
+    video_source_set_decode_ahead(capture_pipeline_get_video(pipeline), options.direct);
+
+    // Like adding the source to a scene: connects, but stays inactive
+    capture_pipeline_settings_t settings = {
+        .device_path = options.device,
+        .width = 1920,
+        .height = 1080,
+        .fps = 30,
+        .decoder = options.decoder
+    };
+    capture_pipeline_update(pipeline, &settings);
+
+    latency_histogram_t activate_call;
+    latency_histogram_t first_frame;
+    latency_histogram_t release;
+    latency_histogram_t abort_release;
+    latency_histogram_reset(&activate_call);
+    latency_histogram_reset(&first_frame);
+    latency_histogram_reset(&release);
+    latency_histogram_reset(&abort_release);
+
+    uint64_t threads_created = 0;
+    uint64_t threads_joined = 0;
+    uint64_t timeouts = 0;
+    uint64_t aborted = 0;
+    size_t max_created = 0;
+
+    thread_set_t idle;
+    thread_set_t running;
+    thread_set_t stopped;
+    read_threads(&idle);
+    size_t idle_threads = idle.count;
+
+    printf("Scene switch: %u cycles (+%u warmup) on %s, %s output, dwell %u ms, gap %u ms\n",
+           options.cycles, options.warmup, options.device,
+           options.direct ? "direct" : "async", options.dwell_ms, options.gap_ms);
+
+    for (uint32_t cycle = 0; cycle < options.warmup + options.cycles; cycle++) {
+        bool measured = cycle >= options.warmup;
+        if (cycle == options.warmup && options.trace) {
+            trace_recorder_start();
+        }
+        uint32_t index = cycle - options.warmup;
+        bool abort_early = measured && options.abort_every > 0 &&
+                           (index + 1) % options.abort_every == 0;
+
+        read_threads(&idle);
+        __atomic_store_n(&g_first_frame_ns, 0, __ATOMIC_RELEASE);
+
+        uint64_t start = os_gettime_ns();
+        capture_pipeline_activate(pipeline);
+        uint64_t activated = os_gettime_ns();
+
+        bool got_frame = false;
+        if (!abort_early) {
+            got_frame = wait_first_frame(pipeline, &options,
+                                         start + (uint64_t)options.timeout_ms * 1000000ULL);
+        }
+        uint64_t first = __atomic_load_n(&g_first_frame_ns, __ATOMIC_ACQUIRE);
+
+        read_threads(&running);
+
+        if (got_frame && options.dwell_ms > 0) {
+            uint64_t dwell_end = os_gettime_ns() + (uint64_t)options.dwell_ms * 1000000ULL;
+            while (os_gettime_ns() < dwell_end) {
+                if (options.direct) {
+                    poll_direct(pipeline);
+                }
+                usleep(1000);
+            }
+        }
+
+        uint64_t stop = os_gettime_ns();
+        capture_pipeline_deactivate(pipeline);
+        uint64_t released = os_gettime_ns();
+
+        read_threads(&stopped);
+
+        if (options.gap_ms > 0) {
+            usleep(options.gap_ms * 1000);
+        }
+
+        if (!measured) {
+            continue;
+        }
+
+        size_t created = count_new_threads(&idle, &running);
+        size_t joined = count_new_threads(&stopped, &running);
+        threads_created += created;
+        threads_joined += joined;
+        max_created = created > max_created ? created : max_created;
+
+        latency_histogram_record(&activate_call, activated - start);
+        if (abort_early) {
+            aborted++;
+            latency_histogram_record(&abort_release, released - stop);
+        } else if (got_frame) {
+            latency_histogram_record(&first_frame, first - start);
+            latency_histogram_record(&release, released - stop);
+        } else {
+            timeouts++;
+            fprintf(stderr, "Cycle %u: no frame within %u ms\n", index, options.timeout_ms);
+        }
+
+        if (options.verbose) {
+            printf("cycle %4u: activate %.2f ms, first frame %.2f ms, release %.2f ms, "
+                   "+%zu/-%zu threads\n", index, (double)(activated - start) / 1e6,
+                   first ? (double)(first - start) / 1e6 : 0.0,
+                   (double)(released - stop) / 1e6, created, joined);
+        }
+    }
+
+    if (options.trace && trace_recorder_stop(options.trace) == CANON_SUCCESS) {
+        printf("Trace written to %s\n", options.trace);
+    }
+
+    capture_pipeline_destroy(pipeline);
+    trace_recorder_shutdown();
+
+    read_threads(&stopped);
+
+    printf("\n  %-16s %8s %9s %9s %9s %9s %9s\n", "transition", "count", "mean_ms",
+           "p50_ms", "p90_ms", "p99_ms", "max_ms");
+    print_row("activate call", &activate_call);
+    print_row("first frame", &first_frame);
+    print_row("release", &release);
+    print_row("aborted release", &abort_release);
+
+    printf("\nThreads: %.2f created and %.2f joined per activation (max %zu), "
+           "%zu alive idle, %zu after destroy\n",
+           (double)threads_created / options.cycles, (double)threads_joined / options.cycles,
+           max_created, idle_threads, stopped.count);
+    printf("Aborted before first frame: %llu, timed out: %llu\n",
+           (unsigned long long)aborted, (unsigned long long)timeouts);
+
+    return timeouts > 0 ? 1 : 0;
+}
@@ -0,0 +1,293 @@
+/*
+ * v4l2loopback sink benchmark.
+ *
+ * Runs one capture pipeline against a synthetic, replay or real camera with
+ * its frames also written to a v4l2loopback device, and reports how many
+ * frames went out decoded in place or converted, and the write latency (JPEG
+ * decode start to the frame being queued on the device). With --read a
+ * second thread reads the device like any other application would and
+ * counts the frames it gets.
+ *
+ *   sudo modprobe v4l2loopback video_nr=10 exclusive_caps=1
+ *   ./canon-eos-v4l2 --sink /dev/video10 --read
+ */
+
+#include <util/base.h>
+#include <util/platform.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+#include "capture-pipeline.h"
+#include "video-source.h"
+#include "utils/latency-histogram.h"
+
+typedef struct {
+    const char *device;
+    const char *sink;
+    const char *decoder;
+    double seconds;
+    uint32_t fps;
+    bool crop;
+    bool direct;
+    bool read;
+    bool verbose;
+} v4l2_options_t;
+
+/**
+ * @brief Reader thread state
+ */
+typedef struct {
+    const char *path;
+    bool running;           // Atomic
+    uint64_t frames;        // Atomic
+    uint64_t first_ns;
+    uint64_t last_ns;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;
+} reader_t;
+
+static bool g_verbose = false;
+
+static void log_handler(int level, const char *format, va_list args, void *param)
+{
+    UNUSED_PARAMETER(param);
+    if (level <= LOG_WARNING || g_verbose) {
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+    }
+}
+
+static void discard_frame(struct obs_source_frame *frame, void *user_data)
+{
+    UNUSED_PARAMETER(frame);
+    UNUSED_PARAMETER(user_data);
+}
+
+/* Reads whole frames from the device's capture side with read() */
+static void *reader_thread_func(void *data)
+{
+    reader_t *reader = data;
+    int fd = -1;
+
+    // With exclusive_caps=1 the capture side appears once a writer streams
+    while (__atomic_load_n(&reader->running, __ATOMIC_ACQUIRE) && fd < 0) {
+        fd = open(reader->path, O_RDONLY);
+        if (fd < 0) {
+            usleep(100000);
+        }
+    }
+
+    struct v4l2_format format = {0};
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (fd >= 0 && ioctl(fd, VIDIOC_G_FMT, &format) < 0) {
+        fprintf(stderr, "Reader: cannot get the format of %s: %s\n", reader->path,
+                strerror(errno));
+        close(fd);
+        fd = -1;
+    }
+
+    size_t size = format.fmt.pix.sizeimage;
+    uint8_t *frame = size > 0 ? malloc(size) : NULL;
+    reader->width = format.fmt.pix.width;
+    reader->height = format.fmt.pix.height;
+    reader->pixelformat = format.fmt.pix.pixelformat;
+
+    while (fd >= 0 && frame && __atomic_load_n(&reader->running, __ATOMIC_ACQUIRE)) {
+        ssize_t got = read(fd, frame, size);
+        if (got < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            fprintf(stderr, "Reader: read failed: %s\n", strerror(errno));
+            break;
+        }
+
+        uint64_t now = os_gettime_ns();
+        if (__atomic_add_fetch(&reader->frames, 1, __ATOMIC_RELAXED) == 1) {
+            reader->first_ns = now;
+        }
+        reader->last_ns = now;
+    }
+
+    free(frame);
+    if (fd >= 0) {
+        close(fd);
+    }
+    return NULL;
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [options]\n"
+           "  --sink PATH       v4l2loopback device to write to (default /dev/video10)\n"
+           "  --device PATH     camera device (default synthetic://1920x1080?frames=90)\n"
+           "  --decoder NAME    JPEG decoder backend (default auto)\n"
+           "  --seconds N       run time (default 10)\n"
+           "  --fps N           requested frame rate (default 30)\n"
+           "  --crop            crop the centre quarter on the host (converted path)\n"
+           "  --direct          poll frames like the Direct Upload source (converted path)\n"
+           "  --read            read the device from a second thread\n"
+           "  --verbose         show plugin log output\n", argv0);
+}
+
+static bool parse_options(int argc, char **argv, v4l2_options_t *options)
+{
+    static const struct option long_options[] = {
+        {"sink", required_argument, NULL, 'o'},
+        {"device", required_argument, NULL, 'd'},
+        {"decoder", required_argument, NULL, 'D'},
+        {"seconds", required_argument, NULL, 's'},
+        {"fps", required_argument, NULL, 'f'},
+        {"crop", no_argument, NULL, 'c'},
+        {"direct", no_argument, NULL, 'x'},
+        {"read", no_argument, NULL, 'r'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    options->sink = "/dev/video10";
+    options->device = "synthetic://1920x1080?frames=90";
+    options->decoder = "auto";
+    options->seconds = 10.0;
+    options->fps = 30;
+    options->crop = false;
+    options->direct = false;
+    options->read = false;
+    options->verbose = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'o': options->sink = optarg; break;
+            case 'd': options->device = optarg; break;
+            case 'D': options->decoder = optarg; break;
+            case 's': options->seconds = atof(optarg); break;
+            case 'f': options->fps = (uint32_t)atoi(optarg); break;
+            case 'c': options->crop = true; break;
+            case 'x': options->direct = true; break;
+            case 'r': options->read = true; break;
+            case 'v': options->verbose = true; break;
+            default:
+                usage(argv[0]);
+                return false;
+        }
+    }
+    return options->fps > 0;
+}
+
+int main(int argc, char **argv)
+{
+    v4l2_options_t options;
+    if (!parse_options(argc, argv, &options)) {
+        return 2;
+    }
+
+    g_verbose = options.verbose;
+    base_set_log_handler(log_handler, NULL);
+
+    capture_pipeline_t *pipeline = capture_pipeline_create(options.direct ? NULL : discard_frame,
+                                                           NULL);
+    if (!pipeline) {
+        fprintf(stderr, "Failed to create pipeline\n");
+        return 1;
+    }
+    video_source_set_decode_ahead(capture_pipeline_get_video(pipeline), options.direct);
+
+    capture_pipeline_settings_t settings = {
+        .device_path = options.device,
+        .width = 1920,
+        .height = 1080,
+        .fps = options.fps,
+        .decoder = options.decoder,
+        .v4l2_device = options.sink
+    };
+    if (options.crop) {
+        settings.crop_mode = VIDEO_CROP_HOST;
+        settings.crop = (canon_roi_t){0.25f, 0.25f, 0.5f, 0.5f};
+    }
+    capture_pipeline_update(pipeline, &settings);
+    capture_pipeline_activate(pipeline);
+
+    if (!capture_pipeline_is_running(pipeline)) {
+        fprintf(stderr, "Pipeline did not start on %s\n", options.device);
+        capture_pipeline_destroy(pipeline);
+        return 1;
+    }
+
+    reader_t reader = {.path = options.sink, .running = true};
+    pthread_t reader_thread;
+    bool reading = options.read &&
+                   pthread_create(&reader_thread, NULL, reader_thread_func, &reader) == 0;
+
+    video_source_t *video = capture_pipeline_get_video(pipeline);
+    uint64_t start = os_gettime_ns();
+    uint64_t end = start + (uint64_t)(options.seconds * 1e9);
+    uint64_t next = start;
+
+    while (os_gettime_ns() < end) {
+        if (options.direct) {
+            struct obs_source_frame frame = {0};
+            if (video_source_get_latest_frame(video, &frame) == CANON_SUCCESS) {
+                video_source_release_frame(video, &frame);
+            }
+        }
+        next += 1000000000ULL / options.fps;
+        os_sleepto_ns(next);
+    }
+
+    if (reading) {
+        __atomic_store_n(&reader.running, false, __ATOMIC_RELEASE);
+    }
+    capture_pipeline_deactivate(pipeline);
+    if (reading) {
+        pthread_join(reader_thread, NULL);
+    }
+
+    video_source_counters_t counters;
+    video_source_read_counters(video, &counters);
+    const latency_histogram_t *write = &counters.sink_write;
+
+    printf("Sink %s, %s output, %.1f s\n", options.sink,
+           options.direct ? "direct" : "async", options.seconds);
+    printf("  frames delivered   %8llu\n", (unsigned long long)counters.frames_delivered);
+    printf("  frames written     %8llu  (%llu decoded in place, %llu converted), %llu failed\n",
+           (unsigned long long)counters.sink_frames,
+           (unsigned long long)counters.sink_frames_direct,
+           (unsigned long long)(counters.sink_frames > counters.sink_frames_direct ?
+                                counters.sink_frames - counters.sink_frames_direct : 0),
+           (unsigned long long)counters.sink_errors);
+    if (write->total > 0) {
+        printf("  write latency      %8.2f ms p50, %.2f ms p90, %.2f ms p99, %.2f ms max\n",
+               (double)latency_histogram_percentile(write, 50.0) / 1e6,
+               (double)latency_histogram_percentile(write, 90.0) / 1e6,
+               (double)latency_histogram_percentile(write, 99.0) / 1e6,
+               (double)write->max / 1e6);
+        printf("  decode             %8.2f ms p50\n",
+               (double)latency_histogram_percentile(&counters.decode, 50.0) / 1e6);
+    }
+    if (reading) {
+        uint64_t frames = __atomic_load_n(&reader.frames, __ATOMIC_RELAXED);
+        uint32_t fourcc = reader.pixelformat;
+        printf("  reader             %8llu frames of %ux%u %c%c%c%c", (unsigned long long)frames,
+               reader.width, reader.height, (char)(fourcc & 0xff), (char)((fourcc >> 8) & 0xff),
+               (char)((fourcc >> 16) & 0xff), (char)((fourcc >> 24) & 0xff));
+        if (frames > 1 && reader.last_ns > reader.first_ns) {
+            printf(" (%.1f fps)", (double)(frames - 1) * 1e9 /
+                                  (double)(reader.last_ns - reader.first_ns));
+        }
+        printf("\n");
+    }
+
+    capture_pipeline_destroy(pipeline);
+    return counters.sink_frames > 0 ? 0 : 1;
+}
@@ -1,6 +1,8 @@
 #include "camera-detector.h"
 #include "utils/logging.h"
+#include "utils/lock-profiler.h"
 #include "utils/error-handling.h"
+#include "utils/thread-registry.h"
 #include <libusb-1.0/libusb.h>
 #include <pthread.h>
 #include <stdlib.h>
@@ -8,7 +10,7 @@
 #include <unistd.h>
 
 #define CANON_VENDOR_ID 0x04A9
-#define MAX_CAMERAS 16
+#define INITIAL_CAPACITY 16
 #define POLL_INTERVAL_MS 1000
 
 /**
@@ -35,19 +37,40 @@ static const canon_model_t g_supported_models[] = {
     {0, NULL}
 };
 
+/**
+ * @brief Published snapshot with its serial number index
+ */
+typedef struct snapshot_impl_t {
+    camera_snapshot_t pub;
+    camera_info_t *cameras;
+    const camera_info_t **by_serial;
+    int serial_count;
+    struct snapshot_impl_t *next_retired;
+} snapshot_impl_t;
+
 /**
  * @brief Camera detector structure
+ *
+ * The registry (cameras, sorted by device path) is only touched under the
+ * mutex. Readers use the published snapshot, which is swapped atomically on
+ * every change. Replaced snapshots are freed once no reader holds one.
  */
 struct camera_detector_t {
     libusb_context *usb_context;
     libusb_hotplug_callback_handle hotplug_handle;
     
     pthread_t monitor_thread;
-    pthread_mutex_t mutex;
+    profiled_mutex_t mutex;
     bool running;
     
-    camera_info_t cameras[MAX_CAMERAS];
+    camera_info_t *cameras;
     int camera_count;
+    int camera_capacity;
+    
+    snapshot_impl_t *snapshot;
+    snapshot_impl_t *retired;
+    int readers;
+    uint64_t generation;
     
     camera_event_callback event_callback;
     void *callback_user_data;
@@ -77,74 +100,258 @@ bool camera_detector_is_supported(uint16_t vendor_id, uint16_t product_id)
     return false;
 }
 
-static int hotplug_callback(libusb_context *ctx, libusb_device *device,
-                          libusb_hotplug_event event, void *user_data)
+static int compare_serial(const void *a, const void *b)
 {
-    UNUSED_PARAMETER(ctx);
-    camera_detector_t *detector = (camera_detector_t *)user_data;
-    struct libusb_device_descriptor desc;
+    const camera_info_t *ca = *(const camera_info_t *const *)a;
+    const camera_info_t *cb = *(const camera_info_t *const *)b;
+    return strcmp(ca->serial_number, cb->serial_number);
+}
+
+static void free_snapshot(snapshot_impl_t *snapshot)
+{
+    if (snapshot) {
+        free(snapshot->by_serial);
+        free(snapshot->cameras);
+        free(snapshot);
+    }
+}
+
+/**
+ * Free retired snapshots if no reader can still reference them.
+ * Called with detector->mutex held.
+ */
+static void reclaim_snapshots(camera_detector_t *detector)
+{
+    if (!detector->retired ||
+        __atomic_load_n(&detector->readers, __ATOMIC_SEQ_CST) != 0) {
+        return;
+    }
     
-    if (libusb_get_device_descriptor(device, &desc) != 0) {
-        return 0;
+    snapshot_impl_t *retired = detector->retired;
+    __atomic_store_n(&detector->retired, NULL, __ATOMIC_SEQ_CST);
+    
+    while (retired) {
+        snapshot_impl_t *next = retired->next_retired;
+        free_snapshot(retired);
+        retired = next;
+    }
+}
+
+/**
+ * Build a snapshot from the registry and publish it.
+ * Called with detector->mutex held.
+ */
+static void publish_snapshot(camera_detector_t *detector)
+{
+    snapshot_impl_t *snapshot = calloc(1, sizeof(snapshot_impl_t));
+    if (!snapshot) {
+        canon_log(LOG_ERROR, "Failed to allocate camera snapshot");
+        return;
     }
     
-    if (desc.idVendor != CANON_VENDOR_ID) {
-        return 0;
+    int count = detector->camera_count;
+    if (count > 0) {
+        snapshot->cameras = malloc(count * sizeof(camera_info_t));
+        snapshot->by_serial = malloc(count * sizeof(camera_info_t *));
+        if (!snapshot->cameras || !snapshot->by_serial) {
+            canon_log(LOG_ERROR, "Failed to allocate camera snapshot");
+            free_snapshot(snapshot);
+            return;
+        }
+        memcpy(snapshot->cameras, detector->cameras, count * sizeof(camera_info_t));
+        
+        for (int i = 0; i < count; i++) {
+            if (snapshot->cameras[i].serial_number[0] != '\0') {
+                snapshot->by_serial[snapshot->serial_count++] = &snapshot->cameras[i];
+            }
+        }
+        qsort(snapshot->by_serial, snapshot->serial_count,
+              sizeof(camera_info_t *), compare_serial);
     }
     
-    pthread_mutex_lock(&detector->mutex);
+    uint64_t generation = __atomic_add_fetch(&detector->generation, 1, __ATOMIC_SEQ_CST);
+    snapshot->pub.generation = generation;
+    snapshot->pub.count = count;
+    snapshot->pub.cameras = snapshot->cameras;
     
-    camera_info_t info = {0};
-    info.vendor_id = desc.idVendor;
-    info.product_id = desc.idProduct;
-    info.is_supported = camera_detector_is_supported(desc.idVendor, desc.idProduct);
+    snapshot_impl_t *old = __atomic_exchange_n(&detector->snapshot, snapshot,
+                                               __ATOMIC_SEQ_CST);
+    if (old) {
+        old->next_retired = detector->retired;
+        __atomic_store_n(&detector->retired, old, __ATOMIC_SEQ_CST);
+    }
     
-    snprintf(info.model_name, sizeof(info.model_name), "%s",
-            get_model_name(desc.idProduct));
+    reclaim_snapshots(detector);
+}
+
+/**
+ * Binary search the registry by device path. Returns true if found, with
+ * *index set to the entry, otherwise *index is the insertion point.
+ */
+static bool registry_find(const camera_detector_t *detector, const char *device_path,
+                          int *index)
+{
+    int lo = 0;
+    int hi = detector->camera_count;
+    
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(detector->cameras[mid].device_path, device_path);
+        if (cmp == 0) {
+            *index = mid;
+            return true;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    *index = lo;
+    return false;
+}
+
+/**
+ * Add a camera to the registry. Called with detector->mutex held.
+ */
+static bool registry_add(camera_detector_t *detector, const camera_info_t *info)
+{
+    int index;
+    if (registry_find(detector, info->device_path, &index)) {
+        return false;
+    }
+    
+    if (detector->camera_count == detector->camera_capacity) {
+        int capacity = detector->camera_capacity ? detector->camera_capacity * 2 : INITIAL_CAPACITY;
+        camera_info_t *cameras = realloc(detector->cameras, capacity * sizeof(camera_info_t));
+        if (!cameras) {
+            canon_log(LOG_ERROR, "Failed to grow camera registry");
+            return false;
+        }
+        detector->cameras = cameras;
+        detector->camera_capacity = capacity;
+    }
+    
+    memmove(&detector->cameras[index + 1], &detector->cameras[index],
+           (detector->camera_count - index) * sizeof(camera_info_t));
+    memcpy(&detector->cameras[index], info, sizeof(camera_info_t));
+    detector->camera_count++;
+    
+    return true;
+}
+
+/**
+ * Remove a camera from the registry. Called with detector->mutex held.
+ */
+static bool registry_remove(camera_detector_t *detector, const char *device_path,
+                            camera_info_t *removed)
+{
+    int index;
+    if (!registry_find(detector, device_path, &index)) {
+        return false;
+    }
+    
+    memcpy(removed, &detector->cameras[index], sizeof(camera_info_t));
+    memmove(&detector->cameras[index], &detector->cameras[index + 1],
+           (detector->camera_count - index - 1) * sizeof(camera_info_t));
+    detector->camera_count--;
+    
+    return true;
+}
+
+/**
+ * Fill in a camera entry from its USB descriptor. The serial number needs
+ * the device opened; with read_serial false, or if it cannot be opened, it
+ * is left empty.
+ */
+static void read_camera_info(libusb_device *device, const struct libusb_device_descriptor *desc,
+                             bool read_serial, camera_info_t *info)
+{
+    memset(info, 0, sizeof(camera_info_t));
+    info->vendor_id = desc->idVendor;
+    info->product_id = desc->idProduct;
+    info->is_supported = camera_detector_is_supported(desc->idVendor, desc->idProduct);
+    
+    snprintf(info->model_name, sizeof(info->model_name), "%s",
+            get_model_name(desc->idProduct));
     
     uint8_t bus = libusb_get_bus_number(device);
     uint8_t addr = libusb_get_device_address(device);
-    snprintf(info.device_path, sizeof(info.device_path),
+    snprintf(info->device_path, sizeof(info->device_path),
             "/dev/bus/usb/%03d/%03d", bus, addr);
     
-    if (desc.iSerialNumber) {
+    if (read_serial && desc->iSerialNumber) {
         libusb_device_handle *handle;
         if (libusb_open(device, &handle) == 0) {
-            libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber,
-                                              (unsigned char *)info.serial_number,
-                                              sizeof(info.serial_number));
+            libusb_get_string_descriptor_ascii(handle, desc->iSerialNumber,
+                                              (unsigned char *)info->serial_number,
+                                              sizeof(info->serial_number));
             libusb_close(handle);
         }
     }
+}
+
+/**
+ * Fill in the serial number of a registered camera that has none yet, e.g.
+ * because the device could not be opened when it was first seen.
+ * Called with detector->mutex held.
+ */
+static bool registry_update_serial(camera_detector_t *detector, const camera_info_t *info)
+{
+    int index;
+    if (info->serial_number[0] == '\0' ||
+        !registry_find(detector, info->device_path, &index) ||
+        detector->cameras[index].serial_number[0] != '\0') {
+        return false;
+    }
+    
+    memcpy(detector->cameras[index].serial_number, info->serial_number,
+           sizeof(info->serial_number));
+    return true;
+}
+
+static int hotplug_callback(libusb_context *ctx, libusb_device *device,
+                          libusb_hotplug_event event, void *user_data)
+{
+    UNUSED_PARAMETER(ctx);
+    camera_detector_t *detector = (camera_detector_t *)user_data;
+    struct libusb_device_descriptor desc;
+    
+    if (libusb_get_device_descriptor(device, &desc) != 0) {
+        return 0;
+    }
+    
+    if (desc.idVendor != CANON_VENDOR_ID) {
+        return 0;
+    }
     
     bool connected = (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED);
     
+    // A device that has left can no longer be opened
+    camera_info_t info;
+    read_camera_info(device, &desc, connected, &info);
+    
+    profiled_mutex_lock(&detector->mutex);
+    
     if (connected) {
-        bool found = false;
-        for (int i = 0; i < detector->camera_count; i++) {
-            if (strcmp(detector->cameras[i].device_path, info.device_path) == 0) {
-                found = true;
-                break;
-            }
-        }
-        
-        if (!found && detector->camera_count < MAX_CAMERAS) {
-            memcpy(&detector->cameras[detector->camera_count], &info, sizeof(camera_info_t));
-            detector->camera_count++;
+        if (registry_add(detector, &info)) {
+            publish_snapshot(detector);
             
-            canon_log(LOG_INFO, "Camera connected: %s at %s",
-                     info.model_name, info.device_path);
+            canon_log(LOG_INFO, "Camera connected: %s at %s (%d total)",
+                     info.model_name, info.device_path, detector->camera_count);
+        } else if (registry_update_serial(detector, &info)) {
+            // Enumeration re-delivers cameras found by the initial scan
+            publish_snapshot(detector);
         }
     } else {
-        for (int i = 0; i < detector->camera_count; i++) {
-            if (strcmp(detector->cameras[i].device_path, info.device_path) == 0) {
-                canon_log(LOG_INFO, "Camera disconnected: %s", info.model_name);
-                
-                memmove(&detector->cameras[i], &detector->cameras[i + 1],
-                       (detector->camera_count - i - 1) * sizeof(camera_info_t));
-                detector->camera_count--;
-                break;
-            }
+        camera_info_t removed;
+        if (registry_remove(detector, info.device_path, &removed)) {
+            // The device can no longer be opened, report what we knew
+            memcpy(info.serial_number, removed.serial_number, sizeof(info.serial_number));
+            publish_snapshot(detector);
+            
+            canon_log(LOG_INFO, "Camera disconnected: %s", info.model_name);
         }
     }
     
@@ -152,7 +359,7 @@ static int hotplug_callback(libusb_context *ctx, libusb_device *device,
         detector->event_callback(&info, connected, detector->callback_user_data);
     }
     
-    pthread_mutex_unlock(&detector->mutex);
+    profiled_mutex_unlock(&detector->mutex);
     
     return 0;
 }
@@ -162,6 +369,7 @@ static void *monitor_thread_func(void *data)
     camera_detector_t *detector = (camera_detector_t *)data;
 
     canon_log(LOG_DEBUG, "Camera monitor thread started");
+    thread_registry_enter(NULL, THREAD_ROLE_DETECTOR);
 
     struct timeval tv;
     tv.tv_sec = 0;
@@ -172,6 +380,7 @@ static void *monitor_thread_func(void *data)
     }
 
     canon_log(LOG_DEBUG, "Camera monitor thread stopped");
+    thread_registry_leave();
     return NULL;
 }
 
@@ -189,7 +398,9 @@ camera_detector_t *camera_detector_create(void)
         return NULL;
     }
     
-    pthread_mutex_init(&detector->mutex, NULL);
+    profiled_mutex_init(&detector->mutex, "detector");
+    
+    profiled_mutex_lock(&detector->mutex);
     
     libusb_device **devices;
     ssize_t count = libusb_get_device_list(detector->usb_context, &devices);
@@ -198,32 +409,23 @@ camera_detector_t *camera_detector_create(void)
         for (ssize_t i = 0; i < count; i++) {
             struct libusb_device_descriptor desc;
             if (libusb_get_device_descriptor(devices[i], &desc) == 0) {
-                if (desc.idVendor == CANON_VENDOR_ID &&
-                    detector->camera_count < MAX_CAMERAS) {
+                if (desc.idVendor == CANON_VENDOR_ID) {
+                    camera_info_t info;
+                    read_camera_info(devices[i], &desc, true, &info);
                     
-                    camera_info_t *info = &detector->cameras[detector->camera_count];
-                    info->vendor_id = desc.idVendor;
-                    info->product_id = desc.idProduct;
-                    info->is_supported = camera_detector_is_supported(desc.idVendor, desc.idProduct);
-                    
-                    snprintf(info->model_name, sizeof(info->model_name), "%s",
-                            get_model_name(desc.idProduct));
-                    
-                    uint8_t bus = libusb_get_bus_number(devices[i]);
-                    uint8_t addr = libusb_get_device_address(devices[i]);
-                    snprintf(info->device_path, sizeof(info->device_path),
-                            "/dev/bus/usb/%03d/%03d", bus, addr);
-                    
-                    detector->camera_count++;
-                    
-                    canon_log(LOG_INFO, "Found camera: %s at %s",
-                             info->model_name, info->device_path);
+                    if (registry_add(detector, &info)) {
+                        canon_log(LOG_INFO, "Found camera: %s at %s",
+                                 info.model_name, info.device_path);
+                    }
                 }
             }
         }
         libusb_free_device_list(devices, 1);
     }
     
+    publish_snapshot(detector);
+    profiled_mutex_unlock(&detector->mutex);
+    
     return detector;
 }
 
@@ -235,7 +437,16 @@ void camera_detector_destroy(camera_detector_t *detector)
     
     camera_detector_stop(detector);
     
-    pthread_mutex_destroy(&detector->mutex);
+    // All readers must have released their snapshots by now
+    free_snapshot(detector->snapshot);
+    while (detector->retired) {
+        snapshot_impl_t *next = detector->retired->next_retired;
+        free_snapshot(detector->retired);
+        detector->retired = next;
+    }
+    free(detector->cameras);
+    
+    profiled_mutex_destroy(&detector->mutex);
     
     if (detector->usb_context) {
         libusb_exit(detector->usb_context);
@@ -308,22 +519,117 @@ int camera_detector_list_devices(camera_detector_t *detector, camera_info_t **ca
         return 0;
     }
     
-    pthread_mutex_lock(&detector->mutex);
+    const camera_snapshot_t *snapshot = camera_detector_acquire_snapshot(detector);
+    int count = 0;
     
-    if (detector->camera_count > 0) {
-        *cameras = calloc(detector->camera_count, sizeof(camera_info_t));
+    if (snapshot && snapshot->count > 0) {
+        *cameras = calloc(snapshot->count, sizeof(camera_info_t));
         if (*cameras) {
-            memcpy(*cameras, detector->cameras,
-                  detector->camera_count * sizeof(camera_info_t));
+            memcpy(*cameras, snapshot->cameras,
+                  snapshot->count * sizeof(camera_info_t));
+            count = snapshot->count;
         }
     }
     
-    int count = detector->camera_count;
-    pthread_mutex_unlock(&detector->mutex);
+    camera_detector_release_snapshot(detector, snapshot);
     
     return count;
 }
 
+const camera_snapshot_t *camera_detector_acquire_snapshot(camera_detector_t *detector)
+{
+    if (!detector) {
+        return NULL;
+    }
+    
+    // Announce the reader before loading the pointer so a concurrent
+    // publish cannot free the snapshot we are about to use
+    __atomic_add_fetch(&detector->readers, 1, __ATOMIC_SEQ_CST);
+    snapshot_impl_t *snapshot = __atomic_load_n(&detector->snapshot, __ATOMIC_SEQ_CST);
+    
+    return snapshot ? &snapshot->pub : NULL;
+}
+
+void camera_detector_release_snapshot(camera_detector_t *detector,
+                                      const camera_snapshot_t *snapshot)
+{
+    UNUSED_PARAMETER(snapshot);
+    if (!detector) {
+        return;
+    }
+    
+    int readers = __atomic_sub_fetch(&detector->readers, 1, __ATOMIC_SEQ_CST);
+    
+    // Last reader out frees retired snapshots unless a writer is busy
+    if (readers == 0 && __atomic_load_n(&detector->retired, __ATOMIC_SEQ_CST) &&
+        profiled_mutex_trylock(&detector->mutex) == 0) {
+        reclaim_snapshots(detector);
+        profiled_mutex_unlock(&detector->mutex);
+    }
+}
+
+uint64_t camera_detector_get_generation(camera_detector_t *detector)
+{
+    if (!detector) {
+        return 0;
+    }
+    
+    return __atomic_load_n(&detector->generation, __ATOMIC_SEQ_CST);
+}
+
+const camera_info_t *camera_snapshot_find_path(const camera_snapshot_t *snapshot,
+                                               const char *device_path)
+{
+    if (!snapshot || !device_path) {
+        return NULL;
+    }
+    
+    int lo = 0;
+    int hi = snapshot->count;
+    
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(snapshot->cameras[mid].device_path, device_path);
+        if (cmp == 0) {
+            return &snapshot->cameras[mid];
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    return NULL;
+}
+
+const camera_info_t *camera_snapshot_find_serial(const camera_snapshot_t *snapshot,
+                                                 const char *serial_number)
+{
+    if (!snapshot || !serial_number || serial_number[0] == '\0') {
+        return NULL;
+    }
+    
+    const snapshot_impl_t *impl = (const snapshot_impl_t *)snapshot;
+    int lo = 0;
+    int hi = impl->serial_count;
+    
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(impl->by_serial[mid]->serial_number, serial_number);
+        if (cmp == 0) {
+            return impl->by_serial[mid];
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    return NULL;
+}
+
 void camera_detector_free_list(camera_info_t *cameras, int count)
 {
     UNUSED_PARAMETER(count);
@@ -340,8 +646,8 @@ void camera_detector_set_callback(camera_detector_t *detector,
         return;
     }
     
-    pthread_mutex_lock(&detector->mutex);
+    profiled_mutex_lock(&detector->mutex);
     detector->event_callback = callback;
     detector->callback_user_data = user_data;
-    pthread_mutex_unlock(&detector->mutex);
+    profiled_mutex_unlock(&detector->mutex);
 }
\ No newline at end of file
@@ -17,6 +17,18 @@ typedef struct camera_info_t {
     bool is_supported;
 } camera_info_t;
 
+/**
+ * @brief Immutable view of the connected cameras
+ *
+ * Cameras are sorted by device path. A snapshot stays valid until it is
+ * released, even if cameras connect or disconnect in the meantime.
+ */
+typedef struct camera_snapshot_t {
+    uint64_t generation;            /**< Detector generation it was built at */
+    int count;                      /**< Number of cameras */
+    const camera_info_t *cameras;   /**< Cameras sorted by device_path */
+} camera_snapshot_t;
+
 /**
  * @brief Camera detector handle
  */
@@ -53,13 +65,53 @@ canon_error_t camera_detector_start(camera_detector_t *detector);
 void camera_detector_stop(camera_detector_t *detector);
 
 /**
- * @brief List currently connected cameras
+ * @brief List currently connected cameras (copy of the current snapshot)
  * @param detector Detector handle
  * @param cameras Output array (caller must free with camera_detector_free_list)
  * @return Number of cameras found
  */
 int camera_detector_list_devices(camera_detector_t *detector, camera_info_t **cameras);
 
+/**
+ * @brief Get the current camera snapshot without locking or copying
+ * @param detector Detector handle
+ * @return Snapshot (release with camera_detector_release_snapshot)
+ */
+const camera_snapshot_t *camera_detector_acquire_snapshot(camera_detector_t *detector);
+
+/**
+ * @brief Release a snapshot obtained from camera_detector_acquire_snapshot
+ * @param detector Detector handle
+ * @param snapshot Snapshot handle
+ */
+void camera_detector_release_snapshot(camera_detector_t *detector,
+                                      const camera_snapshot_t *snapshot);
+
+/**
+ * @brief Get the detector generation (incremented on every camera change)
+ * @param detector Detector handle
+ * @return Generation counter
+ */
+uint64_t camera_detector_get_generation(camera_detector_t *detector);
+
+/**
+ * @brief Find a camera in a snapshot by device path
+ * @param snapshot Snapshot handle
+ * @param device_path USB device path
+ * @return Camera info or NULL if not present
+ */
+const camera_info_t *camera_snapshot_find_path(const camera_snapshot_t *snapshot,
+                                               const char *device_path);
+
+/**
+ * @brief Find a camera in a snapshot by serial number
+ * @param snapshot Snapshot handle
+ * @param serial_number Camera serial number
+ * @return Camera info or NULL if not present
+ */
+const camera_info_t *camera_snapshot_find_serial(const camera_snapshot_t *snapshot,
+                                                 const char *serial_number);
+
 /**
  * @brief Free camera list
  * @param cameras Camera array
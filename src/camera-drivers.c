@@ -0,0 +1,111 @@
+#include "camera-drivers.h"
+#include "utils/logging.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Set by CMake from libgphoto2's pkg-config driverdir variable
+#ifndef CANON_EOS_CAMLIB_DIR
+#define CANON_EOS_CAMLIB_DIR NULL
+#endif
+
+#define PTP_CAMLIB "ptp2.so"
+
+static char g_driver_dir[PATH_MAX];
+static bool g_restricted = false;
+
+static void remove_driver_dir(void)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/%s", g_driver_dir, PTP_CAMLIB);
+    unlink(path);
+    rmdir(g_driver_dir);
+    g_driver_dir[0] = '\0';
+}
+
+/* Link the ptp2 camlib into the private directory; false if it is not installed */
+static bool link_camlib(void)
+{
+    // Read once here; libgphoto2's own loads read it the same way
+    const char *source_dir = getenv("CAMLIBS");
+    if (!source_dir || !source_dir[0]) {
+        source_dir = CANON_EOS_CAMLIB_DIR;
+    }
+    if (!source_dir) {
+        canon_log(LOG_DEBUG, "No camlib directory known, loading all drivers");
+        return false;
+    }
+
+    char target[PATH_MAX];
+    char path[PATH_MAX];
+    snprintf(target, sizeof(target), "%s/%s", source_dir, PTP_CAMLIB);
+    if (access(target, R_OK) != 0) {
+        canon_log(LOG_WARNING, "%s not found, loading all libgphoto2 drivers", target);
+        return false;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", g_driver_dir, PTP_CAMLIB);
+    return symlink(target, path) == 0;
+}
+
+canon_error_t camera_drivers_init(void)
+{
+    if (g_restricted) {
+        return CANON_SUCCESS;
+    }
+
+    const char *mode = getenv("CANON_EOS_CAMLIBS");
+    if (mode && strcmp(mode, "all") == 0) {
+        canon_log(LOG_INFO, "Loading all libgphoto2 drivers (CANON_EOS_CAMLIBS=all)");
+        return CANON_SUCCESS;
+    }
+
+    const char *base = getenv("XDG_RUNTIME_DIR");
+    if (!base || !base[0]) {
+        base = "/tmp";
+    }
+    snprintf(g_driver_dir, sizeof(g_driver_dir), "%s/canon-eos-drivers-XXXXXX", base);
+    if (!mkdtemp(g_driver_dir)) {
+        canon_log(LOG_WARNING, "Failed to create driver directory in %s, "
+                 "loading all libgphoto2 drivers", base);
+        g_driver_dir[0] = '\0';
+        return CANON_SUCCESS;
+    }
+
+    if (!link_camlib()) {
+        remove_driver_dir();
+        return CANON_SUCCESS;
+    }
+
+    g_restricted = true;
+    canon_log(LOG_INFO, "libgphoto2 camera drivers restricted to %s (%s)",
+             PTP_CAMLIB, g_driver_dir);
+    return CANON_SUCCESS;
+}
+
+void camera_drivers_cleanup(void)
+{
+    if (!g_restricted) {
+        return;
+    }
+
+    remove_driver_dir();
+    g_restricted = false;
+}
+
+bool camera_drivers_restricted(void)
+{
+    return g_restricted;
+}
+
+int camera_drivers_load_abilities(CameraAbilitiesList *list, GPContext *context)
+{
+    if (!g_restricted) {
+        return gp_abilities_list_load(list, context);
+    }
+    return gp_abilities_list_load_dir(list, g_driver_dir, context);
+}
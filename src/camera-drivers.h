@@ -0,0 +1,56 @@
+#ifndef CAMERA_DRIVERS_H
+#define CAMERA_DRIVERS_H
+
+#include "canon-errors.h"
+#include <gphoto2/gphoto2.h>
+#include <stdbool.h>
+
+/**
+ * @brief libgphoto2 camera driver set restricted to what the plugin uses
+ *
+ * gp_abilities_list_load() opens every camera driver (camlib) libgphoto2
+ * ships and asks each for its model list, though EOS bodies only ever use
+ * the ptp2 camlib. At library init a private directory is created with a
+ * link to just that one, and camera_drivers_load_abilities() loads the
+ * camera list from it with gp_abilities_list_load_dir(). The environment is
+ * left alone, so other libgphoto2 users in the process and child processes
+ * still see every driver. The port list is loaded unfiltered; libgphoto2
+ * has no per-directory load for it.
+ *
+ * The driver is linked from CAMLIBS if set, else from the directory
+ * libgphoto2 was built with. If it is missing, or CANON_EOS_CAMLIBS=all is
+ * set, all drivers are loaded as before.
+ */
+
+/**
+ * @brief Create the driver directory
+ *
+ * Call once, from canon_camera_init_library().
+ * @return CANON_SUCCESS (falling back to all drivers is not an error)
+ */
+canon_error_t camera_drivers_init(void);
+
+/**
+ * @brief Remove the driver directory
+ *
+ * No camera may be connected anymore.
+ */
+void camera_drivers_cleanup(void);
+
+/**
+ * @brief Check whether only the ptp2 camera driver is loaded
+ * @return true after a successful camera_drivers_init()
+ */
+bool camera_drivers_restricted(void);
+
+/**
+ * @brief Load the camera list from the restricted driver set
+ *
+ * Falls back to gp_abilities_list_load() when not restricted.
+ * @param list Abilities list to fill
+ * @param context libgphoto2 context
+ * @return libgphoto2 result code
+ */
+int camera_drivers_load_abilities(CameraAbilitiesList *list, GPContext *context);
+
+#endif /* CAMERA_DRIVERS_H */
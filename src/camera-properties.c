@@ -0,0 +1,289 @@
+#include "camera-properties.h"
+#include "utils/logging.h"
+#include "utils/lock-profiler.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 64
+
+typedef struct {
+    char name[CAMERA_PROPERTY_NAME_SIZE];
+    char value[CAMERA_PROPERTY_VALUE_SIZE];
+    uint64_t version;
+    bool pending;
+} property_entry_t;
+
+/**
+ * @brief Property mirror implementation
+ *
+ * Entries are kept sorted by name for binary search.
+ */
+struct camera_properties_t {
+    profiled_mutex_t mutex;
+
+    property_entry_t *entries;
+    size_t count;
+    size_t capacity;
+    size_t pending_count;
+
+    uint64_t version;
+
+    camera_property_callback callback;
+    void *callback_data;
+};
+
+/**
+ * Binary search for name. Returns true if found, with *index set to the
+ * entry, otherwise *index is the insertion point.
+ */
+static bool find_entry(const camera_properties_t *props, const char *name,
+                       size_t *index)
+{
+    size_t lo = 0;
+    size_t hi = props->count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(props->entries[mid].name, name);
+        if (cmp == 0) {
+            *index = mid;
+            return true;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    *index = lo;
+    return false;
+}
+
+camera_properties_t *camera_properties_create(void)
+{
+    camera_properties_t *props = calloc(1, sizeof(camera_properties_t));
+    if (!props) {
+        canon_log(LOG_ERROR, "Failed to allocate property mirror");
+        return NULL;
+    }
+
+    props->entries = calloc(INITIAL_CAPACITY, sizeof(property_entry_t));
+    if (!props->entries) {
+        canon_log(LOG_ERROR, "Failed to allocate property entries");
+        free(props);
+        return NULL;
+    }
+    props->capacity = INITIAL_CAPACITY;
+
+    profiled_mutex_init(&props->mutex, "camera_properties");
+
+    return props;
+}
+
+void camera_properties_destroy(camera_properties_t *props)
+{
+    if (!props) {
+        return;
+    }
+
+    profiled_mutex_destroy(&props->mutex);
+    free(props->entries);
+    free(props);
+}
+
+void camera_properties_clear(camera_properties_t *props)
+{
+    if (!props) {
+        return;
+    }
+
+    profiled_mutex_lock(&props->mutex);
+    props->count = 0;
+    props->pending_count = 0;
+    props->version++;
+    profiled_mutex_unlock(&props->mutex);
+}
+
+bool camera_properties_set(camera_properties_t *props,
+                           const char *name, const char *value)
+{
+    if (!props || !name || !value || name[0] == '\0') {
+        return false;
+    }
+
+    profiled_mutex_lock(&props->mutex);
+
+    size_t index;
+    if (find_entry(props, name, &index)) {
+        property_entry_t *entry = &props->entries[index];
+
+        if (strncmp(entry->value, value, sizeof(entry->value) - 1) == 0) {
+            profiled_mutex_unlock(&props->mutex);
+            return false;
+        }
+
+        strncpy(entry->value, value, sizeof(entry->value) - 1);
+        entry->version = ++props->version;
+        if (!entry->pending) {
+            entry->pending = true;
+            props->pending_count++;
+        }
+
+        profiled_mutex_unlock(&props->mutex);
+        return true;
+    }
+
+    if (props->count == props->capacity) {
+        size_t new_capacity = props->capacity * 2;
+        property_entry_t *entries = realloc(props->entries,
+                                            new_capacity * sizeof(property_entry_t));
+        if (!entries) {
+            profiled_mutex_unlock(&props->mutex);
+            canon_log(LOG_ERROR, "Failed to grow property mirror");
+            return false;
+        }
+        props->entries = entries;
+        props->capacity = new_capacity;
+    }
+
+    memmove(&props->entries[index + 1], &props->entries[index],
+            (props->count - index) * sizeof(property_entry_t));
+    props->count++;
+
+    property_entry_t *entry = &props->entries[index];
+    memset(entry, 0, sizeof(*entry));
+    strncpy(entry->name, name, sizeof(entry->name) - 1);
+    strncpy(entry->value, value, sizeof(entry->value) - 1);
+    entry->version = ++props->version;
+    entry->pending = true;
+    props->pending_count++;
+
+    profiled_mutex_unlock(&props->mutex);
+    return true;
+}
+
+void camera_properties_touch(camera_properties_t *props)
+{
+    if (!props) {
+        return;
+    }
+
+    profiled_mutex_lock(&props->mutex);
+    props->version++;
+    profiled_mutex_unlock(&props->mutex);
+}
+
+canon_error_t camera_properties_get(camera_properties_t *props,
+                                    const char *name,
+                                    char *value, size_t value_size,
+                                    uint64_t *version)
+{
+    if (!props || !name || !value || value_size == 0) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    profiled_mutex_lock(&props->mutex);
+
+    size_t index;
+    if (!find_entry(props, name, &index)) {
+        profiled_mutex_unlock(&props->mutex);
+        return CANON_ERROR_NOT_SUPPORTED;
+    }
+
+    strncpy(value, props->entries[index].value, value_size - 1);
+    value[value_size - 1] = '\0';
+    if (version) {
+        *version = props->entries[index].version;
+    }
+
+    profiled_mutex_unlock(&props->mutex);
+
+    return CANON_SUCCESS;
+}
+
+uint64_t camera_properties_version(camera_properties_t *props)
+{
+    if (!props) {
+        return 0;
+    }
+
+    profiled_mutex_lock(&props->mutex);
+    uint64_t version = props->version;
+    profiled_mutex_unlock(&props->mutex);
+
+    return version;
+}
+
+size_t camera_properties_count(camera_properties_t *props)
+{
+    if (!props) {
+        return 0;
+    }
+
+    profiled_mutex_lock(&props->mutex);
+    size_t count = props->count;
+    profiled_mutex_unlock(&props->mutex);
+
+    return count;
+}
+
+void camera_properties_set_callback(camera_properties_t *props,
+                                    camera_property_callback callback,
+                                    void *user_data)
+{
+    if (!props) {
+        return;
+    }
+
+    profiled_mutex_lock(&props->mutex);
+    props->callback = callback;
+    props->callback_data = user_data;
+    profiled_mutex_unlock(&props->mutex);
+}
+
+void camera_properties_dispatch(camera_properties_t *props)
+{
+    if (!props) {
+        return;
+    }
+
+    profiled_mutex_lock(&props->mutex);
+
+    while (props->pending_count > 0) {
+        char name[CAMERA_PROPERTY_NAME_SIZE];
+        char value[CAMERA_PROPERTY_VALUE_SIZE];
+        uint64_t version = 0;
+        bool found = false;
+
+        for (size_t i = 0; i < props->count; i++) {
+            property_entry_t *entry = &props->entries[i];
+            if (entry->pending) {
+                memcpy(name, entry->name, sizeof(name));
+                memcpy(value, entry->value, sizeof(value));
+                version = entry->version;
+                entry->pending = false;
+                found = true;
+                break;
+            }
+        }
+
+        props->pending_count--;
+        if (!found) {
+            props->pending_count = 0;
+            break;
+        }
+
+        camera_property_callback callback = props->callback;
+        void *callback_data = props->callback_data;
+
+        if (callback) {
+            profiled_mutex_unlock(&props->mutex);
+            callback(name, value, version, callback_data);
+            profiled_mutex_lock(&props->mutex);
+        }
+    }
+
+    profiled_mutex_unlock(&props->mutex);
+}
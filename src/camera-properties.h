@@ -0,0 +1,118 @@
+#ifndef CAMERA_PROPERTIES_H
+#define CAMERA_PROPERTIES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "canon-errors.h"
+
+#define CAMERA_PROPERTY_NAME_SIZE 64
+#define CAMERA_PROPERTY_VALUE_SIZE 128
+
+/**
+ * @brief In-memory mirror of camera properties
+ *
+ * Holds the last known value of each camera property as a string, keyed by
+ * the gphoto2 widget name (e.g. "batterylevel", "eosviewfinder"). Every
+ * change bumps the mirror version and the property's own version, so readers
+ * can detect changes without comparing values.
+ */
+typedef struct camera_properties_t camera_properties_t;
+
+/**
+ * @brief Callback for property changes
+ * @param name Property name
+ * @param value New value
+ * @param version Mirror version after the change
+ * @param user_data User data passed to camera_properties_set_callback
+ */
+typedef void (*camera_property_callback)(const char *name, const char *value,
+                                         uint64_t version, void *user_data);
+
+/**
+ * @brief Create an empty property mirror
+ * @return Mirror handle or NULL on failure
+ */
+camera_properties_t *camera_properties_create(void);
+
+/**
+ * @brief Destroy a property mirror
+ * @param props Mirror handle
+ */
+void camera_properties_destroy(camera_properties_t *props);
+
+/**
+ * @brief Remove all properties (e.g. on disconnect)
+ * @param props Mirror handle
+ */
+void camera_properties_clear(camera_properties_t *props);
+
+/**
+ * @brief Store a property value
+ *
+ * Changed values are queued for the callback, which only runs from
+ * camera_properties_dispatch().
+ * @param props Mirror handle
+ * @param name Property name
+ * @param value Property value
+ * @return true if the value changed
+ */
+bool camera_properties_set(camera_properties_t *props,
+                           const char *name, const char *value);
+
+/**
+ * @brief Record a change whose value is unknown
+ *
+ * Bumps the mirror version so readers re-check, without touching any value.
+ * @param props Mirror handle
+ */
+void camera_properties_touch(camera_properties_t *props);
+
+/**
+ * @brief Read a property value
+ * @param props Mirror handle
+ * @param name Property name
+ * @param value Output buffer
+ * @param value_size Output buffer size
+ * @param version Output property version (may be NULL)
+ * @return CANON_SUCCESS, or CANON_ERROR_NOT_SUPPORTED if unknown
+ */
+canon_error_t camera_properties_get(camera_properties_t *props,
+                                    const char *name,
+                                    char *value, size_t value_size,
+                                    uint64_t *version);
+
+/**
+ * @brief Current mirror version (incremented on every change)
+ * @param props Mirror handle
+ * @return Version counter
+ */
+uint64_t camera_properties_version(camera_properties_t *props);
+
+/**
+ * @brief Number of mirrored properties
+ * @param props Mirror handle
+ * @return Property count
+ */
+size_t camera_properties_count(camera_properties_t *props);
+
+/**
+ * @brief Set the change callback
+ * @param props Mirror handle
+ * @param callback Callback function (NULL to disable)
+ * @param user_data User data for the callback
+ */
+void camera_properties_set_callback(camera_properties_t *props,
+                                    camera_property_callback callback,
+                                    void *user_data);
+
+/**
+ * @brief Invoke the callback for queued changes
+ *
+ * The mirror lock is not held while the callback runs. Call this without
+ * holding any lock the callback might take.
+ * @param props Mirror handle
+ */
+void camera_properties_dispatch(camera_properties_t *props);
+
+#endif /* CAMERA_PROPERTIES_H */
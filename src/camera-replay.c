@@ -0,0 +1,435 @@
+#include "camera-replay.h"
+#include "utils/logging.h"
+#include <util/platform.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <jpeglib.h>
+
+#define SYNTHETIC_PREFIX "synthetic://"
+#define REPLAY_PREFIX "replay:"
+#define DEFAULT_SYNTHETIC_FRAMES 60
+#define MAX_SYNTHETIC_DIMENSION 8192
+#define MAX_REPLAY_FILES 4096
+#define MAX_REPLAY_FILE_SIZE (16 * 1024 * 1024)
+#define SYNTHETIC_QUALITY 85
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} replay_frame_t;
+
+/**
+ * @brief Replay source implementation
+ */
+struct camera_replay_t {
+    replay_frame_t *frames;
+    size_t frame_count;
+    size_t next_frame;
+
+    uint64_t fetches;
+    uint32_t delay_us;
+    uint64_t refresh_ns;
+    uint64_t epoch;             // Time of refresh 0
+    uint64_t last_refresh;
+    bool has_refresh;
+    uint32_t disconnect_every;
+    uint32_t disconnect_frames;
+    uint32_t disconnect_remaining;
+};
+
+typedef struct {
+    uint32_t frames;
+    uint32_t restart;
+    uint32_t delay_us;
+    uint32_t refresh_us;
+    uint32_t disconnect_every;
+    uint32_t disconnect_frames;
+} replay_options_t;
+
+static camera_replay_totals_t g_totals;     // Atomic
+
+bool camera_replay_is_replay_path(const char *device_path)
+{
+    if (!device_path) {
+        return false;
+    }
+
+    return strncmp(device_path, SYNTHETIC_PREFIX, strlen(SYNTHETIC_PREFIX)) == 0 ||
+           strncmp(device_path, REPLAY_PREFIX, strlen(REPLAY_PREFIX)) == 0;
+}
+
+static void parse_options(const char *query, replay_options_t *options)
+{
+    options->frames = DEFAULT_SYNTHETIC_FRAMES;
+    options->restart = 1;
+    options->delay_us = 0;
+    options->refresh_us = 0;
+    options->disconnect_every = 0;
+    options->disconnect_frames = 30;
+
+    while (query && *query) {
+        const char *end = strchr(query, '&');
+        size_t len = end ? (size_t)(end - query) : strlen(query);
+        char token[64];
+
+        if (len < sizeof(token)) {
+            memcpy(token, query, len);
+            token[len] = '\0';
+
+            char *value = strchr(token, '=');
+            if (value) {
+                *value++ = '\0';
+                uint32_t number = (uint32_t)strtoul(value, NULL, 10);
+
+                if (strcmp(token, "frames") == 0 && number > 0) {
+                    options->frames = number;
+                } else if (strcmp(token, "restart") == 0) {
+                    options->restart = number;
+                } else if (strcmp(token, "delay_us") == 0) {
+                    options->delay_us = number;
+                } else if (strcmp(token, "refresh_us") == 0) {
+                    options->refresh_us = number;
+                } else if (strcmp(token, "disconnect_every") == 0) {
+                    options->disconnect_every = number;
+                } else if (strcmp(token, "disconnect_frames") == 0) {
+                    options->disconnect_frames = number;
+                } else {
+                    canon_log(LOG_WARNING, "Unknown replay option '%s'", token);
+                }
+            }
+        }
+
+        query = end ? end + 1 : NULL;
+    }
+}
+
+/**
+ * Static gradient background with a box moving across it, so consecutive
+ * frames differ only in a few bands, like a mostly static live view.
+ */
+static bool encode_synthetic_frame(uint32_t width, uint32_t height, uint32_t restart,
+                                   uint32_t index, uint32_t count, replay_frame_t *frame)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned char *output = NULL;
+    unsigned long output_size = 0;
+
+    uint8_t *row = malloc((size_t)width * 3);
+    if (!row) {
+        return false;
+    }
+
+    uint32_t box = height / 6 ? height / 6 : 1;
+    uint32_t box_x = (uint32_t)((uint64_t)(width - (box < width ? box : width)) * index / count);
+    uint32_t box_y = (height - box) / 2;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &output, &output_size);
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, SYNTHETIC_QUALITY, TRUE);
+    cinfo.restart_in_rows = (int)restart;
+
+    jpeg_start_compress(&cinfo, TRUE);
+
+    while (cinfo.next_scanline < cinfo.image_height) {
+        uint32_t y = cinfo.next_scanline;
+        for (uint32_t x = 0; x < width; x++) {
+            bool in_box = x >= box_x && x < box_x + box && y >= box_y && y < box_y + box;
+            row[x * 3 + 0] = in_box ? 230 : (uint8_t)(x * 255 / width);
+            row[x * 3 + 1] = in_box ? 40 : (uint8_t)(y * 255 / height);
+            row[x * 3 + 2] = in_box ? 40 : 128;
+        }
+        JSAMPROW rows[1] = {row};
+        jpeg_write_scanlines(&cinfo, rows, 1);
+    }
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    free(row);
+
+    frame->data = output;
+    frame->size = output_size;
+    return output != NULL;
+}
+
+static canon_error_t open_synthetic(camera_replay_t *replay, const char *spec,
+                                    const replay_options_t *options)
+{
+    unsigned int width = 0;
+    unsigned int height = 0;
+
+    if (sscanf(spec, "%ux%u", &width, &height) != 2 ||
+        width < 16 || height < 16 ||
+        width > MAX_SYNTHETIC_DIMENSION || height > MAX_SYNTHETIC_DIMENSION) {
+        canon_log(LOG_ERROR, "Invalid synthetic device '%s' (expected WIDTHxHEIGHT)", spec);
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    replay->frames = calloc(options->frames, sizeof(replay_frame_t));
+    if (!replay->frames) {
+        return CANON_ERROR_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < options->frames; i++) {
+        if (!encode_synthetic_frame(width, height, options->restart, i,
+                                    options->frames, &replay->frames[i])) {
+            return CANON_ERROR_MEMORY;
+        }
+        replay->frame_count++;
+    }
+
+    canon_log(LOG_INFO, "Synthetic camera: %ux%u, %zu frames, restart every %u MCU rows",
+             width, height, replay->frame_count, options->restart);
+    return CANON_SUCCESS;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static bool has_jpeg_extension(const char *name)
+{
+    const char *dot = strrchr(name, '.');
+    return dot && (strcasecmp(dot, ".jpg") == 0 || strcasecmp(dot, ".jpeg") == 0);
+}
+
+static bool load_file(const char *path, replay_frame_t *frame)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    bool ok = false;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long size = ftell(file);
+        if (size > 0 && size <= MAX_REPLAY_FILE_SIZE && fseek(file, 0, SEEK_SET) == 0) {
+            frame->data = malloc((size_t)size);
+            if (frame->data && fread(frame->data, 1, (size_t)size, file) == (size_t)size) {
+                frame->size = (size_t)size;
+                ok = true;
+            } else {
+                free(frame->data);
+                frame->data = NULL;
+            }
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
+
+static canon_error_t open_directory(camera_replay_t *replay, const char *directory)
+{
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        canon_log(LOG_ERROR, "Cannot open replay directory '%s'", directory);
+        return CANON_ERROR_NO_DEVICE;
+    }
+
+    char **names = calloc(MAX_REPLAY_FILES, sizeof(char *));
+    if (!names) {
+        closedir(dir);
+        return CANON_ERROR_MEMORY;
+    }
+
+    size_t name_count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && name_count < MAX_REPLAY_FILES) {
+        if (has_jpeg_extension(entry->d_name)) {
+            names[name_count] = strdup(entry->d_name);
+            if (names[name_count]) {
+                name_count++;
+            }
+        }
+    }
+    closedir(dir);
+
+    qsort(names, name_count, sizeof(char *), compare_names);
+
+    canon_error_t err = CANON_SUCCESS;
+    replay->frames = calloc(name_count ? name_count : 1, sizeof(replay_frame_t));
+    if (!replay->frames) {
+        err = CANON_ERROR_MEMORY;
+    }
+
+    for (size_t i = 0; err == CANON_SUCCESS && i < name_count; i++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+        if (load_file(path, &replay->frames[replay->frame_count])) {
+            replay->frame_count++;
+        } else {
+            canon_log(LOG_WARNING, "Skipping unreadable replay frame '%s'", path);
+        }
+    }
+
+    for (size_t i = 0; i < name_count; i++) {
+        free(names[i]);
+    }
+    free(names);
+
+    if (err == CANON_SUCCESS && replay->frame_count == 0) {
+        canon_log(LOG_ERROR, "No JPEG frames in replay directory '%s'", directory);
+        err = CANON_ERROR_NO_DEVICE;
+    }
+
+    if (err == CANON_SUCCESS) {
+        canon_log(LOG_INFO, "Replay camera: %zu frames from %s", replay->frame_count, directory);
+    }
+    return err;
+}
+
+canon_error_t camera_replay_open(const char *device_path, camera_replay_t **replay)
+{
+    if (!camera_replay_is_replay_path(device_path) || !replay) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    camera_replay_t *result = calloc(1, sizeof(camera_replay_t));
+    if (!result) {
+        return CANON_ERROR_MEMORY;
+    }
+
+    // Split "prefix:spec?options"
+    bool synthetic = strncmp(device_path, SYNTHETIC_PREFIX, strlen(SYNTHETIC_PREFIX)) == 0;
+    const char *spec_start = device_path + (synthetic ? strlen(SYNTHETIC_PREFIX)
+                                                      : strlen(REPLAY_PREFIX));
+    const char *query = strchr(spec_start, '?');
+    size_t spec_len = query ? (size_t)(query - spec_start) : strlen(spec_start);
+
+    char *spec = malloc(spec_len + 1);
+    if (!spec) {
+        free(result);
+        return CANON_ERROR_MEMORY;
+    }
+    memcpy(spec, spec_start, spec_len);
+    spec[spec_len] = '\0';
+
+    replay_options_t options;
+    parse_options(query ? query + 1 : NULL, &options);
+
+    canon_error_t err = synthetic ? open_synthetic(result, spec, &options)
+                                  : open_directory(result, spec);
+    free(spec);
+
+    if (err != CANON_SUCCESS) {
+        camera_replay_close(result);
+        return err;
+    }
+
+    result->delay_us = options.delay_us;
+    result->refresh_ns = (uint64_t)options.refresh_us * 1000;
+    result->epoch = os_gettime_ns();
+    result->disconnect_every = options.disconnect_every;
+    result->disconnect_frames = options.disconnect_frames;
+
+    *replay = result;
+    return CANON_SUCCESS;
+}
+
+void camera_replay_close(camera_replay_t *replay)
+{
+    if (!replay) {
+        return;
+    }
+
+    if (replay->frames) {
+        for (size_t i = 0; i < replay->frame_count; i++) {
+            free(replay->frames[i].data);
+        }
+        free(replay->frames);
+    }
+
+    free(replay);
+}
+
+canon_error_t camera_replay_next_frame(camera_replay_t *replay,
+                                       uint8_t *buffer,
+                                       size_t buffer_size,
+                                       size_t *bytes_written)
+{
+    if (!replay || !buffer || !bytes_written) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    replay->fetches++;
+
+    if (replay->disconnect_remaining > 0) {
+        replay->disconnect_remaining--;
+        return CANON_ERROR_DISCONNECTED;
+    }
+
+    if (replay->disconnect_every > 0 && replay->fetches % replay->disconnect_every == 0) {
+        replay->disconnect_remaining = replay->disconnect_frames;
+        return CANON_ERROR_DISCONNECTED;
+    }
+
+    // The camera answers with whatever its live view buffer holds when the
+    // request arrives
+    uint64_t requested = os_gettime_ns();
+    uint64_t refreshed = requested;
+    bool duplicate = false;
+
+    if (replay->refresh_ns > 0) {
+        uint64_t refresh = (requested - replay->epoch) / replay->refresh_ns;
+        refreshed = replay->epoch + refresh * replay->refresh_ns;
+
+        if (replay->has_refresh) {
+            duplicate = refresh == replay->last_refresh;
+            if (refresh > replay->last_refresh + 1) {
+                __atomic_add_fetch(&g_totals.missed, refresh - replay->last_refresh - 1,
+                                   __ATOMIC_RELAXED);
+            }
+        }
+        replay->next_frame = (size_t)(refresh % replay->frame_count);
+        replay->last_refresh = refresh;
+        replay->has_refresh = true;
+    }
+
+    if (replay->delay_us > 0) {
+        usleep(replay->delay_us);
+    }
+
+    const replay_frame_t *frame = &replay->frames[replay->next_frame];
+    if (replay->refresh_ns == 0) {
+        replay->next_frame = (replay->next_frame + 1) % replay->frame_count;
+    }
+
+    __atomic_add_fetch(&g_totals.fetches, 1, __ATOMIC_RELAXED);
+    if (duplicate) {
+        __atomic_add_fetch(&g_totals.duplicates, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(&g_totals.frame_age_ns, os_gettime_ns() - refreshed,
+                           __ATOMIC_RELAXED);
+    }
+
+    size_t copy_size = frame->size < buffer_size ? frame->size : buffer_size;
+    memcpy(buffer, frame->data, copy_size);
+    *bytes_written = copy_size;
+
+    return CANON_SUCCESS;
+}
+
+void camera_replay_get_totals(camera_replay_totals_t *totals)
+{
+    if (!totals) {
+        return;
+    }
+
+    totals->fetches = __atomic_load_n(&g_totals.fetches, __ATOMIC_RELAXED);
+    totals->duplicates = __atomic_load_n(&g_totals.duplicates, __ATOMIC_RELAXED);
+    totals->missed = __atomic_load_n(&g_totals.missed, __ATOMIC_RELAXED);
+    totals->frame_age_ns = __atomic_load_n(&g_totals.frame_age_ns, __ATOMIC_RELAXED);
+}
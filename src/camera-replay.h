@@ -0,0 +1,78 @@
+#ifndef CAMERA_REPLAY_H
+#define CAMERA_REPLAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "canon-errors.h"
+
+/**
+ * @brief Camera-less frame source for benchmarks and soak runs
+ *
+ * Selected through the device path given to canon_camera_connect():
+ *   synthetic://WIDTHxHEIGHT[?options]  generated moving test pattern
+ *   replay:DIRECTORY[?options]          *.jpg files of DIRECTORY in name order
+ *
+ * Options (separated by '&'):
+ *   frames=N            distinct synthetic frames to generate (default 60)
+ *   restart=N           restart interval in MCU rows, 0 = none (default 1)
+ *   delay_us=N          simulated USB transfer time per frame (default 0)
+ *   refresh_us=N        live view refresh interval: fetches return the frame
+ *                       of the latest refresh, so polling faster than this
+ *                       fetches duplicates (default 0 = a new frame per fetch)
+ *   disconnect_every=N  fail with CANON_ERROR_DISCONNECTED every N frames
+ *   disconnect_frames=N failed fetches per injected disconnect (default 30)
+ */
+typedef struct camera_replay_t camera_replay_t;
+
+/**
+ * @brief Totals over all replay sources of the process, for benchmarks
+ */
+typedef struct {
+    uint64_t fetches;           /**< Successful fetches */
+    uint64_t duplicates;        /**< Fetches of a frame that was already fetched */
+    uint64_t missed;            /**< Refreshes that were never fetched (refresh_us only) */
+    uint64_t frame_age_ns;      /**< Sum over new frames of fetch completion minus refresh */
+} camera_replay_totals_t;
+
+/**
+ * @brief Check whether a device path selects the replay backend
+ * @param device_path Device path
+ * @return true for synthetic:// and replay: paths
+ */
+bool camera_replay_is_replay_path(const char *device_path);
+
+/**
+ * @brief Open a replay source
+ * @param device_path synthetic:// or replay: device path
+ * @param replay Output handle
+ * @return CANON_SUCCESS or error code
+ */
+canon_error_t camera_replay_open(const char *device_path, camera_replay_t **replay);
+
+/**
+ * @brief Close a replay source
+ * @param replay Replay handle
+ */
+void camera_replay_close(camera_replay_t *replay);
+
+/**
+ * @brief Produce the next preview JPEG
+ * @param replay Replay handle
+ * @param buffer Output buffer
+ * @param buffer_size Buffer size
+ * @param bytes_written Actual bytes written
+ * @return CANON_SUCCESS, or CANON_ERROR_DISCONNECTED during an injected disconnect
+ */
+canon_error_t camera_replay_next_frame(camera_replay_t *replay,
+                                       uint8_t *buffer,
+                                       size_t buffer_size,
+                                       size_t *bytes_written);
+
+/**
+ * @brief Read the process-wide totals
+ * @param totals Output totals
+ */
+void camera_replay_get_totals(camera_replay_totals_t *totals);
+
+#endif /* CAMERA_REPLAY_H */
@@ -1,14 +1,24 @@
 #include "canon-camera.h"
+#include "camera-drivers.h"
+#include "camera-properties.h"
+#include "camera-replay.h"
 #include "utils/logging.h"
+#include "utils/lock-profiler.h"
 #include "utils/error-handling.h"
+#include "utils/mem-accounting.h"
 #include <gphoto2/gphoto2.h>
 #include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #define LIVE_VIEW_TIMEOUT_MS 5000
-#define FRAME_BUFFER_COUNT 3
+#define EVENT_POLL_INTERVAL 4      // Drain camera events every N preview frames
+#define MAX_EVENTS_PER_POLL 16
+// EOS live view magnifications, strongest first
+#define ZOOM_LEVEL_COUNT 2
+static const uint32_t ZOOM_LEVELS[ZOOM_LEVEL_COUNT] = {10, 5};
 
 /**
  * @brief Canon camera implementation
@@ -19,7 +29,8 @@ struct canon_camera_t {
     CameraAbilitiesList *abilities_list;
     GPPortInfoList *port_info_list;
 
-    pthread_mutex_t mutex;
+    profiled_mutex_t mutex;         // Serializes USB I/O
+    profiled_mutex_t state_mutex;   // Guards connected/config/capabilities
     pthread_cond_t frame_ready;
 
     char device_path[256];
@@ -29,12 +40,18 @@ struct canon_camera_t {
     canon_config_t config;
     canon_capabilities_t capabilities;
 
-    uint8_t *frame_buffers[FRAME_BUFFER_COUNT];
-    size_t frame_buffer_size;
-    int current_buffer;
-
     uint64_t frame_count;
     uint64_t error_count;
+
+    camera_properties_t *properties;
+    uint64_t unresolved_events;
+
+    uint32_t zoom;                  // Live view magnification, 0 or 1 = full view
+    uint32_t zoom_space_width;      // eoszoomposition coordinates, 0 = not measured
+    uint32_t zoom_space_height;
+
+    camera_replay_t *replay;        // Set for synthetic:// and replay: devices
+    mem_account_t *account;         // Charged for gphoto2 preview files
 };
 
 static GPContext *g_gphoto_context = NULL;
@@ -56,6 +73,8 @@ canon_error_t canon_camera_init_library(void)
         return CANON_ERROR_MEMORY;
     }
 
+    camera_drivers_init();
+
     g_library_initialized = true;
     pthread_mutex_unlock(&g_library_mutex);
 
@@ -77,6 +96,8 @@ void canon_camera_cleanup_library(void)
         g_gphoto_context = NULL;
     }
 
+    camera_drivers_cleanup();
+
     g_library_initialized = false;
     pthread_mutex_unlock(&g_library_mutex);
 
@@ -91,7 +112,8 @@ canon_camera_t *canon_camera_create(void)
         return NULL;
     }
 
-    pthread_mutex_init(&camera->mutex, NULL);
+    profiled_mutex_init(&camera->mutex, "camera");
+    profiled_mutex_init(&camera->state_mutex, "camera_state");
     pthread_cond_init(&camera->frame_ready, NULL);
 
     camera->gphoto_context = gp_context_new();
@@ -101,18 +123,11 @@ canon_camera_t *canon_camera_create(void)
         return NULL;
     }
 
-    camera->frame_buffer_size = 1920 * 1080 * 3;
-    for (int i = 0; i < FRAME_BUFFER_COUNT; i++) {
-        camera->frame_buffers[i] = malloc(camera->frame_buffer_size);
-        if (!camera->frame_buffers[i]) {
-            canon_log(LOG_ERROR, "Failed to allocate frame buffer %d", i);
-            for (int j = 0; j < i; j++) {
-                free(camera->frame_buffers[j]);
-            }
-            gp_context_unref(camera->gphoto_context);
-            free(camera);
-            return NULL;
-        }
+    camera->properties = camera_properties_create();
+    if (!camera->properties) {
+        gp_context_unref(camera->gphoto_context);
+        free(camera);
+        return NULL;
     }
 
     camera->capabilities.max_width = 3840;
@@ -135,22 +150,220 @@ void canon_camera_destroy(canon_camera_t *camera)
         canon_camera_disconnect(camera);
     }
 
-    for (int i = 0; i < FRAME_BUFFER_COUNT; i++) {
-        if (camera->frame_buffers[i]) {
-            free(camera->frame_buffers[i]);
-        }
-    }
-
     if (camera->gphoto_context) {
         gp_context_unref(camera->gphoto_context);
     }
 
+    camera_properties_destroy(camera->properties);
+
     pthread_cond_destroy(&camera->frame_ready);
-    pthread_mutex_destroy(&camera->mutex);
+    profiled_mutex_destroy(&camera->state_mutex);
+    profiled_mutex_destroy(&camera->mutex);
 
     free(camera);
 }
 
+/**
+ * Copy a widget's current value into the property mirror, recursing into
+ * windows and sections.
+ */
+static void mirror_widget(canon_camera_t *camera, CameraWidget *widget)
+{
+    CameraWidgetType type;
+    const char *name = NULL;
+    char value[CAMERA_PROPERTY_VALUE_SIZE];
+
+    if (gp_widget_get_type(widget, &type) < GP_OK) {
+        return;
+    }
+
+    if (type == GP_WIDGET_WINDOW || type == GP_WIDGET_SECTION) {
+        int count = gp_widget_count_children(widget);
+        for (int i = 0; i < count; i++) {
+            CameraWidget *child = NULL;
+            if (gp_widget_get_child(widget, i, &child) >= GP_OK) {
+                mirror_widget(camera, child);
+            }
+        }
+        return;
+    }
+
+    if (gp_widget_get_name(widget, &name) < GP_OK || !name) {
+        return;
+    }
+
+    switch (type) {
+        case GP_WIDGET_TEXT:
+        case GP_WIDGET_RADIO:
+        case GP_WIDGET_MENU: {
+            const char *text = NULL;
+            if (gp_widget_get_value(widget, &text) < GP_OK || !text) {
+                return;
+            }
+            snprintf(value, sizeof(value), "%s", text);
+            break;
+        }
+        case GP_WIDGET_RANGE: {
+            float number = 0.0f;
+            if (gp_widget_get_value(widget, &number) < GP_OK) {
+                return;
+            }
+            snprintf(value, sizeof(value), "%g", number);
+            break;
+        }
+        case GP_WIDGET_TOGGLE:
+        case GP_WIDGET_DATE: {
+            int number = 0;
+            if (gp_widget_get_value(widget, &number) < GP_OK) {
+                return;
+            }
+            snprintf(value, sizeof(value), "%d", number);
+            break;
+        }
+        default:
+            return;
+    }
+
+    camera_properties_set(camera->properties, name, value);
+}
+
+/**
+ * Parse an EOS property change event. Newer libgphoto2 reports
+ * "PTP Property d1d3 changed, \"name\" to \"value\"", older releases only
+ * "PTP Property d1d3 changed".
+ */
+static void handle_event_text(canon_camera_t *camera, const char *text)
+{
+    static const char prefix[] = "PTP Property ";
+
+    if (strncmp(text, prefix, sizeof(prefix) - 1) != 0) {
+        return;
+    }
+
+    const char *name_start = strchr(text, '"');
+    const char *name_end = name_start ? strchr(name_start + 1, '"') : NULL;
+    const char *value_start = name_end ? strstr(name_end, " to \"") : NULL;
+    const char *value_end = value_start ? strrchr(value_start + 5, '"') : NULL;
+
+    if (!name_end || !value_end) {
+        camera->unresolved_events++;
+        camera_properties_touch(camera->properties);
+        return;
+    }
+
+    char name[CAMERA_PROPERTY_NAME_SIZE];
+    char value[CAMERA_PROPERTY_VALUE_SIZE];
+    size_t name_len = (size_t)(name_end - name_start - 1);
+    size_t value_len = (size_t)(value_end - value_start - 5);
+
+    if (name_len == 0 || name_len >= sizeof(name)) {
+        return;
+    }
+    if (value_len >= sizeof(value)) {
+        value_len = sizeof(value) - 1;
+    }
+
+    memcpy(name, name_start + 1, name_len);
+    name[name_len] = '\0';
+    memcpy(value, value_start + 5, value_len);
+    value[value_len] = '\0';
+
+    if (camera_properties_set(camera->properties, name, value)) {
+        canon_log(LOG_DEBUG, "Camera property %s = %s", name, value);
+    }
+}
+
+/**
+ * Drain pending camera events without waiting. Called with camera->mutex
+ * held, between preview fetches.
+ */
+static void drain_events(canon_camera_t *camera)
+{
+    for (int i = 0; i < MAX_EVENTS_PER_POLL; i++) {
+        CameraEventType type = GP_EVENT_TIMEOUT;
+        void *data = NULL;
+
+        int ret = gp_camera_wait_for_event(camera->gphoto_camera, 0, &type,
+                                           &data, camera->gphoto_context);
+        if (ret < GP_OK) {
+            free(data);
+            break;
+        }
+
+        if (type == GP_EVENT_UNKNOWN && data) {
+            handle_event_text(camera, data);
+        }
+
+        free(data);
+
+        if (type == GP_EVENT_TIMEOUT) {
+            break;
+        }
+    }
+}
+
+/*
+ * Pick the camera at device_path (/dev/bus/usb/BBB/DDD, as the detector
+ * lists it) among the detected ones, else the first, and give its model and
+ * port to gp_camera_init() so it does not load and probe the drivers again.
+ */
+static void select_detected_camera(canon_camera_t *camera, const char *device_path)
+{
+    CameraList *detected = NULL;
+    if (gp_list_new(&detected) < GP_OK) {
+        return;
+    }
+
+    int count = 0;
+    if (gp_abilities_list_detect(camera->abilities_list, camera->port_info_list, detected,
+                                 camera->gphoto_context) >= GP_OK) {
+        count = gp_list_count(detected);
+    }
+    if (count <= 0) {
+        // gp_camera_init() autodetects and reports the error
+        gp_list_free(detected);
+        return;
+    }
+
+    char port[32] = "";
+    unsigned int bus = 0;
+    unsigned int address = 0;
+    if (sscanf(device_path, "/dev/bus/usb/%u/%u", &bus, &address) == 2) {
+        snprintf(port, sizeof(port), "usb:%03u,%03u", bus, address);
+    }
+
+    int chosen = 0;
+    for (int i = 0; i < count && port[0]; i++) {
+        const char *path = NULL;
+        if (gp_list_get_value(detected, i, &path) >= GP_OK && path && strcmp(path, port) == 0) {
+            chosen = i;
+            break;
+        }
+    }
+
+    const char *model = NULL;
+    const char *path = NULL;
+    gp_list_get_name(detected, chosen, &model);
+    gp_list_get_value(detected, chosen, &path);
+
+    int model_index = model ? gp_abilities_list_lookup_model(camera->abilities_list, model)
+                            : GP_ERROR;
+    int port_index = path ? gp_port_info_list_lookup_path(camera->port_info_list, path)
+                          : GP_ERROR;
+    if (model_index >= GP_OK && port_index >= GP_OK) {
+        CameraAbilities abilities;
+        GPPortInfo info;
+        gp_abilities_list_get_abilities(camera->abilities_list, model_index, &abilities);
+        gp_port_info_list_get_info(camera->port_info_list, port_index, &info);
+        gp_camera_set_abilities(camera->gphoto_camera, abilities);
+        gp_camera_set_port_info(camera->gphoto_camera, info);
+        canon_log(LOG_INFO, "Using %s on %s (%d camera%s detected)", model, path, count,
+                 count == 1 ? "" : "s");
+    }
+
+    gp_list_free(detected);
+}
+
 canon_error_t canon_camera_connect(canon_camera_t *camera,
                                    const char *device_path,
                                    const canon_config_t *config)
@@ -159,19 +372,42 @@ canon_error_t canon_camera_connect(canon_camera_t *camera,
         return CANON_ERROR_INVALID_PARAM;
     }
 
-    pthread_mutex_lock(&camera->mutex);
+    profiled_mutex_lock(&camera->mutex);
 
     if (camera->connected) {
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return CANON_ERROR_CAMERA_BUSY;
     }
 
     strncpy(camera->device_path, device_path, sizeof(camera->device_path) - 1);
+    profiled_mutex_lock(&camera->state_mutex);
     memcpy(&camera->config, config, sizeof(canon_config_t));
+    profiled_mutex_unlock(&camera->state_mutex);
+    camera->zoom = 0;
+    camera->zoom_space_width = 0;
+    camera->zoom_space_height = 0;
+
+    if (camera_replay_is_replay_path(device_path)) {
+        canon_error_t err = camera_replay_open(device_path, &camera->replay);
+        if (err != CANON_SUCCESS) {
+            profiled_mutex_unlock(&camera->mutex);
+            return err;
+        }
+
+        camera_properties_clear(camera->properties);
+
+        profiled_mutex_lock(&camera->state_mutex);
+        camera->connected = true;
+        profiled_mutex_unlock(&camera->state_mutex);
+        profiled_mutex_unlock(&camera->mutex);
+
+        canon_log(LOG_INFO, "Camera connected: %s", device_path);
+        return CANON_SUCCESS;
+    }
 
     int ret = gp_camera_new(&camera->gphoto_camera);
     if (ret < GP_OK) {
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         canon_log(LOG_ERROR, "Failed to create camera: %s", gp_result_as_string(ret));
         return error_from_gphoto(ret);
     }
@@ -179,15 +415,15 @@ canon_error_t canon_camera_connect(canon_camera_t *camera,
     ret = gp_abilities_list_new(&camera->abilities_list);
     if (ret < GP_OK) {
         gp_camera_unref(camera->gphoto_camera);
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return error_from_gphoto(ret);
     }
 
-    ret = gp_abilities_list_load(camera->abilities_list, camera->gphoto_context);
+    ret = camera_drivers_load_abilities(camera->abilities_list, camera->gphoto_context);
     if (ret < GP_OK) {
         gp_abilities_list_free(camera->abilities_list);
         gp_camera_unref(camera->gphoto_camera);
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return error_from_gphoto(ret);
     }
 
@@ -195,7 +431,7 @@ canon_error_t canon_camera_connect(canon_camera_t *camera,
     if (ret < GP_OK) {
         gp_abilities_list_free(camera->abilities_list);
         gp_camera_unref(camera->gphoto_camera);
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return error_from_gphoto(ret);
     }
 
@@ -204,31 +440,40 @@ canon_error_t canon_camera_connect(canon_camera_t *camera,
         gp_port_info_list_free(camera->port_info_list);
         gp_abilities_list_free(camera->abilities_list);
         gp_camera_unref(camera->gphoto_camera);
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return error_from_gphoto(ret);
     }
 
-    CameraAbilities abilities;
-    int model_index = gp_abilities_list_lookup_model(camera->abilities_list, "Canon");
-    if (model_index >= GP_OK) {
-        gp_abilities_list_get_abilities(camera->abilities_list, model_index, &abilities);
-        gp_camera_set_abilities(camera->gphoto_camera, abilities);
-    }
+    select_detected_camera(camera, device_path);
 
     ret = gp_camera_init(camera->gphoto_camera, camera->gphoto_context);
     if (ret < GP_OK) {
         gp_port_info_list_free(camera->port_info_list);
         gp_abilities_list_free(camera->abilities_list);
         gp_camera_unref(camera->gphoto_camera);
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         canon_log(LOG_ERROR, "Failed to initialize camera: %s", gp_result_as_string(ret));
         return error_from_gphoto(ret);
     }
 
+    // Seed the property mirror once; events keep it current afterwards
+    camera_properties_clear(camera->properties);
+    CameraWidget *config_tree = NULL;
+    if (gp_camera_get_config(camera->gphoto_camera, &config_tree,
+                             camera->gphoto_context) >= GP_OK) {
+        mirror_widget(camera, config_tree);
+        gp_widget_free(config_tree);
+    }
+
+    profiled_mutex_lock(&camera->state_mutex);
     camera->connected = true;
-    pthread_mutex_unlock(&camera->mutex);
+    profiled_mutex_unlock(&camera->state_mutex);
+    profiled_mutex_unlock(&camera->mutex);
+
+    camera_properties_dispatch(camera->properties);
 
-    canon_log(LOG_INFO, "Camera connected: %s", device_path);
+    canon_log(LOG_INFO, "Camera connected: %s (%zu properties mirrored)", device_path,
+             camera_properties_count(camera->properties));
     return CANON_SUCCESS;
 }
 
@@ -238,15 +483,20 @@ void canon_camera_disconnect(canon_camera_t *camera)
         return;
     }
 
-    pthread_mutex_lock(&camera->mutex);
+    profiled_mutex_lock(&camera->mutex);
 
     if (!camera->connected) {
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return;
     }
 
-    if (camera->live_view_active) {
-        camera->live_view_active = false;
+    profiled_mutex_lock(&camera->state_mutex);
+    camera->live_view_active = false;
+    profiled_mutex_unlock(&camera->state_mutex);
+
+    if (camera->replay) {
+        camera_replay_close(camera->replay);
+        camera->replay = NULL;
     }
 
     if (camera->gphoto_camera) {
@@ -265,8 +515,12 @@ void canon_camera_disconnect(canon_camera_t *camera)
         camera->abilities_list = NULL;
     }
 
+    profiled_mutex_lock(&camera->state_mutex);
     camera->connected = false;
-    pthread_mutex_unlock(&camera->mutex);
+    profiled_mutex_unlock(&camera->state_mutex);
+    profiled_mutex_unlock(&camera->mutex);
+
+    camera_properties_clear(camera->properties);
 
     canon_log(LOG_INFO, "Camera disconnected");
 }
@@ -277,9 +531,9 @@ bool canon_camera_is_connected(canon_camera_t *camera)
         return false;
     }
 
-    pthread_mutex_lock(&camera->mutex);
+    profiled_mutex_lock(&camera->state_mutex);
     bool connected = camera->connected;
-    pthread_mutex_unlock(&camera->mutex);
+    profiled_mutex_unlock(&camera->state_mutex);
 
     return connected;
 }
@@ -291,16 +545,16 @@ canon_error_t canon_camera_get_capabilities(canon_camera_t *camera,
         return CANON_ERROR_INVALID_PARAM;
     }
 
-    pthread_mutex_lock(&camera->mutex);
+    profiled_mutex_lock(&camera->state_mutex);
 
     if (!camera->connected) {
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->state_mutex);
         return CANON_ERROR_DISCONNECTED;
     }
 
     memcpy(caps, &camera->capabilities, sizeof(canon_capabilities_t));
 
-    pthread_mutex_unlock(&camera->mutex);
+    profiled_mutex_unlock(&camera->state_mutex);
 
     return CANON_SUCCESS;
 }
@@ -311,38 +565,42 @@ canon_error_t canon_camera_start_live_view(canon_camera_t *camera)
         return CANON_ERROR_INVALID_PARAM;
     }
 
-    pthread_mutex_lock(&camera->mutex);
+    profiled_mutex_lock(&camera->mutex);
 
     if (!camera->connected) {
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return CANON_ERROR_DISCONNECTED;
     }
 
     if (camera->live_view_active) {
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return CANON_SUCCESS;
     }
 
-    CameraWidget *config = NULL;
-    CameraWidget *child = NULL;
+    if (!camera->replay) {
+        CameraWidget *config = NULL;
+        CameraWidget *child = NULL;
 
-    int ret = gp_camera_get_config(camera->gphoto_camera, &config, camera->gphoto_context);
-    if (ret < GP_OK) {
-        pthread_mutex_unlock(&camera->mutex);
-        return error_from_gphoto(ret);
-    }
+        int ret = gp_camera_get_config(camera->gphoto_camera, &config, camera->gphoto_context);
+        if (ret < GP_OK) {
+            profiled_mutex_unlock(&camera->mutex);
+            return error_from_gphoto(ret);
+        }
 
-    ret = gp_widget_get_child_by_name(config, "viewfinder", &child);
-    if (ret >= GP_OK) {
-        int value = 1;
-        gp_widget_set_value(child, &value);
-        gp_camera_set_config(camera->gphoto_camera, config, camera->gphoto_context);
-    }
+        ret = gp_widget_get_child_by_name(config, "viewfinder", &child);
+        if (ret >= GP_OK) {
+            int value = 1;
+            gp_widget_set_value(child, &value);
+            gp_camera_set_config(camera->gphoto_camera, config, camera->gphoto_context);
+        }
 
-    gp_widget_free(config);
+        gp_widget_free(config);
+    }
 
+    profiled_mutex_lock(&camera->state_mutex);
     camera->live_view_active = true;
-    pthread_mutex_unlock(&camera->mutex);
+    profiled_mutex_unlock(&camera->state_mutex);
+    profiled_mutex_unlock(&camera->mutex);
 
     canon_log(LOG_INFO, "Live view started");
     return CANON_SUCCESS;
@@ -354,17 +612,18 @@ void canon_camera_stop_live_view(canon_camera_t *camera)
         return;
     }
 
-    pthread_mutex_lock(&camera->mutex);
+    profiled_mutex_lock(&camera->mutex);
 
     if (!camera->connected || !camera->live_view_active) {
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return;
     }
 
     CameraWidget *config = NULL;
     CameraWidget *child = NULL;
 
-    int ret = gp_camera_get_config(camera->gphoto_camera, &config, camera->gphoto_context);
+    int ret = camera->replay ? GP_ERROR_NOT_SUPPORTED :
+              gp_camera_get_config(camera->gphoto_camera, &config, camera->gphoto_context);
     if (ret >= GP_OK) {
         ret = gp_widget_get_child_by_name(config, "viewfinder", &child);
         if (ret >= GP_OK) {
@@ -375,8 +634,11 @@ void canon_camera_stop_live_view(canon_camera_t *camera)
         gp_widget_free(config);
     }
 
+    profiled_mutex_lock(&camera->state_mutex);
     camera->live_view_active = false;
-    pthread_mutex_unlock(&camera->mutex);
+    profiled_mutex_unlock(&camera->state_mutex);
+    camera->zoom = 0;
+    profiled_mutex_unlock(&camera->mutex);
 
     canon_log(LOG_INFO, "Live view stopped");
 }
@@ -390,22 +652,32 @@ canon_error_t canon_camera_capture_frame(canon_camera_t *camera,
         return CANON_ERROR_INVALID_PARAM;
     }
 
-    pthread_mutex_lock(&camera->mutex);
+    profiled_mutex_lock(&camera->mutex);
 
     if (!camera->connected) {
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return CANON_ERROR_DISCONNECTED;
     }
 
     if (!camera->live_view_active) {
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return CANON_ERROR_NOT_SUPPORTED;
     }
 
+    if (camera->replay) {
+        canon_error_t err = camera_replay_next_frame(camera->replay, buffer,
+                                                     buffer_size, bytes_written);
+        if (err == CANON_SUCCESS) {
+            camera->frame_count++;
+        }
+        profiled_mutex_unlock(&camera->mutex);
+        return err;
+    }
+
     CameraFile *file = NULL;
     int ret = gp_file_new(&file);
     if (ret < GP_OK) {
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return error_from_gphoto(ret);
     }
 
@@ -415,7 +687,7 @@ canon_error_t canon_camera_capture_frame(canon_camera_t *camera,
             canon_log(LOG_ERROR, "gp_camera_capture_preview failed: %s", gp_result_as_string(ret));
         }
         gp_file_unref(file);
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return error_from_gphoto(ret);
     }
 
@@ -431,22 +703,190 @@ canon_error_t canon_camera_capture_frame(canon_camera_t *camera,
     ret = gp_file_get_data_and_size(file, &data, &size);
     if (ret < GP_OK) {
         gp_file_unref(file);
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->mutex);
         return error_from_gphoto(ret);
     }
 
+    // gphoto2 owns the preview data; it only lives until the unref below
+    mem_account_charge(camera->account, MEM_CATEGORY_CAMERA_FILE, size);
+
     size_t copy_size = (size < buffer_size) ? size : buffer_size;
     memcpy(buffer, data, copy_size);
     *bytes_written = copy_size;
 
     gp_file_unref(file);
+    mem_account_release(camera->account, MEM_CATEGORY_CAMERA_FILE, size);
 
     camera->frame_count++;
-    pthread_mutex_unlock(&camera->mutex);
+    if (camera->frame_count % EVENT_POLL_INTERVAL == 0) {
+        drain_events(camera);
+    }
+    profiled_mutex_unlock(&camera->mutex);
+
+    camera_properties_dispatch(camera->properties);
 
     return CANON_SUCCESS;
 }
 
+/* Called with camera->mutex held */
+static int set_text_config(canon_camera_t *camera, const char *name, const char *value)
+{
+    CameraWidget *widget = NULL;
+    int ret = gp_camera_get_single_config(camera->gphoto_camera, name, &widget,
+                                          camera->gphoto_context);
+    if (ret < GP_OK) {
+        return ret;
+    }
+
+    ret = gp_widget_set_value(widget, value);
+    if (ret >= GP_OK) {
+        ret = gp_camera_set_single_config(camera->gphoto_camera, name, widget,
+                                          camera->gphoto_context);
+    }
+
+    gp_widget_free(widget);
+    return ret;
+}
+
+/* Called with camera->mutex held */
+static int get_text_config(canon_camera_t *camera, const char *name,
+                           char *value, size_t value_size)
+{
+    CameraWidget *widget = NULL;
+    int ret = gp_camera_get_single_config(camera->gphoto_camera, name, &widget,
+                                          camera->gphoto_context);
+    if (ret < GP_OK) {
+        return ret;
+    }
+
+    const char *text = NULL;
+    ret = gp_widget_get_value(widget, &text);
+    if (ret >= GP_OK) {
+        snprintf(value, value_size, "%s", text ? text : "");
+    }
+
+    gp_widget_free(widget);
+    return ret;
+}
+
+/**
+ * The zoom position is the top-left corner of the magnified field, in a
+ * model-specific coordinate system that gphoto2 does not report. Asking for
+ * a position far out of range makes the camera clamp it to the last valid
+ * one, W - W/m by H - H/m, which gives W and H. Called with camera->mutex
+ * held, at magnification m.
+ */
+static bool measure_zoom_space(canon_camera_t *camera, uint32_t magnification)
+{
+    char value[CAMERA_PROPERTY_VALUE_SIZE];
+    unsigned int x = 0;
+    unsigned int y = 0;
+
+    if (set_text_config(camera, "eoszoomposition", "65535,65535") < GP_OK ||
+        get_text_config(camera, "eoszoomposition", value, sizeof(value)) < GP_OK ||
+        sscanf(value, "%u,%u", &x, &y) != 2 || x == 0 || y == 0 ||
+        x >= 65535 || y >= 65535) {
+        return false;
+    }
+
+    camera->zoom_space_width = x * magnification / (magnification - 1);
+    camera->zoom_space_height = y * magnification / (magnification - 1);
+    canon_log(LOG_INFO, "Live view zoom coordinates: %ux%u",
+             camera->zoom_space_width, camera->zoom_space_height);
+    return true;
+}
+
+static float clamp_unit(float value, float max)
+{
+    if (value < 0.0f) {
+        return 0.0f;
+    }
+    return value > max ? max : value;
+}
+
+canon_error_t canon_camera_set_zoom(canon_camera_t *camera, const canon_roi_t *roi,
+                                    canon_roi_t *view)
+{
+    if (!camera) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    if (view) {
+        *view = (canon_roi_t){0.0f, 0.0f, 1.0f, 1.0f};
+    }
+
+    profiled_mutex_lock(&camera->mutex);
+
+    if (!camera->connected) {
+        profiled_mutex_unlock(&camera->mutex);
+        return CANON_ERROR_DISCONNECTED;
+    }
+
+    char value[CAMERA_PROPERTY_VALUE_SIZE];
+    if (camera->replay || !camera->live_view_active ||
+        camera_properties_get(camera->properties, "eoszoom", value, sizeof(value),
+                              NULL) != CANON_SUCCESS) {
+        profiled_mutex_unlock(&camera->mutex);
+        return roi ? CANON_ERROR_NOT_SUPPORTED : CANON_SUCCESS;
+    }
+
+    uint32_t magnification = 1;
+    for (int i = 0; roi && i < ZOOM_LEVEL_COUNT; i++) {
+        float field = 1.0f / (float)ZOOM_LEVELS[i];
+        if (roi->width <= field && roi->height <= field) {
+            magnification = ZOOM_LEVELS[i];
+            break;
+        }
+    }
+
+    int ret = GP_OK;
+    if (magnification != (camera->zoom > 1 ? camera->zoom : 1)) {
+        snprintf(value, sizeof(value), "%u", magnification);
+        ret = set_text_config(camera, "eoszoom", value);
+        camera->zoom = ret >= GP_OK ? magnification : 0;
+    }
+
+    if (ret >= GP_OK && magnification > 1 && camera->zoom_space_width == 0 &&
+        !measure_zoom_space(camera, magnification)) {
+        canon_log(LOG_WARNING, "Cannot determine live view zoom coordinates");
+        ret = GP_ERROR_NOT_SUPPORTED;
+    }
+
+    if (ret >= GP_OK && magnification > 1) {
+        float field = 1.0f / (float)magnification;
+        float left = clamp_unit(roi->x + roi->width / 2.0f - field / 2.0f, 1.0f - field);
+        float top = clamp_unit(roi->y + roi->height / 2.0f - field / 2.0f, 1.0f - field);
+
+        snprintf(value, sizeof(value), "%u,%u",
+                 (unsigned int)(left * (float)camera->zoom_space_width),
+                 (unsigned int)(top * (float)camera->zoom_space_height));
+        ret = set_text_config(camera, "eoszoomposition", value);
+
+        if (ret >= GP_OK && view) {
+            *view = (canon_roi_t){left, top, field, field};
+        }
+    }
+
+    if (ret < GP_OK && camera->zoom > 1) {
+        // Never leave the camera magnified on a region nobody asked for
+        if (set_text_config(camera, "eoszoom", "1") >= GP_OK) {
+            camera->zoom = 1;
+        }
+    }
+
+    profiled_mutex_unlock(&camera->mutex);
+
+    if (ret < GP_OK) {
+        canon_log(LOG_WARNING, "Live view zoom failed: %s", gp_result_as_string(ret));
+        return CANON_ERROR_NOT_SUPPORTED;
+    }
+
+    if (magnification > 1) {
+        canon_log(LOG_INFO, "Live view zoom %ux", magnification);
+    }
+    return roi && magnification == 1 ? CANON_ERROR_NOT_SUPPORTED : CANON_SUCCESS;
+}
+
 canon_error_t canon_camera_set_config(canon_camera_t *camera,
                                      const canon_config_t *config)
 {
@@ -454,16 +894,16 @@ canon_error_t canon_camera_set_config(canon_camera_t *camera,
         return CANON_ERROR_INVALID_PARAM;
     }
 
-    pthread_mutex_lock(&camera->mutex);
+    profiled_mutex_lock(&camera->state_mutex);
 
     if (!camera->connected) {
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->state_mutex);
         return CANON_ERROR_DISCONNECTED;
     }
 
     memcpy(&camera->config, config, sizeof(canon_config_t));
 
-    pthread_mutex_unlock(&camera->mutex);
+    profiled_mutex_unlock(&camera->state_mutex);
 
     return CANON_SUCCESS;
 }
@@ -475,16 +915,60 @@ canon_error_t canon_camera_get_config(canon_camera_t *camera,
         return CANON_ERROR_INVALID_PARAM;
     }
 
-    pthread_mutex_lock(&camera->mutex);
+    profiled_mutex_lock(&camera->state_mutex);
 
     if (!camera->connected) {
-        pthread_mutex_unlock(&camera->mutex);
+        profiled_mutex_unlock(&camera->state_mutex);
         return CANON_ERROR_DISCONNECTED;
     }
 
     memcpy(config, &camera->config, sizeof(canon_config_t));
+    config->live_view = camera->live_view_active;
 
-    pthread_mutex_unlock(&camera->mutex);
+    profiled_mutex_unlock(&camera->state_mutex);
 
     return CANON_SUCCESS;
-}
\ No newline at end of file
+}
+
+canon_error_t canon_camera_get_property(canon_camera_t *camera,
+                                       const char *name,
+                                       char *value, size_t value_size,
+                                       uint64_t *version)
+{
+    if (!camera) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    return camera_properties_get(camera->properties, name, value, value_size, version);
+}
+
+uint64_t canon_camera_get_properties_version(canon_camera_t *camera)
+{
+    if (!camera) {
+        return 0;
+    }
+
+    return camera_properties_version(camera->properties);
+}
+
+void canon_camera_set_property_callback(canon_camera_t *camera,
+                                        canon_property_callback callback,
+                                        void *user_data)
+{
+    if (!camera) {
+        return;
+    }
+
+    camera_properties_set_callback(camera->properties, callback, user_data);
+}
+
+void canon_camera_set_memory_account(canon_camera_t *camera, mem_account_t *account)
+{
+    if (!camera) {
+        return;
+    }
+
+    profiled_mutex_lock(&camera->mutex);
+    camera->account = account;
+    profiled_mutex_unlock(&camera->mutex);
+}
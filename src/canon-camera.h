@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include "canon-errors.h"
+#include "utils/mem-accounting.h"
 
 /**
  * @brief Camera configuration
@@ -17,6 +18,16 @@ typedef struct {
     bool live_view;
 } canon_config_t;
 
+/**
+ * @brief Region of the full live view, as fractions of its width and height
+ */
+typedef struct {
+    float x;
+    float y;
+    float width;
+    float height;
+} canon_roi_t;
+
 /**
  * @brief Camera handle
  */
@@ -34,6 +45,14 @@ typedef struct {
     bool has_auto_focus;
 } canon_capabilities_t;
 
+/**
+ * @brief Callback for camera property changes
+ *
+ * Runs on the thread that reads frames, after the USB lock is released.
+ */
+typedef void (*canon_property_callback)(const char *name, const char *value,
+                                        uint64_t version, void *user_data);
+
 /**
  * @brief Initialize camera library (call once at startup)
  * @return CANON_SUCCESS or error code
@@ -116,6 +135,23 @@ canon_error_t canon_camera_capture_frame(canon_camera_t *camera,
                                         size_t buffer_size,
                                         size_t *bytes_written);
 
+/**
+ * @brief Magnify the live view onto a region (EOS live view zoom)
+ *
+ * Picks the strongest magnification whose field still contains roi and
+ * centres it on roi as far as the frame edges allow. The preview keeps its
+ * JPEG size, so the region arrives with correspondingly more detail. Live
+ * view must be running; stopping it returns the camera to the full view.
+ * @param camera Camera handle
+ * @param roi Region to show, or NULL for the full view
+ * @param view Output region the preview now shows (may be NULL)
+ * @return CANON_SUCCESS, or CANON_ERROR_NOT_SUPPORTED if the camera has no
+ *         live view zoom or roi is too large to magnify, in which case the
+ *         full view is shown
+ */
+canon_error_t canon_camera_set_zoom(canon_camera_t *camera, const canon_roi_t *roi,
+                                    canon_roi_t *view);
+
 /**
  * @brief Set camera configuration
  * @param camera Camera handle
@@ -134,4 +170,48 @@ canon_error_t canon_camera_set_config(canon_camera_t *camera,
 canon_error_t canon_camera_get_config(canon_camera_t *camera,
                                      canon_config_t *config);
 
+/**
+ * @brief Read a mirrored camera property without USB I/O
+ *
+ * The mirror is seeded from the configuration tree at connect and kept
+ * current from the camera event stream while frames are captured.
+ * @param camera Camera handle
+ * @param name gphoto2 property name (e.g. "batterylevel")
+ * @param value Output buffer
+ * @param value_size Output buffer size
+ * @param version Output property version (may be NULL)
+ * @return CANON_SUCCESS, or CANON_ERROR_NOT_SUPPORTED if unknown
+ */
+canon_error_t canon_camera_get_property(canon_camera_t *camera,
+                                       const char *name,
+                                       char *value, size_t value_size,
+                                       uint64_t *version);
+
+/**
+ * @brief Version counter of the property mirror
+ *
+ * Changes whenever any mirrored property changes; compare with a previous
+ * value to detect updates cheaply.
+ * @param camera Camera handle
+ * @return Version counter
+ */
+uint64_t canon_camera_get_properties_version(canon_camera_t *camera);
+
+/**
+ * @brief Set the property change callback
+ * @param camera Camera handle
+ * @param callback Callback function (NULL to disable)
+ * @param user_data User data for the callback
+ */
+void canon_camera_set_property_callback(canon_camera_t *camera,
+                                        canon_property_callback callback,
+                                        void *user_data);
+
+/**
+ * @brief Set the memory account preview file data is charged to
+ * @param camera Camera handle
+ * @param account Memory account (NULL to stop charging)
+ */
+void canon_camera_set_memory_account(canon_camera_t *camera, mem_account_t *account);
+
 #endif /* CANON_CAMERA_H */
\ No newline at end of file
@@ -15,6 +15,7 @@ typedef enum {
     CANON_ERROR_TIMEOUT = -7,
     CANON_ERROR_DISCONNECTED = -8,
     CANON_ERROR_PERMISSION = -9,
+    CANON_ERROR_MEMORY_BUDGET = -10,
     CANON_ERROR_UNKNOWN = -99
 } canon_error_t;
 
@@ -0,0 +1,507 @@
+#include "capture-pipeline.h"
+#include "canon-camera.h"
+#include "utils/logging.h"
+#include "utils/lock-profiler.h"
+#include "utils/thread-registry.h"
+#include "utils/trace-recorder.h"
+#include <util/platform.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Capture pipeline implementation
+ */
+struct capture_pipeline_t {
+    canon_camera_t *camera;
+    video_source_t *video;
+    mem_account_t *account;
+    cpu_group_t *cpu;
+
+    capture_pipeline_output_cb output;
+    void *output_data;
+
+    pthread_t output_thread;
+    profiled_mutex_t mutex;
+    bool active;
+    bool thread_running;
+    bool running;
+
+    char *device_path;
+    canon_error_t error;            // Atomic: why the camera is not connected
+    mjpeg_server_t *stream;
+    v4l2_sink_t *sink;
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+
+    uint64_t frame_count;
+    uint64_t last_frame_time;
+
+    // Registry entry, guarded by g_registry_mutex
+    uint32_t id;
+    char label[CAPTURE_PIPELINE_DEVICE_SIZE];
+    uint64_t connects;
+    struct capture_pipeline_t *next;
+};
+
+/* Live pipelines, for exporters. g_registry_mutex is a leaf lock and is
+ * never held while taking a pipeline's own locks. */
+static pthread_mutex_t g_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static capture_pipeline_t *g_pipelines = NULL;
+static uint32_t g_next_id = 0;
+
+static void *output_thread_func(void *data)
+{
+    capture_pipeline_t *pipeline = data;
+    canon_log(LOG_INFO, "Output thread started for device: %s", pipeline->device_path);
+    thread_registry_enter(pipeline->cpu, THREAD_ROLE_OUTPUT);
+
+    uint64_t next_frame = os_gettime_ns();
+
+    while (__atomic_load_n(&pipeline->thread_running, __ATOMIC_ACQUIRE)) {
+        profiled_mutex_lock(&pipeline->mutex);
+
+        if (pipeline->active && pipeline->camera && pipeline->video) {
+            struct obs_source_frame frame = {0};
+
+            canon_error_t err = video_source_get_frame(pipeline->video, &frame);
+            if (err == CANON_SUCCESS) {
+                frame.timestamp = os_gettime_ns();
+                uint64_t span = trace_begin();
+                pipeline->output(&frame, pipeline->output_data);
+                trace_end(TRACE_OUTPUT, span, pipeline->frame_count);
+
+                pipeline->frame_count++;
+                pipeline->last_frame_time = frame.timestamp;
+
+                video_source_release_frame(pipeline->video, &frame);
+
+                if (pipeline->frame_count % 30 == 0) {
+                    canon_log(LOG_DEBUG, "Frames captured: %lu", (unsigned long)pipeline->frame_count);
+                }
+            } else {
+                if (pipeline->frame_count == 0) {
+                    canon_log(LOG_WARNING, "Failed to get first frame: %s", canon_error_string(err));
+                }
+            }
+        }
+
+        uint32_t fps = pipeline->fps;
+        profiled_mutex_unlock(&pipeline->mutex);
+
+        /* Sleep to an absolute deadline: a relative sleep after each frame
+         * runs slower than the capture rate and lets the queue back up */
+        uint64_t now = os_gettime_ns();
+        next_frame += 1000000000ULL / fps;
+        if (next_frame < now) {
+            next_frame = now;
+        }
+        struct timespec deadline = {
+            .tv_sec = (time_t)(next_frame / 1000000000ULL),
+            .tv_nsec = (long)(next_frame % 1000000000ULL)
+        };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+        }
+    }
+
+    canon_log(LOG_INFO, "Output thread stopped");
+    thread_registry_leave();
+    return NULL;
+}
+
+/**
+ * Start the video source and the output thread.
+ * Called with pipeline->mutex held.
+ */
+static bool start_locked(capture_pipeline_t *pipeline)
+{
+    if (pipeline->running || !pipeline->camera || !pipeline->video) {
+        return pipeline->running;
+    }
+
+    video_format_info_t format = {
+        .width = pipeline->width,
+        .height = pipeline->height,
+        .fps = pipeline->fps,
+        .format = VIDEO_FORMAT_NV12
+    };
+
+    canon_error_t err = video_source_init(pipeline->video, pipeline->camera, &format);
+    if (err != CANON_SUCCESS) {
+        canon_log(LOG_ERROR, "Failed to initialize video source: %s", canon_error_string(err));
+        return false;
+    }
+
+    err = video_source_start(pipeline->video);
+    if (err != CANON_SUCCESS) {
+        canon_log(LOG_ERROR, "Failed to start video source: %s", canon_error_string(err));
+        return false;
+    }
+
+    canon_log(LOG_INFO, "Video source started successfully");
+    __atomic_store_n(&pipeline->running, true, __ATOMIC_RELEASE);
+
+    if (pipeline->output) {
+        pipeline->thread_running = true;
+        if (pthread_create(&pipeline->output_thread, NULL,
+                          output_thread_func, pipeline) != 0) {
+            canon_log(LOG_ERROR, "Failed to create output thread");
+            pipeline->thread_running = false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Stop the output thread and the video source.
+ * Called with pipeline->mutex held, which is released while joining.
+ */
+static void stop_locked(capture_pipeline_t *pipeline)
+{
+    if (pipeline->thread_running) {
+        __atomic_store_n(&pipeline->thread_running, false, __ATOMIC_RELEASE);
+        profiled_mutex_unlock(&pipeline->mutex);
+        pthread_join(pipeline->output_thread, NULL);
+        profiled_mutex_lock(&pipeline->mutex);
+    }
+
+    if (pipeline->running) {
+        video_source_stop(pipeline->video);
+        __atomic_store_n(&pipeline->running, false, __ATOMIC_RELEASE);
+    }
+}
+
+capture_pipeline_t *capture_pipeline_create(capture_pipeline_output_cb output,
+                                            void *user_data)
+{
+    capture_pipeline_t *pipeline = calloc(1, sizeof(capture_pipeline_t));
+    if (!pipeline) {
+        canon_log(LOG_ERROR, "Failed to allocate capture pipeline");
+        return NULL;
+    }
+
+    pipeline->account = mem_account_create("unconfigured");
+    if (!pipeline->account) {
+        canon_log(LOG_ERROR, "Failed to create memory account");
+        free(pipeline);
+        return NULL;
+    }
+
+    // The id names the pipeline's threads, so it is taken up front
+    pthread_mutex_lock(&g_registry_mutex);
+    pipeline->id = ++g_next_id;
+    pthread_mutex_unlock(&g_registry_mutex);
+
+    pipeline->cpu = cpu_group_create(pipeline->id);
+    if (!pipeline->cpu) {
+        canon_log(LOG_ERROR, "Failed to create CPU group");
+        mem_account_destroy(pipeline->account);
+        free(pipeline);
+        return NULL;
+    }
+
+    pipeline->video = video_source_create(pipeline->account, pipeline->cpu);
+    if (!pipeline->video) {
+        canon_log(LOG_ERROR, "Failed to create video source");
+        cpu_group_destroy(pipeline->cpu);
+        mem_account_destroy(pipeline->account);
+        free(pipeline);
+        return NULL;
+    }
+
+    profiled_mutex_init(&pipeline->mutex, "capture_pipeline");
+    pipeline->output = output;
+    pipeline->output_data = user_data;
+    pipeline->width = 1920;
+    pipeline->height = 1080;
+    pipeline->fps = 30;
+
+    pthread_mutex_lock(&g_registry_mutex);
+    pipeline->next = g_pipelines;
+    g_pipelines = pipeline;
+    pthread_mutex_unlock(&g_registry_mutex);
+
+    return pipeline;
+}
+
+void capture_pipeline_destroy(capture_pipeline_t *pipeline)
+{
+    if (!pipeline) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_registry_mutex);
+    for (capture_pipeline_t **link = &g_pipelines; *link; link = &(*link)->next) {
+        if (*link == pipeline) {
+            *link = pipeline->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_registry_mutex);
+
+    // Stop threads first (must be done before destroying resources)
+    profiled_mutex_lock(&pipeline->mutex);
+    pipeline->active = false;
+    stop_locked(pipeline);
+
+    video_source_set_preview_stream(pipeline->video, NULL);
+    mjpeg_server_destroy(pipeline->stream);
+    video_source_set_v4l2_sink(pipeline->video, NULL);
+    v4l2_sink_destroy(pipeline->sink);
+
+    if (pipeline->camera) {
+        canon_camera_disconnect(pipeline->camera);
+        canon_camera_destroy(pipeline->camera);
+    }
+
+    video_source_destroy(pipeline->video);
+    free(pipeline->device_path);
+
+    profiled_mutex_unlock(&pipeline->mutex);
+    profiled_mutex_destroy(&pipeline->mutex);
+
+    cpu_group_destroy(pipeline->cpu);
+    mem_account_destroy(pipeline->account);
+    free(pipeline);
+}
+
+/* Connect to the camera, restarting the pipeline if it was running.
+ * Called with pipeline->mutex held. */
+static canon_error_t connect_locked(capture_pipeline_t *pipeline, const char *device_path,
+                                    bool was_running)
+{
+    canon_config_t config = {
+        .width = pipeline->width,
+        .height = pipeline->height,
+        .fps = pipeline->fps
+    };
+
+    pipeline->camera = canon_camera_create();
+    if (!pipeline->camera) {
+        return CANON_ERROR_MEMORY;
+    }
+
+    canon_camera_set_memory_account(pipeline->camera, pipeline->account);
+    canon_error_t err = canon_camera_connect(pipeline->camera, device_path, &config);
+    if (err != CANON_SUCCESS) {
+        canon_log(LOG_ERROR, "Failed to connect to camera: %s",
+                 canon_error_string(err));
+        canon_camera_destroy(pipeline->camera);
+        pipeline->camera = NULL;
+        return err;
+    }
+
+    __atomic_add_fetch(&pipeline->connects, 1, __ATOMIC_RELAXED);
+
+    if (was_running || pipeline->active) {
+        // Restart the pipeline if it was running, or start it if
+        // the source is showing without a camera until now
+        pipeline->active = true;
+        start_locked(pipeline);
+    }
+    return CANON_SUCCESS;
+}
+
+void capture_pipeline_update(capture_pipeline_t *pipeline,
+                             const capture_pipeline_settings_t *settings)
+{
+    if (!pipeline || !settings) {
+        return;
+    }
+
+    const char *new_device = settings->device_path ? settings->device_path : "";
+
+    profiled_mutex_lock(&pipeline->mutex);
+
+    pipeline->width = settings->width;
+    pipeline->height = settings->height;
+    pipeline->fps = settings->fps ? settings->fps : 30;
+
+    video_source_set_decoder(pipeline->video, settings->decoder);
+    video_source_set_sync_group(pipeline->video, settings->sync_group);
+    video_source_set_phase_lock(pipeline->video, settings->phase_lock);
+    video_source_set_crop(pipeline->video, settings->crop_mode, &settings->crop);
+
+    if (mjpeg_server_get_port(pipeline->stream) != settings->stream_port) {
+        video_source_set_preview_stream(pipeline->video, NULL);
+        mjpeg_server_destroy(pipeline->stream);
+        pipeline->stream = settings->stream_port
+                               ? mjpeg_server_create(settings->stream_port, new_device,
+                                                     pipeline->cpu)
+                               : NULL;
+        video_source_set_preview_stream(pipeline->video, pipeline->stream);
+    }
+
+    // The output thread releases each frame before dropping the mutex, so
+    // no frame decoded into the old sink's buffers is held here
+    const char *v4l2_device = settings->v4l2_device ? settings->v4l2_device : "";
+    if (strcmp(v4l2_sink_get_device(pipeline->sink), v4l2_device) != 0) {
+        video_source_set_v4l2_sink(pipeline->video, NULL);
+        v4l2_sink_destroy(pipeline->sink);
+        pipeline->sink = v4l2_sink_create(v4l2_device);
+        video_source_set_v4l2_sink(pipeline->video, pipeline->sink);
+    }
+
+    // A budget refusal is retried on the next update, memory may have been freed
+    canon_error_t last_error = __atomic_load_n(&pipeline->error, __ATOMIC_RELAXED);
+    if (!pipeline->device_path || strcmp(pipeline->device_path, new_device) != 0 ||
+        last_error == CANON_ERROR_MEMORY_BUDGET) {
+        // Stop the pipeline before changing camera, the video source
+        // capture thread still references the old camera
+        bool was_running = pipeline->running;
+        stop_locked(pipeline);
+
+        free(pipeline->device_path);
+        pipeline->device_path = strdup(new_device);
+        mem_account_set_name(pipeline->account, new_device);
+
+        pthread_mutex_lock(&g_registry_mutex);
+        snprintf(pipeline->label, sizeof(pipeline->label), "%s", new_device);
+        pthread_mutex_unlock(&g_registry_mutex);
+
+        if (pipeline->camera) {
+            canon_camera_disconnect(pipeline->camera);
+            canon_camera_destroy(pipeline->camera);
+            pipeline->camera = NULL;
+        }
+
+        canon_error_t err = CANON_SUCCESS;
+        if (strlen(new_device) > 0) {
+            // Charged after the rename, so a budget refusal names the camera.
+            // A refused source does not claim the camera.
+            err = video_source_reserve_buffers(pipeline->video);
+            if (err == CANON_SUCCESS) {
+                err = connect_locked(pipeline, new_device, was_running);
+            } else {
+                canon_log(LOG_ERROR, "Not connecting to %s: %s", new_device,
+                         canon_error_string(err));
+            }
+        }
+
+        __atomic_store_n(&pipeline->error, err, __ATOMIC_RELAXED);
+    }
+
+    profiled_mutex_unlock(&pipeline->mutex);
+}
+
+void capture_pipeline_activate(capture_pipeline_t *pipeline)
+{
+    if (!pipeline) {
+        return;
+    }
+
+    profiled_mutex_lock(&pipeline->mutex);
+    pipeline->active = true;
+    start_locked(pipeline);
+    profiled_mutex_unlock(&pipeline->mutex);
+}
+
+void capture_pipeline_deactivate(capture_pipeline_t *pipeline)
+{
+    if (!pipeline) {
+        return;
+    }
+
+    profiled_mutex_lock(&pipeline->mutex);
+    pipeline->active = false;
+
+    // Stop output thread and live view on deactivate
+    stop_locked(pipeline);
+
+    profiled_mutex_unlock(&pipeline->mutex);
+}
+
+bool capture_pipeline_is_running(capture_pipeline_t *pipeline)
+{
+    if (!pipeline) {
+        return false;
+    }
+
+    // Lock-free: polled from the graphics thread while update() may hold
+    // the mutex across a camera connect
+    return __atomic_load_n(&pipeline->running, __ATOMIC_ACQUIRE);
+}
+
+video_source_t *capture_pipeline_get_video(capture_pipeline_t *pipeline)
+{
+    return pipeline ? pipeline->video : NULL;
+}
+
+cpu_group_t *capture_pipeline_get_cpu_group(capture_pipeline_t *pipeline)
+{
+    return pipeline ? pipeline->cpu : NULL;
+}
+
+canon_error_t capture_pipeline_get_error(capture_pipeline_t *pipeline)
+{
+    if (!pipeline) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    // Lock-free for the same reason as capture_pipeline_is_running()
+    return __atomic_load_n(&pipeline->error, __ATOMIC_RELAXED);
+}
+
+void capture_pipeline_get_device(capture_pipeline_t *pipeline,
+                                 char *device_path, size_t size)
+{
+    if (!pipeline || !device_path || size == 0) {
+        return;
+    }
+
+    profiled_mutex_lock(&pipeline->mutex);
+    snprintf(device_path, size, "%s", pipeline->device_path ? pipeline->device_path : "");
+    profiled_mutex_unlock(&pipeline->mutex);
+}
+
+void capture_pipeline_get_memory(capture_pipeline_t *pipeline, mem_account_stats_t *stats)
+{
+    if (!pipeline || !stats) {
+        return;
+    }
+
+    mem_account_get_stats(pipeline->account, stats);
+}
+
+void capture_pipeline_get_cpu(capture_pipeline_t *pipeline, cpu_usage_t *usage)
+{
+    if (!pipeline || !usage) {
+        return;
+    }
+
+    cpu_group_read(pipeline->cpu, usage);
+}
+
+void capture_pipeline_foreach(capture_pipeline_visit_cb visit, void *user_data)
+{
+    if (!visit) {
+        return;
+    }
+
+    capture_pipeline_info_t *info = malloc(sizeof(capture_pipeline_info_t));
+    if (!info) {
+        return;
+    }
+
+    // Only lock-free reads and leaf locks: a stalled pipeline cannot block this
+    pthread_mutex_lock(&g_registry_mutex);
+    for (capture_pipeline_t *pipeline = g_pipelines; pipeline; pipeline = pipeline->next) {
+        info->id = pipeline->id;
+        memcpy(info->device_path, pipeline->label, sizeof(info->device_path));
+        info->running = __atomic_load_n(&pipeline->running, __ATOMIC_ACQUIRE);
+        info->connects = __atomic_load_n(&pipeline->connects, __ATOMIC_RELAXED);
+        video_source_read_counters(pipeline->video, &info->counters);
+        mem_account_get_stats(pipeline->account, &info->memory);
+        cpu_group_read(pipeline->cpu, &info->cpu);
+        visit(info, user_data);
+    }
+    pthread_mutex_unlock(&g_registry_mutex);
+
+    free(info);
+}
@@ -0,0 +1,166 @@
+#ifndef CAPTURE_PIPELINE_H
+#define CAPTURE_PIPELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <obs-module.h>
+#include "canon-errors.h"
+#include "video-source.h"
+#include "utils/thread-registry.h"
+
+/**
+ * @brief Camera + video source lifecycle behind one OBS source
+ *
+ * Owns the camera connection, the video source and (for async sources) the
+ * thread that hands decoded frames to the output callback. Does not depend
+ * on the OBS core, so benchmarks can drive it directly.
+ */
+typedef struct capture_pipeline_t capture_pipeline_t;
+
+/**
+ * @brief Pipeline settings (mirrors the source settings)
+ */
+typedef struct {
+    const char *device_path;
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+    const char *decoder;
+    uint32_t sync_group;    /**< 0 = capture on the source's own timer */
+    bool phase_lock;        /**< Time fetches to the camera's refresh */
+    video_crop_mode_t crop_mode;
+    canon_roi_t crop;       /**< Region of the camera's view (crop_mode != OFF) */
+    uint16_t stream_port;   /**< Localhost MJPEG preview stream (mjpeg-server.h), 0 = off */
+    const char *v4l2_device; /**< v4l2loopback device fed with the frames (v4l2-sink.h), NULL = off */
+} capture_pipeline_settings_t;
+
+#define CAPTURE_PIPELINE_DEVICE_SIZE 256
+
+/**
+ * @brief Snapshot of one pipeline for capture_pipeline_foreach()
+ */
+typedef struct {
+    uint32_t id;                                    /**< Unique for the process lifetime */
+    char device_path[CAPTURE_PIPELINE_DEVICE_SIZE];
+    bool running;
+    uint64_t connects;                              /**< Successful camera connects */
+    video_source_counters_t counters;
+    mem_account_stats_t memory;
+    cpu_usage_t cpu;                                /**< CPU time of the pipeline's threads */
+} capture_pipeline_info_t;
+
+/**
+ * @brief Callback for capture_pipeline_foreach()
+ *
+ * Runs with the pipeline registry locked; must not call back into the
+ * pipeline API.
+ */
+typedef void (*capture_pipeline_visit_cb)(const capture_pipeline_info_t *info, void *user_data);
+
+/**
+ * @brief Callback receiving each decoded frame on the output thread
+ *
+ * The frame is only valid during the call.
+ */
+typedef void (*capture_pipeline_output_cb)(struct obs_source_frame *frame, void *user_data);
+
+/**
+ * @brief Create a pipeline
+ * @param output Frame callback, or NULL if frames are pulled from the video
+ *               source directly (no output thread is started)
+ * @param user_data User data for the callback
+ * @return Pipeline handle or NULL on failure
+ */
+capture_pipeline_t *capture_pipeline_create(capture_pipeline_output_cb output,
+                                            void *user_data);
+
+/**
+ * @brief Stop everything and destroy the pipeline
+ * @param pipeline Pipeline handle
+ */
+void capture_pipeline_destroy(capture_pipeline_t *pipeline);
+
+/**
+ * @brief Apply settings, reconnecting the camera if the device changed
+ *
+ * A running pipeline is restarted on the new device. If the memory budget
+ * refuses the new device's buffers, the camera is not connected (see
+ * capture_pipeline_get_error()) and the next update tries again.
+ * @param pipeline Pipeline handle
+ * @param settings New settings
+ */
+void capture_pipeline_update(capture_pipeline_t *pipeline,
+                             const capture_pipeline_settings_t *settings);
+
+/**
+ * @brief Start live view, capture and output (source became active)
+ * @param pipeline Pipeline handle
+ */
+void capture_pipeline_activate(capture_pipeline_t *pipeline);
+
+/**
+ * @brief Stop output, capture and live view (source became inactive)
+ * @param pipeline Pipeline handle
+ */
+void capture_pipeline_deactivate(capture_pipeline_t *pipeline);
+
+/**
+ * @brief Check whether the video source is running
+ * @param pipeline Pipeline handle
+ * @return true if capturing
+ */
+bool capture_pipeline_is_running(capture_pipeline_t *pipeline);
+
+/**
+ * @brief Get the video source (valid for the pipeline's lifetime)
+ * @param pipeline Pipeline handle
+ * @return Video source handle
+ */
+video_source_t *capture_pipeline_get_video(capture_pipeline_t *pipeline);
+
+/**
+ * @brief Get the CPU group the pipeline's threads count towards
+ * @param pipeline Pipeline handle
+ * @return Group, valid for the pipeline's lifetime
+ */
+cpu_group_t *capture_pipeline_get_cpu_group(capture_pipeline_t *pipeline);
+
+/**
+ * @brief Get why the configured camera is not connected
+ * @param pipeline Pipeline handle
+ * @return CANON_SUCCESS if connected or no device is set, otherwise the
+ *         error of the last connect attempt (e.g. CANON_ERROR_MEMORY_BUDGET)
+ */
+canon_error_t capture_pipeline_get_error(capture_pipeline_t *pipeline);
+
+/**
+ * @brief Get the device path currently configured
+ * @param pipeline Pipeline handle
+ * @param device_path Output buffer
+ * @param size Output buffer size
+ */
+void capture_pipeline_get_device(capture_pipeline_t *pipeline,
+                                 char *device_path, size_t size);
+
+/**
+ * @brief Get the memory charged to this pipeline, by category
+ * @param pipeline Pipeline handle
+ * @param stats Output snapshot
+ */
+void capture_pipeline_get_memory(capture_pipeline_t *pipeline, mem_account_stats_t *stats);
+
+/**
+ * @brief Get the CPU time of this pipeline's threads, by role
+ * @param pipeline Pipeline handle
+ * @param usage Output totals, cumulative since the pipeline was created
+ */
+void capture_pipeline_get_cpu(capture_pipeline_t *pipeline, cpu_usage_t *usage);
+
+/**
+ * @brief Visit every live pipeline without taking any pipeline lock
+ * @param visit Callback, called once per pipeline
+ * @param user_data User data for the callback
+ */
+void capture_pipeline_foreach(capture_pipeline_visit_cb visit, void *user_data);
+
+#endif /* CAPTURE_PIPELINE_H */
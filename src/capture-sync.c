@@ -0,0 +1,239 @@
+#include "capture-sync.h"
+#include "utils/logging.h"
+#include <util/platform.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Groups log their skew this often (in ticks)
+#define SYNC_REPORT_TICKS 1800
+// Weight of a new fetch latency sample, as a shift (1/8)
+#define LATENCY_EWMA_SHIFT 3
+
+/**
+ * @brief Sync group implementation
+ */
+typedef struct capture_sync_group_t {
+    uint32_t group;
+    uint32_t fps;
+    uint32_t members;
+    uint64_t epoch;
+    uint64_t period;
+
+    // Capture instants of the tick being collected, relative to the tick
+    uint64_t tick;
+    int64_t earliest;
+    int64_t latest;
+    uint32_t reports;
+
+    uint64_t ticks;
+    uint64_t late;
+    latency_histogram_t skew;
+
+    struct capture_sync_group_t *next;
+} capture_sync_group_t;
+
+/**
+ * @brief Membership implementation, owned by one capture thread
+ */
+struct capture_sync_t {
+    capture_sync_group_t *group;
+    uint64_t latency;           // Smoothed fetch latency, ns
+    uint64_t last_tick;
+    bool has_tick;
+};
+
+/* g_sync_mutex guards the group list and all group fields. It is a leaf
+ * lock taken twice per frame per synced camera. */
+static pthread_mutex_t g_sync_mutex = PTHREAD_MUTEX_INITIALIZER;
+static capture_sync_group_t *g_groups = NULL;
+
+capture_sync_t *capture_sync_join(uint32_t group, uint32_t fps)
+{
+    if (group == 0 || group > CAPTURE_SYNC_MAX_GROUP || fps == 0) {
+        return NULL;
+    }
+
+    capture_sync_t *member = calloc(1, sizeof(capture_sync_t));
+    if (!member) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_sync_mutex);
+
+    capture_sync_group_t *entry = g_groups;
+    while (entry && (entry->group != group || entry->fps != fps)) {
+        entry = entry->next;
+    }
+
+    if (!entry) {
+        entry = calloc(1, sizeof(capture_sync_group_t));
+        if (!entry) {
+            pthread_mutex_unlock(&g_sync_mutex);
+            free(member);
+            return NULL;
+        }
+        entry->group = group;
+        entry->fps = fps;
+        entry->epoch = os_gettime_ns();
+        entry->period = 1000000000ULL / fps;
+        latency_histogram_reset(&entry->skew);
+        entry->next = g_groups;
+        g_groups = entry;
+    }
+
+    entry->members++;
+    member->group = entry;
+    uint32_t members = entry->members;
+
+    pthread_mutex_unlock(&g_sync_mutex);
+
+    canon_log(LOG_INFO, "Joined capture sync group %u at %u fps, now %u members",
+             group, fps, members);
+    return member;
+}
+
+void capture_sync_leave(capture_sync_t *member)
+{
+    if (!member) {
+        return;
+    }
+
+    capture_sync_group_t *group = member->group;
+
+    pthread_mutex_lock(&g_sync_mutex);
+
+    if (--group->members == 0) {
+        for (capture_sync_group_t **link = &g_groups; *link; link = &(*link)->next) {
+            if (*link == group) {
+                *link = group->next;
+                break;
+            }
+        }
+    } else {
+        group = NULL;
+    }
+
+    pthread_mutex_unlock(&g_sync_mutex);
+
+    free(group);
+    free(member);
+}
+
+uint64_t capture_sync_wait(capture_sync_t *member)
+{
+    pthread_mutex_lock(&g_sync_mutex);
+    uint64_t epoch = member->group->epoch;
+    uint64_t period = member->group->period;
+    pthread_mutex_unlock(&g_sync_mutex);
+
+    // Trigger early so the middle of the fetch lands on the tick
+    uint64_t lead = member->latency / 2;
+    if (lead > period / 2) {
+        lead = period / 2;
+    }
+
+    uint64_t now = os_gettime_ns();
+    uint64_t tick = (now + lead - epoch) / period + 1;
+    if (member->has_tick && tick <= member->last_tick) {
+        tick = member->last_tick + 1;
+    }
+
+    uint64_t target = epoch + tick * period - lead;
+    struct timespec deadline = {
+        .tv_sec = (time_t)(target / 1000000000ULL),
+        .tv_nsec = (long)(target % 1000000000ULL)
+    };
+
+    // os_gettime_ns() is CLOCK_MONOTONIC
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+
+    member->last_tick = tick;
+    member->has_tick = true;
+    return tick;
+}
+
+/* Called with g_sync_mutex held */
+static void finish_tick_locked(capture_sync_group_t *group)
+{
+    if (group->reports < 2) {
+        return;
+    }
+
+    latency_histogram_record(&group->skew, (uint64_t)(group->latest - group->earliest));
+    group->ticks++;
+
+    if (group->ticks % SYNC_REPORT_TICKS == 0) {
+        canon_log(LOG_INFO, "Capture sync group %u: %u cameras, skew p50 %.2f ms, "
+                 "p99 %.2f ms (frame interval %.1f ms), %llu late fetches",
+                 group->group, group->members,
+                 (double)latency_histogram_percentile(&group->skew, 50.0) / 1e6,
+                 (double)latency_histogram_percentile(&group->skew, 99.0) / 1e6,
+                 (double)group->period / 1e6, (unsigned long long)group->late);
+    }
+}
+
+void capture_sync_report(capture_sync_t *member, uint64_t tick,
+                         uint64_t fetch_start, uint64_t fetch_end)
+{
+    uint64_t latency = fetch_end > fetch_start ? fetch_end - fetch_start : 0;
+
+    if (member->latency == 0) {
+        member->latency = latency;
+    } else {
+        member->latency += (latency >> LATENCY_EWMA_SHIFT) -
+                           (member->latency >> LATENCY_EWMA_SHIFT);
+    }
+
+    pthread_mutex_lock(&g_sync_mutex);
+
+    capture_sync_group_t *group = member->group;
+    uint64_t tick_time = group->epoch + tick * group->period;
+    int64_t offset = (int64_t)(fetch_start + latency / 2) - (int64_t)tick_time;
+
+    // Started after the next tick was due: the camera could not keep up
+    if (fetch_start > tick_time + group->period / 2) {
+        group->late++;
+    }
+
+    if (tick > group->tick || group->reports == 0) {
+        finish_tick_locked(group);
+        group->tick = tick;
+        group->earliest = offset;
+        group->latest = offset;
+        group->reports = 1;
+    } else if (tick == group->tick) {
+        if (offset < group->earliest) {
+            group->earliest = offset;
+        }
+        if (offset > group->latest) {
+            group->latest = offset;
+        }
+        group->reports++;
+    }
+
+    pthread_mutex_unlock(&g_sync_mutex);
+}
+
+size_t capture_sync_get_all(capture_sync_stats_t *stats, size_t max_count)
+{
+    pthread_mutex_lock(&g_sync_mutex);
+
+    size_t index = 0;
+    for (capture_sync_group_t *group = g_groups; group; group = group->next, index++) {
+        if (stats && index < max_count) {
+            capture_sync_stats_t *out = &stats[index];
+            out->group = group->group;
+            out->fps = group->fps;
+            out->members = group->members;
+            out->ticks = group->ticks;
+            out->late = group->late;
+            out->skew = group->skew;
+        }
+    }
+
+    pthread_mutex_unlock(&g_sync_mutex);
+    return index;
+}
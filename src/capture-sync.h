@@ -0,0 +1,85 @@
+#ifndef CAPTURE_SYNC_H
+#define CAPTURE_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "utils/latency-histogram.h"
+
+/**
+ * @brief Frame capture alignment across cameras
+ *
+ * Cameras in the same sync group fetch their preview frames against one
+ * shared monotonic tick instead of each capture thread's own timer. Each
+ * camera is triggered early by half its measured fetch latency, so the
+ * estimated capture instants (the middle of each fetch) line up on the
+ * tick. Every camera still fetches once per frame interval; only the phase
+ * changes. The spread of capture instants per tick is recorded as the
+ * group's inter-camera skew.
+ *
+ * Groups are identified by a number and a frame rate: sources with the
+ * same number but different rates tick separately.
+ */
+
+#define CAPTURE_SYNC_MAX_GROUP 8
+
+/**
+ * @brief Group membership of one capture thread
+ */
+typedef struct capture_sync_t capture_sync_t;
+
+/**
+ * @brief Snapshot of one sync group
+ */
+typedef struct {
+    uint32_t group;
+    uint32_t fps;
+    uint32_t members;
+    uint64_t ticks;                 /**< Ticks fetched by two or more cameras */
+    uint64_t late;                  /**< Fetches that missed their tick */
+    latency_histogram_t skew;       /**< Spread of capture instants per tick */
+} capture_sync_stats_t;
+
+/**
+ * @brief Join a sync group, creating it if needed
+ * @param group Group number (1 to CAPTURE_SYNC_MAX_GROUP)
+ * @param fps Frame rate of the joining source
+ * @return Membership handle or NULL on failure
+ */
+capture_sync_t *capture_sync_join(uint32_t group, uint32_t fps);
+
+/**
+ * @brief Leave a sync group; the group goes away with its last member
+ * @param member Membership handle (may be NULL)
+ */
+void capture_sync_leave(capture_sync_t *member);
+
+/**
+ * @brief Sleep until this camera's next trigger time
+ *
+ * Call before each preview fetch, instead of sleeping a frame interval
+ * after it.
+ * @param member Membership handle
+ * @return Tick the fetch belongs to, for capture_sync_report()
+ */
+uint64_t capture_sync_wait(capture_sync_t *member);
+
+/**
+ * @brief Report a completed fetch
+ * @param member Membership handle
+ * @param tick Value returned by capture_sync_wait()
+ * @param fetch_start Fetch start (os_gettime_ns())
+ * @param fetch_end Fetch completion (os_gettime_ns())
+ */
+void capture_sync_report(capture_sync_t *member, uint64_t tick,
+                         uint64_t fetch_start, uint64_t fetch_end);
+
+/**
+ * @brief Get statistics for all sync groups
+ * @param stats Output array (may be NULL to only count)
+ * @param max_count Size of the output array
+ * @return Number of groups (may exceed max_count)
+ */
+size_t capture_sync_get_all(capture_sync_stats_t *stats, size_t max_count);
+
+#endif /* CAPTURE_SYNC_H */
@@ -0,0 +1,259 @@
+#include "fetch-scheduler.h"
+#include <stdlib.h>
+
+// Retry interval after a duplicate, as a fraction of the period
+#define RETRY_DIVISOR 16
+#define MIN_RETRY_NS 500000ULL
+// Windows wider than this (fraction of the period) are halved by a probe
+#define PROBE_DIVISOR 32
+#define MIN_PROBE_WIDTH_NS 500000ULL
+// Windows up to this wide (fraction of the period) measure the refresh time
+#define MEASURE_DIVISOR 4
+// Period uncertainty before the first measurement and the floor for clock
+// drift, as fractions of the period
+#define UNKNOWN_PERIOD_DIVISOR 16
+#define DRIFT_DIVISOR 4096
+// Longest baseline between period measurements, in periods
+#define MAX_BASELINE 1024
+// Duplicates in a row (about four periods) before the camera counts as stalled
+#define MAX_DUPLICATE_STREAK (4 * RETRY_DIVISOR)
+
+/**
+ * @brief Scheduler implementation
+ *
+ * The next refresh is known to fall in (lo, hi]. A new frame at time t
+ * means it happened at or before t, a duplicate that it happens after t.
+ */
+struct fetch_scheduler_t {
+    uint64_t nominal;           // Period of the requested frame rate, ns
+    uint64_t period;            // Estimated refresh period, ns
+    uint64_t uncertainty;       // Possible error of the period, ns
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t predicted;         // Window centre before the current probe
+    uint64_t anchor;            // Last measured refresh used for the period
+    uint64_t anchor_width;      // Window width when the anchor was measured
+    uint32_t anchor_frames;     // New frames fetched since the anchor
+    uint32_t baseline;          // Periods needed before the next measurement
+    uint64_t due;               // Earliest next new frame at the requested rate
+    uint64_t last_start;
+    uint32_t duplicate_streak;
+    bool skipped;               // A refresh was left out on purpose
+    bool started;
+    bool locked;
+    bool has_anchor;
+};
+
+fetch_scheduler_t *fetch_scheduler_create(uint32_t fps)
+{
+    if (fps == 0) {
+        return NULL;
+    }
+
+    fetch_scheduler_t *scheduler = calloc(1, sizeof(fetch_scheduler_t));
+    if (!scheduler) {
+        return NULL;
+    }
+
+    scheduler->nominal = 1000000000ULL / fps;
+    scheduler->period = scheduler->nominal;
+    scheduler->uncertainty = scheduler->nominal / UNKNOWN_PERIOD_DIVISOR;
+    scheduler->baseline = 1;
+    return scheduler;
+}
+
+void fetch_scheduler_destroy(fetch_scheduler_t *scheduler)
+{
+    free(scheduler);
+}
+
+static uint64_t probe_width(const fetch_scheduler_t *scheduler)
+{
+    uint64_t width = scheduler->period / PROBE_DIVISOR;
+    return width > MIN_PROBE_WIDTH_NS ? width : MIN_PROBE_WIDTH_NS;
+}
+
+uint64_t fetch_scheduler_next(fetch_scheduler_t *scheduler, uint64_t now)
+{
+    if (!scheduler->started) {
+        scheduler->started = true;
+        return now;
+    }
+
+    uint64_t next;
+    if (scheduler->duplicate_streak > MAX_DUPLICATE_STREAK) {
+        // The camera is not refreshing; poll at the requested rate
+        next = scheduler->last_start + scheduler->nominal;
+    } else if (scheduler->duplicate_streak > 0) {
+        uint64_t retry = scheduler->period / RETRY_DIVISOR;
+        next = scheduler->last_start + (retry > MIN_RETRY_NS ? retry : MIN_RETRY_NS);
+    } else if (!scheduler->skipped && scheduler->hi - scheduler->lo > probe_width(scheduler)) {
+        // Probe the middle: either answer halves the window
+        next = scheduler->lo + (scheduler->hi - scheduler->lo) / 2;
+    } else {
+        // The earliest time the refresh has certainly happened
+        next = scheduler->hi;
+    }
+
+    return next > now ? next : now;
+}
+
+static uint64_t distance(uint64_t a, uint64_t b)
+{
+    return a > b ? a - b : b - a;
+}
+
+/* The period no longer matches the camera: measure it again from scratch */
+static void reset_period(fetch_scheduler_t *scheduler)
+{
+    scheduler->uncertainty = scheduler->period / UNKNOWN_PERIOD_DIVISOR;
+    scheduler->baseline = 1;
+}
+
+/*
+ * Measure the period between two tightly bracketed refreshes. The baseline
+ * doubles with each measurement, as far as the current uncertainty still
+ * tells how many refreshes lie in between.
+ */
+static void update_period(fetch_scheduler_t *scheduler, uint64_t refresh, uint64_t width)
+{
+    if (!scheduler->has_anchor || refresh <= scheduler->anchor) {
+        scheduler->anchor = refresh;
+        scheduler->anchor_width = width;
+        scheduler->anchor_frames = 0;
+        scheduler->has_anchor = true;
+        return;
+    }
+
+    // While the period is unknown, two refreshes bracketed on consecutive
+    // frames are taken as consecutive; rounding with the wrong period could
+    // alias a slow camera to a multiple of its rate
+    uint64_t elapsed = refresh - scheduler->anchor;
+    uint64_t periods = (elapsed + scheduler->period / 2) / scheduler->period;
+    if (scheduler->baseline == 1 && scheduler->anchor_frames == 1) {
+        periods = 1;
+    }
+    if (periods == 0 || periods < scheduler->baseline) {
+        return;
+    }
+
+    uint64_t period = elapsed / periods;
+
+    // A camera refreshing far off the requested rate is still followed, up to
+    // a quarter of it; beyond that the measurement is more likely wrong
+    if (period < scheduler->nominal / 2 || period > scheduler->nominal * 4) {
+        reset_period(scheduler);
+        return;
+    }
+
+    uint64_t uncertainty = (scheduler->anchor_width + width) / 2 / periods;
+    uint64_t drift = period / DRIFT_DIVISOR;
+    if (uncertainty < drift) {
+        uncertainty = drift;
+    } else if (uncertainty > period / UNKNOWN_PERIOD_DIVISOR) {
+        uncertainty = period / UNKNOWN_PERIOD_DIVISOR;
+    }
+
+    scheduler->period = period;
+    scheduler->uncertainty = uncertainty;
+    scheduler->anchor = refresh;
+    scheduler->anchor_width = width;
+    scheduler->anchor_frames = 0;
+    if (scheduler->baseline < MAX_BASELINE) {
+        scheduler->baseline *= 2;
+    }
+}
+
+bool fetch_scheduler_observe(fetch_scheduler_t *scheduler, uint64_t fetch_start,
+                             uint64_t fetch_end, bool duplicate, uint64_t *phase_error)
+{
+    scheduler->last_start = fetch_start;
+
+    if (duplicate) {
+        if (scheduler->duplicate_streak++ == 0) {
+            scheduler->predicted = scheduler->lo + (scheduler->hi - scheduler->lo) / 2;
+        }
+
+        if (!scheduler->locked) {
+            return false;
+        }
+
+        if (fetch_start < scheduler->hi) {
+            if (fetch_start > scheduler->lo) {
+                scheduler->lo = fetch_start;
+            }
+        } else {
+            // Later than the window allowed: the period is off
+            scheduler->lo = fetch_start;
+            scheduler->hi = fetch_start + scheduler->period;
+            reset_period(scheduler);
+        }
+        return false;
+    }
+
+    bool probed = scheduler->duplicate_streak > 0;
+    scheduler->duplicate_streak = 0;
+
+    if (!scheduler->locked) {
+        scheduler->locked = true;
+        scheduler->lo = fetch_start - scheduler->period;
+        scheduler->hi = fetch_start;
+    } else if (scheduler->skipped) {
+        // The skipped refresh makes any fetch return a new frame
+    } else if (fetch_start > scheduler->lo) {
+        if (fetch_start < scheduler->hi) {
+            scheduler->hi = fetch_start;
+        }
+    } else {
+        // Earlier than the window allowed: the period is off
+        scheduler->lo = fetch_start - scheduler->period / 2;
+        scheduler->hi = fetch_start;
+        reset_period(scheduler);
+    }
+
+    if (scheduler->skipped) {
+        scheduler->anchor_frames++;
+    }
+    scheduler->anchor_frames++;
+
+    bool measured = false;
+    uint64_t width = scheduler->hi - scheduler->lo;
+    if (width <= scheduler->period / MEASURE_DIVISOR) {
+        uint64_t refresh = scheduler->lo + width / 2;
+        if (probed && phase_error) {
+            *phase_error = distance(refresh, scheduler->predicted);
+            measured = true;
+        }
+        update_period(scheduler, refresh, width);
+    }
+
+    // A camera refreshing faster than the requested rate is sampled at that
+    // rate, picking the first refresh after each frame interval
+    scheduler->due += scheduler->nominal;
+    if (scheduler->due < fetch_start + scheduler->nominal / 2) {
+        scheduler->due = fetch_start + scheduler->nominal / 2;
+    }
+
+    // Carry the window to the next refresh that is due and has not been
+    // fetched yet, widened by what the period may be off; fetches or decodes
+    // slower than the camera skip refreshes
+    uint32_t refreshes = 0;
+    do {
+        scheduler->lo += scheduler->period - scheduler->uncertainty;
+        scheduler->hi += scheduler->period + scheduler->uncertainty;
+        refreshes++;
+    } while (scheduler->hi < fetch_end || scheduler->hi < scheduler->due);
+    scheduler->skipped = refreshes > 1;
+
+    return measured;
+}
+
+uint64_t fetch_scheduler_period(const fetch_scheduler_t *scheduler)
+{
+    return scheduler->period;
+}
+
+bool fetch_scheduler_is_locked(const fetch_scheduler_t *scheduler)
+{
+    return scheduler->locked;
+}
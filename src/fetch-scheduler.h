@@ -0,0 +1,81 @@
+#ifndef FETCH_SCHEDULER_H
+#define FETCH_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Preview fetch timing locked to the camera's live view refresh
+ *
+ * The camera replaces its live view buffer on its own clock. Polling on a
+ * free-running timer either fetches the same frame twice (too early) or a
+ * frame that is already most of an interval old (too late). The scheduler
+ * estimates the refresh period and phase from which fetches returned a new
+ * frame and which returned a duplicate, and schedules each fetch just after
+ * the predicted refresh.
+ *
+ * The next refresh is kept in a window: a duplicate moves its start up, a
+ * new frame its end down. Wide windows are halved by probing the middle;
+ * narrow ones are fetched at their end, with short retries after a
+ * duplicate. Narrow windows measure a refresh time, and measurements over
+ * doubling baselines refine the period. Each window is carried to the next
+ * refresh widened by the period's uncertainty, so drift in either direction
+ * shows up as a duplicate or an early new frame and is measured again.
+ *
+ * A camera refreshing faster than the requested rate is sampled at that
+ * rate without a phase lock, and fetches slower than the camera skip
+ * refreshes; both are no worse than free-running polling.
+ *
+ * Owned by one capture thread; not thread-safe.
+ */
+typedef struct fetch_scheduler_t fetch_scheduler_t;
+
+/**
+ * @brief Create a scheduler
+ * @param fps Requested frame rate, the initial period estimate
+ * @return Scheduler or NULL on failure
+ */
+fetch_scheduler_t *fetch_scheduler_create(uint32_t fps);
+
+/**
+ * @brief Destroy a scheduler
+ * @param scheduler Scheduler (may be NULL)
+ */
+void fetch_scheduler_destroy(fetch_scheduler_t *scheduler);
+
+/**
+ * @brief Time to start the next fetch
+ * @param scheduler Scheduler
+ * @param now Current time (os_gettime_ns())
+ * @return Start time (os_gettime_ns() clock), never earlier than now
+ */
+uint64_t fetch_scheduler_next(fetch_scheduler_t *scheduler, uint64_t now);
+
+/**
+ * @brief Report a completed fetch
+ * @param scheduler Scheduler
+ * @param fetch_start Fetch start (os_gettime_ns())
+ * @param fetch_end Fetch completion (os_gettime_ns())
+ * @param duplicate true if the camera returned the previous frame again
+ * @param phase_error Set to the distance between the predicted and the
+ *                    measured refresh, in ns, when this fetch measured one
+ * @return true if phase_error was set
+ */
+bool fetch_scheduler_observe(fetch_scheduler_t *scheduler, uint64_t fetch_start,
+                             uint64_t fetch_end, bool duplicate, uint64_t *phase_error);
+
+/**
+ * @brief Estimated camera refresh period
+ * @param scheduler Scheduler
+ * @return Period in ns
+ */
+uint64_t fetch_scheduler_period(const fetch_scheduler_t *scheduler);
+
+/**
+ * @brief Check whether the refresh phase has been measured
+ * @param scheduler Scheduler
+ * @return true once a refresh was bracketed
+ */
+bool fetch_scheduler_is_locked(const fetch_scheduler_t *scheduler);
+
+#endif /* FETCH_SCHEDULER_H */
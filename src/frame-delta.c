@@ -0,0 +1,493 @@
+#include "frame-delta.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define JPEG_MARKER_SOF0 0xC0
+#define JPEG_MARKER_SOF1 0xC1
+#define JPEG_MARKER_DHT  0xC4
+#define JPEG_MARKER_JPG  0xC8
+#define JPEG_MARKER_DAC  0xCC
+#define JPEG_MARKER_RST0 0xD0
+#define JPEG_MARKER_RST7 0xD7
+#define JPEG_MARKER_SOI  0xD8
+#define JPEG_MARKER_EOI  0xD9
+#define JPEG_MARKER_SOS  0xDA
+#define JPEG_MARKER_DRI  0xDD
+
+/* Bands narrower than this many segments are not worth splitting */
+#define MIN_SEGMENT_COUNT 2
+
+/**
+ * @brief Entropy-coded restart interval inside a JPEG
+ */
+typedef struct {
+    size_t offset;
+    size_t size;
+} jpeg_interval_t;
+
+/**
+ * @brief Parsed layout of a baseline JPEG with restart markers
+ */
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t mcu_width;
+    uint32_t mcu_height;
+    uint32_t mcus_per_row;
+    uint32_t mcu_rows;
+    uint32_t restart_interval;
+
+    size_t sof_height_offset;
+    size_t header_size;
+
+    jpeg_interval_t *intervals;
+    uint32_t interval_count;
+    uint32_t interval_capacity;
+} jpeg_layout_t;
+
+/**
+ * @brief Frame delta tracker implementation
+ */
+struct frame_delta_t {
+    jpeg_layout_t cur;
+    jpeg_layout_t prev;
+
+    const uint8_t *cur_data;
+    size_t cur_size;
+    bool cur_valid;
+
+    uint8_t *prev_data;
+    size_t prev_size;
+    size_t prev_capacity;
+    bool prev_valid;
+
+    uint32_t intervals_per_segment;
+    uint32_t rows_per_segment;
+    uint32_t segment_count;
+    uint32_t next_segment;
+
+    uint8_t *band_jpeg;
+    size_t band_capacity;
+};
+
+static uint32_t gcd_u32(uint32_t a, uint32_t b)
+{
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static bool add_interval(jpeg_layout_t *layout, size_t offset, size_t size)
+{
+    if (layout->interval_count == layout->interval_capacity) {
+        uint32_t capacity = layout->interval_capacity ? layout->interval_capacity * 2 : 256;
+        jpeg_interval_t *intervals = realloc(layout->intervals,
+                                             capacity * sizeof(jpeg_interval_t));
+        if (!intervals) {
+            return false;
+        }
+        layout->intervals = intervals;
+        layout->interval_capacity = capacity;
+    }
+
+    layout->intervals[layout->interval_count].offset = offset;
+    layout->intervals[layout->interval_count].size = size;
+    layout->interval_count++;
+    return true;
+}
+
+/**
+ * @brief Split the entropy-coded data of a single scan at its RST markers
+ */
+static bool parse_intervals(jpeg_layout_t *layout, const uint8_t *data, size_t size)
+{
+    size_t start = layout->header_size;
+    size_t pos = start;
+
+    layout->interval_count = 0;
+
+    while (pos + 1 < size) {
+        if (data[pos] != 0xFF) {
+            pos++;
+            continue;
+        }
+
+        uint8_t next = data[pos + 1];
+        if (next == 0x00) {
+            pos += 2;
+            continue;
+        }
+        if (next == 0xFF) {
+            pos++;
+            continue;
+        }
+
+        if (!add_interval(layout, start, pos - start)) {
+            return false;
+        }
+
+        if (next >= JPEG_MARKER_RST0 && next <= JPEG_MARKER_RST7) {
+            pos += 2;
+            start = pos;
+            continue;
+        }
+
+        /* Anything but EOI means a second scan, which bands cannot handle */
+        return next == JPEG_MARKER_EOI;
+    }
+
+    return false;
+}
+
+static bool parse_layout(jpeg_layout_t *layout, const uint8_t *data, size_t size)
+{
+    uint32_t components = 0;
+    uint32_t h_max = 1;
+    uint32_t v_max = 1;
+    bool have_sof = false;
+
+    layout->restart_interval = 0;
+
+    if (size < 4 || data[0] != 0xFF || data[1] != JPEG_MARKER_SOI) {
+        return false;
+    }
+
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xFF) {
+            return false;
+        }
+
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+
+        size_t length = ((size_t)data[pos + 2] << 8) | data[pos + 3];
+        if (length < 2 || pos + 2 + length > size) {
+            return false;
+        }
+        const uint8_t *segment = data + pos + 4;
+
+        if (marker == JPEG_MARKER_SOF0 || marker == JPEG_MARKER_SOF1) {
+            if (length < 8) {
+                return false;
+            }
+            layout->sof_height_offset = pos + 5;
+            layout->height = ((uint32_t)segment[1] << 8) | segment[2];
+            layout->width = ((uint32_t)segment[3] << 8) | segment[4];
+            components = segment[5];
+            if (components == 0 || components > 4 || length < 8 + 3 * components) {
+                return false;
+            }
+            for (uint32_t i = 0; i < components; i++) {
+                uint32_t h = segment[7 + i * 3] >> 4;
+                uint32_t v = segment[7 + i * 3] & 0x0F;
+                if (h > h_max) {
+                    h_max = h;
+                }
+                if (v > v_max) {
+                    v_max = v;
+                }
+            }
+            have_sof = true;
+        } else if (marker >= 0xC2 && marker <= 0xCF &&
+                   marker != JPEG_MARKER_DHT &&
+                   marker != JPEG_MARKER_JPG &&
+                   marker != JPEG_MARKER_DAC) {
+            /* Progressive, lossless and arithmetic-coded frames */
+            return false;
+        } else if (marker == JPEG_MARKER_DRI) {
+            if (length < 4) {
+                return false;
+            }
+            layout->restart_interval = ((uint32_t)segment[0] << 8) | segment[1];
+        } else if (marker == JPEG_MARKER_SOS) {
+            if (!have_sof || layout->restart_interval == 0 ||
+                layout->width == 0 || layout->height == 0 ||
+                segment[0] != components) {
+                return false;
+            }
+            layout->header_size = pos + 2 + length;
+            break;
+        }
+
+        pos += 2 + length;
+    }
+
+    if (layout->header_size == 0) {
+        return false;
+    }
+
+    if (components == 1) {
+        h_max = 1;
+        v_max = 1;
+    }
+    layout->mcu_width = 8 * h_max;
+    layout->mcu_height = 8 * v_max;
+    layout->mcus_per_row = (layout->width + layout->mcu_width - 1) / layout->mcu_width;
+    layout->mcu_rows = (layout->height + layout->mcu_height - 1) / layout->mcu_height;
+
+    if (!parse_intervals(layout, data, size)) {
+        return false;
+    }
+
+    uint32_t total_mcus = layout->mcus_per_row * layout->mcu_rows;
+    uint32_t expected = (total_mcus + layout->restart_interval - 1) / layout->restart_interval;
+
+    return layout->interval_count == expected;
+}
+
+frame_delta_t *frame_delta_create(void)
+{
+    return calloc(1, sizeof(frame_delta_t));
+}
+
+void frame_delta_destroy(frame_delta_t *delta)
+{
+    if (!delta) {
+        return;
+    }
+
+    free(delta->cur.intervals);
+    free(delta->prev.intervals);
+    free(delta->prev_data);
+    free(delta->band_jpeg);
+    free(delta);
+}
+
+void frame_delta_reset(frame_delta_t *delta)
+{
+    if (!delta) {
+        return;
+    }
+
+    delta->prev_valid = false;
+    delta->cur_valid = false;
+}
+
+frame_delta_mode_t frame_delta_prepare(frame_delta_t *delta,
+                                       const uint8_t *jpeg, size_t size)
+{
+    if (!delta || !jpeg) {
+        return FRAME_DELTA_FULL;
+    }
+
+    delta->cur_data = jpeg;
+    delta->cur_size = size;
+    delta->cur.header_size = 0;
+    delta->cur_valid = parse_layout(&delta->cur, jpeg, size);
+
+    if (!delta->cur_valid || !delta->prev_valid) {
+        return FRAME_DELTA_FULL;
+    }
+
+    /* Same headers means same geometry, tables and restart interval */
+    if (delta->cur.header_size != delta->prev.header_size ||
+        delta->cur.interval_count != delta->prev.interval_count ||
+        memcmp(jpeg, delta->prev_data, delta->cur.header_size) != 0) {
+        return FRAME_DELTA_FULL;
+    }
+
+    /* A segment is the shortest run of intervals that ends on an MCU row */
+    uint32_t per_row = delta->cur.mcus_per_row;
+    uint32_t interval = delta->cur.restart_interval;
+    uint32_t lcm = per_row / gcd_u32(per_row, interval) * interval;
+
+    delta->intervals_per_segment = lcm / interval;
+    delta->rows_per_segment = lcm / per_row;
+    delta->segment_count = (delta->cur.interval_count + delta->intervals_per_segment - 1) /
+                           delta->intervals_per_segment;
+    delta->next_segment = 0;
+
+    if (delta->segment_count < MIN_SEGMENT_COUNT) {
+        return FRAME_DELTA_FULL;
+    }
+
+    return FRAME_DELTA_INCREMENTAL;
+}
+
+static void segment_range(const jpeg_layout_t *layout, uint32_t first, uint32_t last,
+                          size_t *offset, size_t *size)
+{
+    const jpeg_interval_t *begin = &layout->intervals[first];
+    const jpeg_interval_t *end = &layout->intervals[last];
+
+    *offset = begin->offset;
+    *size = end->offset + end->size - begin->offset;
+}
+
+static void segment_intervals(const frame_delta_t *delta, uint32_t segment,
+                              uint32_t *first, uint32_t *last)
+{
+    *first = segment * delta->intervals_per_segment;
+    *last = *first + delta->intervals_per_segment - 1;
+    if (*last >= delta->cur.interval_count) {
+        *last = delta->cur.interval_count - 1;
+    }
+}
+
+static bool segment_changed(const frame_delta_t *delta, uint32_t segment)
+{
+    uint32_t first, last;
+    size_t cur_offset, cur_size, prev_offset, prev_size;
+
+    segment_intervals(delta, segment, &first, &last);
+    segment_range(&delta->cur, first, last, &cur_offset, &cur_size);
+    segment_range(&delta->prev, first, last, &prev_offset, &prev_size);
+
+    return cur_size != prev_size ||
+           memcmp(delta->cur_data + cur_offset, delta->prev_data + prev_offset, cur_size) != 0;
+}
+
+/**
+ * @brief Build a standalone JPEG holding only the given intervals
+ *
+ * Restart intervals reset the DC predictors, so a run of intervals that
+ * starts and ends on MCU row boundaries decodes as its own image once the
+ * SOF height is patched and the RST markers are renumbered from zero.
+ */
+static bool build_band_jpeg(frame_delta_t *delta, uint32_t first, uint32_t last,
+                            uint32_t height, size_t *jpeg_size)
+{
+    const jpeg_layout_t *layout = &delta->cur;
+    size_t needed = layout->header_size + 2;
+
+    for (uint32_t i = first; i <= last; i++) {
+        needed += layout->intervals[i].size + 2;
+    }
+
+    if (needed > delta->band_capacity) {
+        uint8_t *buffer = realloc(delta->band_jpeg, needed);
+        if (!buffer) {
+            return false;
+        }
+        delta->band_jpeg = buffer;
+        delta->band_capacity = needed;
+    }
+
+    uint8_t *out = delta->band_jpeg;
+    memcpy(out, delta->cur_data, layout->header_size);
+    out[layout->sof_height_offset] = (uint8_t)(height >> 8);
+    out[layout->sof_height_offset + 1] = (uint8_t)(height & 0xFF);
+
+    size_t pos = layout->header_size;
+    for (uint32_t i = first; i <= last; i++) {
+        const jpeg_interval_t *interval = &layout->intervals[i];
+        memcpy(out + pos, delta->cur_data + interval->offset, interval->size);
+        pos += interval->size;
+
+        out[pos++] = 0xFF;
+        out[pos++] = (i == last) ? JPEG_MARKER_EOI
+                                 : (uint8_t)(JPEG_MARKER_RST0 + ((i - first) & 7));
+    }
+
+    *jpeg_size = pos;
+    return true;
+}
+
+bool frame_delta_next_band(frame_delta_t *delta, frame_band_t *band)
+{
+    if (!delta || !band || delta->next_segment >= delta->segment_count) {
+        return false;
+    }
+
+    uint32_t start = delta->next_segment;
+    bool changed = segment_changed(delta, start);
+    uint32_t end = start + 1;
+
+    while (end < delta->segment_count && segment_changed(delta, end) == changed) {
+        end++;
+    }
+    delta->next_segment = end;
+
+    uint32_t first_row = start * delta->rows_per_segment;
+    uint32_t end_row = end * delta->rows_per_segment;
+    if (end_row > delta->cur.mcu_rows) {
+        end_row = delta->cur.mcu_rows;
+    }
+
+    uint32_t y = first_row * delta->cur.mcu_height;
+    uint32_t y_end = end_row * delta->cur.mcu_height;
+    if (y_end > delta->cur.height) {
+        y_end = delta->cur.height;
+    }
+
+    band->changed = changed;
+    band->y = y;
+    band->height = y_end - y;
+    band->mcu_rows = end_row - first_row;
+    band->jpeg = NULL;
+    band->jpeg_size = 0;
+
+    if (changed) {
+        uint32_t first, last, unused;
+        segment_intervals(delta, start, &first, &unused);
+        segment_intervals(delta, end - 1, &unused, &last);
+
+        if (!build_band_jpeg(delta, first, last, band->height, &band->jpeg_size)) {
+            return false;
+        }
+        band->jpeg = delta->band_jpeg;
+    }
+
+    return true;
+}
+
+uint32_t frame_delta_mcu_rows(const frame_delta_t *delta)
+{
+    if (!delta || !delta->cur_valid) {
+        return 0;
+    }
+    return delta->cur.mcu_rows;
+}
+
+size_t frame_delta_memory_usage(const frame_delta_t *delta)
+{
+    if (!delta) {
+        return 0;
+    }
+
+    return sizeof(frame_delta_t) +
+           (size_t)(delta->cur.interval_capacity + delta->prev.interval_capacity) *
+           sizeof(jpeg_interval_t) +
+           delta->prev_capacity + delta->band_capacity;
+}
+
+bool frame_delta_commit(frame_delta_t *delta)
+{
+    if (!delta) {
+        return false;
+    }
+
+    if (!delta->cur_valid) {
+        delta->prev_valid = false;
+        return false;
+    }
+
+    if (delta->cur_size > delta->prev_capacity) {
+        uint8_t *buffer = realloc(delta->prev_data, delta->cur_size);
+        if (!buffer) {
+            delta->prev_valid = false;
+            return false;
+        }
+        delta->prev_data = buffer;
+        delta->prev_capacity = delta->cur_size;
+    }
+
+    memcpy(delta->prev_data, delta->cur_data, delta->cur_size);
+    delta->prev_size = delta->cur_size;
+
+    jpeg_layout_t swap = delta->prev;
+    delta->prev = delta->cur;
+    delta->cur = swap;
+
+    delta->prev_valid = true;
+    delta->cur_valid = false;
+    delta->cur_data = NULL;
+    return true;
+}
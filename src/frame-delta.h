@@ -0,0 +1,95 @@
+#ifndef FRAME_DELTA_H
+#define FRAME_DELTA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * @brief Restart-interval change tracker for consecutive JPEG frames
+ *
+ * Compares the entropy-coded restart intervals of a new frame against the
+ * previous frame and splits the image into horizontal bands that are either
+ * unchanged (reuse the previous decoded rows) or changed (decode only that
+ * band from a standalone JPEG built out of the changed intervals).
+ */
+typedef struct frame_delta_t frame_delta_t;
+
+/**
+ * @brief Result of comparing a frame against the previous one
+ */
+typedef enum {
+    FRAME_DELTA_FULL = 0,       /**< No usable previous frame, decode everything */
+    FRAME_DELTA_INCREMENTAL     /**< Iterate bands with frame_delta_next_band() */
+} frame_delta_mode_t;
+
+/**
+ * @brief Horizontal band of the image
+ */
+typedef struct {
+    bool changed;               /**< true if the band must be decoded */
+    uint32_t y;                 /**< First pixel row of the band */
+    uint32_t height;            /**< Pixel rows in the band */
+    uint32_t mcu_rows;          /**< MCU rows covered by the band */
+    const uint8_t *jpeg;        /**< Standalone JPEG of the band (changed only) */
+    size_t jpeg_size;           /**< Size of the band JPEG */
+} frame_band_t;
+
+/**
+ * @brief Create a frame delta tracker
+ * @return Tracker handle or NULL on failure
+ */
+frame_delta_t *frame_delta_create(void);
+
+/**
+ * @brief Destroy a frame delta tracker
+ * @param delta Tracker handle
+ */
+void frame_delta_destroy(frame_delta_t *delta);
+
+/**
+ * @brief Forget the previous frame (next frame decodes in full)
+ * @param delta Tracker handle
+ */
+void frame_delta_reset(frame_delta_t *delta);
+
+/**
+ * @brief Parse a new frame and compare it with the previous frame
+ * @param delta Tracker handle
+ * @param jpeg JPEG data (must stay valid until frame_delta_commit())
+ * @param size JPEG size
+ * @return FRAME_DELTA_INCREMENTAL if bands can be decoded separately
+ */
+frame_delta_mode_t frame_delta_prepare(frame_delta_t *delta,
+                                       const uint8_t *jpeg, size_t size);
+
+/**
+ * @brief Get the next band of the prepared frame
+ * @param delta Tracker handle
+ * @param band Output band description
+ * @return false when all bands have been returned
+ */
+bool frame_delta_next_band(frame_delta_t *delta, frame_band_t *band);
+
+/**
+ * @brief Total MCU rows of the prepared frame
+ * @param delta Tracker handle
+ * @return MCU row count, 0 if the frame could not be parsed
+ */
+uint32_t frame_delta_mcu_rows(const frame_delta_t *delta);
+
+/**
+ * @brief Bytes of scratch memory held by the tracker
+ * @param delta Tracker handle
+ * @return Allocated bytes, including the tracker itself
+ */
+size_t frame_delta_memory_usage(const frame_delta_t *delta);
+
+/**
+ * @brief Remember the prepared frame as the reference for the next one
+ * @param delta Tracker handle
+ * @return true on success
+ */
+bool frame_delta_commit(frame_delta_t *delta);
+
+#endif /* FRAME_DELTA_H */
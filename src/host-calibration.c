@@ -0,0 +1,863 @@
+#include "host-calibration.h"
+#include "canon-camera.h"
+#include "capture-pipeline.h"
+#include "video-source.h"
+#include "utils/latency-histogram.h"
+#include "utils/logging.h"
+#include "utils/preview-hash.h"
+#include "utils/thread-registry.h"
+#include <util/platform.h>
+#include <dirent.h>
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef USB_SYSFS_DEVICES
+#define USB_SYSFS_DEVICES "/sys/bus/usb/devices"
+#endif
+
+#define CALIBRATION_DEFAULT_SECONDS 3.0
+#define CALIBRATION_JPEG_SIZE (4 * 1024 * 1024)
+#define CALIBRATION_SAMPLES 8           // Distinct previews kept per camera for decode timing
+#define CALIBRATION_DECODES 30          // Timed decodes per backend and preview size
+#define CALIBRATION_DECODE_BUDGET_NS 1000000000ULL
+#define CALIBRATION_MAX_FAILURES 10     // Consecutive failed fetches before giving up
+#define CALIBRATION_DUPLICATE_SHARE 0.1 // More duplicates than this: the camera refresh limits
+#define CALIBRATION_SHORTFALL 0.9       // Validated rate below this share lowers the frame rate
+#define CALIBRATION_FETCH_HEADROOM 0.9  // Share of the back-to-back fetch rate to poll at
+#define CALIBRATION_WARMUP_NS 1000000000ULL
+#define CALIBRATION_VALIDATION_RUNS 2   // The validation run and a possible re-validation
+#define CALIBRATION_MIN_FPS 24          // Frame rate range of the sources
+#define CALIBRATION_MAX_FPS 60
+#define PROFILE_LINE_SIZE 512
+
+/**
+ * @brief A distinct preview kept for decode timing
+ */
+typedef struct {
+    uint8_t *jpeg;
+    size_t size;
+    uint32_t width;
+    uint32_t height;
+} calibration_sample_t;
+
+static uint32_t clamp_fps(double fps)
+{
+    long rounded = lround(fps);
+    if (rounded < CALIBRATION_MIN_FPS) {
+        return CALIBRATION_MIN_FPS;
+    }
+    return rounded > CALIBRATION_MAX_FPS ? CALIBRATION_MAX_FPS : (uint32_t)rounded;
+}
+
+static bool read_sysfs_value(const char *dir, const char *name, char *value, size_t size)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s/%s", USB_SYSFS_DEVICES, dir, name);
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    bool ok = fgets(value, (int)size, file) != NULL;
+    fclose(file);
+    return ok;
+}
+
+/* Bus, port and link speed of a "usb:BBB,DDD" camera */
+static void read_usb_topology(host_calibration_camera_t *camera)
+{
+    unsigned int bus, address;
+    if (sscanf(camera->device_path, "usb:%u,%u", &bus, &address) != 2) {
+        return;
+    }
+
+    DIR *dir = opendir(USB_SYSFS_DEVICES);
+    if (!dir) {
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        // Interfaces ("1-2:1.0") have no bus number of their own
+        if (entry->d_name[0] == '.' || strchr(entry->d_name, ':')) {
+            continue;
+        }
+
+        char value[32];
+        if (!read_sysfs_value(entry->d_name, "busnum", value, sizeof(value)) ||
+            strtoul(value, NULL, 10) != bus ||
+            !read_sysfs_value(entry->d_name, "devnum", value, sizeof(value)) ||
+            strtoul(value, NULL, 10) != address) {
+            continue;
+        }
+
+        camera->bus = bus;
+        camera->address = address;
+        snprintf(camera->port, sizeof(camera->port), "%s", entry->d_name);
+        if (read_sysfs_value(entry->d_name, "speed", value, sizeof(value))) {
+            camera->speed_mbps = (uint32_t)atof(value);
+        }
+        break;
+    }
+
+    closedir(dir);
+}
+
+/**
+ * @brief Fetch previews back to back and keep the first distinct ones
+ */
+static canon_error_t measure_camera(host_calibration_camera_t *result, double seconds,
+                                    calibration_sample_t *samples, uint32_t *sample_count)
+{
+    canon_config_t config = {
+        .width = 1920,
+        .height = 1080,
+        .fps = 30,
+        .live_view = true
+    };
+
+    canon_camera_t *camera = canon_camera_create();
+    uint8_t *buffer = malloc(CALIBRATION_JPEG_SIZE);
+    if (!camera || !buffer) {
+        canon_camera_destroy(camera);
+        free(buffer);
+        return CANON_ERROR_MEMORY;
+    }
+
+    canon_error_t err = canon_camera_connect(camera, result->device_path, &config);
+    if (err == CANON_SUCCESS) {
+        err = canon_camera_start_live_view(camera);
+    }
+    if (err != CANON_SUCCESS) {
+        canon_log(LOG_WARNING, "Calibration: cannot open %s: %s", result->device_path,
+                 canon_error_string(err));
+        canon_camera_destroy(camera);
+        free(buffer);
+        return err;
+    }
+
+    latency_histogram_t fetch;
+    latency_histogram_reset(&fetch);
+    uint64_t bytes = 0;
+    uint64_t last_hash = 0;
+    uint64_t first_new = 0;
+    uint64_t last_new = 0;
+    uint32_t failures = 0;
+
+    uint64_t start = os_gettime_ns();
+    uint64_t end = start + (uint64_t)(seconds * 1e9);
+    uint64_t now = start;
+
+    while (now < end && failures < CALIBRATION_MAX_FAILURES) {
+        size_t size = 0;
+        uint64_t fetch_start = now;
+        err = canon_camera_capture_frame(camera, buffer, CALIBRATION_JPEG_SIZE, &size);
+        now = os_gettime_ns();
+
+        if (err != CANON_SUCCESS) {
+            failures++;
+            if (err == CANON_ERROR_DISCONNECTED) {
+                break;
+            }
+            continue;
+        }
+        failures = 0;
+
+        latency_histogram_record(&fetch, now - fetch_start);
+        result->fetches++;
+        bytes += size;
+
+        uint64_t hash = preview_hash(buffer, size);
+        if (result->fetches > 1 && hash == last_hash) {
+            result->duplicates++;
+            continue;
+        }
+        last_hash = hash;
+        if (!first_new) {
+            first_new = now;
+        }
+        last_new = now;
+
+        uint32_t width, height;
+        if (*sample_count < CALIBRATION_SAMPLES &&
+            jpeg_decoder_probe(buffer, size, &width, &height)) {
+            calibration_sample_t *sample = &samples[*sample_count];
+            sample->jpeg = malloc(size);
+            if (sample->jpeg) {
+                memcpy(sample->jpeg, buffer, size);
+                sample->size = size;
+                sample->width = width;
+                sample->height = height;
+                (*sample_count)++;
+            }
+        }
+    }
+
+    canon_camera_stop_live_view(camera);
+    canon_camera_disconnect(camera);
+    canon_camera_destroy(camera);
+    free(buffer);
+
+    if (result->fetches == 0) {
+        canon_log(LOG_WARNING, "Calibration: no previews from %s: %s", result->device_path,
+                 canon_error_string(err));
+        return err != CANON_SUCCESS ? err : CANON_ERROR_TIMEOUT;
+    }
+
+    double elapsed = (double)(now - start) / 1e9;
+    uint64_t distinct = result->fetches - result->duplicates;
+
+    result->jpeg_bytes = bytes / result->fetches;
+    result->fetch_fps = (double)result->fetches / elapsed;
+    // Spacing of the new previews, which does not count the first one as a refresh
+    result->refresh_fps = distinct > 1 && last_new > first_new
+                              ? (double)(distinct - 1) * 1e9 / (double)(last_new - first_new)
+                              : (double)distinct / elapsed;
+    result->refresh_bound = (double)result->duplicates >
+                            (double)result->fetches * CALIBRATION_DUPLICATE_SHARE;
+    result->fetch_p50_ns = latency_histogram_percentile(&fetch, 50.0);
+    result->fetch_p99_ns = latency_histogram_percentile(&fetch, 99.0);
+    if (*sample_count > 0) {
+        result->width = samples[0].width;
+        result->height = samples[0].height;
+    }
+
+    canon_log(LOG_INFO, "Calibration: %s %ux%u, %.1f fetches/s, %.1f new previews/s, "
+             "fetch %.2f ms p50",
+             result->device_path, result->width, result->height, result->fetch_fps,
+             result->refresh_fps, (double)result->fetch_p50_ns / 1e6);
+    return CANON_SUCCESS;
+}
+
+static int find_geometry(const host_calibration_report_t *report, uint32_t width,
+                         uint32_t height)
+{
+    for (uint32_t i = 0; i < report->geometry_count; i++) {
+        if (report->geometries[i].width == width && report->geometries[i].height == height) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static int add_geometry(host_calibration_report_t *report, uint32_t width, uint32_t height)
+{
+    int index = find_geometry(report, width, height);
+    if (index >= 0 || report->geometry_count == HOST_CALIBRATION_MAX_GEOMETRIES) {
+        return index;
+    }
+
+    host_calibration_geometry_t *geometry = &report->geometries[report->geometry_count];
+    geometry->width = width;
+    geometry->height = height;
+    geometry->best = -1;
+    return (int)report->geometry_count++;
+}
+
+/**
+ * @brief Time every decoder backend on the previews of one size
+ *
+ * Full-size decodes into a packed NV12 buffer, after one untimed decode of
+ * each preview. The median over up to CALIBRATION_DECODES decodes counts.
+ */
+static void time_decoders(host_calibration_geometry_t *geometry,
+                          const calibration_sample_t *samples, uint32_t sample_count)
+{
+    const calibration_sample_t *matching[HOST_CALIBRATION_MAX_CAMERAS * CALIBRATION_SAMPLES];
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < sample_count; i++) {
+        if (samples[i].jpeg && samples[i].width == geometry->width &&
+            samples[i].height == geometry->height) {
+            matching[count++] = &samples[i];
+        }
+    }
+
+    size_t capacity = (size_t)geometry->width * geometry->height * 2;
+    uint8_t *nv12 = malloc(capacity);
+    if (!nv12 || count == 0) {
+        free(nv12);
+        return;
+    }
+
+    for (size_t index = 0; index < jpeg_decoder_backend_count(); index++) {
+        const jpeg_decoder_backend_t *backend = jpeg_decoder_backend_get(index);
+        void *ctx = backend->create ? backend->create() : NULL;
+        if (backend->create && !ctx) {
+            continue;
+        }
+
+        bool ok = true;
+        latency_histogram_t decode;
+        latency_histogram_reset(&decode);
+        uint64_t budget_end = os_gettime_ns() + CALIBRATION_DECODE_BUDGET_NS;
+
+        for (uint32_t n = 0; ok && n < count + CALIBRATION_DECODES; n++) {
+            const calibration_sample_t *sample = matching[n % count];
+            nv12_target_t target = {
+                .y = nv12,
+                .capacity = capacity
+            };
+            uint32_t width, height;
+
+            uint64_t start = os_gettime_ns();
+            ok = backend->decode(ctx, sample->jpeg, sample->size, &target,
+                                 &width, &height) == CANON_SUCCESS;
+            uint64_t end = os_gettime_ns();
+
+            if (n >= count) {
+                latency_histogram_record(&decode, end - start);
+                if (end > budget_end) {
+                    break;
+                }
+            }
+        }
+
+        if (backend->destroy) {
+            backend->destroy(ctx);
+        }
+
+        if (!ok || decode.total == 0) {
+            continue;
+        }
+        geometry->decode_ns[index] = latency_histogram_percentile(&decode, 50.0);
+        if (geometry->best < 0 || geometry->decode_ns[index] < geometry->decode_ns[geometry->best]) {
+            geometry->best = (int)index;
+        }
+    }
+
+    free(nv12);
+}
+
+/* Settings from the solo measurements, with fetch plus decode as the estimate */
+static void recommend(const host_calibration_report_t *report, host_calibration_camera_t *camera)
+{
+    const host_calibration_geometry_t *geometry =
+        camera->geometry >= 0 ? &report->geometries[camera->geometry] : NULL;
+    uint64_t decode_ns = 0;
+
+    if (geometry && geometry->best >= 0) {
+        camera->decoder = jpeg_decoder_backend_get((size_t)geometry->best)->name;
+        decode_ns = geometry->decode_ns[geometry->best];
+    }
+
+    // New previews per second: the camera refresh, where polling faster only
+    // fetches duplicates. A camera that is fetch bound needs some slack
+    // between fetches, or a late fetch misses the next capture tick.
+    if (camera->refresh_bound) {
+        camera->fps = clamp_fps(camera->refresh_fps);
+    } else {
+        camera->fps = clamp_fps(floor(camera->refresh_fps * CALIBRATION_FETCH_HEADROOM));
+    }
+    // Free-running capture sleeps a frame interval after each fetch, so a
+    // slow fetch lowers the rate; the scheduler sleeps to deadlines instead
+    camera->phase_lock = true;
+
+    camera->expected_fps = fmin(camera->refresh_fps, (double)camera->fps);
+    camera->expected_latency_p50_ns = camera->fetch_p50_ns + decode_ns;
+    camera->expected_latency_p99_ns = camera->fetch_p99_ns + decode_ns;
+    camera->expected_cpu_percent = camera->expected_fps * (double)decode_ns / 1e7;
+    camera->expected_bus_mbytes = (double)camera->jpeg_bytes * camera->expected_fps / 1e6;
+}
+
+static void discard_frame(struct obs_source_frame *frame, void *user_data)
+{
+    UNUSED_PARAMETER(frame);
+    UNUSED_PARAMETER(user_data);
+}
+
+/**
+ * @brief Run every measured camera with its recommendation at once
+ *
+ * Each camera gets an async pipeline as a source would, its frames are
+ * dropped after the decode. The first second (connect, decoder setup) is
+ * not counted.
+ */
+static void validate(host_calibration_report_t *report, double seconds)
+{
+    capture_pipeline_t *pipelines[HOST_CALIBRATION_MAX_CAMERAS] = {0};
+    video_source_counters_t before[HOST_CALIBRATION_MAX_CAMERAS];
+    cpu_usage_t cpu_before[HOST_CALIBRATION_MAX_CAMERAS];
+    bool any = false;
+
+    for (uint32_t i = 0; i < report->camera_count; i++) {
+        host_calibration_camera_t *camera = &report->cameras[i];
+        if (camera->status != CANON_SUCCESS) {
+            continue;
+        }
+
+        pipelines[i] = capture_pipeline_create(discard_frame, NULL);
+        if (!pipelines[i]) {
+            continue;
+        }
+
+        capture_pipeline_settings_t settings = {
+            .device_path = camera->device_path,
+            .width = 1920,
+            .height = 1080,
+            .fps = camera->fps,
+            .decoder = camera->decoder,
+            .phase_lock = camera->phase_lock
+        };
+        capture_pipeline_update(pipelines[i], &settings);
+        capture_pipeline_activate(pipelines[i]);
+        any = true;
+    }
+
+    if (any) {
+        os_sleepto_ns(os_gettime_ns() + CALIBRATION_WARMUP_NS);
+
+        for (uint32_t i = 0; i < report->camera_count; i++) {
+            if (pipelines[i]) {
+                video_source_read_counters(capture_pipeline_get_video(pipelines[i]), &before[i]);
+                capture_pipeline_get_cpu(pipelines[i], &cpu_before[i]);
+            }
+        }
+        uint64_t plugin_before = thread_registry_total_ns();
+        uint64_t start = os_gettime_ns();
+
+        os_sleepto_ns(start + (uint64_t)(seconds * 1e9));
+
+        uint64_t wall = os_gettime_ns() - start;
+        uint64_t plugin_spent = thread_registry_total_ns() - plugin_before;
+
+        for (uint32_t i = 0; i < report->camera_count; i++) {
+            host_calibration_camera_t *camera = &report->cameras[i];
+            if (!pipelines[i]) {
+                continue;
+            }
+
+            video_source_counters_t after;
+            cpu_usage_t cpu_after;
+            video_source_read_counters(capture_pipeline_get_video(pipelines[i]), &after);
+            capture_pipeline_get_cpu(pipelines[i], &cpu_after);
+
+            latency_histogram_t latency;
+            latency_histogram_subtract(&latency, &after.latency, &before[i].latency);
+            uint64_t fetches = after.fetch.total - before[i].fetch.total;
+
+            camera->validated = true;
+            camera->expected_fps = (double)(after.frames_delivered - before[i].frames_delivered) *
+                                   1e9 / (double)wall;
+            camera->expected_latency_p50_ns = latency_histogram_percentile(&latency, 50.0);
+            camera->expected_latency_p99_ns = latency_histogram_percentile(&latency, 99.0);
+            camera->expected_cpu_percent = thread_registry_percent(
+                cpu_after.total_ns - cpu_before[i].total_ns, wall);
+            camera->expected_bus_mbytes = (double)fetches * (double)camera->jpeg_bytes *
+                                          1e9 / (double)wall / 1e6;
+        }
+
+        report->validated = true;
+        report->expected_plugin_cpu_percent = thread_registry_percent(plugin_spent, wall) /
+                                              (double)report->cpus;
+    }
+
+    for (uint32_t i = 0; i < report->camera_count; i++) {
+        if (pipelines[i]) {
+            capture_pipeline_deactivate(pipelines[i]);
+            capture_pipeline_destroy(pipelines[i]);
+        }
+    }
+}
+
+/* Lower the rate of cameras that could not keep it next to the others
+ * (shared bus, busy host) to the rate they reached */
+static bool lower_missed_rates(host_calibration_report_t *report)
+{
+    bool lowered = false;
+
+    for (uint32_t i = 0; i < report->camera_count; i++) {
+        host_calibration_camera_t *camera = &report->cameras[i];
+        if (!camera->validated ||
+            camera->expected_fps >= (double)camera->fps * CALIBRATION_SHORTFALL) {
+            continue;
+        }
+
+        uint32_t fps = clamp_fps(floor(camera->expected_fps));
+        if (fps < camera->fps) {
+            canon_log(LOG_INFO, "Calibration: %s reached %.1f fps of %u with all "
+                     "cameras running, recommending %u",
+                     camera->device_path, camera->expected_fps, camera->fps, fps);
+            camera->fps = fps;
+            lowered = true;
+        }
+    }
+
+    return lowered;
+}
+
+double host_calibration_estimate_seconds(uint32_t count,
+                                         const host_calibration_options_t *options)
+{
+    double seconds = options && options->seconds > 0.0 ? options->seconds
+                                                       : CALIBRATION_DEFAULT_SECONDS;
+    bool run_validation = options ? options->validate : true;
+
+    uint32_t geometries = count < HOST_CALIBRATION_MAX_GEOMETRIES
+                              ? count : HOST_CALIBRATION_MAX_GEOMETRIES;
+    double estimate = (double)count * seconds +
+                      (double)geometries * (double)jpeg_decoder_backend_count() *
+                      (double)CALIBRATION_DECODE_BUDGET_NS / 1e9;
+    if (run_validation) {
+        estimate += CALIBRATION_VALIDATION_RUNS *
+                    ((double)CALIBRATION_WARMUP_NS / 1e9 + seconds);
+    }
+    return estimate;
+}
+
+canon_error_t host_calibration_run(const char *const *devices, uint32_t count,
+                                   const host_calibration_options_t *options,
+                                   host_calibration_report_t *report)
+{
+    if (!devices || !report || count == 0 || count > HOST_CALIBRATION_MAX_CAMERAS) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    double seconds = options && options->seconds > 0.0 ? options->seconds
+                                                       : CALIBRATION_DEFAULT_SECONDS;
+    bool run_validation = options ? options->validate : true;
+
+    calibration_sample_t *samples = calloc((size_t)count * CALIBRATION_SAMPLES,
+                                           sizeof(calibration_sample_t));
+    if (!samples) {
+        return CANON_ERROR_MEMORY;
+    }
+
+    memset(report, 0, sizeof(*report));
+    report->cpus = thread_registry_cpu_count();
+    report->camera_count = count;
+    uint64_t start = os_gettime_ns();
+
+    canon_error_t result = CANON_ERROR_INVALID_PARAM;
+    bool measured = false;
+    uint32_t sample_total = count * CALIBRATION_SAMPLES;
+
+    for (uint32_t i = 0; i < count; i++) {
+        host_calibration_camera_t *camera = &report->cameras[i];
+        snprintf(camera->device_path, sizeof(camera->device_path), "%s",
+                 devices[i] ? devices[i] : "");
+        camera->geometry = -1;
+
+        read_usb_topology(camera);
+
+        calibration_sample_t *taken = &samples[i * CALIBRATION_SAMPLES];
+        uint32_t taken_count = 0;
+        camera->status = measure_camera(camera, seconds, taken, &taken_count);
+        if (camera->status == CANON_SUCCESS) {
+            measured = true;
+        } else if (i == 0) {
+            result = camera->status;
+        }
+
+        for (uint32_t n = 0; n < taken_count; n++) {
+            int index = add_geometry(report, taken[n].width, taken[n].height);
+            if (n == 0) {
+                camera->geometry = index;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < report->geometry_count; i++) {
+        time_decoders(&report->geometries[i], samples, sample_total);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        host_calibration_camera_t *camera = &report->cameras[i];
+        for (uint32_t j = 0; camera->bus && j < count; j++) {
+            if (report->cameras[j].bus == camera->bus) {
+                camera->bus_cameras++;
+            }
+        }
+        if (camera->status == CANON_SUCCESS) {
+            recommend(report, camera);
+        }
+    }
+
+    // The expected figures are those of the settings recommended last
+    if (measured && run_validation) {
+        validate(report, seconds);
+        if (lower_missed_rates(report)) {
+            validate(report, seconds);
+        }
+    }
+
+    for (uint32_t i = 0; i < sample_total; i++) {
+        free(samples[i].jpeg);
+    }
+    free(samples);
+
+    report->seconds = (double)(os_gettime_ns() - start) / 1e9;
+    return measured ? CANON_SUCCESS : result;
+}
+
+const host_calibration_camera_t *host_calibration_find(const host_calibration_report_t *report,
+                                                       const char *device_path)
+{
+    if (!report || !device_path) {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < report->camera_count; i++) {
+        if (strcmp(report->cameras[i].device_path, device_path) == 0) {
+            return &report->cameras[i];
+        }
+    }
+    return NULL;
+}
+
+static void append(char *text, size_t size, size_t *length, const char *format, ...)
+{
+    if (*length >= size) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(text + *length, size - *length, format, args);
+    va_end(args);
+
+    if (written > 0) {
+        *length += (size_t)written;
+    }
+}
+
+void host_calibration_format(const host_calibration_report_t *report, char *text, size_t size)
+{
+    if (!text || size == 0) {
+        return;
+    }
+    text[0] = '\0';
+    if (!report) {
+        return;
+    }
+
+    size_t length = 0;
+    append(text, size, &length, "Calibrated in %.0f s on %u CPUs\n", report->seconds,
+           report->cpus);
+
+    for (uint32_t i = 0; i < report->geometry_count; i++) {
+        const host_calibration_geometry_t *geometry = &report->geometries[i];
+        append(text, size, &length, "%ux%u decode:", geometry->width, geometry->height);
+        for (size_t b = 0; b < jpeg_decoder_backend_count(); b++) {
+            if (geometry->decode_ns[b]) {
+                append(text, size, &length, " %s %.2f ms", jpeg_decoder_backend_get(b)->name,
+                       (double)geometry->decode_ns[b] / 1e6);
+            }
+        }
+        if (geometry->best >= 0) {
+            append(text, size, &length, " (%.0f frames/s per core)",
+                   1e9 / (double)geometry->decode_ns[geometry->best]);
+        }
+        append(text, size, &length, "\n");
+    }
+
+    for (uint32_t i = 0; i < report->camera_count; i++) {
+        const host_calibration_camera_t *camera = &report->cameras[i];
+        append(text, size, &length, "%s", camera->device_path);
+        if (camera->bus) {
+            append(text, size, &length, " (bus %u port %s, %u Mbps, %u camera%s on the bus)",
+                   camera->bus, camera->port, camera->speed_mbps, camera->bus_cameras,
+                   camera->bus_cameras == 1 ? "" : "s");
+        }
+        if (camera->status != CANON_SUCCESS) {
+            append(text, size, &length, ": %s\n", canon_error_string(camera->status));
+            continue;
+        }
+
+        append(text, size, &length, ": %ux%u previews of %.0f KB\n"
+               "  fetch %.1f ms p50 / %.1f ms p99, %.1f fetches/s, %.1f new previews/s%s\n",
+               camera->width, camera->height, (double)camera->jpeg_bytes / 1024.0,
+               (double)camera->fetch_p50_ns / 1e6, (double)camera->fetch_p99_ns / 1e6,
+               camera->fetch_fps, camera->refresh_fps,
+               camera->refresh_bound ? " (camera refresh)" : " (fetch bound)");
+        append(text, size, &length, "  Recommended: %u fps, phase lock %s, decoder %s\n",
+               camera->fps, camera->phase_lock ? "on" : "off",
+               camera->decoder ? camera->decoder : "auto");
+        append(text, size, &length, "  Expected%s: %.1f fps, latency %.1f ms p50 / %.1f ms p99, "
+               "CPU %.1f%% of one core, USB %.1f MB/s\n",
+               camera->validated ? "" : " (fetch + decode only)", camera->expected_fps,
+               (double)camera->expected_latency_p50_ns / 1e6,
+               (double)camera->expected_latency_p99_ns / 1e6,
+               camera->expected_cpu_percent, camera->expected_bus_mbytes);
+    }
+
+    if (report->validated) {
+        append(text, size, &length, "All cameras: %.1f%% of %u CPUs, %s the %.0f%% budget\n",
+               report->expected_plugin_cpu_percent, report->cpus,
+               report->expected_plugin_cpu_percent < THREAD_REGISTRY_CPU_BUDGET
+                   ? "within" : "over",
+               THREAD_REGISTRY_CPU_BUDGET);
+    }
+}
+
+bool host_calibration_profile_path(char *path, size_t size)
+{
+    const char *value = getenv("CANON_EOS_HOST_PROFILE");
+    if (value && *value) {
+        snprintf(path, size, "%s", value);
+        return true;
+    }
+
+    value = getenv("XDG_CONFIG_HOME");
+    if (value && *value) {
+        snprintf(path, size, "%s/obs-canon-eos/host-profile.conf", value);
+        return true;
+    }
+
+    value = getenv("HOME");
+    if (value && *value) {
+        snprintf(path, size, "%s/.config/obs-canon-eos/host-profile.conf", value);
+        return true;
+    }
+
+    return false;
+}
+
+/* Create the directories leading to a file, like mkdir -p */
+static void make_parent_dirs(const char *path)
+{
+    char dir[PROFILE_LINE_SIZE];
+    snprintf(dir, sizeof(dir), "%s", path);
+
+    for (char *slash = strchr(dir + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(dir, 0700);
+        *slash = '/';
+    }
+}
+
+/* Whether an existing profile line is superseded by the report */
+static bool profile_line_replaced(const host_calibration_report_t *report, const char *line)
+{
+    char key[16];
+    char value[HOST_CALIBRATION_PATH_SIZE];
+    unsigned int width, height;
+
+    if (line[0] == '#' || line[0] == '\n' || sscanf(line, "%15s", key) != 1) {
+        return true;
+    }
+    if (strcmp(key, "host") == 0) {
+        return true;
+    }
+    if (strcmp(key, "decoder") == 0 && sscanf(line, "decoder %ux%u", &width, &height) == 2) {
+        int index = find_geometry(report, width, height);
+        return index >= 0 && report->geometries[index].best >= 0;
+    }
+    if (strcmp(key, "camera") == 0 && sscanf(line, "camera %255s", value) == 1) {
+        const host_calibration_camera_t *camera = host_calibration_find(report, value);
+        return camera && camera->status == CANON_SUCCESS;
+    }
+    return false;
+}
+
+static void write_profile(const host_calibration_report_t *report, FILE *file, FILE *previous)
+{
+    fprintf(file, "# obs-canon-eos host profile, written by the calibration\n"
+                  "# decoder WIDTHxHEIGHT BACKEND MS: used by sources on \"auto\"\n"
+                  "# camera DEVICE ...: recommended source settings and what to expect\n");
+    fprintf(file, "host cpus=%u plugin_cpu=%.1f\n", report->cpus,
+            report->expected_plugin_cpu_percent);
+
+    for (uint32_t i = 0; i < report->geometry_count; i++) {
+        const host_calibration_geometry_t *geometry = &report->geometries[i];
+        if (geometry->best >= 0) {
+            fprintf(file, "decoder %ux%u %s %.2f\n", geometry->width, geometry->height,
+                    jpeg_decoder_backend_get((size_t)geometry->best)->name,
+                    (double)geometry->decode_ns[geometry->best] / 1e6);
+        }
+    }
+
+    for (uint32_t i = 0; i < report->camera_count; i++) {
+        const host_calibration_camera_t *camera = &report->cameras[i];
+        if (camera->status != CANON_SUCCESS) {
+            continue;
+        }
+        fprintf(file, "camera %s fps=%u phase_lock=%d decoder=%s preview=%ux%u "
+                      "refresh_fps=%.1f fetch_ms=%.2f latency_ms=%.2f cpu=%.1f port=%s\n",
+                camera->device_path, camera->fps, camera->phase_lock ? 1 : 0,
+                camera->decoder ? camera->decoder : "auto", camera->width, camera->height,
+                camera->refresh_fps, (double)camera->fetch_p50_ns / 1e6,
+                (double)camera->expected_latency_p50_ns / 1e6, camera->expected_cpu_percent,
+                camera->port[0] ? camera->port : "-");
+    }
+
+    char line[PROFILE_LINE_SIZE];
+    while (previous && fgets(line, sizeof(line), previous)) {
+        if (!profile_line_replaced(report, line)) {
+            fputs(line, file);
+        }
+    }
+}
+
+canon_error_t host_calibration_write_profile(const host_calibration_report_t *report,
+                                             const char *path)
+{
+    if (!report || !path || !*path) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    char temp_path[PROFILE_LINE_SIZE];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    make_parent_dirs(path);
+
+    int error = 0;
+    FILE *file = fopen(temp_path, "w");
+    if (file) {
+        FILE *previous = fopen(path, "r");
+        write_profile(report, file, previous);
+        if (previous) {
+            fclose(previous);
+        }
+        if (ferror(file)) {
+            error = errno ? errno : EIO;
+        }
+        if (fclose(file) != 0 && !error) {
+            error = errno;
+        }
+        if (!error && rename(temp_path, path) != 0) {
+            error = errno;
+        }
+        if (error) {
+            remove(temp_path);
+        }
+    } else {
+        error = errno;
+    }
+
+    if (error) {
+        canon_log(LOG_WARNING, "Failed to write host profile %s: %s", path, strerror(error));
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    canon_log(LOG_INFO, "Host profile written to %s", path);
+    return CANON_SUCCESS;
+}
+
+int host_calibration_load_profile(const char *path)
+{
+    FILE *file = path ? fopen(path, "r") : NULL;
+    if (!file) {
+        return 0;
+    }
+
+    int loaded = 0;
+    char line[PROFILE_LINE_SIZE];
+    while (fgets(line, sizeof(line), file)) {
+        unsigned int width, height;
+        char name[64];
+        if (sscanf(line, "decoder %ux%u %63s", &width, &height, name) == 3 &&
+            video_source_prefer_decoder(width, height, name) == CANON_SUCCESS) {
+            loaded++;
+        }
+    }
+    fclose(file);
+
+    if (loaded > 0) {
+        canon_log(LOG_INFO, "Host profile %s: decoders for %d preview sizes", path, loaded);
+    }
+    return loaded;
+}
@@ -0,0 +1,195 @@
+#ifndef HOST_CALIBRATION_H
+#define HOST_CALIBRATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "canon-errors.h"
+#include "jpeg-decoder.h"
+
+/**
+ * @brief One-shot measurement of this host and its cameras, and the
+ *        pipeline settings it suggests
+ *
+ * Each camera is measured on its own. Its previews are fetched back to
+ * back for a few seconds, which gives the fetch latency, the fastest fetch
+ * rate and, from the previews that came back unchanged, how often the
+ * camera refreshes its live view. Every preview size seen is then decoded
+ * with each JPEG decoder backend on this host. The camera's USB bus, port
+ * and link speed are read from sysfs.
+ *
+ * Per camera this recommends the fastest decoder for its preview size, a
+ * frame rate matching what the camera delivers (with some slack if the
+ * fetches are the limit), and phase-locked polling, which also keeps a
+ * camera with slow fetches at its frame rate. A validation run then
+ * captures from all cameras at once with those settings through the normal
+ * pipeline, so the expected latency and CPU include fetch contention on
+ * shared buses. A camera that falls short of its rate there gets the rate
+ * it reached, and the run is repeated with that rate.
+ *
+ * The results go to a host profile. Its decoder lines are loaded when the
+ * plugin starts, so sources on "auto" skip decoder calibration for those
+ * preview sizes; its camera lines record the recommended settings.
+ *
+ * Does not depend on the OBS core, so benchmarks can drive it directly.
+ * Takes the cameras for the duration of the run.
+ */
+
+#define HOST_CALIBRATION_MAX_CAMERAS 16
+#define HOST_CALIBRATION_MAX_GEOMETRIES 8
+#define HOST_CALIBRATION_PATH_SIZE 256
+
+/**
+ * @brief What to measure
+ */
+typedef struct {
+    double seconds;         /**< Fetch and validation time per camera, 0 = 3 s */
+    bool validate;          /**< Run the recommended settings on all cameras together */
+} host_calibration_options_t;
+
+/**
+ * @brief Decode cost of one preview size on this host
+ */
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint64_t decode_ns[JPEG_DECODER_MAX_BACKENDS];  /**< Median full decode, 0 = backend failed */
+    int best;                                       /**< Fastest backend, -1 if none decoded */
+} host_calibration_geometry_t;
+
+/**
+ * @brief Measurements and recommended settings of one camera
+ */
+typedef struct {
+    char device_path[HOST_CALIBRATION_PATH_SIZE];
+    canon_error_t status;           /**< CANON_SUCCESS if the camera was measured */
+
+    // USB topology (sysfs), bus 0 if unknown
+    uint32_t bus;
+    uint32_t address;
+    uint32_t speed_mbps;            /**< Negotiated link speed */
+    char port[32];                  /**< Port chain, e.g. "1-2.3" */
+    uint32_t bus_cameras;           /**< Measured cameras on the same bus, this one included */
+
+    // Preview, fetched back to back
+    uint32_t width;
+    uint32_t height;
+    int geometry;                   /**< Index into the report's geometries, -1 if unknown */
+    uint64_t jpeg_bytes;            /**< Mean preview size */
+    uint64_t fetches;
+    uint64_t duplicates;            /**< Fetches that returned the previous preview */
+    double fetch_fps;               /**< Fetches per second */
+    double refresh_fps;             /**< New previews per second */
+    bool refresh_bound;             /**< Camera refreshes slower than it can be fetched */
+    uint64_t fetch_p50_ns;
+    uint64_t fetch_p99_ns;
+
+    // Recommendation
+    const char *decoder;            /**< Backend name, NULL if no backend decoded the preview */
+    uint32_t fps;
+    bool phase_lock;
+
+    // Expected with the recommendation; measured if validated, otherwise
+    // fetch plus decode only
+    bool validated;
+    double expected_fps;
+    uint64_t expected_latency_p50_ns;   /**< Fetch start to frame hand-off */
+    uint64_t expected_latency_p99_ns;
+    double expected_cpu_percent;        /**< Of one core */
+    double expected_bus_mbytes;         /**< Preview data over USB per second */
+} host_calibration_camera_t;
+
+/**
+ * @brief Result of a calibration run
+ */
+typedef struct {
+    uint32_t cpus;
+    double seconds;                     /**< Wall time of the whole run */
+    uint32_t camera_count;
+    host_calibration_camera_t cameras[HOST_CALIBRATION_MAX_CAMERAS];
+    uint32_t geometry_count;
+    host_calibration_geometry_t geometries[HOST_CALIBRATION_MAX_GEOMETRIES];
+    bool validated;
+    double expected_plugin_cpu_percent; /**< All cameras, of the whole machine (NFR-002) */
+} host_calibration_report_t;
+
+/**
+ * @brief Measure the cameras and this host
+ *
+ * Blocks for about seconds per camera, plus one or two validation runs of
+ * seconds each. The cameras must not be in use by a source.
+ * @param devices Device paths
+ * @param count Number of devices (at most HOST_CALIBRATION_MAX_CAMERAS)
+ * @param options What to measure (may be NULL for the defaults)
+ * @param report Output report
+ * @return CANON_SUCCESS if at least one camera was measured, otherwise the
+ *         first camera's error
+ */
+canon_error_t host_calibration_run(const char *const *devices, uint32_t count,
+                                   const host_calibration_options_t *options,
+                                   host_calibration_report_t *report);
+
+/**
+ * @brief Upper bound of how long host_calibration_run() blocks
+ *
+ * Adds up its phases: the fetch measurement of each camera, the decode
+ * budget of each backend for each preview size (one per camera assumed),
+ * and, if validating, a warm-up and measurement for the validation run and
+ * for the re-validation after lowering a missed frame rate.
+ * @param count Number of devices
+ * @param options What to measure (may be NULL for the defaults)
+ * @return Seconds
+ */
+double host_calibration_estimate_seconds(uint32_t count,
+                                         const host_calibration_options_t *options);
+
+/**
+ * @brief Find a camera in a report
+ * @param report Report
+ * @param device_path Device path
+ * @return Camera, or NULL if it was not calibrated
+ */
+const host_calibration_camera_t *host_calibration_find(const host_calibration_report_t *report,
+                                                       const char *device_path);
+
+/**
+ * @brief Describe a report for people
+ * @param report Report
+ * @param text Output buffer
+ * @param size Output buffer size
+ */
+void host_calibration_format(const host_calibration_report_t *report, char *text, size_t size);
+
+/**
+ * @brief Get the host profile path
+ *
+ * CANON_EOS_HOST_PROFILE if set, otherwise
+ * $XDG_CONFIG_HOME/obs-canon-eos/host-profile.conf (~/.config by default).
+ * @param path Output buffer
+ * @param size Output buffer size
+ * @return true if a path was found
+ */
+bool host_calibration_profile_path(char *path, size_t size);
+
+/**
+ * @brief Merge a report into the host profile
+ *
+ * Entries for preview sizes and cameras that were not calibrated again are
+ * kept. The file is replaced atomically.
+ * @param report Report
+ * @param path Profile path
+ * @return CANON_SUCCESS or CANON_ERROR_UNKNOWN if it could not be written
+ */
+canon_error_t host_calibration_write_profile(const host_calibration_report_t *report,
+                                             const char *path);
+
+/**
+ * @brief Load the decoder choices of a host profile
+ *
+ * See video_source_prefer_decoder().
+ * @param path Profile path
+ * @return Number of preview sizes loaded, 0 if there is no profile
+ */
+int host_calibration_load_profile(const char *path);
+
+#endif /* HOST_CALIBRATION_H */
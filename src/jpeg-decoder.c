@@ -0,0 +1,666 @@
+#include "jpeg-decoder.h"
+#include "utils/logging.h"
+#include "utils/trace-recorder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+#include <setjmp.h>
+
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+/**
+ * @brief libjpeg error manager that returns control instead of exiting
+ */
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+} jpeg_error_handler_t;
+
+static void jpeg_error_exit(j_common_ptr cinfo)
+{
+    jpeg_error_handler_t *handler = (jpeg_error_handler_t *)cinfo->err;
+    char message[JMSG_LENGTH_MAX];
+
+    (*cinfo->err->format_message)(cinfo, message);
+    canon_log(LOG_ERROR, "JPEG decode error: %s", message);
+
+    longjmp(handler->setjmp_buffer, 1);
+}
+
+/**
+ * @brief Resolve the target planes for a frame of the given size
+ * @return false if the frame does not fit
+ */
+static bool nv12_target_fit(nv12_target_t *target, uint32_t width, uint32_t height)
+{
+    if (!target->uv) {
+        if ((size_t)width * height + (size_t)width * ((height + 1) / 2) > target->capacity) {
+            return false;
+        }
+        target->linesize = width;
+        target->max_height = height;
+        target->uv = target->y + (size_t)width * height;
+        return true;
+    }
+
+    return width <= target->linesize && height <= target->max_height;
+}
+
+/* DCT scaling requested by the target (see nv12_target_t) */
+static void set_scale(struct jpeg_decompress_struct *cinfo, const nv12_target_t *target)
+{
+    if (target->scale > 1) {
+        cinfo->scale_num = 1;
+        cinfo->scale_denom = target->scale;
+    }
+}
+
+/* ---- libjpeg, RGB output + software color conversion ---- */
+
+static canon_error_t libjpeg_rgb_decode(void *ctx, const uint8_t *jpeg_data, size_t jpeg_size,
+                                        nv12_target_t *target, uint32_t *width, uint32_t *height)
+{
+    UNUSED_PARAMETER(ctx);
+    struct jpeg_decompress_struct cinfo;
+    jpeg_error_handler_t jerr;
+    uint8_t *volatile rgb_data = NULL;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        free(rgb_data);
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    jpeg_create_decompress(&cinfo);
+
+    jpeg_mem_src(&cinfo, (unsigned char *)jpeg_data, jpeg_size);
+
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+        canon_log(LOG_ERROR, "Failed to read JPEG header");
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    cinfo.out_color_space = JCS_RGB;
+    // Context-free chroma upsampling keeps band decodes identical to full ones
+    cinfo.do_fancy_upsampling = FALSE;
+    set_scale(&cinfo, target);
+    jpeg_start_decompress(&cinfo);
+
+    // Use actual JPEG dimensions, not requested dimensions
+    uint32_t actual_width = cinfo.output_width;
+    uint32_t actual_height = cinfo.output_height;
+
+    if (!nv12_target_fit(target, actual_width, actual_height)) {
+        canon_log(LOG_ERROR, "JPEG too large for frame buffer: %ux%u",
+                 actual_width, actual_height);
+        jpeg_destroy_decompress(&cinfo);
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    *width = actual_width;
+    *height = actual_height;
+
+    uint8_t *y_plane = target->y;
+    uint8_t *uv_plane = target->uv;
+    uint32_t linesize = target->linesize;
+
+    uint32_t row_stride = cinfo.output_width * cinfo.output_components;
+    JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)
+        ((j_common_ptr)&cinfo, JPOOL_IMAGE, row_stride, 1);
+
+    // Allocate RGB buffer
+    rgb_data = malloc(actual_width * actual_height * 3);
+    if (!rgb_data) {
+        jpeg_destroy_decompress(&cinfo);
+        return CANON_ERROR_MEMORY;
+    }
+
+    // Read JPEG into RGB
+    uint32_t row = 0;
+    while (cinfo.output_scanline < cinfo.output_height) {
+        jpeg_read_scanlines(&cinfo, buffer, 1);
+        memcpy(rgb_data + (row * actual_width * 3), buffer[0], actual_width * 3);
+        row++;
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    uint64_t span = trace_begin();
+
+    // Process Y plane
+    for (uint32_t i = 0; i < actual_height; i++) {
+        for (uint32_t j = 0; j < actual_width; j++) {
+            uint32_t rgb_idx = (i * actual_width + j) * 3;
+            uint8_t r = rgb_data[rgb_idx];
+            uint8_t g = rgb_data[rgb_idx + 1];
+            uint8_t b = rgb_data[rgb_idx + 2];
+
+            // RGB to Y
+            y_plane[i * linesize + j] = (uint8_t)(0.299 * r + 0.587 * g + 0.114 * b);
+        }
+    }
+
+    // Process UV plane (subsampled 2x2)
+    // NV12: UV plane is half height, half width, but U and V are interleaved
+    // So each UV row has 'actual_width' bytes (actual_width/2 UV pairs * 2 bytes per pair)
+    for (uint32_t i = 0; i < actual_height; i += 2) {
+        for (uint32_t j = 0; j < actual_width; j += 2) {
+            uint32_t rgb_idx = (i * actual_width + j) * 3;
+            uint8_t r = rgb_data[rgb_idx];
+            uint8_t g = rgb_data[rgb_idx + 1];
+            uint8_t b = rgb_data[rgb_idx + 2];
+
+            // UV plane index: row * linesize + column * 2 (for interleaved UV)
+            uint32_t uv_row = i / 2;
+            uint32_t uv_col = j / 2;
+            uint32_t uv_idx = uv_row * linesize + uv_col * 2;
+
+            uv_plane[uv_idx] = (uint8_t)(-0.169 * r - 0.331 * g + 0.5 * b + 128);     // U
+            uv_plane[uv_idx + 1] = (uint8_t)(0.5 * r - 0.419 * g - 0.081 * b + 128);  // V
+        }
+    }
+
+    trace_end(TRACE_CONVERT, span, (uint64_t)actual_width * actual_height);
+
+    free(rgb_data);
+    return CANON_SUCCESS;
+}
+
+/* ---- libjpeg-turbo, raw YCbCr output straight into NV12 ---- */
+
+/**
+ * @brief Write one luma row and, on even rows, one interleaved chroma row
+ *
+ * JPEG YCbCr is full-range BT.601, which is exactly what the RGB path
+ * computes, so the planes are copied without any color math.
+ */
+static void raw_rows_to_nv12(const nv12_target_t *target, uint32_t width,
+                             uint32_t y, const uint8_t *luma,
+                             const uint8_t *cb, const uint8_t *cr, uint32_t chroma_step)
+{
+    memcpy(target->y + (size_t)y * target->linesize, luma, width);
+
+    if (y & 1) {
+        return;
+    }
+
+    uint8_t *uv = target->uv + (size_t)(y / 2) * target->linesize;
+    uint32_t pairs = (width + 1) / 2;
+
+    if (!cb) {
+        memset(uv, 128, pairs * 2);
+        return;
+    }
+
+    for (uint32_t x = 0; x < pairs; x++) {
+        uv[x * 2] = cb[x * chroma_step];
+        uv[x * 2 + 1] = cr[x * chroma_step];
+    }
+}
+
+static canon_error_t libjpeg_raw_decode(void *ctx, const uint8_t *jpeg_data, size_t jpeg_size,
+                                        nv12_target_t *target, uint32_t *width, uint32_t *height)
+{
+    UNUSED_PARAMETER(ctx);
+    struct jpeg_decompress_struct cinfo;
+    jpeg_error_handler_t jerr;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char *)jpeg_data, jpeg_size);
+
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    int components = cinfo.num_components;
+    int h_max = cinfo.comp_info[0].h_samp_factor;
+    int v_max = cinfo.comp_info[0].v_samp_factor;
+    bool supported = components == 1 ||
+        (components == 3 && cinfo.jpeg_color_space == JCS_YCbCr &&
+         h_max <= 2 && v_max <= 2 &&
+         cinfo.comp_info[1].h_samp_factor == 1 && cinfo.comp_info[1].v_samp_factor == 1 &&
+         cinfo.comp_info[2].h_samp_factor == 1 && cinfo.comp_info[2].v_samp_factor == 1);
+
+    if (!supported) {
+        jpeg_destroy_decompress(&cinfo);
+        return CANON_ERROR_NOT_SUPPORTED;
+    }
+
+    cinfo.raw_data_out = TRUE;
+    set_scale(&cinfo, target);
+    jpeg_start_decompress(&cinfo);
+
+    uint32_t actual_width = cinfo.output_width;
+    uint32_t actual_height = cinfo.output_height;
+
+    if (!nv12_target_fit(target, actual_width, actual_height)) {
+        canon_log(LOG_ERROR, "JPEG too large for frame buffer: %ux%u",
+                 actual_width, actual_height);
+        jpeg_destroy_decompress(&cinfo);
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    *width = actual_width;
+    *height = actual_height;
+
+    /*
+     * With DCT scaling, libjpeg-turbo decodes subsampled chroma at a larger
+     * block size instead of upsampling it later, so the chroma planes can
+     * come out at luma resolution: use each component's own block size.
+     */
+    int h_size[3] = {0, 0, 0};
+    int v_size[3] = {0, 0, 0};
+    JSAMPARRAY planes[3] = {NULL, NULL, NULL};
+    for (int c = 0; c < components; c++) {
+        jpeg_component_info *comp = &cinfo.comp_info[c];
+#if JPEG_LIB_VERSION >= 70
+        h_size[c] = comp->DCT_h_scaled_size;
+        v_size[c] = comp->DCT_v_scaled_size;
+#else
+        h_size[c] = comp->DCT_scaled_size;
+        v_size[c] = comp->DCT_scaled_size;
+#endif
+        planes[c] = (*cinfo.mem->alloc_sarray)((j_common_ptr)&cinfo, JPOOL_IMAGE,
+                                              comp->width_in_blocks * h_size[c],
+                                              comp->v_samp_factor * v_size[c]);
+    }
+    int imcu_rows = cinfo.max_v_samp_factor * v_size[0];
+
+    /* Chroma planes are half width/height for 4:2:x and full for 4:4:x */
+    bool chroma_half_width = components == 3 && h_max * h_size[0] == 2 * h_size[1];
+    bool chroma_half_height = components == 3 && v_max * v_size[0] == 2 * v_size[1];
+    uint32_t chroma_step = chroma_half_width ? 1 : 2;
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+        uint32_t base = cinfo.output_scanline;
+        jpeg_read_raw_data(&cinfo, planes, imcu_rows);
+
+        uint32_t rows = actual_height - base;
+        if (rows > (uint32_t)imcu_rows) {
+            rows = imcu_rows;
+        }
+
+        for (uint32_t r = 0; r < rows; r++) {
+            const uint8_t *cb = NULL;
+            const uint8_t *cr = NULL;
+            if (components == 3) {
+                uint32_t chroma_row = chroma_half_height ? r / 2 : r;
+                cb = planes[1][chroma_row];
+                cr = planes[2][chroma_row];
+            }
+            raw_rows_to_nv12(target, actual_width, base + r, planes[0][r], cb, cr, chroma_step);
+        }
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return CANON_SUCCESS;
+}
+
+/* ---- TurboJPEG 3 planar YUV ---- */
+
+#ifdef HAVE_TURBOJPEG
+typedef struct {
+    tjhandle handle;
+    uint8_t *chroma;
+    size_t chroma_size;
+} turbojpeg_ctx_t;
+
+static void *turbojpeg_create(void)
+{
+    turbojpeg_ctx_t *ctx = calloc(1, sizeof(turbojpeg_ctx_t));
+    if (!ctx) {
+        return NULL;
+    }
+
+    ctx->handle = tj3Init(TJINIT_DECOMPRESS);
+    if (!ctx->handle) {
+        free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+static void turbojpeg_destroy(void *data)
+{
+    turbojpeg_ctx_t *ctx = data;
+    if (!ctx) {
+        return;
+    }
+
+    tj3Destroy(ctx->handle);
+    free(ctx->chroma);
+    free(ctx);
+}
+
+static size_t turbojpeg_memory_usage(void *data)
+{
+    turbojpeg_ctx_t *ctx = data;
+    return ctx ? sizeof(turbojpeg_ctx_t) + ctx->chroma_size : 0;
+}
+
+static canon_error_t turbojpeg_decode(void *data, const uint8_t *jpeg_data, size_t jpeg_size,
+                                      nv12_target_t *target, uint32_t *width, uint32_t *height)
+{
+    turbojpeg_ctx_t *ctx = data;
+
+    if (tj3DecompressHeader(ctx->handle, jpeg_data, jpeg_size) < 0) {
+        canon_log(LOG_ERROR, "TurboJPEG header error: %s", tj3GetErrorStr(ctx->handle));
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    int subsamp = tj3Get(ctx->handle, TJPARAM_SUBSAMP);
+    if (subsamp != TJSAMP_420 && subsamp != TJSAMP_422 &&
+        subsamp != TJSAMP_444 && subsamp != TJSAMP_GRAY) {
+        return CANON_ERROR_NOT_SUPPORTED;
+    }
+
+    uint32_t scale = target->scale > 1 ? target->scale : 1;
+    tjscalingfactor factor = {1, (int)scale};
+    if (tj3SetScalingFactor(ctx->handle, factor) < 0) {
+        return CANON_ERROR_NOT_SUPPORTED;
+    }
+
+    uint32_t actual_width = ((uint32_t)tj3Get(ctx->handle, TJPARAM_JPEGWIDTH) + scale - 1) / scale;
+    uint32_t actual_height = ((uint32_t)tj3Get(ctx->handle, TJPARAM_JPEGHEIGHT) + scale - 1) / scale;
+
+    if (!nv12_target_fit(target, actual_width, actual_height)) {
+        canon_log(LOG_ERROR, "JPEG too large for frame buffer: %ux%u",
+                 actual_width, actual_height);
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    unsigned char *planes[3] = {target->y, NULL, NULL};
+    int strides[3] = {(int)target->linesize, 0, 0};
+    uint32_t chroma_width = 0;
+    uint32_t chroma_height = 0;
+
+    if (subsamp != TJSAMP_GRAY) {
+        chroma_width = (uint32_t)tj3YUVPlaneWidth(1, (int)actual_width, subsamp);
+        chroma_height = (uint32_t)tj3YUVPlaneHeight(1, (int)actual_height, subsamp);
+
+        size_t needed = (size_t)chroma_width * chroma_height * 2;
+        if (needed > ctx->chroma_size) {
+            uint8_t *chroma = realloc(ctx->chroma, needed);
+            if (!chroma) {
+                return CANON_ERROR_MEMORY;
+            }
+            ctx->chroma = chroma;
+            ctx->chroma_size = needed;
+        }
+
+        planes[1] = ctx->chroma;
+        planes[2] = ctx->chroma + (size_t)chroma_width * chroma_height;
+        strides[1] = (int)chroma_width;
+        strides[2] = (int)chroma_width;
+    }
+
+    if (tj3DecompressToYUVPlanes8(ctx->handle, jpeg_data, jpeg_size, planes, strides) < 0) {
+        canon_log(LOG_ERROR, "TurboJPEG decode error: %s", tj3GetErrorStr(ctx->handle));
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    uint64_t span = trace_begin();
+    uint32_t pairs = (actual_width + 1) / 2;
+    for (uint32_t y = 0; y < actual_height; y += 2) {
+        uint8_t *uv = target->uv + (size_t)(y / 2) * target->linesize;
+
+        if (subsamp == TJSAMP_GRAY) {
+            memset(uv, 128, pairs * 2);
+            continue;
+        }
+
+        uint32_t chroma_row = (chroma_height < actual_height) ? y / 2 : y;
+        uint32_t chroma_step = (chroma_width < actual_width) ? 1 : 2;
+        const uint8_t *cb = planes[1] + (size_t)chroma_row * chroma_width;
+        const uint8_t *cr = planes[2] + (size_t)chroma_row * chroma_width;
+
+        for (uint32_t x = 0; x < pairs; x++) {
+            uv[x * 2] = cb[x * chroma_step];
+            uv[x * 2 + 1] = cr[x * chroma_step];
+        }
+    }
+
+    trace_end(TRACE_CONVERT, span, (uint64_t)actual_width * actual_height);
+
+    *width = actual_width;
+    *height = actual_height;
+    return CANON_SUCCESS;
+}
+#endif
+
+static const jpeg_decoder_backend_t g_backends[] = {
+    {
+        .name = "libjpeg-raw",
+        .description = "libjpeg-turbo raw YCbCr",
+        .decode = libjpeg_raw_decode,
+    },
+#ifdef HAVE_TURBOJPEG
+    {
+        .name = "turbojpeg",
+        .description = "TurboJPEG 3 planar YUV",
+        .create = turbojpeg_create,
+        .destroy = turbojpeg_destroy,
+        .decode = turbojpeg_decode,
+        .memory_usage = turbojpeg_memory_usage,
+    },
+#endif
+    /* Must stay last: jpeg_decoder_backend_fallback() */
+    {
+        .name = "libjpeg-rgb",
+        .description = "libjpeg RGB + software conversion",
+        .decode = libjpeg_rgb_decode,
+    },
+};
+
+#define BACKEND_COUNT (sizeof(g_backends) / sizeof(g_backends[0]))
+
+size_t jpeg_decoder_backend_count(void)
+{
+    return BACKEND_COUNT;
+}
+
+const jpeg_decoder_backend_t *jpeg_decoder_backend_get(size_t index)
+{
+    if (index >= BACKEND_COUNT) {
+        return NULL;
+    }
+    return &g_backends[index];
+}
+
+int jpeg_decoder_backend_fallback(void)
+{
+    return (int)BACKEND_COUNT - 1;
+}
+
+int jpeg_decoder_backend_find(const char *name)
+{
+    if (!name) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < BACKEND_COUNT; i++) {
+        if (strcmp(g_backends[i].name, name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+canon_error_t jpeg_decoder_decode_region(const uint8_t *jpeg, size_t size,
+                                         const jpeg_region_t *region, nv12_target_t *target,
+                                         uint32_t *width, uint32_t *height)
+{
+    struct jpeg_decompress_struct cinfo;
+    jpeg_error_handler_t jerr;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char *)jpeg, size);
+
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    // YCbCr straight through, as in libjpeg_raw_decode(); scanline output
+    // is what the crop and skip calls work on
+    int components = cinfo.num_components == 1 ? 1 : 3;
+    cinfo.out_color_space = components == 1 ? JCS_GRAYSCALE : JCS_YCbCr;
+    cinfo.do_fancy_upsampling = FALSE;
+    set_scale(&cinfo, target);
+    jpeg_start_decompress(&cinfo);
+
+    uint32_t scale = target->scale > 1 ? target->scale : 1;
+    uint32_t x = (region->x / scale) & ~1u;
+    uint32_t y = (region->y / scale) & ~1u;
+    if (x >= cinfo.output_width || y >= cinfo.output_height) {
+        jpeg_destroy_decompress(&cinfo);
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    uint32_t crop_width = cinfo.output_width - x;
+    uint32_t crop_height = cinfo.output_height - y;
+    if ((region->width + scale - 1) / scale < crop_width) {
+        crop_width = (region->width + scale - 1) / scale;
+    }
+    if ((region->height + scale - 1) / scale < crop_height) {
+        crop_height = (region->height + scale - 1) / scale;
+    }
+    crop_width &= ~1u;
+    crop_height &= ~1u;
+
+    if (crop_width == 0 || crop_height == 0) {
+        jpeg_destroy_decompress(&cinfo);
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    if (!nv12_target_fit(target, crop_width, crop_height)) {
+        canon_log(LOG_ERROR, "JPEG region too large for frame buffer: %ux%u",
+                 crop_width, crop_height);
+        jpeg_destroy_decompress(&cinfo);
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    // Column of the region within each output row
+    uint32_t column = x;
+#ifdef LIBJPEG_TURBO_VERSION
+    JDIMENSION first_column = x;
+    JDIMENSION columns = crop_width;
+    jpeg_crop_scanline(&cinfo, &first_column, &columns);
+    column = x - first_column;
+#endif
+
+    JSAMPARRAY row = (*cinfo.mem->alloc_sarray)((j_common_ptr)&cinfo, JPOOL_IMAGE,
+                                               cinfo.output_width * components, 1);
+
+#ifdef LIBJPEG_TURBO_VERSION
+    if (y > 0) {
+        jpeg_skip_scanlines(&cinfo, y);
+    }
+#endif
+    while (cinfo.output_scanline < y) {
+        jpeg_read_scanlines(&cinfo, row, 1);
+    }
+
+    uint32_t pairs = crop_width / 2;
+    for (uint32_t r = 0; r < crop_height; r++) {
+        jpeg_read_scanlines(&cinfo, row, 1);
+
+        const uint8_t *pixels = row[0] + (size_t)column * components;
+        uint8_t *luma = target->y + (size_t)r * target->linesize;
+        uint8_t *uv = (r & 1) ? NULL : target->uv + (size_t)(r / 2) * target->linesize;
+
+        if (components == 1) {
+            memcpy(luma, pixels, crop_width);
+            if (uv) {
+                memset(uv, 128, crop_width);
+            }
+            continue;
+        }
+
+        for (uint32_t i = 0; i < crop_width; i++) {
+            luma[i] = pixels[i * 3];
+        }
+        if (uv) {
+            for (uint32_t i = 0; i < pairs; i++) {
+                uv[i * 2] = pixels[i * 6 + 1];
+                uv[i * 2 + 1] = pixels[i * 6 + 2];
+            }
+        }
+    }
+
+    // Rows below the region are never decoded
+    jpeg_destroy_decompress(&cinfo);
+
+    *width = crop_width;
+    *height = crop_height;
+    return CANON_SUCCESS;
+}
+
+bool jpeg_decoder_probe(const uint8_t *jpeg, size_t size,
+                        uint32_t *width, uint32_t *height)
+{
+    if (!jpeg || size < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) {
+        return false;
+    }
+
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (jpeg[pos] != 0xFF) {
+            return false;
+        }
+
+        uint8_t marker = jpeg[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+
+        size_t length = ((size_t)jpeg[pos + 2] << 8) | jpeg[pos + 3];
+        if (length < 2 || pos + 2 + length > size) {
+            return false;
+        }
+
+        /* SOF0..SOF15 except DHT, JPG and DAC */
+        if (marker >= 0xC0 && marker <= 0xCF &&
+            marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (length < 7) {
+                return false;
+            }
+            *height = ((uint32_t)jpeg[pos + 5] << 8) | jpeg[pos + 6];
+            *width = ((uint32_t)jpeg[pos + 7] << 8) | jpeg[pos + 8];
+            return true;
+        }
+
+        if (marker == 0xDA) {
+            return false;
+        }
+
+        pos += 2 + length;
+    }
+
+    return false;
+}
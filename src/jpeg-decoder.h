@@ -0,0 +1,116 @@
+#ifndef JPEG_DECODER_H
+#define JPEG_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "canon-errors.h"
+
+#define JPEG_DECODER_MAX_BACKENDS 4
+
+/**
+ * @brief Destination planes for an NV12 decode
+ *
+ * When uv is NULL the frame is packed at y using the decoded width as
+ * stride, limited to capacity bytes. Otherwise rows are written with the
+ * given linesize and at most max_height rows are produced. A scale of 2, 4
+ * or 8 decodes at that fraction of the JPEG size (DCT scaling, rounded up),
+ * which skips most of the IDCT work; 0 and 1 decode at full size.
+ */
+typedef struct {
+    uint8_t *y;
+    uint8_t *uv;
+    uint32_t linesize;
+    uint32_t max_height;
+    size_t capacity;
+    uint32_t scale;
+} nv12_target_t;
+
+/**
+ * @brief Rectangle of an image, in pixels
+ */
+typedef struct {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} jpeg_region_t;
+
+/**
+ * @brief JPEG to NV12 decoder backend
+ */
+typedef struct {
+    const char *name;
+    const char *description;
+
+    /** Create per-source decoder state (may be NULL if stateless) */
+    void *(*create)(void);
+    /** Destroy state returned by create */
+    void (*destroy)(void *ctx);
+    /** Decode a JPEG, returning CANON_ERROR_NOT_SUPPORTED for unhandled layouts */
+    canon_error_t (*decode)(void *ctx, const uint8_t *jpeg, size_t size,
+                            nv12_target_t *target, uint32_t *width, uint32_t *height);
+    /** Bytes held by state returned by create (may be NULL if stateless) */
+    size_t (*memory_usage)(void *ctx);
+} jpeg_decoder_backend_t;
+
+/**
+ * @brief Number of compiled-in decoder backends
+ * @return Backend count
+ */
+size_t jpeg_decoder_backend_count(void);
+
+/**
+ * @brief Get a decoder backend by index
+ * @param index Backend index
+ * @return Backend or NULL if out of range
+ */
+const jpeg_decoder_backend_t *jpeg_decoder_backend_get(size_t index);
+
+/**
+ * @brief Index of the backend that handles every layout libjpeg can decode
+ * @return Backend index
+ */
+int jpeg_decoder_backend_fallback(void);
+
+/**
+ * @brief Find a decoder backend index by name
+ * @param name Backend name
+ * @return Backend index or -1 if not found
+ */
+int jpeg_decoder_backend_find(const char *name);
+
+/**
+ * @brief Decode only a rectangle of a JPEG into NV12 (host-side crop)
+ *
+ * The region is given in pixels of the full-size JPEG and scaled along with
+ * the image when target->scale is set.
+ * With libjpeg-turbo, rows above the region are entropy-decoded but not
+ * reconstructed, columns outside it are reconstructed only up to the next
+ * MCU boundary, and rows below it are never read. The region is clipped to
+ * the image, with origin and size rounded down to even values for NV12.
+ * @param jpeg JPEG data
+ * @param size JPEG size
+ * @param region Rectangle to decode
+ * @param target Destination planes (see nv12_target_t)
+ * @param width Output decoded width
+ * @param height Output decoded height
+ * @return CANON_SUCCESS, or CANON_ERROR_INVALID_PARAM if nothing of the
+ *         region lies inside the image
+ */
+canon_error_t jpeg_decoder_decode_region(const uint8_t *jpeg, size_t size,
+                                         const jpeg_region_t *region, nv12_target_t *target,
+                                         uint32_t *width, uint32_t *height);
+
+/**
+ * @brief Read the image size from a JPEG header
+ * @param jpeg JPEG data
+ * @param size JPEG size
+ * @param width Output width
+ * @param height Output height
+ * @return true if a baseline or progressive frame header was found
+ */
+bool jpeg_decoder_probe(const uint8_t *jpeg, size_t size,
+                        uint32_t *width, uint32_t *height);
+
+#endif /* JPEG_DECODER_H */
@@ -0,0 +1,637 @@
+#include "metrics-exporter.h"
+#include "capture-pipeline.h"
+#include "capture-sync.h"
+#include "utils/logging.h"
+#include "utils/lock-profiler.h"
+#include "utils/mem-accounting.h"
+#include "utils/thread-registry.h"
+#include <util/platform.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_PATH_SIZE 1024
+
+/**
+ * @brief Counters of a pipeline at the previous write, for rates
+ */
+typedef struct {
+    uint32_t id;
+    uint64_t frames;
+    uint64_t cpu_ns;
+    uint64_t timestamp;
+} rate_sample_t;
+
+/**
+ * @brief Rates of a pipeline since the previous write
+ */
+typedef struct {
+    double fps;
+    double cpu_percent;         // 100 = one core
+    double cpu_ms_per_frame;
+} rate_t;
+
+/**
+ * @brief Pipeline snapshots gathered for one write
+ */
+typedef struct {
+    capture_pipeline_info_t *items;
+    size_t count;
+    size_t capacity;
+} snapshot_list_t;
+
+/**
+ * @brief Exporter implementation
+ */
+struct metrics_exporter_t {
+    char path[MAX_PATH_SIZE];
+    char temp_path[MAX_PATH_SIZE + 8];
+    uint32_t interval;
+
+    pthread_t thread;
+    profiled_mutex_t mutex;
+    pthread_cond_t wake;
+    bool running;
+
+    rate_sample_t *rates;       // Only touched by the writing thread
+    size_t rate_count;
+    uint64_t plugin_cpu_ns;     // All plugin threads at the previous write
+    uint64_t plugin_timestamp;
+    bool write_failed;
+};
+
+metrics_exporter_t *metrics_exporter_create(const char *path, uint32_t interval_seconds)
+{
+    if (!path || !*path || strlen(path) >= MAX_PATH_SIZE) {
+        canon_log(LOG_ERROR, "Invalid metrics file path");
+        return NULL;
+    }
+
+    metrics_exporter_t *exporter = calloc(1, sizeof(metrics_exporter_t));
+    if (!exporter) {
+        canon_log(LOG_ERROR, "Failed to allocate metrics exporter");
+        return NULL;
+    }
+
+    snprintf(exporter->path, sizeof(exporter->path), "%s", path);
+    snprintf(exporter->temp_path, sizeof(exporter->temp_path), "%s.tmp", path);
+    exporter->interval = interval_seconds ? interval_seconds : METRICS_EXPORTER_DEFAULT_INTERVAL;
+
+    profiled_mutex_init(&exporter->mutex, "metrics_exporter");
+    pthread_cond_init(&exporter->wake, NULL);
+
+    return exporter;
+}
+
+metrics_exporter_t *metrics_exporter_create_from_env(void)
+{
+    const char *path = getenv("CANON_EOS_METRICS_FILE");
+    if (!path || !*path) {
+        return NULL;
+    }
+
+    const char *interval = getenv("CANON_EOS_METRICS_INTERVAL");
+    uint32_t seconds = interval ? (uint32_t)strtoul(interval, NULL, 10) : 0;
+
+    return metrics_exporter_create(path, seconds);
+}
+
+void metrics_exporter_destroy(metrics_exporter_t *exporter)
+{
+    if (!exporter) {
+        return;
+    }
+
+    metrics_exporter_stop(exporter);
+
+    pthread_cond_destroy(&exporter->wake);
+    profiled_mutex_destroy(&exporter->mutex);
+    free(exporter->rates);
+    free(exporter);
+}
+
+static void collect(const capture_pipeline_info_t *info, void *data)
+{
+    snapshot_list_t *list = data;
+
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 4;
+        capture_pipeline_info_t *items = realloc(list->items,
+                                                 capacity * sizeof(capture_pipeline_info_t));
+        if (!items) {
+            return;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    list->items[list->count++] = *info;
+}
+
+/* Prometheus label values escape backslash, double quote and newline */
+static void write_label(FILE *file, const char *value)
+{
+    for (const char *c = value; *c; c++) {
+        if (*c == '\\' || *c == '"') {
+            fputc('\\', file);
+            fputc(*c, file);
+        } else if (*c == '\n') {
+            fputs("\\n", file);
+        } else {
+            fputc(*c, file);
+        }
+    }
+}
+
+static void write_header(FILE *file, const char *name, const char *type, const char *help)
+{
+    fprintf(file, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/* Writes `name{pipeline="..",device=".."` without the closing brace */
+static void write_series(FILE *file, const char *name, const capture_pipeline_info_t *info)
+{
+    fprintf(file, "%s{pipeline=\"%u\",device=\"", name, info->id);
+    write_label(file, info->device_path);
+    fputc('"', file);
+}
+
+static void write_value(FILE *file, const char *name, const capture_pipeline_info_t *info,
+                        const char *label, const char *label_value, double value)
+{
+    write_series(file, name, info);
+    if (label) {
+        fprintf(file, ",%s=\"%s\"", label, label_value);
+    }
+    fprintf(file, "} %.17g\n", value);
+}
+
+static void write_summary(FILE *file, const char *name, const capture_pipeline_info_t *info,
+                          const char *stage, const latency_histogram_t *hist)
+{
+    static const double quantiles[] = {0.5, 0.9, 0.99};
+    char metric[128];
+    char label[64] = "";
+
+    if (stage) {
+        snprintf(label, sizeof(label), ",stage=\"%s\"", stage);
+    }
+
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+        write_series(file, name, info);
+        fprintf(file, "%s,quantile=\"%g\"} %.9f\n", label, quantiles[i],
+                (double)latency_histogram_percentile(hist, quantiles[i] * 100.0) / 1e9);
+    }
+
+    snprintf(metric, sizeof(metric), "%s_sum", name);
+    write_series(file, metric, info);
+    fprintf(file, "%s} %.9f\n", label, (double)hist->sum / 1e9);
+    snprintf(metric, sizeof(metric), "%s_count", name);
+    write_series(file, metric, info);
+    fprintf(file, "%s} %llu\n", label, (unsigned long long)hist->total);
+}
+
+/**
+ * Frames delivered per second, CPU% and CPU time per frame since the
+ * previous write; 0 for pipelines seen for the first time.
+ */
+static rate_t update_rate(metrics_exporter_t *exporter, rate_sample_t *rates,
+                          const capture_pipeline_info_t *info, uint64_t now)
+{
+    rate_t rate = {0};
+
+    for (size_t i = 0; i < exporter->rate_count; i++) {
+        const rate_sample_t *previous = &exporter->rates[i];
+        if (previous->id == info->id && now > previous->timestamp &&
+            info->counters.frames_delivered >= previous->frames &&
+            info->cpu.total_ns >= previous->cpu_ns) {
+            uint64_t frames = info->counters.frames_delivered - previous->frames;
+            uint64_t cpu = info->cpu.total_ns - previous->cpu_ns;
+            rate.fps = (double)frames * 1e9 / (double)(now - previous->timestamp);
+            rate.cpu_percent = thread_registry_percent(cpu, now - previous->timestamp);
+            rate.cpu_ms_per_frame = frames ? (double)cpu / 1e6 / (double)frames : 0.0;
+            break;
+        }
+    }
+
+    rates->id = info->id;
+    rates->frames = info->counters.frames_delivered;
+    rates->cpu_ns = info->cpu.total_ns;
+    rates->timestamp = now;
+    return rate;
+}
+
+static void write_cpu(metrics_exporter_t *exporter, FILE *file, const snapshot_list_t *list,
+                      const rate_t *values, uint64_t now)
+{
+    static const thread_role_t pipeline_roles[] = {
+        THREAD_ROLE_CAPTURE, THREAD_ROLE_OUTPUT, THREAD_ROLE_RENDER, THREAD_ROLE_STREAM
+    };
+    static const thread_role_t shared_roles[] = {
+        THREAD_ROLE_DETECTOR, THREAD_ROLE_METRICS, THREAD_ROLE_GRID
+    };
+
+    write_header(file, "canon_eos_cpu_seconds_total", "counter",
+                 "CPU time of the pipeline's threads, by thread");
+    for (size_t i = 0; i < list->count; i++) {
+        for (size_t r = 0; r < sizeof(pipeline_roles) / sizeof(pipeline_roles[0]); r++) {
+            thread_role_t role = pipeline_roles[r];
+            write_value(file, "canon_eos_cpu_seconds_total", &list->items[i], "thread",
+                        thread_role_name(role), (double)list->items[i].cpu.cpu_ns[role] / 1e9);
+        }
+    }
+
+    write_header(file, "canon_eos_cpu_percent", "gauge",
+                 "CPU use of the pipeline since the last write, 100 = one core");
+    for (size_t i = 0; i < list->count && values; i++) {
+        write_value(file, "canon_eos_cpu_percent", &list->items[i], NULL, NULL,
+                    values[i].cpu_percent);
+    }
+
+    write_header(file, "canon_eos_cpu_ms_per_frame", "gauge",
+                 "CPU milliseconds per frame delivered since the last write");
+    for (size_t i = 0; i < list->count && values; i++) {
+        write_value(file, "canon_eos_cpu_ms_per_frame", &list->items[i], NULL, NULL,
+                    values[i].cpu_ms_per_frame);
+    }
+
+    cpu_usage_t shared;
+    cpu_group_read(NULL, &shared);
+    write_header(file, "canon_eos_shared_cpu_seconds_total", "counter",
+                 "CPU time of the plugin threads shared by all cameras, by thread");
+    for (size_t r = 0; r < sizeof(shared_roles) / sizeof(shared_roles[0]); r++) {
+        fprintf(file, "canon_eos_shared_cpu_seconds_total{thread=\"%s\"} %.9f\n",
+                thread_role_name(shared_roles[r]), (double)shared.cpu_ns[shared_roles[r]] / 1e9);
+    }
+
+    // NFR-002 is measured against the whole machine, not one core
+    uint64_t total = thread_registry_total_ns();
+    double machine = 0.0;
+    if (exporter->plugin_timestamp && now > exporter->plugin_timestamp &&
+        total >= exporter->plugin_cpu_ns) {
+        machine = thread_registry_percent(total - exporter->plugin_cpu_ns,
+                                          now - exporter->plugin_timestamp) /
+                  (double)thread_registry_cpu_count();
+    }
+    exporter->plugin_cpu_ns = total;
+    exporter->plugin_timestamp = now;
+
+    write_header(file, "canon_eos_plugin_cpu_percent", "gauge",
+                 "CPU use of all plugin threads since the last write, 100 = every core");
+    fprintf(file, "canon_eos_plugin_cpu_percent %.17g\n", machine);
+
+    write_header(file, "canon_eos_plugin_cpu_budget_percent", "gauge",
+                 "CPU budget of the plugin (PRD NFR-002), 100 = every core");
+    fprintf(file, "canon_eos_plugin_cpu_budget_percent %.17g\n", THREAD_REGISTRY_CPU_BUDGET);
+}
+
+static void write_sync_groups(FILE *file)
+{
+    static const double quantiles[] = {0.5, 0.9, 0.99};
+
+    size_t count = capture_sync_get_all(NULL, 0);
+    capture_sync_stats_t *groups = count ? calloc(count, sizeof(capture_sync_stats_t)) : NULL;
+    if (groups) {
+        count = capture_sync_get_all(groups, count);
+    } else {
+        count = 0;
+    }
+
+    write_header(file, "canon_eos_sync_cameras", "gauge", "Cameras capturing in the sync group");
+    for (size_t i = 0; i < count; i++) {
+        fprintf(file, "canon_eos_sync_cameras{group=\"%u\",fps=\"%u\"} %u\n",
+                groups[i].group, groups[i].fps, groups[i].members);
+    }
+
+    write_header(file, "canon_eos_sync_skew_seconds", "summary",
+                 "Spread of the cameras' estimated capture instants per tick");
+    for (size_t i = 0; i < count; i++) {
+        const latency_histogram_t *skew = &groups[i].skew;
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            fprintf(file, "canon_eos_sync_skew_seconds{group=\"%u\",fps=\"%u\",quantile=\"%g\"} "
+                    "%.9f\n", groups[i].group, groups[i].fps, quantiles[q],
+                    (double)latency_histogram_percentile(skew, quantiles[q] * 100.0) / 1e9);
+        }
+        fprintf(file, "canon_eos_sync_skew_seconds_sum{group=\"%u\",fps=\"%u\"} %.9f\n",
+                groups[i].group, groups[i].fps, (double)skew->sum / 1e9);
+        fprintf(file, "canon_eos_sync_skew_seconds_count{group=\"%u\",fps=\"%u\"} %llu\n",
+                groups[i].group, groups[i].fps, (unsigned long long)skew->total);
+    }
+
+    write_header(file, "canon_eos_sync_late_fetches_total", "counter",
+                 "Fetches that started too late for their tick");
+    for (size_t i = 0; i < count; i++) {
+        fprintf(file, "canon_eos_sync_late_fetches_total{group=\"%u\",fps=\"%u\"} %llu\n",
+                groups[i].group, groups[i].fps, (unsigned long long)groups[i].late);
+    }
+
+    free(groups);
+}
+
+static void write_metrics(metrics_exporter_t *exporter, FILE *file,
+                          const snapshot_list_t *list)
+{
+    static const char *category_labels[MEM_CATEGORY_COUNT] = {
+        "frame_pool", "conversion", "decoder", "camera_file", "queue"
+    };
+
+    uint64_t now = os_gettime_ns();
+    rate_sample_t *rates = list->count ? calloc(list->count, sizeof(rate_sample_t)) : NULL;
+    rate_t *values = list->count ? calloc(list->count, sizeof(rate_t)) : NULL;
+    if (!values) {
+        free(rates);
+        rates = NULL;
+    }
+
+    write_header(file, "canon_eos_up", "gauge", "Whether the pipeline is capturing");
+    for (size_t i = 0; i < list->count; i++) {
+        write_value(file, "canon_eos_up", &list->items[i], NULL, NULL,
+                    list->items[i].running ? 1.0 : 0.0);
+    }
+
+    write_header(file, "canon_eos_fps", "gauge", "Frames delivered per second since the last write");
+    for (size_t i = 0; i < list->count && rates; i++) {
+        values[i] = update_rate(exporter, &rates[i], &list->items[i], now);
+        write_value(file, "canon_eos_fps", &list->items[i], NULL, NULL, values[i].fps);
+    }
+
+    write_header(file, "canon_eos_frames_captured_total", "counter",
+                 "Preview frames fetched and decoded");
+    for (size_t i = 0; i < list->count; i++) {
+        write_value(file, "canon_eos_frames_captured_total", &list->items[i], NULL, NULL,
+                    (double)list->items[i].counters.frames_captured);
+    }
+
+    write_header(file, "canon_eos_frames_delivered_total", "counter", "Frames handed to OBS");
+    for (size_t i = 0; i < list->count; i++) {
+        write_value(file, "canon_eos_frames_delivered_total", &list->items[i], NULL, NULL,
+                    (double)list->items[i].counters.frames_delivered);
+    }
+
+    write_header(file, "canon_eos_frames_dropped_total", "counter", "Frames dropped, by cause");
+    for (size_t i = 0; i < list->count; i++) {
+        const video_source_counters_t *c = &list->items[i].counters;
+        write_value(file, "canon_eos_frames_dropped_total", &list->items[i], "cause",
+                    "queue_full", (double)c->drops_queue_full);
+        write_value(file, "canon_eos_frames_dropped_total", &list->items[i], "cause",
+                    "superseded", (double)c->drops_superseded);
+        write_value(file, "canon_eos_frames_dropped_total", &list->items[i], "cause",
+                    "decode_error", (double)c->decode_errors);
+    }
+
+    write_header(file, "canon_eos_capture_errors_total", "counter",
+                 "Failed preview fetches from the camera, by cause");
+    for (size_t i = 0; i < list->count; i++) {
+        const video_source_counters_t *c = &list->items[i].counters;
+        write_value(file, "canon_eos_capture_errors_total", &list->items[i], "cause",
+                    "timeout", (double)c->capture_timeouts);
+        write_value(file, "canon_eos_capture_errors_total", &list->items[i], "cause",
+                    "disconnected", (double)c->capture_disconnects);
+        write_value(file, "canon_eos_capture_errors_total", &list->items[i], "cause",
+                    "usb", (double)c->capture_failures);
+    }
+
+    write_header(file, "canon_eos_capture_recoveries_total", "counter",
+                 "Times capture resumed after a run of failed fetches");
+    for (size_t i = 0; i < list->count; i++) {
+        write_value(file, "canon_eos_capture_recoveries_total", &list->items[i], NULL, NULL,
+                    (double)list->items[i].counters.recoveries);
+    }
+
+    write_header(file, "canon_eos_capture_page_faults_total", "counter",
+                 "Page faults taken by the capture thread (CANON_EOS_BUFFER_MODE)");
+    for (size_t i = 0; i < list->count; i++) {
+        const video_source_counters_t *c = &list->items[i].counters;
+        write_value(file, "canon_eos_capture_page_faults_total", &list->items[i], "kind",
+                    "minor", (double)c->page_faults_minor);
+        write_value(file, "canon_eos_capture_page_faults_total", &list->items[i], "kind",
+                    "major", (double)c->page_faults_major);
+    }
+
+    write_header(file, "canon_eos_camera_connects_total", "counter",
+                 "Successful camera connections");
+    for (size_t i = 0; i < list->count; i++) {
+        write_value(file, "canon_eos_camera_connects_total", &list->items[i], NULL, NULL,
+                    (double)list->items[i].connects);
+    }
+
+    write_header(file, "canon_eos_stage_latency_seconds", "summary",
+                 "Pipeline stage latency: camera fetch, JPEG decode, fetch to delivery");
+    for (size_t i = 0; i < list->count; i++) {
+        const video_source_counters_t *c = &list->items[i].counters;
+        write_summary(file, "canon_eos_stage_latency_seconds", &list->items[i], "fetch",
+                      &c->fetch);
+        write_summary(file, "canon_eos_stage_latency_seconds", &list->items[i], "decode",
+                      &c->decode);
+        write_summary(file, "canon_eos_stage_latency_seconds", &list->items[i], "delivery",
+                      &c->latency);
+    }
+
+    write_header(file, "canon_eos_fetch_duplicates_total", "counter",
+                 "Preview fetches that returned the previous frame again");
+    for (size_t i = 0; i < list->count; i++) {
+        write_value(file, "canon_eos_fetch_duplicates_total", &list->items[i], NULL, NULL,
+                    (double)list->items[i].counters.fetch_duplicates);
+    }
+
+    write_header(file, "canon_eos_refresh_period_seconds", "gauge",
+                 "Estimated live view refresh period of the camera, 0 without phase lock");
+    for (size_t i = 0; i < list->count; i++) {
+        write_value(file, "canon_eos_refresh_period_seconds", &list->items[i], NULL, NULL,
+                    (double)list->items[i].counters.refresh_period / 1e9);
+    }
+
+    write_header(file, "canon_eos_refresh_phase_error_seconds", "summary",
+                 "Distance between the predicted and the measured camera refresh");
+    for (size_t i = 0; i < list->count; i++) {
+        write_summary(file, "canon_eos_refresh_phase_error_seconds", &list->items[i], NULL,
+                      &list->items[i].counters.phase_error);
+    }
+
+    write_header(file, "canon_eos_live_view_zoom", "gauge",
+                 "Camera live view magnification used for the crop, 1 without camera zoom");
+    for (size_t i = 0; i < list->count; i++) {
+        write_value(file, "canon_eos_live_view_zoom", &list->items[i], NULL, NULL,
+                    (double)list->items[i].counters.zoom);
+    }
+
+    write_header(file, "canon_eos_decode_scale", "gauge",
+                 "Preview JPEGs are decoded at 1/scale of their size (auto resolution)");
+    for (size_t i = 0; i < list->count; i++) {
+        write_value(file, "canon_eos_decode_scale", &list->items[i], NULL, NULL,
+                    (double)list->items[i].counters.decode_scale);
+    }
+
+    write_header(file, "canon_eos_decoded_pixels_total", "counter",
+                 "Luma pixels decoded, and the same frames' pixels at full size");
+    for (size_t i = 0; i < list->count; i++) {
+        const video_source_counters_t *c = &list->items[i].counters;
+        write_value(file, "canon_eos_decoded_pixels_total", &list->items[i], "size",
+                    "decoded", (double)c->pixels_decoded);
+        write_value(file, "canon_eos_decoded_pixels_total", &list->items[i], "size",
+                    "full", (double)c->pixels_native);
+    }
+
+    write_header(file, "canon_eos_v4l2_frames_total", "counter",
+                 "Frames written to the v4l2loopback device, by path");
+    for (size_t i = 0; i < list->count; i++) {
+        const video_source_counters_t *c = &list->items[i].counters;
+        write_value(file, "canon_eos_v4l2_frames_total", &list->items[i], "path",
+                    "direct", (double)c->sink_frames_direct);
+        uint64_t converted = c->sink_frames > c->sink_frames_direct ?
+                             c->sink_frames - c->sink_frames_direct : 0;
+        write_value(file, "canon_eos_v4l2_frames_total", &list->items[i], "path",
+                    "converted", (double)converted);
+        write_value(file, "canon_eos_v4l2_frames_total", &list->items[i], "path",
+                    "failed", (double)c->sink_errors);
+    }
+
+    write_header(file, "canon_eos_v4l2_write_seconds", "summary",
+                 "JPEG decode start to the frame being queued on the v4l2loopback device");
+    for (size_t i = 0; i < list->count; i++) {
+        write_summary(file, "canon_eos_v4l2_write_seconds", &list->items[i], NULL,
+                      &list->items[i].counters.sink_write);
+    }
+
+    write_header(file, "canon_eos_memory_bytes", "gauge", "Memory charged to the pipeline, by category");
+    for (size_t i = 0; i < list->count; i++) {
+        for (int c = 0; c < MEM_CATEGORY_COUNT; c++) {
+            write_value(file, "canon_eos_memory_bytes", &list->items[i], "category",
+                        category_labels[c], (double)list->items[i].memory.current[c]);
+        }
+    }
+
+    write_header(file, "canon_eos_memory_budget_bytes", "gauge",
+                 "CANON_EOS_MEMORY_BUDGET_MB in bytes, 0 if unlimited");
+    fprintf(file, "canon_eos_memory_budget_bytes %zu\n", mem_accounting_get_budget());
+
+    write_cpu(exporter, file, list, values, now);
+    write_sync_groups(file);
+
+    free(values);
+    free(exporter->rates);
+    exporter->rates = rates;
+    exporter->rate_count = rates ? list->count : 0;
+}
+
+canon_error_t metrics_exporter_write(metrics_exporter_t *exporter)
+{
+    if (!exporter) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    snapshot_list_t list = {0};
+    capture_pipeline_foreach(collect, &list);
+
+    int error = 0;
+    FILE *file = fopen(exporter->temp_path, "w");
+    if (file) {
+        write_metrics(exporter, file, &list);
+        if (ferror(file)) {
+            error = errno ? errno : EIO;
+        }
+        if (fclose(file) != 0 && !error) {
+            error = errno;
+        }
+        // rename() is atomic: the collector sees the old or the new file
+        if (!error && rename(exporter->temp_path, exporter->path) != 0) {
+            error = errno;
+        }
+        if (error) {
+            remove(exporter->temp_path);
+        }
+    } else {
+        error = errno;
+    }
+
+    free(list.items);
+
+    canon_error_t result = error ? CANON_ERROR_UNKNOWN : CANON_SUCCESS;
+
+    // Log once per failure streak, not every interval
+    if (result != CANON_SUCCESS && !exporter->write_failed) {
+        canon_log(LOG_WARNING, "Failed to write metrics to %s: %s", exporter->path,
+                 strerror(error));
+    } else if (result == CANON_SUCCESS && exporter->write_failed) {
+        canon_log(LOG_INFO, "Writing metrics to %s again", exporter->path);
+    }
+    exporter->write_failed = result != CANON_SUCCESS;
+
+    return result;
+}
+
+static void *exporter_thread_func(void *data)
+{
+    metrics_exporter_t *exporter = data;
+
+    canon_log(LOG_DEBUG, "Metrics exporter thread started");
+    thread_registry_enter(NULL, THREAD_ROLE_METRICS);
+
+    profiled_mutex_lock(&exporter->mutex);
+    while (exporter->running) {
+        profiled_mutex_unlock(&exporter->mutex);
+        metrics_exporter_write(exporter);
+        profiled_mutex_lock(&exporter->mutex);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += exporter->interval;
+        int ret = 0;
+        while (exporter->running && ret != ETIMEDOUT) {
+            ret = profiled_cond_timedwait(&exporter->wake, &exporter->mutex, &deadline);
+        }
+    }
+    profiled_mutex_unlock(&exporter->mutex);
+
+    canon_log(LOG_DEBUG, "Metrics exporter thread stopped");
+    thread_registry_leave();
+    return NULL;
+}
+
+canon_error_t metrics_exporter_start(metrics_exporter_t *exporter)
+{
+    if (!exporter) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    profiled_mutex_lock(&exporter->mutex);
+
+    if (exporter->running) {
+        profiled_mutex_unlock(&exporter->mutex);
+        return CANON_SUCCESS;
+    }
+
+    exporter->running = true;
+    if (pthread_create(&exporter->thread, NULL, exporter_thread_func, exporter) != 0) {
+        exporter->running = false;
+        profiled_mutex_unlock(&exporter->mutex);
+        canon_log(LOG_ERROR, "Failed to create metrics exporter thread");
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    profiled_mutex_unlock(&exporter->mutex);
+
+    canon_log(LOG_INFO, "Writing metrics to %s every %u s", exporter->path, exporter->interval);
+    return CANON_SUCCESS;
+}
+
+void metrics_exporter_stop(metrics_exporter_t *exporter)
+{
+    if (!exporter) {
+        return;
+    }
+
+    profiled_mutex_lock(&exporter->mutex);
+    if (!exporter->running) {
+        profiled_mutex_unlock(&exporter->mutex);
+        return;
+    }
+    exporter->running = false;
+    pthread_cond_signal(&exporter->wake);
+    profiled_mutex_unlock(&exporter->mutex);
+
+    pthread_join(exporter->thread, NULL);
+}
@@ -0,0 +1,71 @@
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "canon-errors.h"
+
+/**
+ * @brief Prometheus textfile exporter for all capture pipelines
+ *
+ * A background thread periodically writes per-pipeline frame rates, drop
+ * and error counters, stage latency quantiles and memory use in Prometheus
+ * exposition format, for node_exporter's textfile collector. The file is
+ * written to a temporary name and renamed, so the collector never reads a
+ * partial file. Only lock-free counters are read; a stalled pipeline does
+ * not stall the exporter.
+ */
+
+#define METRICS_EXPORTER_DEFAULT_INTERVAL 15
+
+/**
+ * @brief Exporter handle
+ */
+typedef struct metrics_exporter_t metrics_exporter_t;
+
+/**
+ * @brief Create an exporter
+ * @param path Output file, e.g. /var/lib/node_exporter/textfile/canon-eos.prom
+ * @param interval_seconds Seconds between writes (0 for the default)
+ * @return Exporter handle or NULL on failure
+ */
+metrics_exporter_t *metrics_exporter_create(const char *path, uint32_t interval_seconds);
+
+/**
+ * @brief Create an exporter configured from the environment
+ *
+ * Reads CANON_EOS_METRICS_FILE (output path) and CANON_EOS_METRICS_INTERVAL
+ * (seconds).
+ * @return Exporter handle, or NULL if CANON_EOS_METRICS_FILE is not set
+ */
+metrics_exporter_t *metrics_exporter_create_from_env(void);
+
+/**
+ * @brief Stop and destroy an exporter
+ * @param exporter Exporter handle (may be NULL)
+ */
+void metrics_exporter_destroy(metrics_exporter_t *exporter);
+
+/**
+ * @brief Start the background writer
+ * @param exporter Exporter handle
+ * @return CANON_SUCCESS or error code
+ */
+canon_error_t metrics_exporter_start(metrics_exporter_t *exporter);
+
+/**
+ * @brief Stop the background writer
+ * @param exporter Exporter handle
+ */
+void metrics_exporter_stop(metrics_exporter_t *exporter);
+
+/**
+ * @brief Write the metrics file once, now
+ *
+ * For exporters without a running background writer.
+ * @param exporter Exporter handle
+ * @return CANON_SUCCESS or CANON_ERROR_UNKNOWN if the file could not be written
+ */
+canon_error_t metrics_exporter_write(metrics_exporter_t *exporter);
+
+#endif /* METRICS_EXPORTER_H */
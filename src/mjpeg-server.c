@@ -0,0 +1,615 @@
+#define _GNU_SOURCE  // accept4, pipe2
+#include "mjpeg-server.h"
+#include "utils/logging.h"
+#include "utils/lock-profiler.h"
+#include "utils/thread-registry.h"
+#include <util/platform.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define REQUEST_SIZE 2048
+#define HEADER_SIZE 512
+#define LISTEN_BACKLOG 8
+#define BOUNDARY "canoneosframe"
+// Clients that send no complete request in this long are dropped
+#define REQUEST_TIMEOUT_NS 5000000000ULL
+#define IDLE_POLL_MS 1000
+
+static const char STREAM_RESPONSE[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace; boundary=" BOUNDARY "\r\n"
+    "Cache-Control: no-cache, no-store\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static const char PART_TRAILER[] = "\r\n";
+
+/**
+ * @brief Preview JPEG shared by all clients sending it
+ */
+typedef struct {
+    uint32_t refs;              // Atomic
+    size_t size;
+    uint64_t sequence;
+    uint8_t data[];
+} mjpeg_frame_t;
+
+typedef enum {
+    CLIENT_FREE = 0,
+    CLIENT_REQUEST,             // Reading the HTTP request
+    CLIENT_STREAM,
+    CLIENT_SNAPSHOT
+} client_state_t;
+
+/**
+ * @brief One connection, only touched by the server thread
+ */
+typedef struct {
+    int fd;
+    client_state_t state;
+    char request[REQUEST_SIZE];
+    size_t request_len;
+    uint64_t connected_at;
+    bool response_sent;         // HTTP response header is out
+    uint64_t min_interval;      // ?fps=N as ns between frames, 0 = every frame
+    uint64_t last_sent_at;
+    uint64_t last_sequence;     // Newest frame started
+    mjpeg_frame_t *frame;       // Frame being sent, referenced
+    char header[HEADER_SIZE];
+    size_t header_len;
+    size_t trailer_len;
+    size_t sent;                // Bytes of header, frame and trailer written
+} mjpeg_client_t;
+
+/**
+ * @brief Server implementation
+ */
+struct mjpeg_server_t {
+    char name[128];
+    cpu_group_t *cpu;
+    uint16_t port;
+    int listen_fd;
+    int wake_pipe[2];
+
+    pthread_t thread;
+    bool running;               // Atomic
+
+    profiled_mutex_t mutex;     // Guards latest and sequence; never held for I/O
+    mjpeg_frame_t *latest;
+    uint64_t sequence;
+
+    uint32_t client_count;      // Atomic, read by the publisher
+    uint64_t frames_published;  // Atomic
+    uint64_t frames_sent;       // Atomic
+    uint64_t frames_skipped;    // Atomic
+
+    mjpeg_client_t clients[MJPEG_SERVER_MAX_CLIENTS];
+};
+
+static void frame_ref(mjpeg_frame_t *frame)
+{
+    __atomic_add_fetch(&frame->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void frame_unref(mjpeg_frame_t *frame)
+{
+    if (frame && __atomic_sub_fetch(&frame->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(frame);
+    }
+}
+
+static void count(uint64_t *counter, uint64_t n)
+{
+    __atomic_add_fetch(counter, n, __ATOMIC_RELAXED);
+}
+
+static void wake(mjpeg_server_t *server)
+{
+    // A full pipe already has a wake-up pending
+    ssize_t written = write(server->wake_pipe[1], "", 1);
+    (void)written;
+}
+
+static void close_client(mjpeg_server_t *server, mjpeg_client_t *client)
+{
+    frame_unref(client->frame);
+    close(client->fd);
+    memset(client, 0, sizeof(*client));
+    client->fd = -1;
+
+    uint32_t remaining = __atomic_sub_fetch(&server->client_count, 1, __ATOMIC_RELAXED);
+    canon_log(LOG_INFO, "Preview stream %s: client disconnected (%u connected)",
+             server->name, remaining);
+
+    if (remaining == 0) {
+        // Nobody to send it to; publishing stops copying until the next client
+        profiled_mutex_lock(&server->mutex);
+        mjpeg_frame_t *latest = server->latest;
+        server->latest = NULL;
+        profiled_mutex_unlock(&server->mutex);
+        frame_unref(latest);
+    }
+}
+
+/* Best effort; the connection is closed right after */
+static void send_status(mjpeg_client_t *client, const char *status)
+{
+    char response[256];
+    int length = snprintf(response, sizeof(response),
+                          "HTTP/1.0 %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+                          status);
+    ssize_t written = send(client->fd, response, (size_t)length, MSG_NOSIGNAL | MSG_DONTWAIT);
+    (void)written;
+}
+
+/* Returns false if the request is complete but not servable */
+static bool parse_request(mjpeg_client_t *client)
+{
+    char *end = strstr(client->request, "\r\n\r\n");
+    if (!end) {
+        end = strstr(client->request, "\n\n");
+    }
+    if (!end) {
+        return true;    // Not complete yet
+    }
+
+    if (strncmp(client->request, "GET ", 4) != 0) {
+        send_status(client, "405 Method Not Allowed");
+        return false;
+    }
+
+    char *path = client->request + 4;
+    char *path_end = strpbrk(path, " \r\n");
+    if (!path_end) {
+        send_status(client, "400 Bad Request");
+        return false;
+    }
+    *path_end = '\0';
+
+    char *query = strchr(path, '?');
+    if (query) {
+        *query++ = '\0';
+        const char *fps = strstr(query, "fps=");
+        if (fps) {
+            unsigned long rate = strtoul(fps + 4, NULL, 10);
+            client->min_interval = rate > 0 ? 1000000000ULL / rate : 0;
+        }
+    }
+
+    if (strcmp(path, "/") == 0 || strcmp(path, "/stream") == 0) {
+        client->state = CLIENT_STREAM;
+    } else if (strcmp(path, "/snapshot.jpg") == 0) {
+        client->state = CLIENT_SNAPSHOT;
+    } else {
+        send_status(client, "404 Not Found");
+        return false;
+    }
+    return true;
+}
+
+/* Returns false if the client is gone */
+static bool read_request(mjpeg_client_t *client)
+{
+    size_t space = sizeof(client->request) - 1 - client->request_len;
+    if (space == 0) {
+        send_status(client, "431 Request Header Fields Too Large");
+        return false;
+    }
+
+    ssize_t received = recv(client->fd, client->request + client->request_len, space,
+                            MSG_DONTWAIT);
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR)) {
+        return false;
+    }
+    if (received > 0) {
+        client->request_len += (size_t)received;
+        client->request[client->request_len] = '\0';
+    }
+    return parse_request(client);
+}
+
+/* Streaming clients have nothing more to say; returns false on hang-up */
+static bool drain_input(mjpeg_client_t *client)
+{
+    char discard[256];
+    ssize_t received = recv(client->fd, discard, sizeof(discard), MSG_DONTWAIT);
+    return received > 0 || (received < 0 && (errno == EAGAIN || errno == EINTR));
+}
+
+/*
+ * Write as much of the current frame as the socket takes, straight from
+ * the shared buffer. Returns false if the client is gone or done.
+ */
+static bool send_pending(mjpeg_server_t *server, mjpeg_client_t *client, uint64_t now)
+{
+    mjpeg_frame_t *frame = client->frame;
+    size_t total = client->header_len + frame->size + client->trailer_len;
+
+    while (client->sent < total) {
+        struct iovec iov[3];
+        int count_iov = 0;
+        size_t offset = client->sent;
+
+        const uint8_t *parts[3] = {(const uint8_t *)client->header, frame->data,
+                                   (const uint8_t *)PART_TRAILER};
+        size_t sizes[3] = {client->header_len, frame->size, client->trailer_len};
+        for (int i = 0; i < 3; i++) {
+            if (offset >= sizes[i]) {
+                offset -= sizes[i];
+                continue;
+            }
+            iov[count_iov].iov_base = (void *)(parts[i] + offset);
+            iov[count_iov].iov_len = sizes[i] - offset;
+            count_iov++;
+            offset = 0;
+        }
+
+        struct msghdr message = {0};
+        message.msg_iov = iov;
+        message.msg_iovlen = (size_t)count_iov;
+
+        ssize_t written = sendmsg(client->fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;    // Wait for POLLOUT
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        client->sent += (size_t)written;
+    }
+
+    frame_unref(frame);
+    client->frame = NULL;
+    client->last_sent_at = now;
+    count(&server->frames_sent, 1);
+
+    return client->state == CLIENT_STREAM;
+}
+
+/*
+ * Start sending the newest frame if the client is idle and it is newer
+ * than the last one. Returns false if the client is gone or done.
+ */
+static bool start_frame(mjpeg_server_t *server, mjpeg_client_t *client, uint64_t now)
+{
+    if (client->frame) {
+        return true;
+    }
+    if (client->min_interval > 0 && client->last_sent_at > 0 &&
+        now - client->last_sent_at < client->min_interval) {
+        return true;
+    }
+
+    profiled_mutex_lock(&server->mutex);
+    mjpeg_frame_t *frame = server->latest;
+    if (frame && frame->sequence > client->last_sequence) {
+        frame_ref(frame);
+    } else {
+        frame = NULL;
+    }
+    profiled_mutex_unlock(&server->mutex);
+
+    if (!frame) {
+        return true;
+    }
+
+    if (client->last_sequence > 0 && frame->sequence > client->last_sequence + 1) {
+        count(&server->frames_skipped, frame->sequence - client->last_sequence - 1);
+    }
+    client->last_sequence = frame->sequence;
+    client->frame = frame;
+    client->sent = 0;
+
+    int length;
+    if (client->state == CLIENT_SNAPSHOT) {
+        length = snprintf(client->header, sizeof(client->header),
+                          "HTTP/1.0 200 OK\r\n"
+                          "Content-Type: image/jpeg\r\n"
+                          "Content-Length: %zu\r\n"
+                          "Cache-Control: no-cache, no-store\r\n"
+                          "Connection: close\r\n"
+                          "\r\n", frame->size);
+        client->trailer_len = 0;
+    } else {
+        length = snprintf(client->header, sizeof(client->header),
+                          "%s--" BOUNDARY "\r\n"
+                          "Content-Type: image/jpeg\r\n"
+                          "Content-Length: %zu\r\n"
+                          "\r\n", client->response_sent ? "" : STREAM_RESPONSE, frame->size);
+        client->trailer_len = sizeof(PART_TRAILER) - 1;
+    }
+    client->header_len = (size_t)length;
+    client->response_sent = true;
+
+    return send_pending(server, client, now);
+}
+
+static void accept_clients(mjpeg_server_t *server, uint64_t now)
+{
+    for (;;) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+
+        mjpeg_client_t *client = NULL;
+        for (int i = 0; i < MJPEG_SERVER_MAX_CLIENTS && !client; i++) {
+            if (server->clients[i].state == CLIENT_FREE) {
+                client = &server->clients[i];
+            }
+        }
+        if (!client) {
+            mjpeg_client_t busy = {.fd = fd};
+            send_status(&busy, "503 Service Unavailable");
+            close(fd);
+            canon_log(LOG_WARNING, "Preview stream %s: client refused, %d connected",
+                     server->name, MJPEG_SERVER_MAX_CLIENTS);
+            continue;
+        }
+
+        memset(client, 0, sizeof(*client));
+        client->fd = fd;
+        client->state = CLIENT_REQUEST;
+        client->connected_at = now;
+
+        uint32_t connected = __atomic_add_fetch(&server->client_count, 1, __ATOMIC_RELAXED);
+        canon_log(LOG_INFO, "Preview stream %s: client connected (%u connected)",
+                 server->name, connected);
+    }
+}
+
+/* Milliseconds until the earliest rate-capped client may get its next frame */
+static int poll_timeout(mjpeg_server_t *server, uint64_t now)
+{
+    uint64_t wait = (uint64_t)IDLE_POLL_MS * 1000000ULL;
+
+    for (int i = 0; i < MJPEG_SERVER_MAX_CLIENTS; i++) {
+        const mjpeg_client_t *client = &server->clients[i];
+        if (client->state != CLIENT_STREAM || client->frame || client->min_interval == 0) {
+            continue;
+        }
+        uint64_t due = client->last_sent_at + client->min_interval;
+        uint64_t remaining = due > now ? due - now : 0;
+        if (remaining < wait) {
+            wait = remaining;
+        }
+    }
+    return (int)((wait + 999999ULL) / 1000000ULL);
+}
+
+static void *server_thread_func(void *data)
+{
+    mjpeg_server_t *server = data;
+    thread_registry_enter(server->cpu, THREAD_ROLE_STREAM);
+    canon_log(LOG_INFO, "Preview stream %s: http://127.0.0.1:%u/", server->name,
+             (unsigned int)server->port);
+
+    struct pollfd fds[2 + MJPEG_SERVER_MAX_CLIENTS];
+    int client_of[2 + MJPEG_SERVER_MAX_CLIENTS];
+
+    while (__atomic_load_n(&server->running, __ATOMIC_ACQUIRE)) {
+        nfds_t count_fds = 0;
+        fds[count_fds++] = (struct pollfd){.fd = server->listen_fd, .events = POLLIN};
+        fds[count_fds++] = (struct pollfd){.fd = server->wake_pipe[0], .events = POLLIN};
+
+        for (int i = 0; i < MJPEG_SERVER_MAX_CLIENTS; i++) {
+            mjpeg_client_t *client = &server->clients[i];
+            if (client->state == CLIENT_FREE) {
+                continue;
+            }
+            client_of[count_fds] = i;
+            fds[count_fds++] = (struct pollfd){
+                .fd = client->fd,
+                .events = (short)(client->frame ? POLLOUT : POLLIN)
+            };
+        }
+
+        int ready = poll(fds, count_fds, poll_timeout(server, os_gettime_ns()));
+        if (ready < 0 && errno != EINTR) {
+            canon_log(LOG_ERROR, "Preview stream %s: poll failed: %s", server->name,
+                     strerror(errno));
+            break;
+        }
+
+        uint64_t now = os_gettime_ns();
+
+        if (fds[1].revents & POLLIN) {
+            char discard[64];
+            while (read(server->wake_pipe[0], discard, sizeof(discard)) > 0) {
+            }
+        }
+
+        for (nfds_t n = 2; n < count_fds; n++) {
+            mjpeg_client_t *client = &server->clients[client_of[n]];
+            short revents = fds[n].revents;
+            bool alive = true;
+
+            if (revents & (POLLERR | POLLNVAL)) {
+                alive = false;
+            } else if (client->state == CLIENT_REQUEST) {
+                if (revents & (POLLIN | POLLHUP)) {
+                    alive = read_request(client);
+                } else if (now - client->connected_at > REQUEST_TIMEOUT_NS) {
+                    alive = false;
+                }
+            } else if (client->frame) {
+                if (revents & (POLLOUT | POLLHUP)) {
+                    alive = send_pending(server, client, now);
+                }
+            } else if (revents & (POLLIN | POLLHUP)) {
+                alive = drain_input(client);
+            }
+
+            if (!alive) {
+                close_client(server, client);
+            }
+        }
+
+        // Idle clients pick up the newest frame, skipping any they missed
+        for (int i = 0; i < MJPEG_SERVER_MAX_CLIENTS; i++) {
+            mjpeg_client_t *client = &server->clients[i];
+            if ((client->state == CLIENT_STREAM || client->state == CLIENT_SNAPSHOT) &&
+                !start_frame(server, client, now)) {
+                close_client(server, client);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            accept_clients(server, now);
+        }
+    }
+
+    for (int i = 0; i < MJPEG_SERVER_MAX_CLIENTS; i++) {
+        if (server->clients[i].state != CLIENT_FREE) {
+            close_client(server, &server->clients[i]);
+        }
+    }
+
+    canon_log(LOG_INFO, "Preview stream %s stopped", server->name);
+    thread_registry_leave();
+    return NULL;
+}
+
+mjpeg_server_t *mjpeg_server_create(uint16_t port, const char *name, cpu_group_t *cpu)
+{
+    mjpeg_server_t *server = calloc(1, sizeof(mjpeg_server_t));
+    if (!server) {
+        canon_log(LOG_ERROR, "Failed to allocate preview stream server");
+        return NULL;
+    }
+
+    snprintf(server->name, sizeof(server->name), "%s", name ? name : "");
+    server->cpu = cpu;
+    server->wake_pipe[0] = -1;
+    server->wake_pipe[1] = -1;
+    for (int i = 0; i < MJPEG_SERVER_MAX_CLIENTS; i++) {
+        server->clients[i].fd = -1;
+    }
+    profiled_mutex_init(&server->mutex, "mjpeg_server");
+
+    server->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->listen_fd < 0) {
+        canon_log(LOG_ERROR, "Preview stream %s: socket failed: %s", server->name,
+                 strerror(errno));
+        mjpeg_server_destroy(server);
+        return NULL;
+    }
+
+    int reuse = 1;
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(server->listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(server->listen_fd, LISTEN_BACKLOG) != 0) {
+        canon_log(LOG_ERROR, "Preview stream %s: cannot listen on 127.0.0.1:%u: %s",
+                 server->name, (unsigned int)port, strerror(errno));
+        mjpeg_server_destroy(server);
+        return NULL;
+    }
+
+    socklen_t length = sizeof(address);
+    getsockname(server->listen_fd, (struct sockaddr *)&address, &length);
+    server->port = ntohs(address.sin_port);
+
+    if (pipe2(server->wake_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        canon_log(LOG_ERROR, "Preview stream %s: pipe failed: %s", server->name,
+                 strerror(errno));
+        mjpeg_server_destroy(server);
+        return NULL;
+    }
+
+    server->running = true;
+    if (pthread_create(&server->thread, NULL, server_thread_func, server) != 0) {
+        canon_log(LOG_ERROR, "Preview stream %s: failed to create thread", server->name);
+        server->running = false;
+        mjpeg_server_destroy(server);
+        return NULL;
+    }
+
+    return server;
+}
+
+void mjpeg_server_destroy(mjpeg_server_t *server)
+{
+    if (!server) {
+        return;
+    }
+
+    if (__atomic_exchange_n(&server->running, false, __ATOMIC_ACQ_REL)) {
+        wake(server);
+        pthread_join(server->thread, NULL);
+    }
+
+    if (server->listen_fd >= 0) {
+        close(server->listen_fd);
+    }
+    if (server->wake_pipe[0] >= 0) {
+        close(server->wake_pipe[0]);
+        close(server->wake_pipe[1]);
+    }
+
+    frame_unref(server->latest);
+    profiled_mutex_destroy(&server->mutex);
+    free(server);
+}
+
+void mjpeg_server_publish(mjpeg_server_t *server, const uint8_t *data, size_t size)
+{
+    if (!server || !data || size == 0 ||
+        __atomic_load_n(&server->client_count, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    mjpeg_frame_t *frame = malloc(sizeof(mjpeg_frame_t) + size);
+    if (!frame) {
+        return;
+    }
+    frame->refs = 1;
+    frame->size = size;
+    memcpy(frame->data, data, size);
+
+    profiled_mutex_lock(&server->mutex);
+    frame->sequence = ++server->sequence;
+    mjpeg_frame_t *previous = server->latest;
+    server->latest = frame;
+    profiled_mutex_unlock(&server->mutex);
+
+    frame_unref(previous);
+    count(&server->frames_published, 1);
+    wake(server);
+}
+
+uint16_t mjpeg_server_get_port(mjpeg_server_t *server)
+{
+    return server ? server->port : 0;
+}
+
+void mjpeg_server_get_stats(mjpeg_server_t *server, mjpeg_server_stats_t *stats)
+{
+    if (!server || !stats) {
+        return;
+    }
+
+    stats->clients = __atomic_load_n(&server->client_count, __ATOMIC_RELAXED);
+    stats->frames_published = __atomic_load_n(&server->frames_published, __ATOMIC_RELAXED);
+    stats->frames_sent = __atomic_load_n(&server->frames_sent, __ATOMIC_RELAXED);
+    stats->frames_skipped = __atomic_load_n(&server->frames_skipped, __ATOMIC_RELAXED);
+}
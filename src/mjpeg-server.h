@@ -0,0 +1,79 @@
+#ifndef MJPEG_SERVER_H
+#define MJPEG_SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "canon-errors.h"
+#include "utils/thread-registry.h"
+
+/**
+ * @brief Localhost MJPEG stream of one camera's preview JPEGs
+ *
+ * Serves the compressed previews the capture thread fetches anyway, for
+ * confidence monitors and tally dashboards, over HTTP on 127.0.0.1:
+ *   GET /               multipart/x-mixed-replace stream (also /stream)
+ *   GET /snapshot.jpg   the newest frame
+ * A "?fps=N" query caps a stream's frame rate.
+ *
+ * Publishing copies the frame once into a reference-counted buffer, and
+ * only while clients are connected. Every client is sent that same buffer
+ * with sendmsg() scatter-gather, with no copy per client. A client still
+ * sending an older frame skips to the newest when it is done. Nothing is
+ * decoded, the camera is not polled any extra, and a slow client never
+ * holds up the capture thread.
+ */
+typedef struct mjpeg_server_t mjpeg_server_t;
+
+#define MJPEG_SERVER_MAX_CLIENTS 8
+
+/**
+ * @brief Server counters, cumulative since creation
+ */
+typedef struct {
+    uint32_t clients;           /**< Connected clients */
+    uint64_t frames_published;  /**< Frames offered while clients were connected */
+    uint64_t frames_sent;       /**< Frames written out, summed over clients */
+    uint64_t frames_skipped;    /**< Frames clients skipped for being slow or rate-capped */
+} mjpeg_server_stats_t;
+
+/**
+ * @brief Listen on 127.0.0.1:port and start the server thread
+ * @param port TCP port
+ * @param name Camera name for log messages
+ * @param cpu CPU group the server thread is charged to (may be NULL)
+ * @return Server handle or NULL on failure (e.g. port in use)
+ */
+mjpeg_server_t *mjpeg_server_create(uint16_t port, const char *name, cpu_group_t *cpu);
+
+/**
+ * @brief Close all connections and destroy the server
+ * @param server Server handle (may be NULL)
+ */
+void mjpeg_server_destroy(mjpeg_server_t *server);
+
+/**
+ * @brief Offer a new preview JPEG to the clients
+ *
+ * Returns at once without copying when no client is connected. Never
+ * waits for clients.
+ * @param server Server handle
+ * @param data JPEG data, only read during the call
+ * @param size JPEG size in bytes
+ */
+void mjpeg_server_publish(mjpeg_server_t *server, const uint8_t *data, size_t size);
+
+/**
+ * @brief Get the port the server listens on
+ * @param server Server handle
+ * @return TCP port
+ */
+uint16_t mjpeg_server_get_port(mjpeg_server_t *server);
+
+/**
+ * @brief Read the counters
+ * @param server Server handle
+ * @param stats Output counters
+ */
+void mjpeg_server_get_stats(mjpeg_server_t *server, mjpeg_server_stats_t *stats);
+
+#endif /* MJPEG_SERVER_H */
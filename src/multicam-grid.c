@@ -0,0 +1,476 @@
+#include "multicam-grid.h"
+#include "utils/buffer-alloc.h"
+#include "utils/logging.h"
+#include "utils/lock-profiler.h"
+#include "utils/thread-registry.h"
+#include "utils/trace-recorder.h"
+#include <util/platform.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define GRID_MIN_CELL 2         // Even, so every tile origin is on a chroma sample
+#define GRID_BLACK_Y 16         // Limited range black
+#define GRID_BLACK_UV 128
+
+/**
+ * @brief One configured camera and where its tile is
+ */
+typedef struct {
+    capture_pipeline_t *pipeline;
+    uint32_t width;             // Last decoded tile size, 0 before the first preview
+    uint32_t height;
+    bool shown;                 // The cell holds the camera's last decoded frame, in place
+} grid_tile_t;
+
+/**
+ * @brief Multicam grid implementation
+ */
+struct multicam_grid_t {
+    capture_pipeline_output_cb output;
+    void *output_data;
+
+    pthread_t thread;
+    profiled_mutex_t mutex;
+    bool active;
+    bool thread_running;
+
+    grid_tile_t tiles[MULTICAM_GRID_MAX_CAMERAS];   // By settings index
+    uint32_t order[MULTICAM_GRID_MAX_CAMERAS];      // Configured tiles, in layout order
+    uint32_t count;
+    uint32_t scale;
+    uint32_t fps;
+    bool bottom_up;
+
+    // Layout
+    uint32_t columns;
+    uint32_t rows;
+    uint32_t cell_width;
+    uint32_t cell_height;
+    uint32_t width;
+    uint32_t height;
+    uint8_t *data;
+    size_t capacity;
+
+    multicam_grid_stats_t stats;    // Counters atomic, read lock-free
+};
+
+static inline void count(uint64_t *counter, uint64_t value)
+{
+    __atomic_add_fetch(counter, value, __ATOMIC_RELAXED);
+}
+
+static uint32_t round_even(uint32_t value)
+{
+    return (value + 1) & ~1u;
+}
+
+static void fill_black(uint8_t *y, uint8_t *uv, uint32_t linesize,
+                       uint32_t width, uint32_t height)
+{
+    for (uint32_t row = 0; row < height; row++) {
+        memset(y + (size_t)row * linesize, GRID_BLACK_Y, width);
+    }
+    for (uint32_t row = 0; row < height / 2; row++) {
+        memset(uv + (size_t)row * linesize, GRID_BLACK_UV, width);
+    }
+}
+
+/* Called with grid->mutex held: top-left corner of a tile's cell */
+static void cell_origin(const multicam_grid_t *grid, uint32_t position,
+                        uint32_t *x, uint32_t *y)
+{
+    uint32_t row = position / grid->columns;
+    if (grid->bottom_up) {
+        row = grid->rows - 1 - row;
+    }
+    *x = (position % grid->columns) * grid->cell_width;
+    *y = row * grid->cell_height;
+}
+
+/* Called with grid->mutex held: blank one cell */
+static void clear_cell(multicam_grid_t *grid, uint32_t position)
+{
+    uint32_t x, y;
+    cell_origin(grid, position, &x, &y);
+
+    uint8_t *uv = grid->data + (size_t)grid->width * grid->height;
+    fill_black(grid->data + (size_t)y * grid->width + x, uv + (size_t)(y / 2) * grid->width + x,
+               grid->width, grid->cell_width, grid->cell_height);
+}
+
+/**
+ * Size the grid for the configured cameras and the given cell size, and
+ * blank it. Tiles keep their last size, so they land centred on their next
+ * preview. Called with grid->mutex held.
+ */
+static bool relayout_locked(multicam_grid_t *grid, uint32_t cell_width, uint32_t cell_height)
+{
+    uint32_t columns = 1;
+    while (columns * columns < grid->count) {
+        columns++;
+    }
+    uint32_t rows = grid->count > 0 ? (grid->count + columns - 1) / columns : 0;
+
+    cell_width = round_even(cell_width < GRID_MIN_CELL ? GRID_MIN_CELL : cell_width);
+    cell_height = round_even(cell_height < GRID_MIN_CELL ? GRID_MIN_CELL : cell_height);
+
+    size_t size = (size_t)columns * cell_width * rows * cell_height * 3 / 2;
+    if (size > grid->capacity) {
+        uint8_t *data = buffer_alloc(size);
+        if (!data) {
+            canon_log(LOG_ERROR, "Failed to allocate %ux%u grid frame",
+                     columns * cell_width, rows * cell_height);
+            return false;
+        }
+        buffer_free(grid->data, grid->capacity);
+        grid->data = data;
+        grid->capacity = size;
+    }
+
+    grid->columns = columns;
+    grid->rows = rows;
+    grid->cell_width = cell_width;
+    grid->cell_height = cell_height;
+    grid->width = columns * cell_width;
+    grid->height = rows * cell_height;
+
+    if (grid->data) {
+        fill_black(grid->data, grid->data + (size_t)grid->width * grid->height,
+                   grid->width, grid->width, grid->height);
+    }
+    for (uint32_t i = 0; i < MULTICAM_GRID_MAX_CAMERAS; i++) {
+        grid->tiles[i].shown = false;
+    }
+
+    count(&grid->stats.relayouts, 1);
+    __atomic_store_n(&grid->stats.width, grid->width, __ATOMIC_RELAXED);
+    __atomic_store_n(&grid->stats.height, grid->height, __ATOMIC_RELAXED);
+    __atomic_store_n(&grid->stats.cameras, grid->count, __ATOMIC_RELAXED);
+
+    if (grid->count > 0 && cell_width > GRID_MIN_CELL) {
+        canon_log(LOG_INFO, "Multicam grid: %u cameras in %ux%u cells of %ux%u, %ux%u frame",
+                 grid->count, columns, rows, cell_width, cell_height, grid->width, grid->height);
+    }
+    return true;
+}
+
+/**
+ * Refresh every tile from its camera's newest preview.
+ * Called with grid->mutex held.
+ * @return true if the grid changed
+ */
+static bool compose_locked(multicam_grid_t *grid)
+{
+    bool changed = false;
+
+    for (uint32_t position = 0; position < grid->count && grid->data; position++) {
+        grid_tile_t *tile = &grid->tiles[grid->order[position]];
+        video_source_t *video = capture_pipeline_get_video(tile->pipeline);
+
+        // Centred on the last known size; a new size is placed next frame
+        uint32_t x, y;
+        cell_origin(grid, position, &x, &y);
+        uint32_t offset_x = ((grid->cell_width - tile->width) / 2) & ~1u;
+        uint32_t offset_y = ((grid->cell_height - tile->height) / 2) & ~1u;
+        x += offset_x;
+        y += offset_y;
+
+        uint8_t *uv = grid->data + (size_t)grid->width * grid->height;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        canon_error_t err = video_source_decode_latest_into(
+            video, grid->data + (size_t)y * grid->width + x,
+            uv + (size_t)(y / 2) * grid->width + x, grid->width,
+            grid->cell_width - offset_x, grid->cell_height - offset_y, grid->scale,
+            tile->shown, &width, &height);
+
+        if (err == CANON_SUCCESS && round_even(width) == tile->width &&
+            round_even(height) == tile->height) {
+            tile->shown = true;
+            changed = true;
+            count(&grid->stats.tiles_decoded, 1);
+        } else if (err == CANON_SUCCESS || err == CANON_ERROR_INVALID_PARAM) {
+            // First preview or a new preview size: this one is dropped
+            if (width == 0 || height == 0) {
+                count(&grid->stats.decode_errors, 1);
+                continue;
+            }
+            tile->width = round_even(width);
+            tile->height = round_even(height);
+            if (tile->width > grid->cell_width || tile->height > grid->cell_height) {
+                uint32_t cell_width = tile->width > grid->cell_width ? tile->width
+                                                                     : grid->cell_width;
+                uint32_t cell_height = tile->height > grid->cell_height ? tile->height
+                                                                        : grid->cell_height;
+                // All cells are blank now and refill on the next tick
+                relayout_locked(grid, cell_width, cell_height);
+                return false;
+            }
+            clear_cell(grid, position);
+            tile->shown = false;
+            changed = true;
+        } else if (err == CANON_ERROR_TIMEOUT) {
+            count(&grid->stats.tiles_reused, 1);
+        } else if (err == CANON_ERROR_DISCONNECTED) {
+            if (tile->shown) {
+                clear_cell(grid, position);
+                tile->shown = false;
+                changed = true;
+            }
+        } else {
+            count(&grid->stats.decode_errors, 1);
+        }
+    }
+
+    return changed;
+}
+
+static void *grid_thread_func(void *data)
+{
+    multicam_grid_t *grid = data;
+    canon_log(LOG_INFO, "Multicam grid thread started");
+    thread_registry_enter(NULL, THREAD_ROLE_GRID);
+
+    uint64_t next_frame = os_gettime_ns();
+
+    while (__atomic_load_n(&grid->thread_running, __ATOMIC_ACQUIRE)) {
+        profiled_mutex_lock(&grid->mutex);
+
+        uint64_t start = os_gettime_ns();
+        bool changed = compose_locked(grid);
+
+        if (changed) {
+            latency_histogram_record_atomic(&grid->stats.compose, os_gettime_ns() - start);
+
+            struct obs_source_frame frame = {0};
+            frame.data[0] = grid->data;
+            frame.data[1] = grid->data + (size_t)grid->width * grid->height;
+            frame.linesize[0] = grid->width;
+            frame.linesize[1] = grid->width;
+            frame.width = grid->width;
+            frame.height = grid->height;
+            frame.format = VIDEO_FORMAT_NV12;
+            frame.timestamp = os_gettime_ns();
+
+            uint64_t frames = __atomic_load_n(&grid->stats.frames, __ATOMIC_RELAXED);
+            uint64_t span = trace_begin();
+            grid->output(&frame, grid->output_data);
+            trace_end(TRACE_OUTPUT, span, frames);
+            count(&grid->stats.frames, 1);
+        }
+
+        uint32_t fps = grid->fps;
+        profiled_mutex_unlock(&grid->mutex);
+
+        // Absolute deadlines, as in the pipeline output thread
+        uint64_t now = os_gettime_ns();
+        next_frame += 1000000000ULL / fps;
+        if (next_frame < now) {
+            next_frame = now;
+        }
+        struct timespec deadline = {
+            .tv_sec = (time_t)(next_frame / 1000000000ULL),
+            .tv_nsec = (long)(next_frame % 1000000000ULL)
+        };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+        }
+    }
+
+    canon_log(LOG_INFO, "Multicam grid thread stopped");
+    thread_registry_leave();
+    return NULL;
+}
+
+/* Called with grid->mutex held */
+static void start_locked(multicam_grid_t *grid)
+{
+    for (uint32_t i = 0; i < MULTICAM_GRID_MAX_CAMERAS; i++) {
+        capture_pipeline_activate(grid->tiles[i].pipeline);
+    }
+
+    if (!grid->thread_running) {
+        grid->thread_running = true;
+        if (pthread_create(&grid->thread, NULL, grid_thread_func, grid) != 0) {
+            canon_log(LOG_ERROR, "Failed to create multicam grid thread");
+            grid->thread_running = false;
+        }
+    }
+}
+
+/* Called with grid->mutex held, which is released while joining */
+static void stop_locked(multicam_grid_t *grid)
+{
+    if (grid->thread_running) {
+        __atomic_store_n(&grid->thread_running, false, __ATOMIC_RELEASE);
+        profiled_mutex_unlock(&grid->mutex);
+        pthread_join(grid->thread, NULL);
+        profiled_mutex_lock(&grid->mutex);
+    }
+
+    for (uint32_t i = 0; i < MULTICAM_GRID_MAX_CAMERAS; i++) {
+        capture_pipeline_deactivate(grid->tiles[i].pipeline);
+    }
+}
+
+multicam_grid_t *multicam_grid_create(capture_pipeline_output_cb output, void *user_data)
+{
+    if (!output) {
+        return NULL;
+    }
+
+    multicam_grid_t *grid = calloc(1, sizeof(multicam_grid_t));
+    if (!grid) {
+        canon_log(LOG_ERROR, "Failed to allocate multicam grid");
+        return NULL;
+    }
+
+    profiled_mutex_init(&grid->mutex, "multicam_grid");
+    grid->output = output;
+    grid->output_data = user_data;
+    grid->scale = 4;
+    grid->fps = 30;
+
+    return grid;
+}
+
+void multicam_grid_destroy(multicam_grid_t *grid)
+{
+    if (!grid) {
+        return;
+    }
+
+    profiled_mutex_lock(&grid->mutex);
+    grid->active = false;
+    stop_locked(grid);
+
+    for (uint32_t i = 0; i < MULTICAM_GRID_MAX_CAMERAS; i++) {
+        capture_pipeline_destroy(grid->tiles[i].pipeline);
+    }
+    buffer_free(grid->data, grid->capacity);
+
+    profiled_mutex_unlock(&grid->mutex);
+    profiled_mutex_destroy(&grid->mutex);
+    free(grid);
+}
+
+void multicam_grid_update(multicam_grid_t *grid, const multicam_grid_settings_t *settings)
+{
+    if (!grid || !settings) {
+        return;
+    }
+
+    uint32_t scale = settings->scale == 8 ? 8 : 4;
+    uint32_t fps = settings->fps ? settings->fps : 30;
+
+    profiled_mutex_lock(&grid->mutex);
+
+    bool resize = scale != grid->scale || settings->bottom_up != grid->bottom_up;
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < MULTICAM_GRID_MAX_CAMERAS; i++) {
+        grid_tile_t *tile = &grid->tiles[i];
+        const char *device = settings->devices[i] ? settings->devices[i] : "";
+
+        if (device[0] == '\0') {
+            if (tile->pipeline) {
+                capture_pipeline_destroy(tile->pipeline);
+                memset(tile, 0, sizeof(*tile));
+                resize = true;
+            }
+            continue;
+        }
+
+        if (!tile->pipeline) {
+            tile->pipeline = capture_pipeline_create(NULL, NULL);
+            if (!tile->pipeline) {
+                continue;
+            }
+            resize = true;
+        }
+
+        // Each camera delivers previews at the grid rate; the tile only
+        // ever needs the newest one
+        capture_pipeline_settings_t pipeline_settings = {
+            .device_path = device,
+            .width = 1920,
+            .height = 1080,
+            .fps = fps,
+            .decoder = settings->decoder
+        };
+        capture_pipeline_update(tile->pipeline, &pipeline_settings);
+        if (grid->active) {
+            capture_pipeline_activate(tile->pipeline);
+        }
+
+        grid->order[count++] = i;
+    }
+
+    grid->scale = scale;
+    grid->fps = fps;
+    grid->bottom_up = settings->bottom_up;
+
+    if (resize || count != grid->count) {
+        grid->count = count;
+        for (uint32_t i = 0; i < MULTICAM_GRID_MAX_CAMERAS; i++) {
+            grid->tiles[i].width = 0;
+            grid->tiles[i].height = 0;
+        }
+        // Cells grow to the previews' size as they arrive
+        relayout_locked(grid, GRID_MIN_CELL, GRID_MIN_CELL);
+    }
+
+    profiled_mutex_unlock(&grid->mutex);
+}
+
+void multicam_grid_activate(multicam_grid_t *grid)
+{
+    if (!grid) {
+        return;
+    }
+
+    profiled_mutex_lock(&grid->mutex);
+    grid->active = true;
+    start_locked(grid);
+    profiled_mutex_unlock(&grid->mutex);
+}
+
+void multicam_grid_deactivate(multicam_grid_t *grid)
+{
+    if (!grid) {
+        return;
+    }
+
+    profiled_mutex_lock(&grid->mutex);
+    grid->active = false;
+    stop_locked(grid);
+    profiled_mutex_unlock(&grid->mutex);
+}
+
+void multicam_grid_get_stats(multicam_grid_t *grid, multicam_grid_stats_t *stats)
+{
+    if (!grid || !stats) {
+        return;
+    }
+
+    const multicam_grid_stats_t *live = &grid->stats;
+    stats->frames = __atomic_load_n(&live->frames, __ATOMIC_RELAXED);
+    stats->tiles_decoded = __atomic_load_n(&live->tiles_decoded, __ATOMIC_RELAXED);
+    stats->tiles_reused = __atomic_load_n(&live->tiles_reused, __ATOMIC_RELAXED);
+    stats->decode_errors = __atomic_load_n(&live->decode_errors, __ATOMIC_RELAXED);
+    stats->relayouts = __atomic_load_n(&live->relayouts, __ATOMIC_RELAXED);
+    latency_histogram_load(&stats->compose, &live->compose);
+    stats->width = __atomic_load_n(&live->width, __ATOMIC_RELAXED);
+    stats->height = __atomic_load_n(&live->height, __ATOMIC_RELAXED);
+    stats->cameras = __atomic_load_n(&live->cameras, __ATOMIC_RELAXED);
+}
+
+capture_pipeline_t *multicam_grid_get_pipeline(multicam_grid_t *grid, uint32_t index)
+{
+    if (!grid || index >= MULTICAM_GRID_MAX_CAMERAS) {
+        return NULL;
+    }
+    return grid->tiles[index].pipeline;
+}
@@ -0,0 +1,110 @@
+#ifndef MULTICAM_GRID_H
+#define MULTICAM_GRID_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "canon-errors.h"
+#include "capture-pipeline.h"
+#include "utils/latency-histogram.h"
+
+/**
+ * @brief Several cameras composited into one NV12 frame on the CPU
+ *
+ * Each configured camera gets its own capture pipeline (pulled, no output
+ * thread). One grid thread decodes every camera's newest preview at 1/4 or
+ * 1/8 DCT scale straight into that camera's tile of a shared NV12 frame and
+ * hands the frame to the output callback once per tick. A tile stays in
+ * place between frames, so only the bands that changed since the camera's
+ * previous preview are decoded into it. A multiview of N cameras then costs
+ * N cheap decodes and one frame upload instead of N full-size decodes and N
+ * uploads.
+ *
+ * Tiles are laid out in ceil(sqrt(N)) columns, in the order the cameras
+ * are configured. All cells have the size of the largest decoded tile;
+ * smaller tiles are centred, and a cell whose camera has no frame is dark.
+ * The grid grows when a larger tile arrives, which blanks all cells until
+ * their cameras' next previews; a camera's first preview only sizes its
+ * tile.
+ *
+ * Does not depend on the OBS core, so benchmarks can drive it directly.
+ */
+typedef struct multicam_grid_t multicam_grid_t;
+
+#define MULTICAM_GRID_MAX_CAMERAS 9
+
+/**
+ * @brief Grid settings
+ */
+typedef struct {
+    const char *devices[MULTICAM_GRID_MAX_CAMERAS]; /**< NULL or "" = unused */
+    uint32_t scale;         /**< DCT scale of each tile: 4 or 8 */
+    uint32_t fps;           /**< Grid frames per second */
+    const char *decoder;    /**< JPEG decoder backend, NULL/"auto" to calibrate */
+    bool bottom_up;         /**< First tile row at the bottom of the buffer, for
+                                 consumers that show the frame flipped */
+} multicam_grid_settings_t;
+
+/**
+ * @brief Grid counters, cumulative since creation
+ */
+typedef struct {
+    uint64_t frames;                /**< Grid frames handed to the output callback */
+    uint64_t tiles_decoded;         /**< Tiles refreshed from a new preview */
+    uint64_t tiles_reused;          /**< Tiles kept because their camera had no new preview */
+    uint64_t decode_errors;         /**< Tile decodes that failed */
+    uint64_t relayouts;             /**< Grid size changes */
+    latency_histogram_t compose;    /**< Per tick: all tile decodes of one frame */
+    uint32_t width;                 /**< Current grid frame size */
+    uint32_t height;
+    uint32_t cameras;               /**< Configured cameras */
+} multicam_grid_stats_t;
+
+/**
+ * @brief Create a grid
+ * @param output Callback receiving each grid frame on the grid thread
+ * @param user_data User data for the callback
+ * @return Grid handle or NULL on failure
+ */
+multicam_grid_t *multicam_grid_create(capture_pipeline_output_cb output, void *user_data);
+
+/**
+ * @brief Stop everything and destroy the grid
+ * @param grid Grid handle (may be NULL)
+ */
+void multicam_grid_destroy(multicam_grid_t *grid);
+
+/**
+ * @brief Apply settings, connecting and disconnecting cameras as needed
+ * @param grid Grid handle
+ * @param settings New settings
+ */
+void multicam_grid_update(multicam_grid_t *grid, const multicam_grid_settings_t *settings);
+
+/**
+ * @brief Start all cameras and the grid thread (source became active)
+ * @param grid Grid handle
+ */
+void multicam_grid_activate(multicam_grid_t *grid);
+
+/**
+ * @brief Stop the grid thread and all cameras (source became inactive)
+ * @param grid Grid handle
+ */
+void multicam_grid_deactivate(multicam_grid_t *grid);
+
+/**
+ * @brief Get the grid counters
+ * @param grid Grid handle
+ * @param stats Output snapshot
+ */
+void multicam_grid_get_stats(multicam_grid_t *grid, multicam_grid_stats_t *stats);
+
+/**
+ * @brief Get the pipeline behind a tile (valid until the next update)
+ * @param grid Grid handle
+ * @param index Camera index in the settings
+ * @return Pipeline, or NULL if that camera is not configured
+ */
+capture_pipeline_t *multicam_grid_get_pipeline(multicam_grid_t *grid, uint32_t index);
+
+#endif /* MULTICAM_GRID_H */
@@ -1,14 +1,24 @@
 #include <obs-module.h>
 #include <obs-source.h>
 #include <util/platform.h>
+#include <math.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include <unistd.h>
+#include <string.h>
 #include "canon-camera.h"
 #include "video-source.h"
+#include "capture-pipeline.h"
+#include "capture-sync.h"
 #include "camera-detector.h"
+#include "metrics-exporter.h"
+#include "multicam-grid.h"
+#include "host-calibration.h"
+#include "jpeg-decoder.h"
 #include "utils/logging.h"
+#include "utils/lock-profiler.h"
+#include "utils/thread-registry.h"
+#include "utils/trace-recorder.h"
 
 OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE("obs-canon-eos", "en-US")
@@ -16,72 +26,430 @@ OBS_MODULE_USE_DEFAULT_LOCALE("obs-canon-eos", "en-US")
 #define PLUGIN_NAME "Canon EOS Camera"
 #define PLUGIN_VERSION "1.1.0"
 
+// Resolution setting value: decode at the size the source is shown on canvas
+#define RESOLUTION_AUTO 0
+// Seconds between on-canvas size checks with auto resolution
+#define DECODE_REPLAN_INTERVAL 1.0f
+// Scene nesting followed when measuring the on-canvas size
+#define MAX_SCENE_DEPTH 8
+#define MAX_NESTED_SCENES 64
+// Fetch and validation time of a calibration from the properties dialog
+#define CALIBRATION_SECONDS 3.0
+#define CALIBRATION_TEXT_SIZE 2048
+
+static const host_calibration_options_t g_calibration_options = {
+    .seconds = CALIBRATION_SECONDS,
+    .validate = true
+};
+
 static pthread_mutex_t g_plugin_mutex = PTHREAD_MUTEX_INITIALIZER;
 static bool g_plugin_initialized = false;
 static camera_detector_t *g_detector = NULL;
+static metrics_exporter_t *g_metrics = NULL;
+static obs_hotkey_id g_trace_hotkey = OBS_INVALID_HOTKEY_ID;
 
 /**
  * @brief Canon EOS source structure
  */
 struct canon_eos_source {
     obs_source_t *source;
-    canon_camera_t *camera;
+    capture_pipeline_t *pipeline;
     video_source_t *video;
 
-    pthread_t capture_thread;
-    pthread_mutex_t mutex;
-    bool active;
-    bool thread_running;
+    uint64_t frame_count;
 
-    char *device_path;
-    uint32_t width;
-    uint32_t height;
-    uint32_t fps;
+    // Readings at the previous statistics refresh (UI thread only)
+    uint64_t stats_cpu_ns;
+    uint64_t stats_plugin_cpu_ns;
+    uint64_t stats_frames;
+    uint64_t stats_timestamp;
+
+    // Direct upload mode (synchronous source, graphics thread only)
+    bool direct;
+    struct obs_source_frame pending;
+    bool pending_valid;
+    gs_texture_t *tex_y;
+    gs_texture_t *tex_uv;
+    gs_effect_t *effect;
+    uint32_t tex_width;
+    uint32_t tex_height;
+    uint32_t display_width;     // Full-size frame, what the scene item is laid out for
+    uint32_t display_height;
+    bool auto_scale;            // Resolution "Auto": decode at the on-canvas size
+    float replan_elapsed;
+    float color_matrix[16];
+    float color_range_min[3];
+    float color_range_max[3];
+
+    // Host calibration, run on its own thread holding a source reference
+    profiled_mutex_t calibration_mutex;
+    bool calibrating;                   // Guarded by calibration_mutex
+    char calibration_text[CALIBRATION_TEXT_SIZE];
+};
 
-    uint64_t frame_count;
-    uint64_t last_frame_time;
+/**
+ * @brief Multicam grid source structure
+ */
+struct canon_eos_grid_source {
+    obs_source_t *source;
+    multicam_grid_t *grid;
+    float color_matrix[16];
+    float color_range_min[3];
+    float color_range_max[3];
 };
 
+/**
+ * NV12 to RGB conversion for the direct upload source. Y is sampled from an
+ * R8 texture and interleaved CbCr from a half-size R8G8 texture.
+ */
+static const char *nv12_effect_source =
+    "uniform float4x4 ViewProj;\n"
+    "uniform texture2d image_y;\n"
+    "uniform texture2d image_uv;\n"
+    "uniform float4x4 color_matrix;\n"
+    "uniform float3 color_range_min = {0.0, 0.0, 0.0};\n"
+    "uniform float3 color_range_max = {1.0, 1.0, 1.0};\n"
+    "\n"
+    "sampler_state def_sampler {\n"
+    "    Filter   = Linear;\n"
+    "    AddressU = Clamp;\n"
+    "    AddressV = Clamp;\n"
+    "};\n"
+    "\n"
+    "struct VertInOut {\n"
+    "    float4 pos : POSITION;\n"
+    "    float2 uv  : TEXCOORD0;\n"
+    "};\n"
+    "\n"
+    "VertInOut VSDefault(VertInOut vert_in)\n"
+    "{\n"
+    "    VertInOut vert_out;\n"
+    "    vert_out.pos = mul(float4(vert_in.pos.xyz, 1.0), ViewProj);\n"
+    "    vert_out.uv  = vert_in.uv;\n"
+    "    return vert_out;\n"
+    "}\n"
+    "\n"
+    "float4 PSNV12(VertInOut vert_in) : TARGET\n"
+    "{\n"
+    "    float y = image_y.Sample(def_sampler, vert_in.uv).r;\n"
+    "    float2 cbcr = image_uv.Sample(def_sampler, vert_in.uv).rg;\n"
+    "    float3 yuv = clamp(float3(y, cbcr), color_range_min, color_range_max);\n"
+    "    return saturate(mul(float4(yuv, 1.0), color_matrix));\n"
+    "}\n"
+    "\n"
+    "technique Draw\n"
+    "{\n"
+    "    pass\n"
+    "    {\n"
+    "        vertex_shader = VSDefault(vert_in);\n"
+    "        pixel_shader  = PSNV12(vert_in);\n"
+    "    }\n"
+    "}\n";
+
 static const char *canon_eos_get_name(void *unused)
 {
     UNUSED_PARAMETER(unused);
     return PLUGIN_NAME;
 }
 
+static const char *canon_eos_direct_get_name(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    return PLUGIN_NAME " (Direct Upload)";
+}
+
+static const char *canon_eos_grid_get_name(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    return PLUGIN_NAME " Grid";
+}
+
 static void canon_eos_get_defaults(obs_data_t *settings)
 {
     obs_data_set_default_string(settings, "device_path", "");
     obs_data_set_default_int(settings, "resolution", 1080);
     obs_data_set_default_int(settings, "fps", 30);
     obs_data_set_default_bool(settings, "auto_reconnect", true);
+    obs_data_set_default_string(settings, "decoder", "auto");
+    obs_data_set_default_int(settings, "sync_group", 0);
+    obs_data_set_default_bool(settings, "phase_lock", true);
+    obs_data_set_default_int(settings, "crop_mode", VIDEO_CROP_OFF);
+    obs_data_set_default_int(settings, "crop_left", 0);
+    obs_data_set_default_int(settings, "crop_top", 0);
+    obs_data_set_default_int(settings, "crop_width", 100);
+    obs_data_set_default_int(settings, "crop_height", 100);
+    obs_data_set_default_int(settings, "stream_port", 0);
+    obs_data_set_default_string(settings, "v4l2_device", "");
 }
 
-static obs_properties_t *canon_eos_get_properties(void *data)
+static bool canon_eos_trace_clicked(obs_properties_t *props, obs_property_t *property,
+                                    void *data)
 {
+    UNUSED_PARAMETER(props);
     UNUSED_PARAMETER(data);
-    obs_properties_t *props = obs_properties_create();
+    trace_recorder_toggle();
+    obs_property_set_description(property, trace_recorder_is_recording()
+                                 ? "Stop Trace Recording" : "Start Trace Recording");
+    return true;
+}
+
+static void canon_eos_trace_hotkey(void *data, obs_hotkey_id id, obs_hotkey_t *hotkey,
+                                   bool pressed)
+{
+    UNUSED_PARAMETER(data);
+    UNUSED_PARAMETER(id);
+    UNUSED_PARAMETER(hotkey);
+    if (pressed) {
+        trace_recorder_toggle();
+    }
+}
+
+/* Connect errors, then CPU use of this camera and of the whole plugin since
+ * the previous refresh */
+static void canon_eos_format_statistics(struct canon_eos_source *source, char *text, size_t size)
+{
+    cpu_usage_t cpu;
+    video_source_counters_t counters;
+    capture_pipeline_get_cpu(source->pipeline, &cpu);
+    video_source_read_counters(source->video, &counters);
+    uint64_t plugin_cpu = thread_registry_total_ns();
+    uint64_t now = os_gettime_ns();
+
+    uint64_t wall = now - source->stats_timestamp;
+    uint64_t spent = cpu.total_ns - source->stats_cpu_ns;
+    uint64_t frames = counters.frames_delivered - source->stats_frames;
+    double machine = thread_registry_percent(plugin_cpu - source->stats_plugin_cpu_ns, wall) /
+                     (double)thread_registry_cpu_count();
+
+    int length = 0;
+    canon_error_t error = capture_pipeline_get_error(source->pipeline);
+    if (error != CANON_SUCCESS) {
+        length = snprintf(text, size, "Camera not connected: %s\n", canon_error_string(error));
+    }
+    if (length >= 0 && (size_t)length < size) {
+        int line = snprintf(text + length, size - (size_t)length,
+                            "Last %.0f s: %.1f fps, CPU %.1f%% of one core",
+                            (double)wall / 1e9,
+                            (double)frames * 1e9 / (double)(wall ? wall : 1),
+                            thread_registry_percent(spent, wall));
+        length = line < 0 ? line : length + line;
+    }
+    if (frames > 0 && length > 0 && (size_t)length < size) {
+        length += snprintf(text + length, size - (size_t)length, " (%.2f ms per frame)",
+                           (double)spent / 1e6 / (double)frames);
+    }
+    if (length > 0 && (size_t)length < size) {
+        snprintf(text + length, size - (size_t)length,
+                 "\nAll cameras: %.1f%% of %u CPUs, %s the %.0f%% budget", machine,
+                 thread_registry_cpu_count(),
+                 machine < THREAD_REGISTRY_CPU_BUDGET ? "within" : "over",
+                 THREAD_REGISTRY_CPU_BUDGET);
+    }
+
+    source->stats_cpu_ns = cpu.total_ns;
+    source->stats_plugin_cpu_ns = plugin_cpu;
+    source->stats_frames = counters.frames_delivered;
+    source->stats_timestamp = now;
+}
 
+static void canon_eos_add_device_list(obs_properties_t *props, const char *name,
+                                     const char *description)
+{
     obs_property_t *device_list = obs_properties_add_list(
-        props, "device_path", "Camera Device",
+        props, name, description,
         OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
 
     if (g_detector) {
-        camera_info_t *cameras = NULL;
-        int count = camera_detector_list_devices(g_detector, &cameras);
+        const camera_snapshot_t *snapshot = camera_detector_acquire_snapshot(g_detector);
 
         obs_property_list_add_string(device_list, "None", "");
 
-        for (int i = 0; i < count; i++) {
+        for (int i = 0; snapshot && i < snapshot->count; i++) {
+            const camera_info_t *camera = &snapshot->cameras[i];
             char display_name[512];
             snprintf(display_name, sizeof(display_name), "%.127s (%.127s)",
-                    cameras[i].model_name, cameras[i].device_path);
+                    camera->model_name, camera->device_path);
             obs_property_list_add_string(device_list,
                                         display_name,
-                                        cameras[i].device_path);
+                                        camera->device_path);
         }
 
-        camera_detector_free_list(cameras, count);
+        camera_detector_release_snapshot(g_detector, snapshot);
+    }
+}
+
+static void canon_eos_add_decoder_list(obs_properties_t *props)
+{
+    obs_property_t *decoder = obs_properties_add_list(
+        props, "decoder", "JPEG Decoder",
+        OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+
+    obs_property_list_add_string(decoder, "Auto (calibrate on first frames)", "auto");
+    for (size_t i = 0; i < jpeg_decoder_backend_count(); i++) {
+        const jpeg_decoder_backend_t *backend = jpeg_decoder_backend_get(i);
+        obs_property_list_add_string(decoder, backend->description, backend->name);
+    }
+}
+
+static void canon_eos_pipeline_settings(obs_data_t *settings,
+                                        capture_pipeline_settings_t *pipeline_settings)
+{
+    int resolution = (int)obs_data_get_int(settings, "resolution");
+
+    *pipeline_settings = (capture_pipeline_settings_t){
+        .device_path = obs_data_get_string(settings, "device_path"),
+        .fps = (uint32_t)obs_data_get_int(settings, "fps"),
+        .decoder = obs_data_get_string(settings, "decoder"),
+        .sync_group = (uint32_t)obs_data_get_int(settings, "sync_group"),
+        .phase_lock = obs_data_get_bool(settings, "phase_lock"),
+        .crop_mode = (video_crop_mode_t)obs_data_get_int(settings, "crop_mode"),
+        .stream_port = (uint16_t)obs_data_get_int(settings, "stream_port"),
+        .v4l2_device = obs_data_get_string(settings, "v4l2_device"),
+        .crop = {
+            .x = (float)obs_data_get_int(settings, "crop_left") / 100.0f,
+            .y = (float)obs_data_get_int(settings, "crop_top") / 100.0f,
+            .width = (float)obs_data_get_int(settings, "crop_width") / 100.0f,
+            .height = (float)obs_data_get_int(settings, "crop_height") / 100.0f
+        }
+    };
+
+    switch (resolution) {
+        case 2160:
+            pipeline_settings->width = 3840;
+            pipeline_settings->height = 2160;
+            break;
+        case 1080:
+            pipeline_settings->width = 1920;
+            pipeline_settings->height = 1080;
+            break;
+        case 720:
+            pipeline_settings->width = 1280;
+            pipeline_settings->height = 720;
+            break;
+        default:
+            pipeline_settings->width = 1920;
+            pipeline_settings->height = 1080;
+    }
+}
+
+/*
+ * Calibrates the source's camera and this host's decoders, then applies the
+ * recommended decoder, frame rate and phase lock through obs_source_update()
+ * so they are saved with the source. The reference taken for the thread
+ * keeps the source alive until it is done.
+ */
+static void *canon_eos_calibration_thread(void *data)
+{
+    struct canon_eos_source *source = data;
+    char *text = bzalloc(CALIBRATION_TEXT_SIZE);
+    host_calibration_report_t *report = bzalloc(sizeof(host_calibration_report_t));
+
+    obs_data_t *settings = obs_source_get_settings(source->source);
+    capture_pipeline_settings_t pipeline_settings;
+    canon_eos_pipeline_settings(settings, &pipeline_settings);
+    char *device = bstrdup(pipeline_settings.device_path);
+
+    // The calibration opens the camera itself
+    pipeline_settings.device_path = "";
+    capture_pipeline_update(source->pipeline, &pipeline_settings);
+    obs_data_release(settings);
+
+    const char *devices[] = {device};
+    canon_error_t err = host_calibration_run(devices, 1, &g_calibration_options, report);
+    const host_calibration_camera_t *camera = host_calibration_find(report, device);
+
+    obs_data_t *recommended = NULL;
+    if (err == CANON_SUCCESS && camera && camera->status == CANON_SUCCESS) {
+        recommended = obs_data_create();
+        if (camera->decoder) {
+            obs_data_set_string(recommended, "decoder", camera->decoder);
+        }
+        obs_data_set_int(recommended, "fps", camera->fps);
+        obs_data_set_bool(recommended, "phase_lock", camera->phase_lock);
+
+        char path[512];
+        if (host_calibration_profile_path(path, sizeof(path))) {
+            host_calibration_write_profile(report, path);
+        }
+        host_calibration_format(report, text, CALIBRATION_TEXT_SIZE);
+    } else {
+        snprintf(text, CALIBRATION_TEXT_SIZE, "Calibration of %s failed: %s", device,
+                 canon_error_string(err));
+    }
+
+    profiled_mutex_lock(&source->calibration_mutex);
+    snprintf(source->calibration_text, sizeof(source->calibration_text), "%s", text);
+    source->calibrating = false;
+    profiled_mutex_unlock(&source->calibration_mutex);
+
+    // Reconnects the camera, with the recommendation if there is one and
+    // any settings changed meanwhile. OBS runs the update on the next video
+    // tick, so calibrating must be clear by then.
+    obs_source_update(source->source, recommended);
+    obs_data_release(recommended);
+
+    canon_log(LOG_INFO, "Calibration of %s finished", device);
+    bfree(device);
+    bfree(report);
+    bfree(text);
+    obs_source_release(source->source);
+    return NULL;
+}
+
+static bool canon_eos_calibrate_clicked(obs_properties_t *props, obs_property_t *property,
+                                        void *data)
+{
+    UNUSED_PARAMETER(props);
+    UNUSED_PARAMETER(property);
+    struct canon_eos_source *source = data;
+
+    obs_data_t *settings = obs_source_get_settings(source->source);
+    bool has_camera = *obs_data_get_string(settings, "device_path") != '\0';
+    obs_data_release(settings);
+
+    profiled_mutex_lock(&source->calibration_mutex);
+    if (source->calibrating) {
+        profiled_mutex_unlock(&source->calibration_mutex);
+        return false;
+    }
+    if (!has_camera) {
+        snprintf(source->calibration_text, sizeof(source->calibration_text),
+                 "Select a camera to calibrate");
+        profiled_mutex_unlock(&source->calibration_mutex);
+        return false;
+    }
+
+    // NULL while the source is being destroyed; the thread must not start then
+    if (!obs_source_get_ref(source->source)) {
+        snprintf(source->calibration_text, sizeof(source->calibration_text),
+                 "The source is being removed, calibration not started");
+        profiled_mutex_unlock(&source->calibration_mutex);
+        return false;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, canon_eos_calibration_thread, source) == 0) {
+        pthread_detach(thread);
+        source->calibrating = true;
+        snprintf(source->calibration_text, sizeof(source->calibration_text),
+                 "Calibrating, up to %.0f seconds. Settings changed meanwhile apply "
+                 "afterwards. Reopen the properties for the results.",
+                 host_calibration_estimate_seconds(1, &g_calibration_options));
+    } else {
+        canon_log(LOG_ERROR, "Failed to create calibration thread");
+        obs_source_release(source->source);
     }
+    profiled_mutex_unlock(&source->calibration_mutex);
+
+    return false;
+}
+
+static obs_properties_t *canon_eos_get_properties(void *data)
+{
+    struct canon_eos_source *source = data;
+    obs_properties_t *props = obs_properties_create();
+
+    canon_eos_add_device_list(props, "device_path", "Camera Device");
 
     obs_property_t *resolution = obs_properties_add_list(
         props, "resolution", "Resolution",
@@ -90,170 +458,295 @@ static obs_properties_t *canon_eos_get_properties(void *data)
     obs_property_list_add_int(resolution, "4K (3840x2160)", 2160);
     obs_property_list_add_int(resolution, "1080p (1920x1080)", 1080);
     obs_property_list_add_int(resolution, "720p (1280x720)", 720);
+    // Async frames size their scene item, so only the direct source can
+    // deliver smaller frames and still be laid out at full size
+    if (source && source->direct) {
+        obs_property_list_add_int(resolution, "Auto (Decode at On-Canvas Size)",
+                                  RESOLUTION_AUTO);
+    }
 
     obs_properties_add_int_slider(props, "fps", "Frame Rate", 24, 60, 1);
 
     obs_properties_add_bool(props, "auto_reconnect", "Auto Reconnect");
 
+    canon_eos_add_decoder_list(props);
+
+    // Cameras in the same group fetch preview frames on a shared tick
+    obs_property_t *sync_group = obs_properties_add_list(
+        props, "sync_group", "Capture Sync Group",
+        OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+    obs_property_list_add_int(sync_group, "Off", 0);
+    for (int i = 1; i <= CAPTURE_SYNC_MAX_GROUP; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "Group %d", i);
+        obs_property_list_add_int(sync_group, name, i);
+    }
+
+    // Fetch just after the camera refreshes its live view (ignored in a sync group)
+    obs_properties_add_bool(props, "phase_lock", "Lock Polling to Camera Refresh");
+
+    // Camera zoom magnifies live view 5x or 10x, so it needs a crop of at
+    // most 20% of the width and height; larger crops are cut on the host
+    obs_property_t *crop_mode = obs_properties_add_list(
+        props, "crop_mode", "Crop",
+        OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+    obs_property_list_add_int(crop_mode, "Off", VIDEO_CROP_OFF);
+    obs_property_list_add_int(crop_mode, "Decode Region Only", VIDEO_CROP_HOST);
+    obs_property_list_add_int(crop_mode, "Camera Zoom (Decode Region If Unsupported)",
+                              VIDEO_CROP_CAMERA);
+
+    obs_properties_add_int_slider(props, "crop_left", "Crop Left (%)", 0, 99, 1);
+    obs_properties_add_int_slider(props, "crop_top", "Crop Top (%)", 0, 99, 1);
+    obs_properties_add_int_slider(props, "crop_width", "Crop Width (%)", 1, 100, 1);
+    obs_properties_add_int_slider(props, "crop_height", "Crop Height (%)", 1, 100, 1);
+
+    // Serves the undecoded previews on http://127.0.0.1:PORT/ for monitors
+    obs_properties_add_int(props, "stream_port", "Preview Stream Port (0 = Off)",
+                           0, 65535, 1);
+
+    // Decoded frames for other applications, e.g. /dev/video10 created by
+    // "modprobe v4l2loopback video_nr=10 exclusive_caps=1"
+    obs_properties_add_text(props, "v4l2_device", "v4l2loopback Device (Empty = Off)",
+                            OBS_TEXT_DEFAULT);
+
+    // Reopening the properties refreshes the figures
+    if (source) {
+        char statistics[256];
+        canon_eos_format_statistics(source, statistics, sizeof(statistics));
+        obs_properties_add_text(props, "statistics", statistics, OBS_TEXT_INFO);
+    }
+
+    // Measures the camera and this host, then sets decoder, frame rate and
+    // phase lock; the camera is off the air meanwhile
+    if (source) {
+        obs_properties_add_button(props, "calibrate", "Calibrate Camera and Host",
+                                  canon_eos_calibrate_clicked);
+
+        profiled_mutex_lock(&source->calibration_mutex);
+        if (source->calibration_text[0]) {
+            obs_properties_add_text(props, "calibration", source->calibration_text,
+                                    OBS_TEXT_INFO);
+        }
+        profiled_mutex_unlock(&source->calibration_mutex);
+    }
+
+    // Chrome trace of all pipelines, written to CANON_EOS_TRACE_DIR (default /tmp)
+    obs_properties_add_button(props, "trace", trace_recorder_is_recording()
+                              ? "Stop Trace Recording" : "Start Trace Recording",
+                              canon_eos_trace_clicked);
+
     return props;
 }
 
-static void *canon_eos_capture_thread(void *data)
+static void canon_eos_output_frame(struct obs_source_frame *frame, void *data)
 {
     struct canon_eos_source *source = data;
-    canon_log(LOG_INFO, "Capture thread started for device: %s", source->device_path);
-
-    while (source->thread_running) {
-        pthread_mutex_lock(&source->mutex);
-
-        if (source->active && source->camera && source->video) {
-            struct obs_source_frame frame = {0};
-
-            canon_error_t err = video_source_get_frame(source->video, &frame);
-            if (err == CANON_SUCCESS) {
-                frame.timestamp = os_gettime_ns();
-                // Note: frame.width and frame.height are already set by video_source_get_frame()
-                // to the actual JPEG dimensions, don't overwrite them!
-                frame.format = VIDEO_FORMAT_NV12;
-                frame.full_range = false;
-                frame.flip = true;  // Flip vertically to correct orientation
-
-                // Set color space info
-                video_format_get_parameters(VIDEO_CS_709, VIDEO_RANGE_PARTIAL,
-                                           frame.color_matrix, frame.color_range_min,
-                                           frame.color_range_max);
-
-                if (source->frame_count < 5) {
-                    canon_log(LOG_INFO, "Outputting frame to OBS: %ux%u, data[0]=%p, data[1]=%p, linesize[0]=%u, linesize[1]=%u",
-                             frame.width, frame.height, (void*)frame.data[0], (void*)frame.data[1],
-                             frame.linesize[0], frame.linesize[1]);
-                }
-
-                obs_source_output_video(source->source, &frame);
-
-                source->frame_count++;
-                source->last_frame_time = frame.timestamp;
-
-                video_source_release_frame(source->video, &frame);
-
-                if (source->frame_count % 30 == 0) {
-                    canon_log(LOG_DEBUG, "Frames captured: %lu", (unsigned long)source->frame_count);
-                }
-            } else {
-                if (source->frame_count == 0) {
-                    canon_log(LOG_WARNING, "Failed to get first frame: %s", canon_error_string(err));
-                }
-            }
-        }
 
-        pthread_mutex_unlock(&source->mutex);
-
-        usleep(1000000 / source->fps);
+    // Note: frame->width and frame->height are already set by video_source_get_frame()
+    // to the actual JPEG dimensions, don't overwrite them!
+    frame->format = VIDEO_FORMAT_NV12;
+    frame->full_range = false;
+    frame->flip = true;  // Flip vertically to correct orientation
+
+    // Set color space info
+    memcpy(frame->color_matrix, source->color_matrix, sizeof(source->color_matrix));
+    memcpy(frame->color_range_min, source->color_range_min, sizeof(source->color_range_min));
+    memcpy(frame->color_range_max, source->color_range_max, sizeof(source->color_range_max));
+
+    if (source->frame_count < 5) {
+        canon_log(LOG_INFO, "Outputting frame to OBS: %ux%u, data[0]=%p, data[1]=%p, linesize[0]=%u, linesize[1]=%u",
+                 frame->width, frame->height, (void*)frame->data[0], (void*)frame->data[1],
+                 frame->linesize[0], frame->linesize[1]);
     }
 
-    canon_log(LOG_INFO, "Capture thread stopped");
-    return NULL;
+    obs_source_output_video(source->source, frame);
+    source->frame_count++;
 }
 
 static void canon_eos_update(void *data, obs_data_t *settings)
 {
     struct canon_eos_source *source = data;
 
-    const char *new_device = obs_data_get_string(settings, "device_path");
+    // The calibration holds the camera; its final update applies these settings
+    profiled_mutex_lock(&source->calibration_mutex);
+    bool calibrating = source->calibrating;
+    profiled_mutex_unlock(&source->calibration_mutex);
+    if (calibrating) {
+        canon_log(LOG_DEBUG, "Calibration running, settings applied when it finishes");
+        return;
+    }
+
     int resolution = (int)obs_data_get_int(settings, "resolution");
-    uint32_t new_fps = (uint32_t)obs_data_get_int(settings, "fps");
 
-    uint32_t new_width, new_height;
-    switch (resolution) {
-        case 2160:
-            new_width = 3840;
-            new_height = 2160;
-            break;
-        case 1080:
-            new_width = 1920;
-            new_height = 1080;
-            break;
-        case 720:
-            new_width = 1280;
-            new_height = 720;
-            break;
-        default:
-            new_width = 1920;
-            new_height = 1080;
+    capture_pipeline_settings_t pipeline_settings;
+    canon_eos_pipeline_settings(settings, &pipeline_settings);
+    capture_pipeline_update(source->pipeline, &pipeline_settings);
+
+    source->auto_scale = source->direct && resolution == RESOLUTION_AUTO;
+    source->replan_elapsed = DECODE_REPLAN_INTERVAL;
+    if (!source->auto_scale) {
+        video_source_set_decode_size(source->video, 0, 0);
     }
+}
 
-    pthread_mutex_lock(&source->mutex);
+/**
+ * Largest size a source is drawn at on the canvas, found by walking the
+ * scenes that are showing and composing the box transforms of the scene
+ * items, groups and nested scenes that lead to it.
+ */
+struct canvas_size {
+    obs_source_t *target;
+    float scale_x;              // Canvas pixels per pixel of the scene being walked
+    float scale_y;
+    int depth;
+    float width;
+    float height;
+    obs_source_t *nested[MAX_NESTED_SCENES];
+    size_t nested_count;
+};
 
-    source->width = new_width;
-    source->height = new_height;
-    source->fps = new_fps;
+static bool canon_eos_collect_nested(obs_scene_t *scene, obs_sceneitem_t *item, void *param)
+{
+    UNUSED_PARAMETER(scene);
+    struct canvas_size *canvas = param;
+    obs_source_t *item_source = obs_sceneitem_get_source(item);
+    bool group = obs_sceneitem_is_group(item);
+
+    if ((group || obs_scene_from_source(item_source)) &&
+        canvas->nested_count < MAX_NESTED_SCENES) {
+        canvas->nested[canvas->nested_count++] = item_source;
+    }
+    if (group) {
+        obs_sceneitem_group_enum_items(item, canon_eos_collect_nested, canvas);
+    }
+    return true;
+}
 
-    if (!source->device_path || strcmp(source->device_path, new_device) != 0) {
-        // Stop capture thread before changing camera
-        bool was_running = source->thread_running;
-        if (source->thread_running) {
-            source->thread_running = false;
-            source->active = false;
-            pthread_mutex_unlock(&source->mutex);
-            pthread_join(source->capture_thread, NULL);
-            pthread_mutex_lock(&source->mutex);
-        }
+static bool canon_eos_measure_item(obs_scene_t *scene, obs_sceneitem_t *item, void *param)
+{
+    UNUSED_PARAMETER(scene);
+    struct canvas_size *canvas = param;
 
-        if (source->device_path) {
-            bfree(source->device_path);
-        }
-        source->device_path = bstrdup(new_device);
+    if (!obs_sceneitem_visible(item)) {
+        return true;
+    }
 
-        if (source->camera) {
-            canon_camera_disconnect(source->camera);
-            canon_camera_destroy(source->camera);
-            source->camera = NULL;
-        }
+    struct matrix4 box;
+    obs_sceneitem_get_box_transform(item, &box);
+    float width = sqrtf(box.x.x * box.x.x + box.x.y * box.x.y) * canvas->scale_x;
+    float height = sqrtf(box.y.x * box.y.x + box.y.y * box.y.y) * canvas->scale_y;
+
+    obs_source_t *item_source = obs_sceneitem_get_source(item);
+    if (item_source == canvas->target) {
+        canvas->width = width > canvas->width ? width : canvas->width;
+        canvas->height = height > canvas->height ? height : canvas->height;
+        return true;
+    }
 
-        if (strlen(new_device) > 0) {
-            canon_config_t config = {
-                .width = source->width,
-                .height = source->height,
-                .fps = source->fps
-            };
-
-            source->camera = canon_camera_create();
-            if (source->camera) {
-                canon_error_t err = canon_camera_connect(source->camera,
-                                                         new_device,
-                                                         &config);
-                if (err != CANON_SUCCESS) {
-                    canon_log(LOG_ERROR, "Failed to connect to camera: %s",
-                             canon_error_string(err));
-                    canon_camera_destroy(source->camera);
-                    source->camera = NULL;
-                } else if (was_running) {
-                    // Restart capture thread if it was running
-                    source->active = true;
-                    source->thread_running = true;
-                    pthread_create(&source->capture_thread, NULL,
-                                  canon_eos_capture_thread, source);
-                }
-            }
+    bool group = obs_sceneitem_is_group(item);
+    obs_scene_t *nested = group ? NULL : obs_scene_from_source(item_source);
+    uint32_t source_width = obs_source_get_width(item_source);
+    uint32_t source_height = obs_source_get_height(item_source);
+    if ((!group && !nested) || canvas->depth >= MAX_SCENE_DEPTH ||
+        source_width == 0 || source_height == 0) {
+        return true;
+    }
+
+    float scale_x = canvas->scale_x;
+    float scale_y = canvas->scale_y;
+    canvas->scale_x = width / (float)source_width;
+    canvas->scale_y = height / (float)source_height;
+    canvas->depth++;
+
+    if (group) {
+        obs_sceneitem_group_enum_items(item, canon_eos_measure_item, canvas);
+    } else {
+        obs_scene_enum_items(nested, canon_eos_measure_item, canvas);
+    }
+
+    canvas->depth--;
+    canvas->scale_x = scale_x;
+    canvas->scale_y = scale_y;
+    return true;
+}
+
+static bool canon_eos_collect_scene(void *param, obs_source_t *scene_source)
+{
+    obs_scene_t *scene = obs_scene_from_source(scene_source);
+    if (scene && obs_source_showing(scene_source)) {
+        obs_scene_enum_items(scene, canon_eos_collect_nested, param);
+    }
+    return true;
+}
+
+static bool canon_eos_measure_scene(void *param, obs_source_t *scene_source)
+{
+    struct canvas_size *canvas = param;
+    obs_scene_t *scene = obs_scene_from_source(scene_source);
+
+    if (!scene || !obs_source_showing(scene_source)) {
+        return true;
+    }
+
+    // Scenes shown inside another scene are measured through that one
+    for (size_t i = 0; i < canvas->nested_count; i++) {
+        if (canvas->nested[i] == scene_source) {
+            return true;
         }
     }
 
-    pthread_mutex_unlock(&source->mutex);
+    canvas->scale_x = 1.0f;
+    canvas->scale_y = 1.0f;
+    canvas->depth = 0;
+    obs_scene_enum_items(scene, canon_eos_measure_item, canvas);
+    return true;
 }
 
-static void *canon_eos_create(obs_data_t *settings, obs_source_t *source)
+static void canon_eos_plan_decode_size(struct canon_eos_source *source)
 {
-    struct canon_eos_source *eos = bzalloc(sizeof(struct canon_eos_source));
-    eos->source = source;
+    struct canvas_size canvas = {
+        .target = source->source
+    };
 
-    pthread_mutex_init(&eos->mutex, NULL);
+    obs_enum_scenes(canon_eos_collect_scene, &canvas);
+    obs_enum_scenes(canon_eos_measure_scene, &canvas);
 
-    eos->video = video_source_create();
-    if (!eos->video) {
-        canon_log(LOG_ERROR, "Failed to create video source");
+    // Shown outside any scene (projector, preview only): keep the last size
+    if (canvas.width < 1.0f || canvas.height < 1.0f) {
+        return;
+    }
+
+    video_source_set_decode_size(source->video, (uint32_t)ceilf(canvas.width),
+                                 (uint32_t)ceilf(canvas.height));
+}
+
+static void *canon_eos_create_common(obs_data_t *settings, obs_source_t *source,
+                                     bool direct)
+{
+    struct canon_eos_source *eos = bzalloc(sizeof(struct canon_eos_source));
+    eos->source = source;
+    eos->direct = direct;
+    profiled_mutex_init(&eos->calibration_mutex, "calibration");
+
+    video_format_get_parameters(VIDEO_CS_709, VIDEO_RANGE_PARTIAL,
+                               eos->color_matrix, eos->color_range_min,
+                               eos->color_range_max);
+
+    // Direct upload sources pull frames from video_tick, no output thread
+    eos->pipeline = capture_pipeline_create(direct ? NULL : canon_eos_output_frame, eos);
+    if (!eos->pipeline) {
+        canon_log(LOG_ERROR, "Failed to create capture pipeline");
+        profiled_mutex_destroy(&eos->calibration_mutex);
         bfree(eos);
         return NULL;
     }
+    eos->video = capture_pipeline_get_video(eos->pipeline);
+    // video_tick only takes frames the capture thread has decoded already
+    video_source_set_decode_ahead(eos->video, direct);
+    eos->stats_plugin_cpu_ns = thread_registry_total_ns();
+    eos->stats_timestamp = os_gettime_ns();
 
     canon_eos_get_defaults(settings);
     canon_eos_update(eos, settings);
@@ -261,101 +754,307 @@ static void *canon_eos_create(obs_data_t *settings, obs_source_t *source)
     return eos;
 }
 
+static void *canon_eos_create(obs_data_t *settings, obs_source_t *source)
+{
+    return canon_eos_create_common(settings, source, false);
+}
+
+static void *canon_eos_direct_create(obs_data_t *settings, obs_source_t *source)
+{
+    return canon_eos_create_common(settings, source, true);
+}
+
 static void canon_eos_destroy(void *data)
 {
     struct canon_eos_source *source = data;
 
-    // Stop capture thread first (must be done before destroying resources)
-    if (source->thread_running) {
-        pthread_mutex_lock(&source->mutex);
-        source->thread_running = false;
-        source->active = false;
-        pthread_mutex_unlock(&source->mutex);
+    if (source->pending_valid) {
+        video_source_release_frame(source->video, &source->pending);
+        source->pending_valid = false;
+    }
+
+    // Stops the output and capture threads before releasing the camera
+    capture_pipeline_destroy(source->pipeline);
 
-        pthread_join(source->capture_thread, NULL);
+    if (source->tex_y || source->tex_uv || source->effect) {
+        obs_enter_graphics();
+        gs_texture_destroy(source->tex_y);
+        gs_texture_destroy(source->tex_uv);
+        gs_effect_destroy(source->effect);
+        obs_leave_graphics();
     }
 
-    pthread_mutex_lock(&source->mutex);
+    profiled_mutex_destroy(&source->calibration_mutex);
+    bfree(source);
+}
+
+static void canon_eos_activate(void *data)
+{
+    struct canon_eos_source *source = data;
+
+    capture_pipeline_activate(source->pipeline);
+
+    canon_log(LOG_INFO, "Source activated");
+    logging_memory_stats();
+}
 
-    if (source->camera) {
-        canon_camera_disconnect(source->camera);
-        canon_camera_destroy(source->camera);
+static void canon_eos_deactivate(void *data)
+{
+    struct canon_eos_source *source = data;
+
+    if (source->pending_valid) {
+        video_source_release_frame(source->video, &source->pending);
+        source->pending_valid = false;
+    }
+
+    capture_pipeline_deactivate(source->pipeline);
+
+    canon_log(LOG_INFO, "Source deactivated");
+}
+
+static void canon_eos_direct_tick(void *data, float seconds)
+{
+    struct canon_eos_source *source = data;
+
+    if (!capture_pipeline_is_running(source->pipeline)) {
+        return;
     }
 
-    if (source->video) {
-        video_source_destroy(source->video);
+    // Scene items are resized without telling the source; check periodically
+    if (source->auto_scale) {
+        source->replan_elapsed += seconds;
+        if (source->replan_elapsed >= DECODE_REPLAN_INTERVAL) {
+            source->replan_elapsed = 0.0f;
+            canon_eos_plan_decode_size(source);
+        }
     }
 
-    if (source->device_path) {
-        bfree(source->device_path);
+    struct obs_source_frame frame = {0};
+    if (video_source_get_latest_frame(source->video, &frame) != CANON_SUCCESS) {
+        return;
     }
 
-    pthread_mutex_unlock(&source->mutex);
-    pthread_mutex_destroy(&source->mutex);
+    // A frame that was never rendered is superseded by the newer one
+    if (source->pending_valid) {
+        video_source_release_frame(source->video, &source->pending);
+    }
 
-    bfree(source);
+    source->pending = frame;
+    source->pending_valid = true;
 }
 
-static void canon_eos_activate(void *data)
+static void canon_eos_direct_upload(struct canon_eos_source *source)
 {
-    struct canon_eos_source *source = data;
+    struct obs_source_frame *frame = &source->pending;
 
-    pthread_mutex_lock(&source->mutex);
-    source->active = true;
-
-    if (!source->thread_running && source->camera) {
-        // Initialize video source with camera
-        if (source->video) {
-            video_format_info_t format = {
-                .width = source->width,
-                .height = source->height,
-                .fps = source->fps,
-                .format = VIDEO_FORMAT_NV12
-            };
-
-            canon_error_t err = video_source_init(source->video, source->camera, &format);
-            if (err != CANON_SUCCESS) {
-                canon_log(LOG_ERROR, "Failed to initialize video source: %s", canon_error_string(err));
-                pthread_mutex_unlock(&source->mutex);
-                return;
-            }
-
-            err = video_source_start(source->video);
-            if (err != CANON_SUCCESS) {
-                canon_log(LOG_ERROR, "Failed to start video source: %s", canon_error_string(err));
-                pthread_mutex_unlock(&source->mutex);
-                return;
-            }
-
-            canon_log(LOG_INFO, "Video source started successfully");
+    if (!source->effect) {
+        char *errors = NULL;
+        source->effect = gs_effect_create(nv12_effect_source, "canon-eos-nv12.effect", &errors);
+        if (!source->effect) {
+            canon_log(LOG_ERROR, "Failed to create NV12 effect: %s", errors ? errors : "unknown");
         }
+        bfree(errors);
+    }
+
+    if (!source->tex_y || source->tex_width != frame->width ||
+        source->tex_height != frame->height) {
+        gs_texture_destroy(source->tex_y);
+        gs_texture_destroy(source->tex_uv);
+
+        source->tex_y = gs_texture_create(frame->width, frame->height,
+                                         GS_R8, 1, NULL, GS_DYNAMIC);
+        source->tex_uv = gs_texture_create((frame->width + 1) / 2, (frame->height + 1) / 2,
+                                          GS_R8G8, 1, NULL, GS_DYNAMIC);
+        source->tex_width = frame->width;
+        source->tex_height = frame->height;
 
-        source->thread_running = true;
-        pthread_create(&source->capture_thread, NULL,
-                      canon_eos_capture_thread, source);
+        canon_log(LOG_INFO, "Direct upload textures created: %ux%u",
+                 frame->width, frame->height);
     }
-    pthread_mutex_unlock(&source->mutex);
 
-    canon_log(LOG_INFO, "Source activated");
+    video_source_get_frame_full_size(source->video, frame, &source->display_width,
+                                     &source->display_height);
+
+    // Upload straight from the pool buffer, the driver map is the only copy
+    if (source->tex_y && source->tex_uv) {
+        // The copy into the driver's map counts towards this camera
+        uint64_t cpu_start = thread_registry_charge_begin();
+        uint64_t span = trace_begin();
+        gs_texture_set_image(source->tex_y, frame->data[0], frame->linesize[0], false);
+        gs_texture_set_image(source->tex_uv, frame->data[1], frame->linesize[1], false);
+        trace_end(TRACE_OUTPUT, span, source->frame_count);
+        thread_registry_charge_end(capture_pipeline_get_cpu_group(source->pipeline),
+                                   THREAD_ROLE_RENDER, cpu_start);
+        source->frame_count++;
+    }
+
+    video_source_release_frame(source->video, frame);
+    source->pending_valid = false;
 }
 
-static void canon_eos_deactivate(void *data)
+static void canon_eos_direct_render(void *data, gs_effect_t *unused)
 {
+    UNUSED_PARAMETER(unused);
     struct canon_eos_source *source = data;
 
-    pthread_mutex_lock(&source->mutex);
-    source->active = false;
+    if (source->pending_valid) {
+        canon_eos_direct_upload(source);
+    }
 
-    // Stop capture thread on deactivate
-    if (source->thread_running) {
-        source->thread_running = false;
-        pthread_mutex_unlock(&source->mutex);
-        pthread_join(source->capture_thread, NULL);
-    } else {
-        pthread_mutex_unlock(&source->mutex);
+    if (!source->effect || !source->tex_y || !source->tex_uv) {
+        return;
     }
 
-    canon_log(LOG_INFO, "Source deactivated");
+    gs_effect_set_texture(gs_effect_get_param_by_name(source->effect, "image_y"),
+                         source->tex_y);
+    gs_effect_set_texture(gs_effect_get_param_by_name(source->effect, "image_uv"),
+                         source->tex_uv);
+    gs_effect_set_val(gs_effect_get_param_by_name(source->effect, "color_matrix"),
+                     source->color_matrix, sizeof(source->color_matrix));
+    gs_effect_set_val(gs_effect_get_param_by_name(source->effect, "color_range_min"),
+                     source->color_range_min, sizeof(source->color_range_min));
+    gs_effect_set_val(gs_effect_get_param_by_name(source->effect, "color_range_max"),
+                     source->color_range_max, sizeof(source->color_range_max));
+
+    // Same orientation as the async path (frame.flip = true); frames decoded
+    // at a smaller scale are stretched back to the full-size layout
+    while (gs_effect_loop(source->effect, "Draw")) {
+        gs_draw_sprite(source->tex_y, GS_FLIP_V, source->display_width,
+                       source->display_height);
+    }
+}
+
+static uint32_t canon_eos_direct_get_width(void *data)
+{
+    struct canon_eos_source *source = data;
+    return source->display_width;
+}
+
+static uint32_t canon_eos_direct_get_height(void *data)
+{
+    struct canon_eos_source *source = data;
+    return source->display_height;
+}
+
+static void canon_eos_grid_get_defaults(obs_data_t *settings)
+{
+    for (int i = 1; i <= MULTICAM_GRID_MAX_CAMERAS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "camera_%d", i);
+        obs_data_set_default_string(settings, name, "");
+    }
+    obs_data_set_default_int(settings, "grid_scale", 4);
+    obs_data_set_default_int(settings, "fps", 30);
+    obs_data_set_default_string(settings, "decoder", "auto");
+}
+
+static obs_properties_t *canon_eos_grid_get_properties(void *data)
+{
+    UNUSED_PARAMETER(data);
+    obs_properties_t *props = obs_properties_create();
+
+    // Tiles fill the grid row by row in this order; unused entries are skipped
+    for (int i = 1; i <= MULTICAM_GRID_MAX_CAMERAS; i++) {
+        char name[16];
+        char description[32];
+        snprintf(name, sizeof(name), "camera_%d", i);
+        snprintf(description, sizeof(description), "Camera %d", i);
+        canon_eos_add_device_list(props, name, description);
+    }
+
+    obs_property_t *scale = obs_properties_add_list(
+        props, "grid_scale", "Tile Size",
+        OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+    obs_property_list_add_int(scale, "1/4 of the Live View (e.g. 256x144)", 4);
+    obs_property_list_add_int(scale, "1/8 of the Live View (e.g. 128x72)", 8);
+
+    obs_properties_add_int_slider(props, "fps", "Frame Rate", 24, 60, 1);
+
+    canon_eos_add_decoder_list(props);
+
+    return props;
+}
+
+static void canon_eos_grid_output_frame(struct obs_source_frame *frame, void *data)
+{
+    struct canon_eos_grid_source *source = data;
+
+    // Tiles are decoded like the single camera sources, so the grid is
+    // flipped the same way and laid out bottom-up (see the settings)
+    frame->full_range = false;
+    frame->flip = true;
+    memcpy(frame->color_matrix, source->color_matrix, sizeof(source->color_matrix));
+    memcpy(frame->color_range_min, source->color_range_min, sizeof(source->color_range_min));
+    memcpy(frame->color_range_max, source->color_range_max, sizeof(source->color_range_max));
+
+    obs_source_output_video(source->source, frame);
+}
+
+static void canon_eos_grid_update(void *data, obs_data_t *settings)
+{
+    struct canon_eos_grid_source *source = data;
+
+    multicam_grid_settings_t grid_settings = {
+        .scale = (uint32_t)obs_data_get_int(settings, "grid_scale"),
+        .fps = (uint32_t)obs_data_get_int(settings, "fps"),
+        .decoder = obs_data_get_string(settings, "decoder"),
+        .bottom_up = true
+    };
+    for (int i = 0; i < MULTICAM_GRID_MAX_CAMERAS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "camera_%d", i + 1);
+        grid_settings.devices[i] = obs_data_get_string(settings, name);
+    }
+
+    multicam_grid_update(source->grid, &grid_settings);
+}
+
+static void *canon_eos_grid_create(obs_data_t *settings, obs_source_t *source)
+{
+    struct canon_eos_grid_source *grid = bzalloc(sizeof(struct canon_eos_grid_source));
+    grid->source = source;
+
+    video_format_get_parameters(VIDEO_CS_709, VIDEO_RANGE_PARTIAL,
+                               grid->color_matrix, grid->color_range_min,
+                               grid->color_range_max);
+
+    grid->grid = multicam_grid_create(canon_eos_grid_output_frame, grid);
+    if (!grid->grid) {
+        canon_log(LOG_ERROR, "Failed to create multicam grid");
+        bfree(grid);
+        return NULL;
+    }
+
+    canon_eos_grid_get_defaults(settings);
+    canon_eos_grid_update(grid, settings);
+
+    return grid;
+}
+
+static void canon_eos_grid_destroy(void *data)
+{
+    struct canon_eos_grid_source *source = data;
+
+    // Stops the grid thread before the cameras
+    multicam_grid_destroy(source->grid);
+    bfree(source);
+}
+
+static void canon_eos_grid_activate(void *data)
+{
+    struct canon_eos_grid_source *source = data;
+
+    multicam_grid_activate(source->grid);
+    canon_log(LOG_INFO, "Grid source activated");
+}
+
+static void canon_eos_grid_deactivate(void *data)
+{
+    struct canon_eos_grid_source *source = data;
+
+    multicam_grid_deactivate(source->grid);
+    canon_log(LOG_INFO, "Grid source deactivated");
 }
 
 static struct obs_source_info canon_eos_source = {
@@ -373,6 +1072,49 @@ static struct obs_source_info canon_eos_source = {
     .icon_type = OBS_ICON_TYPE_CAMERA,
 };
 
+/**
+ * Synchronous variant that uploads decoded frames from the video source pool
+ * straight into GPU textures, skipping the copy into OBS's async frame cache.
+ */
+static struct obs_source_info canon_eos_direct_source = {
+    .id = "canon_eos_camera_direct_source",
+    .type = OBS_SOURCE_TYPE_INPUT,
+    .output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW |
+                    OBS_SOURCE_DO_NOT_DUPLICATE,
+    .get_name = canon_eos_direct_get_name,
+    .create = canon_eos_direct_create,
+    .destroy = canon_eos_destroy,
+    .get_defaults = canon_eos_get_defaults,
+    .get_properties = canon_eos_get_properties,
+    .update = canon_eos_update,
+    .activate = canon_eos_activate,
+    .deactivate = canon_eos_deactivate,
+    .video_tick = canon_eos_direct_tick,
+    .video_render = canon_eos_direct_render,
+    .get_width = canon_eos_direct_get_width,
+    .get_height = canon_eos_direct_get_height,
+    .icon_type = OBS_ICON_TYPE_CAMERA,
+};
+
+/**
+ * Several cameras in one async source: each decoded at 1/4 or 1/8 scale
+ * into its tile of a shared frame, so OBS gets one upload per frame.
+ */
+static struct obs_source_info canon_eos_grid_source = {
+    .id = "canon_eos_camera_grid_source",
+    .type = OBS_SOURCE_TYPE_INPUT,
+    .output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_DO_NOT_DUPLICATE,
+    .get_name = canon_eos_grid_get_name,
+    .create = canon_eos_grid_create,
+    .destroy = canon_eos_grid_destroy,
+    .get_defaults = canon_eos_grid_get_defaults,
+    .get_properties = canon_eos_grid_get_properties,
+    .update = canon_eos_grid_update,
+    .activate = canon_eos_grid_activate,
+    .deactivate = canon_eos_grid_deactivate,
+    .icon_type = OBS_ICON_TYPE_CAMERA,
+};
+
 bool obs_module_load(void)
 {
     pthread_mutex_lock(&g_plugin_mutex);
@@ -383,6 +1125,7 @@ bool obs_module_load(void)
     }
 
     canon_log(LOG_INFO, "Loading Canon EOS plugin v%s", PLUGIN_VERSION);
+    lock_profiler_init();
 
     if (canon_camera_init_library() != CANON_SUCCESS) {
         canon_log(LOG_ERROR, "Failed to initialize camera library");
@@ -408,6 +1151,25 @@ bool obs_module_load(void)
     }
 
     obs_register_source(&canon_eos_source);
+    obs_register_source(&canon_eos_direct_source);
+    obs_register_source(&canon_eos_grid_source);
+
+    // Decoder choices of the last host calibration, if any
+    char profile[512];
+    if (host_calibration_profile_path(profile, sizeof(profile))) {
+        host_calibration_load_profile(profile);
+    }
+
+    // Optional: CANON_EOS_METRICS_FILE enables the Prometheus textfile writer
+    g_metrics = metrics_exporter_create_from_env();
+    if (g_metrics && metrics_exporter_start(g_metrics) != CANON_SUCCESS) {
+        metrics_exporter_destroy(g_metrics);
+        g_metrics = NULL;
+    }
+
+    g_trace_hotkey = obs_hotkey_register_frontend("canon_eos_trace",
+                                                  "Canon EOS: Start/Stop Trace Recording",
+                                                  canon_eos_trace_hotkey, NULL);
 
     g_plugin_initialized = true;
     pthread_mutex_unlock(&g_plugin_mutex);
@@ -427,6 +1189,14 @@ void obs_module_unload(void)
 
     canon_log(LOG_INFO, "Unloading Canon EOS plugin");
 
+    metrics_exporter_destroy(g_metrics);
+    g_metrics = NULL;
+
+    if (g_trace_hotkey != OBS_INVALID_HOTKEY_ID) {
+        obs_hotkey_unregister(g_trace_hotkey);
+        g_trace_hotkey = OBS_INVALID_HOTKEY_ID;
+    }
+
     if (g_detector) {
         camera_detector_stop(g_detector);
         camera_detector_destroy(g_detector);
@@ -434,6 +1204,8 @@ void obs_module_unload(void)
     }
 
     canon_camera_cleanup_library();
+    lock_profiler_dump();
+    trace_recorder_shutdown();
 
     g_plugin_initialized = false;
     pthread_mutex_unlock(&g_plugin_mutex);
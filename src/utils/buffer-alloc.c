@@ -0,0 +1,118 @@
+#include "buffer-alloc.h"
+#include "logging.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static buffer_mode_t mode = BUFFER_MODE_DEFAULT;
+static bool lock_failed = false;       // Atomic; warn once
+static size_t page_size = 4096;
+
+static void read_environment(void)
+{
+    long size = sysconf(_SC_PAGESIZE);
+    if (size > 0) {
+        page_size = (size_t)size;
+    }
+
+    const char *value = getenv("CANON_EOS_BUFFER_MODE");
+    if (!value || !*value || strcmp(value, "default") == 0) {
+        return;
+    }
+
+    if (strcmp(value, "prefault") == 0) {
+        mode = BUFFER_MODE_PREFAULT;
+    } else if (strcmp(value, "locked") == 0) {
+        mode = BUFFER_MODE_LOCKED;
+    } else {
+        canon_log(LOG_WARNING, "Unknown CANON_EOS_BUFFER_MODE '%s' "
+                 "(expected default, prefault or locked)", value);
+        return;
+    }
+
+    canon_log(LOG_INFO, "Pipeline buffers: %s", mode == BUFFER_MODE_LOCKED
+             ? "prefaulted and locked" : "prefaulted");
+}
+
+buffer_mode_t buffer_alloc_mode(void)
+{
+    pthread_once(&init_once, read_environment);
+    return mode;
+}
+
+static void warn_lock_failed(size_t size, int error)
+{
+    if (__atomic_exchange_n(&lock_failed, true, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        canon_log(LOG_WARNING, "Cannot lock %.1f MB pipeline buffer (%s), "
+                 "RLIMIT_MEMLOCK is %.1f MB; buffers stay prefaulted but unlocked "
+                 "(raise it with ulimit -l or LimitMEMLOCK=)",
+                 (double)size / 1048576.0, strerror(error),
+                 (double)limit.rlim_cur / 1048576.0);
+    } else {
+        canon_log(LOG_WARNING, "Cannot lock %.1f MB pipeline buffer (%s); "
+                 "buffers stay prefaulted but unlocked",
+                 (double)size / 1048576.0, strerror(error));
+    }
+}
+
+void *buffer_alloc(size_t size)
+{
+    if (buffer_alloc_mode() == BUFFER_MODE_DEFAULT || size == 0) {
+        return malloc(size);
+    }
+
+    // Huge page alignment lets the kernel back the buffer with 2 MB pages
+    void *ptr = NULL;
+    size_t alignment = size >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : page_size;
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+        return NULL;
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (size >= HUGE_PAGE_SIZE) {
+        madvise(ptr, size - size % HUGE_PAGE_SIZE, MADV_HUGEPAGE);
+    }
+#endif
+
+    volatile uint8_t *bytes = ptr;
+    for (size_t offset = 0; offset < size; offset += page_size) {
+        bytes[offset] = 0;
+    }
+    bytes[size - 1] = 0;
+
+    if (mode == BUFFER_MODE_LOCKED) {
+        if (mlock(ptr, size) != 0) {
+            warn_lock_failed(size, errno);
+        }
+    }
+
+    return ptr;
+}
+
+void buffer_free(void *ptr, size_t size)
+{
+    if (!ptr) {
+        return;
+    }
+
+    // Unlock before free() can hand the pages to another allocation. This is
+    // harmless for buffers whose mlock() failed.
+    if (mode == BUFFER_MODE_LOCKED && size > 0) {
+        munlock(ptr, size);
+    }
+
+    free(ptr);
+}
@@ -0,0 +1,51 @@
+#ifndef BUFFER_ALLOC_H
+#define BUFFER_ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Allocation of large pipeline buffers (frame pool, staging buffer)
+ *
+ * CANON_EOS_BUFFER_MODE selects how they are backed:
+ *   unset / "default"  plain malloc(); pages fault in on first use, which is
+ *                      inside the first frames' decode
+ *   "prefault"         touch every page at allocation, with transparent huge
+ *                      pages requested where the kernel allows madvise
+ *   "locked"           prefault and mlock(), so the pages are never swapped
+ *                      or reclaimed; falls back to prefault past
+ *                      RLIMIT_MEMLOCK
+ *
+ * Buffers are allocated when a source gets its camera or is started, never
+ * on the capture path, so prefaulting moves all faults out of it.
+ */
+
+/**
+ * @brief Buffer backing modes
+ */
+typedef enum {
+    BUFFER_MODE_DEFAULT = 0,
+    BUFFER_MODE_PREFAULT,
+    BUFFER_MODE_LOCKED
+} buffer_mode_t;
+
+/**
+ * @brief Get the mode selected by CANON_EOS_BUFFER_MODE
+ */
+buffer_mode_t buffer_alloc_mode(void);
+
+/**
+ * @brief Allocate a buffer in the configured mode
+ * @param size Bytes
+ * @return Buffer or NULL if out of memory
+ */
+void *buffer_alloc(size_t size);
+
+/**
+ * @brief Free a buffer from buffer_alloc()
+ * @param ptr Buffer (may be NULL)
+ * @param size Size given to buffer_alloc()
+ */
+void buffer_free(void *ptr, size_t size);
+
+#endif /* BUFFER_ALLOC_H */
@@ -32,6 +32,8 @@ const char* canon_error_string(canon_error_t error)
             return "Device disconnected";
         case CANON_ERROR_PERMISSION:
             return "Permission denied";
+        case CANON_ERROR_MEMORY_BUDGET:
+            return "Memory budget exceeded";
         case CANON_ERROR_UNKNOWN:
         default:
             return "Unknown error";
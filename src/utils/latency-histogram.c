@@ -0,0 +1,170 @@
+#include "latency-histogram.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define SUB_BITS 3
+
+static int bucket_index(uint64_t value)
+{
+    if (value < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return (int)value;
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SUB_BITS;
+    int index = (shift + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS +
+                (int)((value >> shift) & (LATENCY_HISTOGRAM_SUB_BUCKETS - 1));
+
+    if (index >= LATENCY_HISTOGRAM_BUCKETS) {
+        index = LATENCY_HISTOGRAM_BUCKETS - 1;
+    }
+    return index;
+}
+
+static uint64_t bucket_upper_bound(int index)
+{
+    if (index < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+
+    int shift = index / LATENCY_HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t sub = (uint64_t)(index % LATENCY_HISTOGRAM_SUB_BUCKETS);
+
+    return ((LATENCY_HISTOGRAM_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void latency_histogram_reset(latency_histogram_t *hist)
+{
+    if (hist) {
+        memset(hist, 0, sizeof(*hist));
+    }
+}
+
+void latency_histogram_record(latency_histogram_t *hist, uint64_t value)
+{
+    if (!hist) {
+        return;
+    }
+
+    hist->counts[bucket_index(value)]++;
+    hist->total++;
+    hist->sum += value;
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+void latency_histogram_record_atomic(latency_histogram_t *hist, uint64_t value)
+{
+    if (!hist) {
+        return;
+    }
+
+    __atomic_add_fetch(&hist->counts[bucket_index(value)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hist->sum, value, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hist->total, 1, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    while (value > max &&
+           !__atomic_compare_exchange_n(&hist->max, &max, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void latency_histogram_load(latency_histogram_t *dst, const latency_histogram_t *src)
+{
+    if (!dst || !src) {
+        return;
+    }
+
+    dst->sum = __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+    dst->max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+
+    // Derive total from the buckets so percentiles stay consistent with
+    // samples recorded during the copy
+    dst->total = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        dst->counts[i] = __atomic_load_n(&src->counts[i], __ATOMIC_RELAXED);
+        dst->total += dst->counts[i];
+    }
+}
+
+void latency_histogram_merge(latency_histogram_t *hist,
+                             const latency_histogram_t *other)
+{
+    if (!hist || !other) {
+        return;
+    }
+
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        hist->counts[i] += other->counts[i];
+    }
+    hist->total += other->total;
+    hist->sum += other->sum;
+    if (other->max > hist->max) {
+        hist->max = other->max;
+    }
+}
+
+void latency_histogram_subtract(latency_histogram_t *result,
+                                const latency_histogram_t *later,
+                                const latency_histogram_t *earlier)
+{
+    if (!result || !later || !earlier) {
+        return;
+    }
+
+    result->max = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        uint64_t count = later->counts[i] >= earlier->counts[i] ?
+                         later->counts[i] - earlier->counts[i] : 0;
+        result->counts[i] = count;
+        if (count > 0) {
+            result->max = bucket_upper_bound(i);
+        }
+    }
+    result->total = later->total >= earlier->total ? later->total - earlier->total : 0;
+    result->sum = later->sum >= earlier->sum ? later->sum - earlier->sum : 0;
+
+    if (result->max > later->max) {
+        result->max = later->max;
+    }
+}
+
+uint64_t latency_histogram_percentile(const latency_histogram_t *hist,
+                                      double percentile)
+{
+    if (!hist || hist->total == 0) {
+        return 0;
+    }
+
+    if (percentile < 0.0) {
+        percentile = 0.0;
+    } else if (percentile > 100.0) {
+        percentile = 100.0;
+    }
+
+    uint64_t target = (uint64_t)((percentile / 100.0) * (double)hist->total + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= target) {
+            uint64_t bound = bucket_upper_bound(i);
+            return bound < hist->max ? bound : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+double latency_histogram_mean(const latency_histogram_t *hist)
+{
+    if (!hist || hist->total == 0) {
+        return 0.0;
+    }
+
+    return (double)hist->sum / (double)hist->total;
+}
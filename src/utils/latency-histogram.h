@@ -0,0 +1,90 @@
+#ifndef UTILS_LATENCY_HISTOGRAM_H
+#define UTILS_LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+/**
+ * @brief Log-linear bucketing: 8 sub-buckets per power of two (~12% error)
+ */
+#define LATENCY_HISTOGRAM_SUB_BUCKETS 8
+#define LATENCY_HISTOGRAM_BUCKETS (62 * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * @brief Fixed-size latency histogram (plain struct, safe to copy)
+ */
+typedef struct {
+    uint64_t counts[LATENCY_HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+} latency_histogram_t;
+
+/**
+ * @brief Clear all samples
+ * @param hist Histogram
+ */
+void latency_histogram_reset(latency_histogram_t *hist);
+
+/**
+ * @brief Record one sample
+ * @param hist Histogram
+ * @param value Sample value (e.g. nanoseconds)
+ */
+void latency_histogram_record(latency_histogram_t *hist, uint64_t value);
+
+/**
+ * @brief Record one sample with atomic updates
+ *
+ * For histograms read concurrently with latency_histogram_load(). Several
+ * writers may record into the same histogram at once.
+ * @param hist Histogram
+ * @param value Sample value
+ */
+void latency_histogram_record_atomic(latency_histogram_t *hist, uint64_t value);
+
+/**
+ * @brief Copy a histogram updated with latency_histogram_record_atomic()
+ *
+ * Lock-free; the copy may be off by the samples recorded while it is taken.
+ * @param dst Output histogram
+ * @param src Histogram being recorded into
+ */
+void latency_histogram_load(latency_histogram_t *dst, const latency_histogram_t *src);
+
+/**
+ * @brief Add all samples of another histogram
+ * @param hist Destination histogram
+ * @param other Source histogram
+ */
+void latency_histogram_merge(latency_histogram_t *hist,
+                             const latency_histogram_t *other);
+
+/**
+ * @brief Compute the samples recorded between two cumulative snapshots
+ *
+ * The max of the result is approximated from the highest non-empty bucket.
+ * @param result Output histogram (later - earlier)
+ * @param later Later snapshot
+ * @param earlier Earlier snapshot of the same histogram
+ */
+void latency_histogram_subtract(latency_histogram_t *result,
+                                const latency_histogram_t *later,
+                                const latency_histogram_t *earlier);
+
+/**
+ * @brief Value at a percentile
+ * @param hist Histogram
+ * @param percentile Percentile in [0, 100]
+ * @return Upper bound of the bucket holding the percentile, 0 if empty
+ */
+uint64_t latency_histogram_percentile(const latency_histogram_t *hist,
+                                      double percentile);
+
+/**
+ * @brief Mean sample value
+ * @param hist Histogram
+ * @return Mean, 0 if empty
+ */
+double latency_histogram_mean(const latency_histogram_t *hist);
+
+#endif /* UTILS_LATENCY_HISTOGRAM_H */
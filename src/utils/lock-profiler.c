@@ -0,0 +1,387 @@
+#include "lock-profiler.h"
+#include "logging.h"
+#include <util/platform.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LOCK_NAMES 32
+#define MAX_LOCK_SITES 256
+#define DUMP_SITE_COUNT 10
+#define SITE_CACHE_SIZE 32      // Direct-mapped, per lock instance
+
+/**
+ * @brief Call site statistics resolved for one lock instance
+ */
+typedef struct {
+    const char *file;
+    int line;
+    lock_stats_t *site;
+} site_cache_entry_t;
+
+/**
+ * @brief Per-instance profiling state, allocated only when profiling is on
+ *
+ * acquired_at, holder and the site cache are only touched by the thread
+ * holding the mutex, so they need no further locking.
+ */
+struct lock_profile_t {
+    lock_stats_t stats;
+    lock_stats_t *totals;       /**< Per-name totals */
+    uint64_t acquired_at;
+    lock_stats_t *holder;       /**< Call site that acquired the lock */
+    site_cache_entry_t site_cache[SITE_CACHE_SIZE];
+};
+
+/* The name and site tables only change under stats_mutex, taken when a lock
+ * or call site is first seen and when statistics are read. It is a leaf
+ * lock: never held while acquiring a profiled mutex. Counters are updated
+ * with atomics, so recording an acquisition takes no global lock. */
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static bool enabled = false;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static lock_stats_t *names[MAX_LOCK_NAMES];
+static size_t name_count = 0;
+static lock_stats_t *sites[MAX_LOCK_SITES];
+static size_t site_count = 0;
+
+static void read_environment(void)
+{
+    const char *value = getenv("CANON_EOS_LOCK_PROFILE");
+    enabled = value && *value && strcmp(value, "0") != 0;
+
+    if (enabled) {
+        canon_log(LOG_INFO, "Lock profiling enabled");
+    }
+}
+
+void lock_profiler_init(void)
+{
+    pthread_once(&init_once, read_environment);
+}
+
+bool lock_profiler_enabled(void)
+{
+    lock_profiler_init();
+    return enabled;
+}
+
+/* Called with stats_mutex held */
+static lock_stats_t *find_name(const char *name)
+{
+    for (size_t i = 0; i < name_count; i++) {
+        if (strcmp(names[i]->name, name) == 0) {
+            return names[i];
+        }
+    }
+
+    if (name_count == MAX_LOCK_NAMES) {
+        return NULL;
+    }
+
+    lock_stats_t *entry = calloc(1, sizeof(lock_stats_t));
+    if (entry) {
+        snprintf(entry->name, sizeof(entry->name), "%s", name);
+        names[name_count++] = entry;
+    }
+    return entry;
+}
+
+/* Called with stats_mutex held */
+static lock_stats_t *find_site(const char *name, const char *file, int line,
+                               const char *function)
+{
+    for (size_t i = 0; i < site_count; i++) {
+        lock_stats_t *site = sites[i];
+        if (site->line == line &&
+            (site->file == file || strcmp(site->file, file) == 0) &&
+            strcmp(site->name, name) == 0) {
+            return site;
+        }
+    }
+
+    if (site_count == MAX_LOCK_SITES) {
+        return NULL;
+    }
+
+    lock_stats_t *entry = calloc(1, sizeof(lock_stats_t));
+    if (entry) {
+        snprintf(entry->name, sizeof(entry->name), "%s", name);
+        entry->file = file;
+        entry->line = line;
+        entry->function = function;
+        sites[site_count++] = entry;
+    }
+    return entry;
+}
+
+/* Called by the holder; the global table is only searched the first time
+ * this lock is taken at a call site (or after a cache collision). */
+static lock_stats_t *resolve_site(struct lock_profile_t *profile, const char *file, int line,
+                                  const char *function)
+{
+    size_t slot = (((uintptr_t)file >> 3) ^ (uintptr_t)line * 31u) % SITE_CACHE_SIZE;
+    site_cache_entry_t *entry = &profile->site_cache[slot];
+
+    if (entry->file == file && entry->line == line) {
+        return entry->site;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    lock_stats_t *site = find_site(profile->stats.name, file, line, function);
+    pthread_mutex_unlock(&stats_mutex);
+
+    entry->file = file;
+    entry->line = line;
+    entry->site = site;
+    return site;
+}
+
+static void record(lock_stats_t *stats, bool contended, uint64_t wait)
+{
+    if (!stats) {
+        return;
+    }
+
+    __atomic_add_fetch(&stats->acquisitions, 1, __ATOMIC_RELAXED);
+    if (contended) {
+        __atomic_add_fetch(&stats->contended, 1, __ATOMIC_RELAXED);
+    }
+    latency_histogram_record_atomic(&stats->wait, wait);
+}
+
+/* Called by the new holder right after acquiring the mutex */
+static void record_acquire(struct lock_profile_t *profile, bool contended, uint64_t start,
+                           const char *file, int line, const char *function)
+{
+    uint64_t now = os_gettime_ns();
+    uint64_t wait = contended ? now - start : 0;
+
+    lock_stats_t *site = resolve_site(profile, file, line, function);
+    record(&profile->stats, contended, wait);
+    record(profile->totals, contended, wait);
+    record(site, contended, wait);
+
+    profile->holder = site;
+    profile->acquired_at = os_gettime_ns();
+}
+
+/* Called by the holder right before releasing the mutex */
+static void record_release(struct lock_profile_t *profile)
+{
+    uint64_t hold = os_gettime_ns() - profile->acquired_at;
+
+    latency_histogram_record_atomic(&profile->stats.hold, hold);
+    if (profile->totals) {
+        latency_histogram_record_atomic(&profile->totals->hold, hold);
+    }
+    if (profile->holder) {
+        latency_histogram_record_atomic(&profile->holder->hold, hold);
+    }
+}
+
+/* Copy statistics that may be recorded into concurrently */
+static void load_stats(lock_stats_t *dst, const lock_stats_t *src)
+{
+    memcpy(dst->name, src->name, sizeof(dst->name));
+    dst->file = src->file;
+    dst->line = src->line;
+    dst->function = src->function;
+    dst->acquisitions = __atomic_load_n(&src->acquisitions, __ATOMIC_RELAXED);
+    dst->contended = __atomic_load_n(&src->contended, __ATOMIC_RELAXED);
+    latency_histogram_load(&dst->wait, &src->wait);
+    latency_histogram_load(&dst->hold, &src->hold);
+}
+
+int profiled_mutex_init(profiled_mutex_t *mutex, const char *name)
+{
+    mutex->profile = NULL;
+
+    int ret = pthread_mutex_init(&mutex->mutex, NULL);
+    if (ret != 0 || !lock_profiler_enabled()) {
+        return ret;
+    }
+
+    struct lock_profile_t *profile = calloc(1, sizeof(struct lock_profile_t));
+    if (!profile) {
+        // Profiling is best effort; the mutex itself works
+        canon_log(LOG_WARNING, "Failed to allocate lock profile for '%s'", name);
+        return 0;
+    }
+
+    snprintf(profile->stats.name, sizeof(profile->stats.name), "%s", name);
+
+    pthread_mutex_lock(&stats_mutex);
+    profile->totals = find_name(name);
+    pthread_mutex_unlock(&stats_mutex);
+
+    mutex->profile = profile;
+    return 0;
+}
+
+void profiled_mutex_destroy(profiled_mutex_t *mutex)
+{
+    pthread_mutex_destroy(&mutex->mutex);
+    free(mutex->profile);
+    mutex->profile = NULL;
+}
+
+void profiled_mutex_lock_at(profiled_mutex_t *mutex, const char *file, int line,
+                            const char *function)
+{
+    struct lock_profile_t *profile = mutex->profile;
+    if (!profile) {
+        pthread_mutex_lock(&mutex->mutex);
+        return;
+    }
+
+    uint64_t start = os_gettime_ns();
+    bool contended = pthread_mutex_trylock(&mutex->mutex) == EBUSY;
+    if (contended) {
+        pthread_mutex_lock(&mutex->mutex);
+    }
+
+    record_acquire(profile, contended, start, file, line, function);
+}
+
+int profiled_mutex_trylock_at(profiled_mutex_t *mutex, const char *file, int line,
+                              const char *function)
+{
+    int ret = pthread_mutex_trylock(&mutex->mutex);
+
+    if (ret == 0 && mutex->profile) {
+        record_acquire(mutex->profile, false, 0, file, line, function);
+    }
+    return ret;
+}
+
+void profiled_mutex_unlock(profiled_mutex_t *mutex)
+{
+    if (mutex->profile) {
+        record_release(mutex->profile);
+    }
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+int profiled_cond_timedwait_at(pthread_cond_t *cond, profiled_mutex_t *mutex,
+                               const struct timespec *abstime,
+                               const char *file, int line, const char *function)
+{
+    struct lock_profile_t *profile = mutex->profile;
+    if (!profile) {
+        return pthread_cond_timedwait(cond, &mutex->mutex, abstime);
+    }
+
+    // The wait releases the mutex: close the hold period and start a new
+    // one at this call site when it is reacquired. Waiting for the condition
+    // is not contention, so it is not recorded.
+    record_release(profile);
+    int ret = pthread_cond_timedwait(cond, &mutex->mutex, abstime);
+
+    profile->holder = resolve_site(profile, file, line, function);
+    profile->acquired_at = os_gettime_ns();
+
+    return ret;
+}
+
+void profiled_mutex_get_stats(profiled_mutex_t *mutex, lock_stats_t *stats)
+{
+    if (!stats) {
+        return;
+    }
+
+    if (!mutex || !mutex->profile) {
+        memset(stats, 0, sizeof(lock_stats_t));
+        return;
+    }
+
+    load_stats(stats, &mutex->profile->stats);
+}
+
+static int compare_wait(const void *a, const void *b)
+{
+    const lock_stats_t *sa = a;
+    const lock_stats_t *sb = b;
+
+    if (sa->wait.sum != sb->wait.sum) {
+        return sa->wait.sum < sb->wait.sum ? 1 : -1;
+    }
+    return sa->acquisitions < sb->acquisitions ? 1 : (sa->acquisitions > sb->acquisitions ? -1 : 0);
+}
+
+size_t lock_profiler_get_stats(lock_stats_t *stats, size_t max_count,
+                               lock_stats_scope_t scope)
+{
+    pthread_mutex_lock(&stats_mutex);
+
+    lock_stats_t **entries = scope == LOCK_STATS_BY_SITE ? sites : names;
+    size_t count = scope == LOCK_STATS_BY_SITE ? site_count : name_count;
+
+    lock_stats_t *sorted = count ? malloc(count * sizeof(lock_stats_t)) : NULL;
+    if (sorted) {
+        for (size_t i = 0; i < count; i++) {
+            load_stats(&sorted[i], entries[i]);
+        }
+    }
+
+    pthread_mutex_unlock(&stats_mutex);
+
+    if (!sorted) {
+        return 0;
+    }
+
+    qsort(sorted, count, sizeof(lock_stats_t), compare_wait);
+    if (stats) {
+        memcpy(stats, sorted, (count < max_count ? count : max_count) * sizeof(lock_stats_t));
+    }
+    free(sorted);
+    return count;
+}
+
+static void log_stats(const char *label, const lock_stats_t *stats)
+{
+    canon_log(LOG_INFO, "  %-40s acq %8lu  contended %5.1f%%  "
+             "wait p50/p99/max %.3f/%.3f/%.3f ms  total %.1f ms  "
+             "hold p50/p99/max %.3f/%.3f/%.3f ms",
+             label, (unsigned long)stats->acquisitions,
+             stats->acquisitions ? 100.0 * (double)stats->contended /
+                                   (double)stats->acquisitions : 0.0,
+             (double)latency_histogram_percentile(&stats->wait, 50.0) / 1e6,
+             (double)latency_histogram_percentile(&stats->wait, 99.0) / 1e6,
+             (double)stats->wait.max / 1e6,
+             (double)stats->wait.sum / 1e6,
+             (double)latency_histogram_percentile(&stats->hold, 50.0) / 1e6,
+             (double)latency_histogram_percentile(&stats->hold, 99.0) / 1e6,
+             (double)stats->hold.max / 1e6);
+}
+
+void lock_profiler_dump(void)
+{
+    if (!lock_profiler_enabled()) {
+        return;
+    }
+
+    lock_stats_t *stats = malloc(MAX_LOCK_SITES * sizeof(lock_stats_t));
+    if (!stats) {
+        return;
+    }
+
+    size_t count = lock_profiler_get_stats(stats, MAX_LOCK_NAMES, LOCK_STATS_BY_NAME);
+    canon_log(LOG_INFO, "Lock profile by lock:");
+    for (size_t i = 0; i < count && i < MAX_LOCK_NAMES; i++) {
+        log_stats(stats[i].name, &stats[i]);
+    }
+
+    count = lock_profiler_get_stats(stats, MAX_LOCK_SITES, LOCK_STATS_BY_SITE);
+    canon_log(LOG_INFO, "Lock profile by call site (top %d by wait time):", DUMP_SITE_COUNT);
+    for (size_t i = 0; i < count && i < DUMP_SITE_COUNT; i++) {
+        const char *file = strrchr(stats[i].file, '/');
+        char label[128];
+        snprintf(label, sizeof(label), "%s %s:%d %s()", stats[i].name,
+                 file ? file + 1 : stats[i].file, stats[i].line, stats[i].function);
+        log_stats(label, &stats[i]);
+    }
+
+    free(stats);
+}
@@ -0,0 +1,118 @@
+#ifndef LOCK_PROFILER_H
+#define LOCK_PROFILER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include "utils/latency-histogram.h"
+
+/**
+ * @brief Opt-in lock contention profiler
+ *
+ * profiled_mutex_t wraps a pthread mutex. With CANON_EOS_LOCK_PROFILE=1 in the
+ * environment, every acquisition records how long the caller waited and how
+ * long the lock was then held, per lock instance, per lock name and per call
+ * site (file:line). Without it the wrappers add one branch to the plain
+ * pthread calls. With it, each lock instance caches the call sites it is
+ * taken at, and counters are updated with atomics; a global lock is only
+ * taken when a lock or call site is first seen and when reading statistics.
+ */
+
+#define LOCK_PROFILER_NAME_SIZE 32
+
+/**
+ * @brief Lock wrapper; use the profiled_mutex_* macros below
+ */
+typedef struct {
+    pthread_mutex_t mutex;
+    struct lock_profile_t *profile;     /**< NULL when profiling is disabled */
+} profiled_mutex_t;
+
+/**
+ * @brief Contention statistics of a lock, lock name or call site
+ */
+typedef struct {
+    char name[LOCK_PROFILER_NAME_SIZE];
+    const char *file;                   /**< Call site (NULL for locks and names) */
+    int line;
+    const char *function;
+    uint64_t acquisitions;
+    uint64_t contended;                 /**< Acquisitions that had to block */
+    latency_histogram_t wait;           /**< Time blocked before acquiring, in ns */
+    latency_histogram_t hold;           /**< Time held (excluding condition waits), in ns */
+} lock_stats_t;
+
+/**
+ * @brief Aggregation level for lock_profiler_get_stats()
+ */
+typedef enum {
+    LOCK_STATS_BY_NAME = 0,
+    LOCK_STATS_BY_SITE
+} lock_stats_scope_t;
+
+/**
+ * @brief Read CANON_EOS_LOCK_PROFILE (once; also done by the first mutex init)
+ */
+void lock_profiler_init(void);
+
+/**
+ * @brief Check whether lock profiling is enabled
+ * @return true if CANON_EOS_LOCK_PROFILE is set to a non-zero value
+ */
+bool lock_profiler_enabled(void);
+
+/**
+ * @brief Initialize a profiled mutex
+ * @param mutex Mutex to initialize
+ * @param name Lock name statistics are aggregated under (e.g. "camera")
+ * @return 0 on success, pthread error code otherwise
+ */
+int profiled_mutex_init(profiled_mutex_t *mutex, const char *name);
+
+/**
+ * @brief Destroy a profiled mutex; its statistics stay in the name totals
+ * @param mutex Mutex to destroy
+ */
+void profiled_mutex_destroy(profiled_mutex_t *mutex);
+
+void profiled_mutex_lock_at(profiled_mutex_t *mutex, const char *file, int line,
+                            const char *function);
+int profiled_mutex_trylock_at(profiled_mutex_t *mutex, const char *file, int line,
+                              const char *function);
+void profiled_mutex_unlock(profiled_mutex_t *mutex);
+int profiled_cond_timedwait_at(pthread_cond_t *cond, profiled_mutex_t *mutex,
+                               const struct timespec *abstime,
+                               const char *file, int line, const char *function);
+
+#define profiled_mutex_lock(mutex) \
+    profiled_mutex_lock_at(mutex, __FILE__, __LINE__, __func__)
+#define profiled_mutex_trylock(mutex) \
+    profiled_mutex_trylock_at(mutex, __FILE__, __LINE__, __func__)
+#define profiled_cond_timedwait(cond, mutex, abstime) \
+    profiled_cond_timedwait_at(cond, mutex, abstime, __FILE__, __LINE__, __func__)
+
+/**
+ * @brief Get the statistics of one lock instance
+ * @param mutex Profiled mutex
+ * @param stats Output statistics (zeroed when profiling is disabled)
+ */
+void profiled_mutex_get_stats(profiled_mutex_t *mutex, lock_stats_t *stats);
+
+/**
+ * @brief Get statistics for every lock name or call site seen so far
+ * @param stats Output array, sorted by total wait time, longest first
+ * @param max_count Array capacity
+ * @param scope Aggregate per lock name or per call site
+ * @return Number of entries available (may exceed max_count)
+ */
+size_t lock_profiler_get_stats(lock_stats_t *stats, size_t max_count,
+                               lock_stats_scope_t scope);
+
+/**
+ * @brief Log per-name totals and the call sites with the most wait time
+ */
+void lock_profiler_dump(void);
+
+#endif /* LOCK_PROFILER_H */
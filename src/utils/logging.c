@@ -1,7 +1,10 @@
 #include "logging.h"
+#include "mem-accounting.h"
 #include <time.h>
 #include <sys/resource.h>
 
+#define MEMORY_STATS_MAX_ACCOUNTS 16
+
 void logging_init(void)
 {
     canon_log(LOG_INFO, "Logging subsystem initialized");
@@ -19,6 +22,26 @@ void logging_memory_stats(void)
         canon_log(LOG_DEBUG, "Memory usage: RSS=%ld KB",
                  usage.ru_maxrss);
     }
+
+    mem_account_stats_t accounts[MEMORY_STATS_MAX_ACCOUNTS];
+    size_t count = mem_accounting_get_all(accounts, MEMORY_STATS_MAX_ACCOUNTS);
+    size_t budget = mem_accounting_get_budget();
+
+    canon_log(LOG_DEBUG, "Accounted memory: %zu KB in %zu sources (budget %s%zu KB)",
+             mem_accounting_total() / 1024, count, budget ? "" : "unlimited, ",
+             budget / 1024);
+
+    for (size_t i = 0; i < count && i < MEMORY_STATS_MAX_ACCOUNTS; i++) {
+        canon_log(LOG_DEBUG, "  '%s'%s: %zu KB", accounts[i].name,
+                 accounts[i].active ? "" : " (inactive)", accounts[i].total / 1024);
+        for (int c = 0; c < MEM_CATEGORY_COUNT; c++) {
+            if (accounts[i].peak[c] > 0) {
+                canon_log(LOG_DEBUG, "    %-12s %8zu KB (peak %zu KB)",
+                         mem_category_name((mem_category_t)c),
+                         accounts[i].current[c] / 1024, accounts[i].peak[c] / 1024);
+            }
+        }
+    }
 }
 
 void logging_performance(const char *operation, double duration_ms)
@@ -0,0 +1,388 @@
+#include "mem-accounting.h"
+#include "logging.h"
+#include "buffer-alloc.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MB(bytes) ((double)(bytes) / (1024.0 * 1024.0))
+
+/**
+ * @brief Account implementation
+ */
+struct mem_account_t {
+    char name[MEM_ACCOUNT_NAME_SIZE];
+    bool active;
+    size_t current[MEM_CATEGORY_COUNT];
+    size_t peak[MEM_CATEGORY_COUNT];
+
+    mem_reclaim_cb reclaim;
+    void *reclaim_data;
+
+    struct mem_account_t *next;
+};
+
+/* Lock order: list_mutex, then stats_mutex. list_mutex guards the account
+ * list and reclaim callbacks and is held while callbacks run, so an account
+ * cannot unregister (and its owner cannot go away) mid-reclaim. stats_mutex
+ * guards the counters only. */
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static mem_account_t *accounts = NULL;
+static size_t total_bytes = 0;
+static size_t budget_bytes = 0;
+
+static const char *category_names[MEM_CATEGORY_COUNT] = {
+    "frame pool",
+    "conversion",
+    "decoder",
+    "camera file",
+    "queue"
+};
+
+static void read_environment(void)
+{
+    const char *value = getenv("CANON_EOS_MEMORY_BUDGET_MB");
+    if (!value || !*value) {
+        return;
+    }
+
+    unsigned long megabytes = strtoul(value, NULL, 10);
+    budget_bytes = (size_t)megabytes * 1024 * 1024;
+    if (budget_bytes > 0) {
+        canon_log(LOG_INFO, "Memory budget: %lu MB", megabytes);
+    }
+}
+
+static void init(void)
+{
+    pthread_once(&init_once, read_environment);
+}
+
+const char *mem_category_name(mem_category_t category)
+{
+    return category < MEM_CATEGORY_COUNT ? category_names[category] : "unknown";
+}
+
+mem_account_t *mem_account_create(const char *name)
+{
+    init();
+
+    mem_account_t *account = calloc(1, sizeof(mem_account_t));
+    if (!account) {
+        return NULL;
+    }
+
+    snprintf(account->name, sizeof(account->name), "%s", name ? name : "");
+
+    pthread_mutex_lock(&list_mutex);
+    account->next = accounts;
+    accounts = account;
+    pthread_mutex_unlock(&list_mutex);
+
+    return account;
+}
+
+void mem_account_destroy(mem_account_t *account)
+{
+    if (!account) {
+        return;
+    }
+
+    pthread_mutex_lock(&list_mutex);
+
+    for (mem_account_t **link = &accounts; *link; link = &(*link)->next) {
+        if (*link == account) {
+            *link = account->next;
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++) {
+        if (account->current[i] > 0) {
+            canon_log(LOG_WARNING, "Memory account '%s' destroyed with %zu bytes of %s charged",
+                     account->name, account->current[i], category_names[i]);
+            total_bytes -= account->current[i];
+        }
+    }
+    pthread_mutex_unlock(&stats_mutex);
+
+    pthread_mutex_unlock(&list_mutex);
+
+    free(account);
+}
+
+void mem_account_set_name(mem_account_t *account, const char *name)
+{
+    if (!account) {
+        return;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    snprintf(account->name, sizeof(account->name), "%s", name ? name : "");
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void mem_account_set_active(mem_account_t *account, bool active)
+{
+    if (!account) {
+        return;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    account->active = active;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void mem_account_set_reclaim(mem_account_t *account, mem_reclaim_cb reclaim, void *user_data)
+{
+    if (!account) {
+        return;
+    }
+
+    // Waits for a reclaim pass that may be calling the old callback
+    pthread_mutex_lock(&list_mutex);
+    account->reclaim = reclaim;
+    account->reclaim_data = user_data;
+    pthread_mutex_unlock(&list_mutex);
+}
+
+/* Called with stats_mutex held */
+static void add_locked(mem_account_t *account, mem_category_t category, size_t size)
+{
+    total_bytes += size;
+    if (account) {
+        account->current[category] += size;
+        if (account->current[category] > account->peak[category]) {
+            account->peak[category] = account->current[category];
+        }
+    }
+}
+
+/* Called with stats_mutex held */
+static bool try_add_locked(mem_account_t *account, mem_category_t category, size_t size)
+{
+    if (budget_bytes > 0 && total_bytes + size > budget_bytes) {
+        return false;
+    }
+
+    add_locked(account, category, size);
+    return true;
+}
+
+/**
+ * Ask inactive accounts other than the requester to release idle buffers
+ * until the reservation fits.
+ */
+static bool reclaim_and_add(mem_account_t *account, mem_category_t category, size_t size)
+{
+    bool added = false;
+    size_t released = 0;
+
+    pthread_mutex_lock(&list_mutex);
+
+    for (mem_account_t *other = accounts; other && !added; other = other->next) {
+        if (other == account || !other->reclaim) {
+            continue;
+        }
+
+        char name[MEM_ACCOUNT_NAME_SIZE];
+        pthread_mutex_lock(&stats_mutex);
+        bool idle = !other->active;
+        memcpy(name, other->name, sizeof(name));
+        pthread_mutex_unlock(&stats_mutex);
+
+        if (idle) {
+            size_t freed = other->reclaim(other->reclaim_data);
+            if (freed > 0) {
+                canon_log(LOG_INFO, "Memory budget: released %.1f MB from inactive source '%s'",
+                         MB(freed), name);
+                released += freed;
+            }
+        }
+
+        pthread_mutex_lock(&stats_mutex);
+        added = try_add_locked(account, category, size);
+        pthread_mutex_unlock(&stats_mutex);
+    }
+
+    pthread_mutex_unlock(&list_mutex);
+
+    if (!added && released > 0) {
+        pthread_mutex_lock(&stats_mutex);
+        added = try_add_locked(account, category, size);
+        pthread_mutex_unlock(&stats_mutex);
+    }
+    return added;
+}
+
+canon_error_t mem_account_reserve(mem_account_t *account, mem_category_t category, size_t size)
+{
+    if (category >= MEM_CATEGORY_COUNT) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    init();
+
+    pthread_mutex_lock(&stats_mutex);
+    bool added = try_add_locked(account, category, size);
+    pthread_mutex_unlock(&stats_mutex);
+
+    if (added || reclaim_and_add(account, category, size)) {
+        return CANON_SUCCESS;
+    }
+
+    char name[MEM_ACCOUNT_NAME_SIZE] = "plugin";
+    pthread_mutex_lock(&stats_mutex);
+    if (account) {
+        memcpy(name, account->name, sizeof(name));
+    }
+    size_t in_use = total_bytes;
+    size_t budget = budget_bytes;
+    pthread_mutex_unlock(&stats_mutex);
+
+    canon_log(LOG_ERROR, "Memory budget exceeded: '%s' needs %.1f MB for %s, "
+             "%.1f of %.1f MB already in use (CANON_EOS_MEMORY_BUDGET_MB)",
+             name, MB(size), category_names[category], MB(in_use), MB(budget));
+
+    return CANON_ERROR_MEMORY_BUDGET;
+}
+
+void mem_account_charge(mem_account_t *account, mem_category_t category, size_t size)
+{
+    if (category >= MEM_CATEGORY_COUNT) {
+        return;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    add_locked(account, category, size);
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void mem_account_release(mem_account_t *account, mem_category_t category, size_t size)
+{
+    if (category >= MEM_CATEGORY_COUNT) {
+        return;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    if (account) {
+        size = size < account->current[category] ? size : account->current[category];
+        account->current[category] -= size;
+    }
+    total_bytes -= size < total_bytes ? size : total_bytes;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void mem_account_set(mem_account_t *account, mem_category_t category, size_t size)
+{
+    if (!account || category >= MEM_CATEGORY_COUNT) {
+        return;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    total_bytes -= account->current[category];
+    account->current[category] = 0;
+    add_locked(account, category, size);
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void *mem_account_alloc(mem_account_t *account, mem_category_t category, size_t size)
+{
+    if (mem_account_reserve(account, category, size) != CANON_SUCCESS) {
+        return NULL;
+    }
+
+    void *ptr = buffer_alloc(size);
+    if (!ptr) {
+        mem_account_release(account, category, size);
+    }
+    return ptr;
+}
+
+void mem_account_free(mem_account_t *account, mem_category_t category, void *ptr, size_t size)
+{
+    if (!ptr) {
+        return;
+    }
+
+    buffer_free(ptr, size);
+    mem_account_release(account, category, size);
+}
+
+/* Called with stats_mutex held */
+static void fill_stats(const mem_account_t *account, mem_account_stats_t *stats)
+{
+    memcpy(stats->name, account->name, sizeof(stats->name));
+    stats->active = account->active;
+    stats->total = 0;
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++) {
+        stats->current[i] = account->current[i];
+        stats->peak[i] = account->peak[i];
+        stats->total += account->current[i];
+    }
+}
+
+void mem_account_get_stats(mem_account_t *account, mem_account_stats_t *stats)
+{
+    if (!stats) {
+        return;
+    }
+
+    memset(stats, 0, sizeof(mem_account_stats_t));
+    if (!account) {
+        return;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    fill_stats(account, stats);
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+size_t mem_accounting_get_all(mem_account_stats_t *stats, size_t max_count)
+{
+    pthread_mutex_lock(&list_mutex);
+    pthread_mutex_lock(&stats_mutex);
+
+    size_t index = 0;
+    for (mem_account_t *account = accounts; account; account = account->next, index++) {
+        if (stats && index < max_count) {
+            fill_stats(account, &stats[index]);
+        }
+    }
+
+    pthread_mutex_unlock(&stats_mutex);
+    pthread_mutex_unlock(&list_mutex);
+
+    return index;
+}
+
+size_t mem_accounting_total(void)
+{
+    pthread_mutex_lock(&stats_mutex);
+    size_t total = total_bytes;
+    pthread_mutex_unlock(&stats_mutex);
+    return total;
+}
+
+size_t mem_accounting_get_budget(void)
+{
+    init();
+
+    pthread_mutex_lock(&stats_mutex);
+    size_t budget = budget_bytes;
+    pthread_mutex_unlock(&stats_mutex);
+    return budget;
+}
+
+void mem_accounting_set_budget(size_t bytes)
+{
+    init();
+
+    pthread_mutex_lock(&stats_mutex);
+    budget_bytes = bytes;
+    pthread_mutex_unlock(&stats_mutex);
+}
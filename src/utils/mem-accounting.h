@@ -0,0 +1,174 @@
+#ifndef MEM_ACCOUNTING_H
+#define MEM_ACCOUNTING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "canon-errors.h"
+
+/**
+ * @brief Per-source memory accounting with a global budget
+ *
+ * Each capture pipeline owns an account; its subsystems charge their
+ * buffers against it by category. The budget comes from
+ * CANON_EOS_MEMORY_BUDGET_MB (unset or 0 = unlimited). A reservation that
+ * would exceed it first asks inactive accounts to release idle buffers and
+ * fails with CANON_ERROR_MEMORY_BUDGET if that is not enough.
+ */
+
+#define MEM_ACCOUNT_NAME_SIZE 64
+
+/**
+ * @brief Allocation categories
+ */
+typedef enum {
+    MEM_CATEGORY_FRAME_POOL = 0,    /**< Decoded NV12 frame buffers */
+    MEM_CATEGORY_CONVERSION,        /**< Compressed preview staging buffer */
+    MEM_CATEGORY_DECODER,           /**< Decoder contexts and band decode scratch */
+    MEM_CATEGORY_CAMERA_FILE,       /**< gphoto2 CameraFile preview data */
+    MEM_CATEGORY_QUEUE,             /**< Frame queue slots and source state */
+    MEM_CATEGORY_COUNT
+} mem_category_t;
+
+typedef struct mem_account_t mem_account_t;
+
+/**
+ * @brief Release idle memory of an inactive account
+ * @param user_data User data given to mem_account_set_reclaim()
+ * @return Bytes released
+ *
+ * Called from whichever thread needs memory; must not block on locks the
+ * caller may hold (use trylock and give up instead).
+ */
+typedef size_t (*mem_reclaim_cb)(void *user_data);
+
+/**
+ * @brief Snapshot of an account
+ */
+typedef struct {
+    char name[MEM_ACCOUNT_NAME_SIZE];
+    bool active;
+    size_t total;
+    size_t current[MEM_CATEGORY_COUNT];
+    size_t peak[MEM_CATEGORY_COUNT];
+} mem_account_stats_t;
+
+/**
+ * @brief Create an account
+ * @param name Display name (e.g. the device path)
+ * @return Account or NULL on failure
+ */
+mem_account_t *mem_account_create(const char *name);
+
+/**
+ * @brief Destroy an account; any remaining charge is released
+ * @param account Account (may be NULL)
+ */
+void mem_account_destroy(mem_account_t *account);
+
+/**
+ * @brief Rename an account
+ * @param account Account
+ * @param name New display name
+ */
+void mem_account_set_name(mem_account_t *account, const char *name);
+
+/**
+ * @brief Mark an account active (capturing); only inactive ones are reclaimed
+ * @param account Account
+ * @param active Activity state
+ */
+void mem_account_set_active(mem_account_t *account, bool active);
+
+/**
+ * @brief Register the callback that shrinks this account under pressure
+ * @param account Account
+ * @param reclaim Callback, or NULL to unregister
+ * @param user_data User data for the callback
+ */
+void mem_account_set_reclaim(mem_account_t *account, mem_reclaim_cb reclaim, void *user_data);
+
+/**
+ * @brief Charge memory about to be allocated, enforcing the budget
+ * @param account Account (NULL charges the global total only)
+ * @param category Category
+ * @param size Bytes
+ * @return CANON_SUCCESS or CANON_ERROR_MEMORY_BUDGET
+ */
+canon_error_t mem_account_reserve(mem_account_t *account, mem_category_t category, size_t size);
+
+/**
+ * @brief Charge memory that was already allocated (never fails)
+ * @param account Account (may be NULL)
+ * @param category Category
+ * @param size Bytes
+ */
+void mem_account_charge(mem_account_t *account, mem_category_t category, size_t size);
+
+/**
+ * @brief Return a charge made by mem_account_reserve() or mem_account_charge()
+ * @param account Account (may be NULL)
+ * @param category Category
+ * @param size Bytes
+ */
+void mem_account_release(mem_account_t *account, mem_category_t category, size_t size);
+
+/**
+ * @brief Set a category to an absolute size (for buffers that grow on demand)
+ * @param account Account (may be NULL)
+ * @param category Category
+ * @param size Bytes now in use
+ */
+void mem_account_set(mem_account_t *account, mem_category_t category, size_t size);
+
+/**
+ * @brief buffer_alloc() charged against an account
+ *
+ * The buffer is backed according to CANON_EOS_BUFFER_MODE (see
+ * buffer-alloc.h).
+ * @return Buffer, or NULL if over budget or out of memory
+ */
+void *mem_account_alloc(mem_account_t *account, mem_category_t category, size_t size);
+
+/**
+ * @brief Free a buffer from mem_account_alloc()
+ */
+void mem_account_free(mem_account_t *account, mem_category_t category, void *ptr, size_t size);
+
+/**
+ * @brief Get an account snapshot
+ * @param account Account
+ * @param stats Output snapshot
+ */
+void mem_account_get_stats(mem_account_t *account, mem_account_stats_t *stats);
+
+/**
+ * @brief Get snapshots of every live account
+ * @param stats Output array (may be NULL to count)
+ * @param max_count Array capacity
+ * @return Number of live accounts (may exceed max_count)
+ */
+size_t mem_accounting_get_all(mem_account_stats_t *stats, size_t max_count);
+
+/**
+ * @brief Total bytes charged across all accounts
+ */
+size_t mem_accounting_total(void);
+
+/**
+ * @brief Get the budget in bytes (0 = unlimited)
+ */
+size_t mem_accounting_get_budget(void);
+
+/**
+ * @brief Override the budget from the environment
+ * @param bytes Budget in bytes, 0 for unlimited
+ */
+void mem_accounting_set_budget(size_t bytes);
+
+/**
+ * @brief Get a category's display name
+ */
+const char *mem_category_name(mem_category_t category);
+
+#endif /* MEM_ACCOUNTING_H */
@@ -0,0 +1,21 @@
+#include "preview-hash.h"
+#include <string.h>
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+uint64_t preview_hash(const uint8_t *data, size_t size)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    size_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * FNV_PRIME;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
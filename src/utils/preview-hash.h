@@ -0,0 +1,20 @@
+#ifndef PREVIEW_HASH_H
+#define PREVIEW_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Content hash of a fetched preview JPEG
+ *
+ * Cameras hand out the same live view frame again when polled faster than
+ * they refresh it. The capture thread and the host calibration tell such
+ * repeats apart by this hash: FNV-1a over 64-bit words, so identical
+ * previews hash identically at a fraction of a decode's cost.
+ * @param data Preview data
+ * @param size Preview size in bytes
+ * @return Hash
+ */
+uint64_t preview_hash(const uint8_t *data, size_t size);
+
+#endif /* PREVIEW_HASH_H */
@@ -0,0 +1,270 @@
+#define _GNU_SOURCE  // pthread_setname_np
+
+#include "thread-registry.h"
+#include "logging.h"
+#include "trace-recorder.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief A registered, running thread
+ */
+typedef struct thread_entry_t {
+    clockid_t clock;
+    cpu_group_t *group;
+    thread_role_t role;
+    struct thread_entry_t *next;
+} thread_entry_t;
+
+/**
+ * @brief Group implementation
+ */
+struct cpu_group_t {
+    uint32_t id;
+    uint64_t exited_ns[THREAD_ROLE_COUNT];      // Guarded by registry_mutex
+    uint64_t charged_ns[THREAD_ROLE_COUNT];     // Atomic
+    struct cpu_group_t *next;
+};
+
+/* registry_mutex guards the thread and group lists and the exited times.
+ * A thread removes itself before it exits, so every listed clock belongs
+ * to a live thread. It is a leaf lock. */
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static thread_entry_t *threads = NULL;
+static cpu_group_t *groups = NULL;
+static cpu_group_t shared_group;
+static uint64_t retired_ns = 0;
+
+static __thread thread_entry_t *tls_entry = NULL;
+
+static const char *role_names[THREAD_ROLE_COUNT] = {
+    "capture",
+    "output",
+    "render",
+    "stream",
+    "detector",
+    "metrics",
+    "grid"
+};
+
+/* Kernel thread name prefixes, short enough for a pipeline id */
+static const char *role_prefixes[THREAD_ROLE_COUNT] = {
+    "canon-cap",
+    "canon-out",
+    "canon-render",
+    "canon-mjpeg",
+    "canon-detect",
+    "canon-metrics",
+    "canon-grid"
+};
+
+static uint64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+const char *thread_role_name(thread_role_t role)
+{
+    return role < THREAD_ROLE_COUNT ? role_names[role] : "unknown";
+}
+
+cpu_group_t *cpu_group_create(uint32_t id)
+{
+    cpu_group_t *group = calloc(1, sizeof(cpu_group_t));
+    if (!group) {
+        return NULL;
+    }
+
+    group->id = id;
+
+    pthread_mutex_lock(&registry_mutex);
+    group->next = groups;
+    groups = group;
+    pthread_mutex_unlock(&registry_mutex);
+
+    return group;
+}
+
+void cpu_group_destroy(cpu_group_t *group)
+{
+    if (!group) {
+        return;
+    }
+
+    pthread_mutex_lock(&registry_mutex);
+
+    for (cpu_group_t **link = &groups; *link; link = &(*link)->next) {
+        if (*link == group) {
+            *link = group->next;
+            break;
+        }
+    }
+
+    for (thread_entry_t *entry = threads; entry; entry = entry->next) {
+        if (entry->group == group) {
+            canon_log(LOG_WARNING, "CPU group %u destroyed with %s thread still registered",
+                     group->id, role_names[entry->role]);
+            entry->group = &shared_group;
+        }
+    }
+
+    // Keeps the process total monotonic
+    for (int i = 0; i < THREAD_ROLE_COUNT; i++) {
+        retired_ns += group->exited_ns[i] +
+                      __atomic_load_n(&group->charged_ns[i], __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&registry_mutex);
+
+    free(group);
+}
+
+void thread_registry_enter(cpu_group_t *group, thread_role_t role)
+{
+    if (role >= THREAD_ROLE_COUNT) {
+        return;
+    }
+    if (tls_entry) {
+        thread_registry_leave();
+    }
+
+    thread_entry_t *entry = calloc(1, sizeof(thread_entry_t));
+    if (!entry) {
+        return;
+    }
+
+    char name[THREAD_NAME_SIZE];
+    if (group) {
+        snprintf(name, sizeof(name), "%s-%u", role_prefixes[role], group->id);
+    } else {
+        snprintf(name, sizeof(name), "%s", role_prefixes[role]);
+    }
+    pthread_setname_np(pthread_self(), name);
+    trace_set_thread_name(name);
+
+    if (pthread_getcpuclockid(pthread_self(), &entry->clock) != 0) {
+        entry->clock = CLOCK_THREAD_CPUTIME_ID;
+    }
+    entry->group = group ? group : &shared_group;
+    entry->role = role;
+
+    pthread_mutex_lock(&registry_mutex);
+    entry->next = threads;
+    threads = entry;
+    pthread_mutex_unlock(&registry_mutex);
+
+    tls_entry = entry;
+}
+
+void thread_registry_leave(void)
+{
+    thread_entry_t *entry = tls_entry;
+    if (!entry) {
+        return;
+    }
+
+    uint64_t spent = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+
+    pthread_mutex_lock(&registry_mutex);
+    for (thread_entry_t **link = &threads; *link; link = &(*link)->next) {
+        if (*link == entry) {
+            *link = entry->next;
+            break;
+        }
+    }
+    entry->group->exited_ns[entry->role] += spent;
+    pthread_mutex_unlock(&registry_mutex);
+
+    tls_entry = NULL;
+    free(entry);
+}
+
+uint64_t thread_registry_charge_begin(void)
+{
+    if (tls_entry) {
+        return 0;
+    }
+    return clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void thread_registry_charge_end(cpu_group_t *group, thread_role_t role, uint64_t start)
+{
+    if (!start || role >= THREAD_ROLE_COUNT) {
+        return;
+    }
+
+    uint64_t now = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    if (now > start) {
+        __atomic_add_fetch(&(group ? group : &shared_group)->charged_ns[role], now - start,
+                           __ATOMIC_RELAXED);
+    }
+}
+
+/* Called with registry_mutex held */
+static void read_group_locked(cpu_group_t *group, cpu_usage_t *usage)
+{
+    memset(usage, 0, sizeof(*usage));
+
+    for (int i = 0; i < THREAD_ROLE_COUNT; i++) {
+        usage->cpu_ns[i] = group->exited_ns[i] +
+                           __atomic_load_n(&group->charged_ns[i], __ATOMIC_RELAXED);
+    }
+
+    for (thread_entry_t *entry = threads; entry; entry = entry->next) {
+        if (entry->group == group) {
+            usage->cpu_ns[entry->role] += clock_ns(entry->clock);
+            usage->threads++;
+        }
+    }
+
+    for (int i = 0; i < THREAD_ROLE_COUNT; i++) {
+        usage->total_ns += usage->cpu_ns[i];
+    }
+}
+
+void cpu_group_read(cpu_group_t *group, cpu_usage_t *usage)
+{
+    if (!usage) {
+        return;
+    }
+
+    pthread_mutex_lock(&registry_mutex);
+    read_group_locked(group ? group : &shared_group, usage);
+    pthread_mutex_unlock(&registry_mutex);
+}
+
+uint64_t thread_registry_total_ns(void)
+{
+    cpu_usage_t usage;
+
+    pthread_mutex_lock(&registry_mutex);
+    uint64_t total = retired_ns;
+    read_group_locked(&shared_group, &usage);
+    total += usage.total_ns;
+    for (cpu_group_t *group = groups; group; group = group->next) {
+        read_group_locked(group, &usage);
+        total += usage.total_ns;
+    }
+    pthread_mutex_unlock(&registry_mutex);
+
+    return total;
+}
+
+uint32_t thread_registry_cpu_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+}
+
+double thread_registry_percent(uint64_t cpu_ns, uint64_t wall_ns)
+{
+    return wall_ns > 0 ? (double)cpu_ns * 100.0 / (double)wall_ns : 0.0;
+}
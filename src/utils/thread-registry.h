@@ -0,0 +1,131 @@
+#ifndef THREAD_REGISTRY_H
+#define THREAD_REGISTRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "canon-errors.h"
+
+/**
+ * @brief Named plugin threads and their CPU time, grouped per camera
+ *
+ * Every plugin thread registers itself when it starts. The registry gives
+ * it a kernel name (e.g. "canon-cap-3" for pipeline 3's capture thread, so
+ * `top -H` tells cameras apart), names its trace track the same, and keeps
+ * its CLOCK_THREAD_CPUTIME_ID clock so CPU time can be read from any
+ * thread. A thread's time is added to its group when it unregisters, so a
+ * group's totals keep counting across capture restarts.
+ *
+ * Work a camera causes on threads the plugin does not own (the Direct
+ * Upload source's texture uploads on the OBS graphics thread) is charged to
+ * the group per call with thread_registry_charge_begin()/_end().
+ *
+ * CPU% follows top: 100% is one core busy. NFR-002 in the PRD limits the
+ * whole plugin to THREAD_REGISTRY_CPU_BUDGET percent of the machine, i.e.
+ * of all online cores together.
+ */
+
+#define THREAD_NAME_SIZE 16         // Kernel limit, including the terminator
+#define THREAD_REGISTRY_CPU_BUDGET 15.0
+
+/**
+ * @brief What a thread does
+ */
+typedef enum {
+    THREAD_ROLE_CAPTURE = 0,    /**< Preview fetch (video source capture thread) */
+    THREAD_ROLE_OUTPUT,         /**< Decode at dequeue and hand-off to OBS (async source) */
+    THREAD_ROLE_RENDER,         /**< Upload on the OBS graphics thread (Direct Upload), charged */
+    THREAD_ROLE_STREAM,         /**< Preview stream server */
+    THREAD_ROLE_DETECTOR,       /**< USB hotplug monitor (process-wide) */
+    THREAD_ROLE_METRICS,        /**< Prometheus exporter (process-wide) */
+    THREAD_ROLE_GRID,           /**< Multicam grid compositing, decodes for several cameras */
+    THREAD_ROLE_COUNT
+} thread_role_t;
+
+/**
+ * @brief Threads of one camera (capture pipeline)
+ */
+typedef struct cpu_group_t cpu_group_t;
+
+/**
+ * @brief CPU time of a group, cumulative since creation
+ */
+typedef struct {
+    uint64_t cpu_ns[THREAD_ROLE_COUNT];     /**< By role, live and exited threads */
+    uint64_t total_ns;                      /**< Sum over all roles */
+    uint32_t threads;                       /**< Threads registered now */
+} cpu_usage_t;
+
+/**
+ * @brief Create a group
+ * @param id Number used in the group's thread names (the pipeline id)
+ * @return Group or NULL on failure
+ */
+cpu_group_t *cpu_group_create(uint32_t id);
+
+/**
+ * @brief Destroy a group; its threads must have unregistered
+ * @param group Group (may be NULL)
+ */
+void cpu_group_destroy(cpu_group_t *group);
+
+/**
+ * @brief Register and name the calling thread
+ * @param group Camera the thread works for, NULL for process-wide threads
+ * @param role What the thread does
+ */
+void thread_registry_enter(cpu_group_t *group, thread_role_t role);
+
+/**
+ * @brief Unregister the calling thread, adding its CPU time to its group
+ *
+ * Must be called before the thread exits.
+ */
+void thread_registry_leave(void);
+
+/**
+ * @brief Start charging work done on an unregistered thread
+ * @return Thread CPU time, or 0 if the calling thread is registered (its
+ *         time is counted already)
+ */
+uint64_t thread_registry_charge_begin(void);
+
+/**
+ * @brief Charge the CPU time since thread_registry_charge_begin() to a group
+ * @param group Group (may be NULL)
+ * @param role Role to charge
+ * @param start Value returned by thread_registry_charge_begin()
+ */
+void thread_registry_charge_end(cpu_group_t *group, thread_role_t role, uint64_t start);
+
+/**
+ * @brief Read a group's CPU time
+ * @param group Group, or NULL for the process-wide threads
+ * @param usage Output totals
+ */
+void cpu_group_read(cpu_group_t *group, cpu_usage_t *usage);
+
+/**
+ * @brief CPU time of all plugin threads and charges, every group included
+ * @return Nanoseconds since the plugin was loaded
+ */
+uint64_t thread_registry_total_ns(void);
+
+/**
+ * @brief Number of online cores, the NFR-002 denominator
+ */
+uint32_t thread_registry_cpu_count(void);
+
+/**
+ * @brief CPU% between two readings, 100% being one core
+ * @param cpu_ns CPU time spent in the interval
+ * @param wall_ns Length of the interval
+ * @return Percentage, 0 for an empty interval
+ */
+double thread_registry_percent(uint64_t cpu_ns, uint64_t wall_ns);
+
+/**
+ * @brief Get a role's display name ("capture", "output", ...)
+ */
+const char *thread_role_name(thread_role_t role);
+
+#endif /* THREAD_REGISTRY_H */
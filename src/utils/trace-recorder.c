@@ -0,0 +1,403 @@
+#define _GNU_SOURCE  // pthread_getname_np
+
+#include "trace-recorder.h"
+#include "logging.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define TRACE_MAX_THREADS 64
+#define TRACE_EVENTS_PER_THREAD 32768
+#define TRACE_THREAD_NAME_SIZE 32
+
+/**
+ * @brief One completed span
+ */
+typedef struct {
+    uint64_t start;
+    uint64_t value;
+    uint32_t duration;
+    uint32_t event;
+} trace_span_t;
+
+/**
+ * @brief Per-thread span buffer
+ *
+ * Only the owning thread writes spans and count; count is published with a
+ * release store, so spans below it are complete for any reader. A buffer
+ * holds the recording whose generation it carries; the owner clears it the
+ * first time it records into a newer one.
+ */
+typedef struct {
+    trace_span_t *spans;
+    uint32_t count;
+    uint32_t dropped;
+    uint32_t generation;
+    bool exited;
+
+    // Written under registry_mutex before the buffer joins a recording
+    pid_t tid;
+    char name[TRACE_THREAD_NAME_SIZE];
+} trace_buffer_t;
+
+bool g_trace_armed = false;
+
+/* control_mutex serialises start/stop, so a recording is never cleared
+ * while it is being written. registry_mutex guards the buffer table and
+ * is only taken the first time a thread records. */
+static pthread_mutex_t control_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t exit_key;
+static trace_buffer_t *buffers[TRACE_MAX_THREADS];
+static uint32_t buffer_count = 0;
+static uint32_t generation = 0;
+static uint32_t untracked = 0;
+static uint64_t recording_start = 0;
+
+static __thread trace_buffer_t *tls_buffer = NULL;
+static __thread uint32_t tls_failed_generation = 0;
+static __thread char tls_name[TRACE_THREAD_NAME_SIZE];
+
+// Sized by their initializers, so a missing entry fails the checks below
+static const char *event_names[] = {
+    "fetch",
+    "delta",
+    "decode",
+    "convert",
+    "queue wait",
+    "output",
+    "v4l2 sink"
+};
+
+static const char *event_args[] = {
+    "bytes",
+    "mcu_rows",
+    "bytes",
+    "pixels",
+    "queued",
+    "frame",
+    "pixels"
+};
+
+// C99 compile-time checks: a negative array size if a table misses an event
+typedef char event_names_complete[
+    sizeof(event_names) / sizeof(event_names[0]) == TRACE_EVENT_COUNT ? 1 : -1];
+typedef char event_args_complete[
+    sizeof(event_args) / sizeof(event_args[0]) == TRACE_EVENT_COUNT ? 1 : -1];
+
+static void thread_exited(void *data)
+{
+    trace_buffer_t *buffer = data;
+    __atomic_store_n(&buffer->exited, true, __ATOMIC_RELEASE);
+}
+
+static void create_key(void)
+{
+    pthread_key_create(&exit_key, thread_exited);
+}
+
+static void thread_name(char *name, size_t size)
+{
+    if (tls_name[0]) {
+        snprintf(name, size, "%s", tls_name);
+    } else if (pthread_getname_np(pthread_self(), name, size) != 0) {
+        snprintf(name, size, "thread");
+    }
+}
+
+/**
+ * Find a buffer for the calling thread: a new one, or one left behind by
+ * an exited thread that is not part of the current recording.
+ */
+static trace_buffer_t *acquire_buffer(uint32_t current)
+{
+    trace_buffer_t *buffer = NULL;
+
+    pthread_once(&key_once, create_key);
+    pthread_mutex_lock(&registry_mutex);
+
+    for (uint32_t i = 0; i < buffer_count && !buffer; i++) {
+        if (__atomic_load_n(&buffers[i]->exited, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&buffers[i]->generation, __ATOMIC_RELAXED) != current) {
+            buffer = buffers[i];
+        }
+    }
+
+    if (!buffer && buffer_count < TRACE_MAX_THREADS) {
+        buffer = calloc(1, sizeof(trace_buffer_t));
+        if (buffer) {
+            buffer->spans = malloc(TRACE_EVENTS_PER_THREAD * sizeof(trace_span_t));
+            if (!buffer->spans) {
+                free(buffer);
+                buffer = NULL;
+            }
+        }
+        if (buffer) {
+            buffers[buffer_count++] = buffer;
+        }
+    }
+
+    if (buffer) {
+        buffer->tid = (pid_t)syscall(SYS_gettid);
+        thread_name(buffer->name, sizeof(buffer->name));
+        __atomic_store_n(&buffer->exited, false, __ATOMIC_RELAXED);
+        pthread_setspecific(exit_key, buffer);
+    }
+
+    pthread_mutex_unlock(&registry_mutex);
+    return buffer;
+}
+
+void trace_record(trace_event_t event, uint64_t start, uint64_t value)
+{
+    uint64_t end = os_gettime_ns();
+    uint32_t current = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+    trace_buffer_t *buffer = tls_buffer;
+
+    if (!buffer) {
+        if (tls_failed_generation == current) {
+            return;
+        }
+        buffer = acquire_buffer(current);
+        if (!buffer) {
+            // Table full; count once per thread and recording
+            tls_failed_generation = current;
+            __atomic_add_fetch(&untracked, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        tls_buffer = buffer;
+    }
+
+    if (buffer->generation != current) {
+        __atomic_store_n(&buffer->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&buffer->dropped, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&buffer->generation, current, __ATOMIC_RELEASE);
+    }
+
+    uint32_t index = buffer->count;
+    if (index >= TRACE_EVENTS_PER_THREAD) {
+        __atomic_store_n(&buffer->dropped, buffer->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uint64_t duration = end > start ? end - start : 0;
+    trace_span_t *span = &buffer->spans[index];
+    span->start = start;
+    span->value = value;
+    span->duration = duration > UINT32_MAX ? UINT32_MAX : (uint32_t)duration;
+    span->event = (uint32_t)event;
+
+    __atomic_store_n(&buffer->count, index + 1, __ATOMIC_RELEASE);
+}
+
+void trace_set_thread_name(const char *name)
+{
+    snprintf(tls_name, sizeof(tls_name), "%s", name ? name : "");
+
+    if (tls_buffer) {
+        pthread_mutex_lock(&registry_mutex);
+        snprintf(tls_buffer->name, sizeof(tls_buffer->name), "%s", tls_name);
+        pthread_mutex_unlock(&registry_mutex);
+    }
+}
+
+void trace_recorder_start(void)
+{
+    pthread_mutex_lock(&control_mutex);
+
+    if (!__atomic_load_n(&g_trace_armed, __ATOMIC_RELAXED)) {
+        recording_start = os_gettime_ns();
+        __atomic_store_n(&untracked, 0, __ATOMIC_RELAXED);
+        // Never 0, so fresh buffers and threads count as outdated
+        uint32_t next = generation + 1 ? generation + 1 : 1;
+        __atomic_store_n(&generation, next, __ATOMIC_RELEASE);
+        __atomic_store_n(&g_trace_armed, true, __ATOMIC_RELEASE);
+        canon_log(LOG_INFO, "Trace recording started");
+    }
+
+    pthread_mutex_unlock(&control_mutex);
+}
+
+bool trace_recorder_is_recording(void)
+{
+    return __atomic_load_n(&g_trace_armed, __ATOMIC_ACQUIRE);
+}
+
+static void write_escaped(FILE *file, const char *text)
+{
+    for (; *text; text++) {
+        unsigned char c = (unsigned char)*text;
+        if (c == '"' || c == '\\') {
+            fprintf(file, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+}
+
+/**
+ * Write the current recording. Spans a thread is still appending after the
+ * recorder was disarmed are either included whole or not at all.
+ */
+static bool write_trace(FILE *file, uint32_t current, uint64_t *spans_written,
+                        uint64_t *spans_dropped)
+{
+    trace_buffer_t *snapshot[TRACE_MAX_THREADS];
+    pid_t tids[TRACE_MAX_THREADS];
+    char names[TRACE_MAX_THREADS][TRACE_THREAD_NAME_SIZE];
+    uint32_t threads = 0;
+
+    pthread_mutex_lock(&registry_mutex);
+    for (uint32_t i = 0; i < buffer_count; i++) {
+        if (__atomic_load_n(&buffers[i]->generation, __ATOMIC_ACQUIRE) == current) {
+            snapshot[threads] = buffers[i];
+            tids[threads] = buffers[i]->tid;
+            memcpy(names[threads], buffers[i]->name, TRACE_THREAD_NAME_SIZE);
+            threads++;
+        }
+    }
+    pthread_mutex_unlock(&registry_mutex);
+
+    pid_t pid = getpid();
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"canon-eos\"}}", (int)pid, (int)pid);
+
+    for (uint32_t t = 0; t < threads; t++) {
+        trace_buffer_t *buffer = snapshot[t];
+        uint32_t count = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"", (int)pid, (int)tids[t]);
+        write_escaped(file, names[t]);
+        fprintf(file, "\"}}");
+
+        for (uint32_t i = 0; i < count; i++) {
+            const trace_span_t *span = &buffer->spans[i];
+            uint32_t event = span->event < TRACE_EVENT_COUNT ? span->event : 0;
+            uint64_t offset = span->start > recording_start ? span->start - recording_start : 0;
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"canon-eos\",\"ph\":\"X\","
+                    "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+                    "\"args\":{\"%s\":%llu}}",
+                    event_names[event], (double)offset / 1000.0,
+                    (double)span->duration / 1000.0, (int)pid, (int)tids[t],
+                    event_args[event], (unsigned long long)span->value);
+        }
+
+        *spans_written += count;
+        *spans_dropped += __atomic_load_n(&buffer->dropped, __ATOMIC_RELAXED);
+    }
+
+    fprintf(file, "\n]}\n");
+    return !ferror(file);
+}
+
+canon_error_t trace_recorder_stop(const char *path)
+{
+    if (!path) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    pthread_mutex_lock(&control_mutex);
+
+    if (!__atomic_load_n(&g_trace_armed, __ATOMIC_RELAXED)) {
+        pthread_mutex_unlock(&control_mutex);
+        return CANON_SUCCESS;
+    }
+
+    __atomic_store_n(&g_trace_armed, false, __ATOMIC_RELEASE);
+    uint32_t current = __atomic_load_n(&generation, __ATOMIC_RELAXED);
+    double seconds = (double)(os_gettime_ns() - recording_start) / 1e9;
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        int error = errno;
+        pthread_mutex_unlock(&control_mutex);
+        canon_log(LOG_ERROR, "Failed to write trace %s: %s", path, strerror(error));
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    bool ok = write_trace(file, current, &written, &dropped);
+    ok = fclose(file) == 0 && ok;
+    uint32_t lost_threads = __atomic_load_n(&untracked, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&control_mutex);
+
+    if (!ok) {
+        canon_log(LOG_ERROR, "Failed to write trace %s", path);
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    canon_log(LOG_INFO, "Trace written to %s: %llu spans over %.1f s",
+             path, (unsigned long long)written, seconds);
+    if (dropped > 0) {
+        canon_log(LOG_WARNING, "Trace buffers filled up: %llu later spans were not recorded",
+                 (unsigned long long)dropped);
+    }
+    if (lost_threads > 0) {
+        canon_log(LOG_WARNING, "Trace: %u threads were not recorded (limit %d)",
+                 lost_threads, TRACE_MAX_THREADS);
+    }
+
+    return CANON_SUCCESS;
+}
+
+void trace_recorder_toggle(void)
+{
+    if (!trace_recorder_is_recording()) {
+        trace_recorder_start();
+        return;
+    }
+
+    const char *dir = getenv("CANON_EOS_TRACE_DIR");
+    if (!dir || !*dir) {
+        dir = "/tmp";
+    }
+
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/canon-eos-trace-%s.json", dir, stamp);
+    trace_recorder_stop(path);
+}
+
+void trace_recorder_shutdown(void)
+{
+    if (trace_recorder_is_recording()) {
+        trace_recorder_toggle();
+    }
+
+    pthread_mutex_lock(&control_mutex);
+    pthread_mutex_lock(&registry_mutex);
+
+    // Buffers of threads that outlive the plugin must not be touched again
+    pthread_once(&key_once, create_key);
+    pthread_key_delete(exit_key);
+
+    for (uint32_t i = 0; i < buffer_count; i++) {
+        free(buffers[i]->spans);
+        free(buffers[i]);
+        buffers[i] = NULL;
+    }
+    buffer_count = 0;
+
+    pthread_mutex_unlock(&registry_mutex);
+    pthread_mutex_unlock(&control_mutex);
+}
@@ -0,0 +1,109 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <util/platform.h>
+#include "canon-errors.h"
+
+/**
+ * @brief In-process span recorder writing Chrome trace-event JSON
+ *
+ * While armed, every thread records begin/end spans of the pipeline stages
+ * into its own buffer, without locks. Stopping writes all buffers as a
+ * Chrome trace-event file that chrome://tracing and ui.perfetto.dev open.
+ * Disarmed, trace_begin() costs one predictable branch and trace_end() one
+ * more on a constant zero.
+ *
+ * Usage:
+ *     uint64_t span = trace_begin();
+ *     ...work...
+ *     trace_end(TRACE_DECODE, span, value);
+ */
+
+/**
+ * @brief Traced pipeline stages
+ */
+typedef enum {
+    TRACE_FETCH = 0,        /**< Preview fetch from the camera (value: JPEG bytes) */
+    TRACE_DELTA,            /**< Restart-interval scan against the previous frame (value: MCU rows) */
+    TRACE_DECODE,           /**< JPEG decode into the frame queue (value: JPEG bytes) */
+    TRACE_CONVERT,          /**< Software colour conversion into NV12 */
+    TRACE_QUEUE_WAIT,       /**< Consumer waiting for a decoded frame */
+    TRACE_OUTPUT,           /**< Hand-off to OBS (async output or texture upload) */
+    TRACE_SINK,             /**< Conversion into a v4l2 sink buffer (value: pixels) */
+    TRACE_EVENT_COUNT
+} trace_event_t;
+
+/** Set while recording; read through trace_begin() only */
+extern bool g_trace_armed;
+
+/**
+ * @brief Record a completed span (use trace_end())
+ */
+void trace_record(trace_event_t event, uint64_t start, uint64_t value);
+
+/**
+ * @brief Start a span
+ * @return Start timestamp, or 0 when not recording
+ */
+static inline uint64_t trace_begin(void)
+{
+    if (__builtin_expect(__atomic_load_n(&g_trace_armed, __ATOMIC_RELAXED), 0)) {
+        return os_gettime_ns();
+    }
+    return 0;
+}
+
+/**
+ * @brief End a span started by trace_begin()
+ * @param event Stage
+ * @param start Value returned by trace_begin()
+ * @param value Stage-specific argument shown in the trace viewer
+ */
+static inline void trace_end(trace_event_t event, uint64_t start, uint64_t value)
+{
+    if (start) {
+        trace_record(event, start, value);
+    }
+}
+
+/**
+ * @brief Name the calling thread in traces (default: its pthread name)
+ * @param name Thread name, e.g. "canon-capture"
+ */
+void trace_set_thread_name(const char *name);
+
+/**
+ * @brief Arm the recorder, discarding any previous recording
+ */
+void trace_recorder_start(void);
+
+/**
+ * @brief Disarm the recorder and write the recording
+ * @param path Output JSON file
+ * @return CANON_SUCCESS, or CANON_ERROR_UNKNOWN if the file could not be written
+ */
+canon_error_t trace_recorder_stop(const char *path);
+
+/**
+ * @brief Check whether the recorder is armed
+ */
+bool trace_recorder_is_recording(void);
+
+/**
+ * @brief Start recording, or stop and write to a timestamped file
+ *
+ * The file goes to CANON_EOS_TRACE_DIR (default /tmp) as
+ * canon-eos-trace-YYYYMMDD-HHMMSS.json; its path is logged.
+ */
+void trace_recorder_toggle(void);
+
+/**
+ * @brief Write any recording in progress and free all trace buffers
+ *
+ * Call once at plugin unload, after all pipelines have stopped.
+ */
+void trace_recorder_shutdown(void);
+
+#endif /* TRACE_RECORDER_H */
@@ -0,0 +1,443 @@
+#include "v4l2-sink.h"
+#include "utils/logging.h"
+#include <util/platform.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+// A device whose format could not be set is tried again after this long,
+// in case the reader that fixed it has gone
+#define FORMAT_RETRY_NS 2000000000ULL
+
+typedef enum {
+    BUFFER_FREE = 0,            // Ours, not holding a frame
+    BUFFER_HELD,                // Dequeued by the caller
+    BUFFER_QUEUED               // With the device
+} buffer_state_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t length;
+    buffer_state_t state;
+} sink_buffer_t;
+
+/**
+ * @brief Sink implementation
+ */
+struct v4l2_sink_t {
+    char device[256];
+    int fd;
+
+    // Format the device is set to, valid when format_ok
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;
+    uint32_t bytesperline;
+    uint32_t sizeimage;
+    bool format_ok;
+    uint64_t format_failed_at;  // Last failed attempt at width x height
+
+    sink_buffer_t buffers[V4L2_SINK_BUFFERS];
+    uint32_t buffer_count;
+    uint32_t generation;
+    bool streaming;
+    bool logged_error;
+};
+
+static int xioctl(int fd, unsigned long request, void *arg)
+{
+    int ret;
+    do {
+        ret = ioctl(fd, request, arg);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+static void release_buffers(v4l2_sink_t *sink)
+{
+    if (sink->streaming) {
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        xioctl(sink->fd, VIDIOC_STREAMOFF, &type);
+        sink->streaming = false;
+    }
+
+    for (uint32_t i = 0; i < sink->buffer_count; i++) {
+        if (sink->buffers[i].data) {
+            munmap(sink->buffers[i].data, sink->buffers[i].length);
+        }
+    }
+    memset(sink->buffers, 0, sizeof(sink->buffers));
+
+    if (sink->buffer_count > 0) {
+        struct v4l2_requestbuffers request = {
+            .count = 0,
+            .type = V4L2_BUF_TYPE_VIDEO_OUTPUT,
+            .memory = V4L2_MEMORY_MMAP
+        };
+        xioctl(sink->fd, VIDIOC_REQBUFS, &request);
+        sink->buffer_count = 0;
+    }
+
+    sink->format_ok = false;
+    sink->generation++;
+}
+
+/* Bytes a frame takes in the device's layout, 0 for unsupported layouts */
+static size_t frame_bytes(uint32_t pixelformat, uint32_t bytesperline,
+                          uint32_t width, uint32_t height)
+{
+    size_t chroma_rows = (height + 1) / 2;
+
+    switch (pixelformat) {
+        case V4L2_PIX_FMT_NV12:
+            return bytesperline >= width
+                ? (size_t)bytesperline * (height + chroma_rows) : 0;
+        case V4L2_PIX_FMT_YUV420:
+            return bytesperline >= width
+                ? (size_t)bytesperline * height + 2 * (size_t)(bytesperline / 2) * chroma_rows : 0;
+        case V4L2_PIX_FMT_YUYV:
+            return bytesperline >= width * 2 ? (size_t)bytesperline * height : 0;
+        default:
+            return 0;
+    }
+}
+
+static bool map_buffers(v4l2_sink_t *sink)
+{
+    struct v4l2_requestbuffers request = {
+        .count = V4L2_SINK_BUFFERS,
+        .type = V4L2_BUF_TYPE_VIDEO_OUTPUT,
+        .memory = V4L2_MEMORY_MMAP
+    };
+    if (xioctl(sink->fd, VIDIOC_REQBUFS, &request) < 0 || request.count == 0) {
+        canon_log(LOG_ERROR, "v4l2 sink %s: cannot allocate buffers: %s",
+                 sink->device, strerror(errno));
+        return false;
+    }
+    sink->buffer_count = request.count < V4L2_SINK_BUFFERS ? request.count : V4L2_SINK_BUFFERS;
+
+    for (uint32_t i = 0; i < sink->buffer_count; i++) {
+        struct v4l2_buffer query = {
+            .index = i,
+            .type = V4L2_BUF_TYPE_VIDEO_OUTPUT,
+            .memory = V4L2_MEMORY_MMAP
+        };
+        if (xioctl(sink->fd, VIDIOC_QUERYBUF, &query) < 0) {
+            canon_log(LOG_ERROR, "v4l2 sink %s: cannot query buffer %u: %s",
+                     sink->device, i, strerror(errno));
+            return false;
+        }
+
+        void *data = mmap(NULL, query.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                          sink->fd, query.m.offset);
+        if (data == MAP_FAILED) {
+            canon_log(LOG_ERROR, "v4l2 sink %s: cannot map buffer %u: %s",
+                     sink->device, i, strerror(errno));
+            return false;
+        }
+        sink->buffers[i].data = data;
+        sink->buffers[i].length = query.length;
+        sink->buffers[i].state = BUFFER_FREE;
+    }
+
+    int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    if (xioctl(sink->fd, VIDIOC_STREAMON, &type) < 0) {
+        canon_log(LOG_ERROR, "v4l2 sink %s: cannot start streaming: %s",
+                 sink->device, strerror(errno));
+        return false;
+    }
+    sink->streaming = true;
+    return true;
+}
+
+/* Set the device to width x height and map its buffers */
+static canon_error_t configure(v4l2_sink_t *sink, uint32_t width, uint32_t height)
+{
+    uint64_t now = os_gettime_ns();
+    if (!sink->format_ok && sink->width == width && sink->height == height &&
+        now - sink->format_failed_at < FORMAT_RETRY_NS) {
+        return CANON_ERROR_NOT_SUPPORTED;
+    }
+
+    release_buffers(sink);
+
+    struct v4l2_format format = {0};
+    format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    format.fmt.pix.width = width;
+    format.fmt.pix.height = height;
+    format.fmt.pix.pixelformat = V4L2_PIX_FMT_NV12;
+    format.fmt.pix.field = V4L2_FIELD_NONE;
+    format.fmt.pix.bytesperline = width;
+    format.fmt.pix.sizeimage = (uint32_t)frame_bytes(V4L2_PIX_FMT_NV12, width, width, height);
+    format.fmt.pix.colorspace = V4L2_COLORSPACE_REC709;
+    format.fmt.pix.quantization = V4L2_QUANTIZATION_LIM_RANGE;
+
+    // A device held by a reader keeps its format; write in that if possible
+    if (xioctl(sink->fd, VIDIOC_S_FMT, &format) < 0 &&
+        xioctl(sink->fd, VIDIOC_G_FMT, &format) < 0) {
+        canon_log(LOG_ERROR, "v4l2 sink %s: cannot set the format: %s",
+                 sink->device, strerror(errno));
+        memset(&format, 0, sizeof(format));
+    }
+
+    const struct v4l2_pix_format *pix = &format.fmt.pix;
+    size_t needed = frame_bytes(pix->pixelformat, pix->bytesperline, width, height);
+    sink->width = width;
+    sink->height = height;
+
+    if (pix->width != width || pix->height != height || needed == 0 ||
+        pix->sizeimage < needed) {
+        uint32_t fourcc = pix->pixelformat;
+        canon_log(LOG_WARNING, "v4l2 sink %s: device is set to %ux%u %c%c%c%c, "
+                 "cannot write %ux%u frames", sink->device, pix->width, pix->height,
+                 (char)(fourcc & 0xff), (char)((fourcc >> 8) & 0xff),
+                 (char)((fourcc >> 16) & 0xff), (char)((fourcc >> 24) & 0xff),
+                 width, height);
+        sink->format_failed_at = now;
+        return CANON_ERROR_NOT_SUPPORTED;
+    }
+
+    sink->pixelformat = pix->pixelformat;
+    sink->bytesperline = pix->bytesperline;
+    sink->sizeimage = pix->sizeimage;
+
+    if (!map_buffers(sink)) {
+        release_buffers(sink);
+        sink->format_failed_at = now;
+        return CANON_ERROR_NOT_SUPPORTED;
+    }
+
+    sink->format_ok = true;
+    sink->logged_error = false;
+    canon_log(LOG_INFO, "v4l2 sink %s: %ux%u %s, %u buffers", sink->device, width, height,
+             sink->pixelformat == V4L2_PIX_FMT_NV12 ? "NV12"
+             : sink->pixelformat == V4L2_PIX_FMT_YUV420 ? "I420 (converted)"
+                                                        : "YUYV (converted)",
+             sink->buffer_count);
+    return CANON_SUCCESS;
+}
+
+v4l2_sink_t *v4l2_sink_create(const char *device)
+{
+    if (!device || !device[0]) {
+        return NULL;
+    }
+
+    v4l2_sink_t *sink = calloc(1, sizeof(v4l2_sink_t));
+    if (!sink) {
+        canon_log(LOG_ERROR, "Failed to allocate v4l2 sink");
+        return NULL;
+    }
+
+    snprintf(sink->device, sizeof(sink->device), "%s", device);
+    sink->fd = open(device, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (sink->fd < 0) {
+        canon_log(LOG_ERROR, "v4l2 sink %s: cannot open: %s", device, strerror(errno));
+        free(sink);
+        return NULL;
+    }
+
+    struct v4l2_capability caps = {0};
+    if (xioctl(sink->fd, VIDIOC_QUERYCAP, &caps) < 0) {
+        canon_log(LOG_ERROR, "v4l2 sink %s: not a video device", device);
+        v4l2_sink_destroy(sink);
+        return NULL;
+    }
+
+    uint32_t device_caps = (caps.capabilities & V4L2_CAP_DEVICE_CAPS)
+                               ? caps.device_caps : caps.capabilities;
+    if (!(device_caps & V4L2_CAP_VIDEO_OUTPUT) || !(device_caps & V4L2_CAP_STREAMING)) {
+        canon_log(LOG_ERROR, "v4l2 sink %s: %s takes no streaming output "
+                 "(is it a v4l2loopback device?)", device, (const char *)caps.card);
+        v4l2_sink_destroy(sink);
+        return NULL;
+    }
+
+    canon_log(LOG_INFO, "v4l2 sink %s: writing to %s", device, (const char *)caps.card);
+    return sink;
+}
+
+void v4l2_sink_destroy(v4l2_sink_t *sink)
+{
+    if (!sink) {
+        return;
+    }
+
+    if (sink->fd >= 0) {
+        release_buffers(sink);
+        close(sink->fd);
+    }
+    free(sink);
+}
+
+const char *v4l2_sink_get_device(v4l2_sink_t *sink)
+{
+    return sink ? sink->device : "";
+}
+
+canon_error_t v4l2_sink_dequeue(v4l2_sink_t *sink, uint32_t width, uint32_t height,
+                                v4l2_sink_buffer_t *buffer)
+{
+    if (!sink || !buffer || width == 0 || height == 0) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    if (!sink->format_ok || sink->width != width || sink->height != height) {
+        canon_error_t err = configure(sink, width, height);
+        if (err != CANON_SUCCESS) {
+            return err;
+        }
+    }
+
+    int index = -1;
+    for (uint32_t i = 0; i < sink->buffer_count; i++) {
+        if (sink->buffers[i].state == BUFFER_FREE) {
+            index = (int)i;
+            break;
+        }
+    }
+
+    // The device hands written buffers back in the order they were queued
+    if (index < 0) {
+        struct v4l2_buffer done = {
+            .type = V4L2_BUF_TYPE_VIDEO_OUTPUT,
+            .memory = V4L2_MEMORY_MMAP
+        };
+        if (xioctl(sink->fd, VIDIOC_DQBUF, &done) < 0) {
+            if (errno == EAGAIN) {
+                return CANON_ERROR_CAMERA_BUSY;
+            }
+            if (!sink->logged_error) {
+                canon_log(LOG_ERROR, "v4l2 sink %s: dequeue failed: %s", sink->device,
+                         strerror(errno));
+                sink->logged_error = true;
+            }
+            return errno == ENODEV ? CANON_ERROR_DISCONNECTED : CANON_ERROR_UNKNOWN;
+        }
+        if (done.index >= sink->buffer_count) {
+            return CANON_ERROR_UNKNOWN;
+        }
+        index = (int)done.index;
+    }
+
+    sink_buffer_t *held = &sink->buffers[index];
+    held->state = BUFFER_HELD;
+
+    buffer->data = held->data;
+    buffer->capacity = held->length;
+    buffer->index = (uint32_t)index;
+    buffer->width = width;
+    buffer->height = height;
+    buffer->generation = sink->generation;
+    buffer->direct = sink->pixelformat == V4L2_PIX_FMT_NV12 && sink->bytesperline == width;
+    return CANON_SUCCESS;
+}
+
+canon_error_t v4l2_sink_fill(v4l2_sink_t *sink, const v4l2_sink_buffer_t *buffer,
+                             const uint8_t *y, const uint8_t *uv, uint32_t linesize,
+                             uint32_t width, uint32_t height)
+{
+    if (!sink || !buffer || !y || !uv || buffer->generation != sink->generation ||
+        width != sink->width || height != sink->height) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    uint8_t *out = buffer->data;
+    uint32_t stride = sink->bytesperline;
+    uint32_t chroma_rows = (height + 1) / 2;
+
+    switch (sink->pixelformat) {
+        case V4L2_PIX_FMT_NV12: {
+            uint8_t *out_uv = out + (size_t)stride * height;
+            for (uint32_t row = 0; row < height; row++) {
+                memcpy(out + (size_t)row * stride, y + (size_t)row * linesize, width);
+            }
+            for (uint32_t row = 0; row < chroma_rows; row++) {
+                memcpy(out_uv + (size_t)row * stride, uv + (size_t)row * linesize, width);
+            }
+            break;
+        }
+        case V4L2_PIX_FMT_YUV420: {
+            uint32_t chroma_stride = stride / 2;
+            uint8_t *out_u = out + (size_t)stride * height;
+            uint8_t *out_v = out_u + (size_t)chroma_stride * chroma_rows;
+            for (uint32_t row = 0; row < height; row++) {
+                memcpy(out + (size_t)row * stride, y + (size_t)row * linesize, width);
+            }
+            for (uint32_t row = 0; row < chroma_rows; row++) {
+                const uint8_t *in = uv + (size_t)row * linesize;
+                uint8_t *u = out_u + (size_t)row * chroma_stride;
+                uint8_t *v = out_v + (size_t)row * chroma_stride;
+                for (uint32_t x = 0; x < width / 2; x++) {
+                    u[x] = in[2 * x];
+                    v[x] = in[2 * x + 1];
+                }
+            }
+            break;
+        }
+        case V4L2_PIX_FMT_YUYV:
+            for (uint32_t row = 0; row < height; row++) {
+                const uint8_t *in_y = y + (size_t)row * linesize;
+                const uint8_t *in_uv = uv + (size_t)(row / 2) * linesize;
+                uint8_t *line = out + (size_t)row * stride;
+                for (uint32_t x = 0; x + 1 < width; x += 2) {
+                    line[2 * x] = in_y[x];
+                    line[2 * x + 1] = in_uv[x];
+                    line[2 * x + 2] = in_y[x + 1];
+                    line[2 * x + 3] = in_uv[x + 1];
+                }
+            }
+            break;
+        default:
+            return CANON_ERROR_NOT_SUPPORTED;
+    }
+
+    return CANON_SUCCESS;
+}
+
+canon_error_t v4l2_sink_queue(v4l2_sink_t *sink, const v4l2_sink_buffer_t *buffer,
+                              bool filled)
+{
+    if (!sink || !buffer || buffer->generation != sink->generation ||
+        buffer->index >= sink->buffer_count ||
+        sink->buffers[buffer->index].state != BUFFER_HELD) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    sink_buffer_t *held = &sink->buffers[buffer->index];
+    if (!filled) {
+        held->state = BUFFER_FREE;
+        return CANON_SUCCESS;
+    }
+
+    struct v4l2_buffer queue = {
+        .index = buffer->index,
+        .type = V4L2_BUF_TYPE_VIDEO_OUTPUT,
+        .memory = V4L2_MEMORY_MMAP,
+        .bytesused = sink->sizeimage,
+        .field = V4L2_FIELD_NONE
+    };
+    if (xioctl(sink->fd, VIDIOC_QBUF, &queue) < 0) {
+        if (!sink->logged_error) {
+            canon_log(LOG_ERROR, "v4l2 sink %s: queue failed: %s", sink->device,
+                     strerror(errno));
+            sink->logged_error = true;
+        }
+        held->state = BUFFER_FREE;
+        return CANON_ERROR_UNKNOWN;
+    }
+
+    held->state = BUFFER_QUEUED;
+    return CANON_SUCCESS;
+}
+
+uint32_t v4l2_sink_generation(v4l2_sink_t *sink)
+{
+    return sink ? sink->generation : 0;
+}
@@ -0,0 +1,113 @@
+#ifndef V4L2_SINK_H
+#define V4L2_SINK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "canon-errors.h"
+
+/**
+ * @brief Decoded frames written to a v4l2loopback device
+ *
+ * Makes the camera available to applications other than OBS (browsers,
+ * video call clients) through a /dev/videoN created by the v4l2loopback
+ * module, using mmap streaming I/O on the device's output queue.
+ *
+ * The device is set to NV12 at the size of the frames written to it. When
+ * it takes NV12 with rows packed back to back, a dequeued buffer has the
+ * same layout as the plugin's frame buffers, and the JPEG can be decoded
+ * straight into it. A device whose format is fixed otherwise (another
+ * writer or reader holds it, or v4l2loopback was loaded with a fixed
+ * format) gets frames converted to its I420 or YUYV layout, or nothing if
+ * the size differs.
+ *
+ * Not thread-safe; the caller serializes all calls.
+ */
+typedef struct v4l2_sink_t v4l2_sink_t;
+
+#define V4L2_SINK_BUFFERS 4
+
+/**
+ * @brief A device buffer held by the caller between dequeue and queue
+ */
+typedef struct {
+    uint8_t *data;              /**< Mapped buffer */
+    size_t capacity;            /**< Mapped size in bytes */
+    uint32_t index;             /**< Device buffer index */
+    uint32_t width;             /**< Frame size the buffer is laid out for */
+    uint32_t height;
+    uint32_t generation;        /**< Mapping it belongs to, see v4l2_sink_generation() */
+    bool direct;                /**< Packed NV12 of the requested size: decode into data */
+} v4l2_sink_buffer_t;
+
+/**
+ * @brief Open a v4l2loopback device for writing
+ * @param device Device path, e.g. /dev/video10
+ * @return Sink handle or NULL if the device cannot be opened or has no output
+ */
+v4l2_sink_t *v4l2_sink_create(const char *device);
+
+/**
+ * @brief Stop streaming, unmap the buffers and close the device
+ * @param sink Sink handle (may be NULL)
+ */
+void v4l2_sink_destroy(v4l2_sink_t *sink);
+
+/**
+ * @brief Get the device path
+ * @param sink Sink handle (may be NULL)
+ * @return Path given to v4l2_sink_create(), "" for NULL
+ */
+const char *v4l2_sink_get_device(v4l2_sink_t *sink);
+
+/**
+ * @brief Take a device buffer for a frame of the given size
+ *
+ * Sets the device format first if the size changed, which unmaps all
+ * buffers of the previous size.
+ * @param sink Sink handle
+ * @param width Frame width
+ * @param height Frame height
+ * @param buffer Output buffer
+ * @return CANON_SUCCESS, CANON_ERROR_NOT_SUPPORTED if the device cannot take
+ *         frames of this size, CANON_ERROR_CAMERA_BUSY if no buffer is free
+ */
+canon_error_t v4l2_sink_dequeue(v4l2_sink_t *sink, uint32_t width, uint32_t height,
+                                v4l2_sink_buffer_t *buffer);
+
+/**
+ * @brief Convert an NV12 frame into a dequeued buffer's layout
+ * @param sink Sink handle
+ * @param buffer Buffer from v4l2_sink_dequeue() for this frame's size
+ * @param y Luma plane
+ * @param uv Interleaved chroma plane
+ * @param linesize Bytes per row of both planes
+ * @param width Frame width
+ * @param height Frame height
+ * @return CANON_SUCCESS or CANON_ERROR_INVALID_PARAM on a size mismatch
+ */
+canon_error_t v4l2_sink_fill(v4l2_sink_t *sink, const v4l2_sink_buffer_t *buffer,
+                             const uint8_t *y, const uint8_t *uv, uint32_t linesize,
+                             uint32_t width, uint32_t height);
+
+/**
+ * @brief Hand a buffer back to the device
+ * @param sink Sink handle
+ * @param buffer Buffer from v4l2_sink_dequeue()
+ * @param filled false to return it unused, nothing is written then
+ * @return CANON_SUCCESS or CANON_ERROR_UNKNOWN if the device refused it
+ */
+canon_error_t v4l2_sink_queue(v4l2_sink_t *sink, const v4l2_sink_buffer_t *buffer,
+                              bool filled);
+
+/**
+ * @brief Get the current buffer mapping
+ *
+ * Changes whenever the buffers are remapped; memory of a buffer from an
+ * older generation must not be read anymore.
+ * @param sink Sink handle
+ * @return Mapping generation
+ */
+uint32_t v4l2_sink_generation(v4l2_sink_t *sink);
+
+#endif /* V4L2_SINK_H */
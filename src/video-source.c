@@ -1,17 +1,35 @@
+#define _GNU_SOURCE  // RUSAGE_THREAD
 #include "video-source.h"
+#include "capture-sync.h"
+#include "fetch-scheduler.h"
+#include "frame-delta.h"
+#include "jpeg-decoder.h"
 #include "utils/logging.h"
+#include "utils/lock-profiler.h"
 #include "utils/error-handling.h"
+#include "utils/mem-accounting.h"
+#include "utils/preview-hash.h"
+#include "utils/thread-registry.h"
+#include "utils/trace-recorder.h"
 #include <util/platform.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <time.h>
-#include <jpeglib.h>
-#include <setjmp.h>
+#include <sys/resource.h>
 
-#define FRAME_QUEUE_SIZE 4
+#define JPEG_QUEUE_SIZE 4
+#define JPEG_SLOT_SIZE (4 * 1024 * 1024)
+// One frame held by the consumer and one being decoded for it
+#define FRAME_POOL_SIZE 2
 #define MAX_FRAME_SIZE (3840 * 2160 * 4)
+#define DELTA_REPORT_INTERVAL 300
+#define DECODER_CALIBRATION_FRAMES 5
+#define DECODER_CACHE_SIZE 16
+// A smaller decode scale must clear the on-canvas size by this many percent
+#define DECODE_SCALE_MARGIN 10
 
 /**
  * @brief Frame buffer for video pipeline
@@ -22,24 +40,56 @@ typedef struct {
     uint32_t width;
     uint32_t height;
     uint64_t timestamp;
+    uint64_t capture_start;
+    uint32_t scale;             // Decoded at 1/scale of the JPEG size
+    uint32_t full_width;        // Size at scale 1
+    uint32_t full_height;
     bool in_use;
+    v4l2_sink_buffer_t sink;    // Device buffer it maps, data NULL for pool buffers
+    uint64_t decode_start;      // Decoded into the v4l2 sink's buffer at
 } frame_buffer_t;
 
+typedef enum {
+    JPEG_SLOT_FREE = 0,
+    JPEG_SLOT_QUEUED,
+    JPEG_SLOT_DECODING
+} jpeg_slot_state_t;
+
+/**
+ * @brief Fetched preview JPEG waiting for a consumer
+ */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    uint64_t sequence;          // Fetch order
+    uint64_t capture_start;
+    jpeg_slot_state_t state;
+} jpeg_slot_t;
+
 /**
  * @brief Video source implementation
  */
 struct video_source_t {
     canon_camera_t *camera;
     video_format_info_t format;
+    mem_account_t *account;
+    cpu_group_t *cpu;
 
     pthread_t capture_thread;
-    pthread_mutex_t mutex;
+    profiled_mutex_t mutex;
     pthread_cond_t frame_available;
 
-    frame_buffer_t frame_queue[FRAME_QUEUE_SIZE];
-    int write_index;
-    int read_index;
-    int frame_count;
+    // Fetched frames stay compressed until a consumer takes one, so frames
+    // dropped or superseded in the queue are never decoded
+    jpeg_slot_t jpeg_queue[JPEG_QUEUE_SIZE];
+    int jpeg_count;                     // Slots in JPEG_SLOT_QUEUED
+    uint64_t jpeg_sequence;
+    frame_buffer_t frame_pool[FRAME_POOL_SIZE];
+
+    // With decode_ahead the capture thread decodes the newest JPEG into the
+    // pool after each fetch, and video_source_get_latest_frame() takes it
+    bool decode_ahead;                  // Atomic, applied by the capture thread
+    frame_buffer_t *ready;              // Decoded and not taken yet, NULL = none
 
     bool active;
     bool thread_running;
@@ -47,63 +97,287 @@ struct video_source_t {
     uint8_t *conversion_buffer;
     size_t conversion_buffer_size;
 
-    uint64_t frames_captured;
-    uint64_t frames_dropped;
-    uint64_t last_frame_time;
+    // Decoder state below, up to the counters, is guarded by decode_mutex.
+    // Consumers decode on their own thread; taken before the mutex.
+    profiled_mutex_t decode_mutex;
+    frame_delta_t *delta;
+    frame_buffer_t *last_decoded;
+
+    v4l2_sink_t *sink;                  // Loopback device output, NULL = off
+    frame_buffer_t sink_frames[FRAME_POOL_SIZE];    // Decoded into the sink's buffers
+
+    profiled_mutex_t stream_mutex;      // Guards stream against removal mid-publish
+    mjpeg_server_t *stream;             // Compressed preview stream, NULL = off
+
+    uint32_t sync_group;                // Atomic, applied by the capture thread
+    bool phase_lock;                    // Atomic, applied by the capture thread
+
+    video_crop_mode_t crop_mode;        // Guarded by the mutex, applied by the
+    canon_roi_t crop;                   // capture thread when crop_generation
+    uint32_t crop_generation;           // changes
+    canon_roi_t decode_region;          // Crop within the preview
+    bool crop_active;
+
+    uint64_t decode_target;             // Atomic: on-canvas width << 32 | height, 0 = any
+    uint32_t decode_scale;
+
+    int decoder_override;
+    int decoder_index;
+    uint32_t decoder_width;
+    uint32_t decoder_height;
+    void *decoder_ctx[JPEG_DECODER_MAX_BACKENDS];
+    bool decoder_ctx_created[JPEG_DECODER_MAX_BACKENDS];
+    size_t decoder_memory;
+    uint32_t calibration_frames;
+    uint64_t calibration_ns[JPEG_DECODER_MAX_BACKENDS];
+    uint32_t calibration_failures[JPEG_DECODER_MAX_BACKENDS];
+
+    uint64_t frames_incremental;
+    uint64_t mcu_rows_total;
+    uint64_t mcu_rows_decoded;
+
+    video_source_counters_t counters;   // Atomic, read without the mutex
 };
 
+/**
+ * @brief Decoder chosen by calibration for a frame geometry
+ */
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    int index;
+} decoder_cache_entry_t;
+
+static decoder_cache_entry_t g_decoder_cache[DECODER_CACHE_SIZE];
+static int g_decoder_cache_count = 0;
+static pthread_mutex_t g_decoder_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static void *capture_thread_func(void *data);
-static canon_error_t convert_jpeg_to_nv12(const uint8_t *jpeg_data, size_t jpeg_size,
-                                         uint8_t *nv12_data, uint32_t *width, uint32_t *height);
+static canon_error_t decode_frame(video_source_t *source, const uint8_t *jpeg_data,
+                                  size_t jpeg_size, frame_buffer_t *buffer);
+static void apply_crop(video_source_t *source, bool *zoomed);
+static void decoder_cache_store(uint32_t width, uint32_t height, int index);
 
-video_source_t *video_source_create(void)
+static inline void count(uint64_t *counter, uint64_t value)
 {
-    video_source_t *source = calloc(1, sizeof(video_source_t));
-    if (!source) {
-        canon_log(LOG_ERROR, "Failed to allocate video source");
-        return NULL;
+    __atomic_add_fetch(counter, value, __ATOMIC_RELAXED);
+}
+
+/* Bytes a decode may write to the buffer */
+static size_t buffer_capacity(const frame_buffer_t *buffer)
+{
+    return buffer->sink.data ? buffer->sink.capacity : MAX_FRAME_SIZE;
+}
+
+static void sleep_until(uint64_t deadline)
+{
+    struct timespec ts = {
+        .tv_sec = (time_t)(deadline / 1000000000ULL),
+        .tv_nsec = (long)(deadline % 1000000000ULL)
+    };
+
+    // os_gettime_ns() is CLOCK_MONOTONIC
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
     }
+}
 
-    pthread_mutex_init(&source->mutex, NULL);
-    pthread_cond_init(&source->frame_available, NULL);
+/* Charge the calling thread's page faults since the last call to the source */
+static void count_page_faults(video_source_t *source, struct rusage *last)
+{
+    struct rusage now;
+    if (getrusage(RUSAGE_THREAD, &now) != 0) {
+        return;
+    }
+
+    count(&source->counters.page_faults_minor, (uint64_t)(now.ru_minflt - last->ru_minflt));
+    count(&source->counters.page_faults_major, (uint64_t)(now.ru_majflt - last->ru_majflt));
+    *last = now;
+}
 
-    source->conversion_buffer_size = MAX_FRAME_SIZE;
-    source->conversion_buffer = malloc(source->conversion_buffer_size);
+/* Called with the source mutex held (or before the source is shared) */
+static canon_error_t ensure_buffers_locked(video_source_t *source)
+{
     if (!source->conversion_buffer) {
-        canon_log(LOG_ERROR, "Failed to allocate conversion buffer");
-        pthread_mutex_destroy(&source->mutex);
-        pthread_cond_destroy(&source->frame_available);
-        free(source);
-        return NULL;
+        source->conversion_buffer = mem_account_alloc(source->account,
+                                                      MEM_CATEGORY_CONVERSION,
+                                                      MAX_FRAME_SIZE);
+        if (!source->conversion_buffer) {
+            canon_log(LOG_ERROR, "Failed to allocate conversion buffer");
+            return CANON_ERROR_MEMORY_BUDGET;
+        }
+        source->conversion_buffer_size = MAX_FRAME_SIZE;
+    }
+
+    for (int i = 0; i < JPEG_QUEUE_SIZE; i++) {
+        jpeg_slot_t *slot = &source->jpeg_queue[i];
+        if (slot->data) {
+            continue;
+        }
+
+        slot->data = mem_account_alloc(source->account, MEM_CATEGORY_QUEUE, JPEG_SLOT_SIZE);
+        if (!slot->data) {
+            canon_log(LOG_ERROR, "Failed to allocate JPEG queue slot %d", i);
+            return CANON_ERROR_MEMORY_BUDGET;
+        }
+        slot->state = JPEG_SLOT_FREE;
     }
 
-    for (int i = 0; i < FRAME_QUEUE_SIZE; i++) {
-        frame_buffer_t *frame = &source->frame_queue[i];
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        frame_buffer_t *frame = &source->frame_pool[i];
+        if (frame->data[0]) {
+            continue;
+        }
 
-        frame->data[0] = malloc(MAX_FRAME_SIZE);
+        frame->data[0] = mem_account_alloc(source->account, MEM_CATEGORY_FRAME_POOL,
+                                           MAX_FRAME_SIZE);
         if (!frame->data[0]) {
             canon_log(LOG_ERROR, "Failed to allocate frame buffer %d", i);
-
-            for (int j = 0; j < i; j++) {
-                free(source->frame_queue[j].data[0]);
-            }
-            free(source->conversion_buffer);
-            pthread_mutex_destroy(&source->mutex);
-            pthread_cond_destroy(&source->frame_available);
-            free(source);
-            return NULL;
+            return CANON_ERROR_MEMORY_BUDGET;
         }
 
-        frame->data[1] = NULL;
-        frame->data[2] = NULL;
-        frame->data[3] = NULL;
         frame->width = 0;
         frame->height = 0;
-        frame->linesize[0] = 0;
-        frame->linesize[1] = 0;
         frame->in_use = false;
     }
 
+    return CANON_SUCCESS;
+}
+
+/* Called with the source mutex held; returns the bytes freed */
+static size_t free_buffers_locked(video_source_t *source)
+{
+    size_t freed = 0;
+
+    for (int i = 0; i < JPEG_QUEUE_SIZE; i++) {
+        jpeg_slot_t *slot = &source->jpeg_queue[i];
+        if (slot->data) {
+            mem_account_free(source->account, MEM_CATEGORY_QUEUE, slot->data, JPEG_SLOT_SIZE);
+            slot->data = NULL;
+            slot->state = JPEG_SLOT_FREE;
+            freed += JPEG_SLOT_SIZE;
+        }
+    }
+
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        frame_buffer_t *frame = &source->frame_pool[i];
+        if (frame->data[0]) {
+            mem_account_free(source->account, MEM_CATEGORY_FRAME_POOL,
+                             frame->data[0], MAX_FRAME_SIZE);
+            frame->data[0] = NULL;
+            frame->width = 0;
+            frame->height = 0;
+            freed += MAX_FRAME_SIZE;
+        }
+    }
+
+    if (source->conversion_buffer) {
+        mem_account_free(source->account, MEM_CATEGORY_CONVERSION,
+                         source->conversion_buffer, source->conversion_buffer_size);
+        source->conversion_buffer = NULL;
+        freed += source->conversion_buffer_size;
+        source->conversion_buffer_size = 0;
+    }
+
+    source->jpeg_count = 0;
+    source->ready = NULL;
+    source->last_decoded = NULL;
+    frame_delta_reset(source->delta);
+
+    return freed;
+}
+
+/* Called with the source mutex held; frames handed out or being decoded */
+static bool frames_held_locked(video_source_t *source)
+{
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        if (source->frame_pool[i].in_use) {
+            return true;
+        }
+    }
+    for (int i = 0; i < JPEG_QUEUE_SIZE; i++) {
+        if (source->jpeg_queue[i].state == JPEG_SLOT_DECODING) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Memory budget reclaim callback
+ *
+ * Drops the frame pool and staging buffer of a stopped source; they are
+ * reallocated by the next video_source_start().
+ */
+static size_t reclaim_buffers(void *data)
+{
+    video_source_t *source = data;
+
+    if (profiled_mutex_trylock(&source->mutex) != 0) {
+        return 0;
+    }
+
+    size_t freed = 0;
+    if (!source->active && !frames_held_locked(source)) {
+        freed = free_buffers_locked(source);
+    }
+
+    profiled_mutex_unlock(&source->mutex);
+    return freed;
+}
+
+/* Called with the decode mutex held, after a decode */
+static void update_decoder_memory_locked(video_source_t *source)
+{
+    size_t usage = frame_delta_memory_usage(source->delta);
+
+    for (size_t i = 0; i < jpeg_decoder_backend_count(); i++) {
+        const jpeg_decoder_backend_t *backend = jpeg_decoder_backend_get(i);
+        if (source->decoder_ctx[i] && backend->memory_usage) {
+            usage += backend->memory_usage(source->decoder_ctx[i]);
+        }
+    }
+
+    if (usage != source->decoder_memory) {
+        source->decoder_memory = usage;
+        mem_account_set(source->account, MEM_CATEGORY_DECODER, usage);
+    }
+}
+
+video_source_t *video_source_create(mem_account_t *account, cpu_group_t *cpu)
+{
+    video_source_t *source = calloc(1, sizeof(video_source_t));
+    if (!source) {
+        canon_log(LOG_ERROR, "Failed to allocate video source");
+        return NULL;
+    }
+
+    source->account = account;
+    source->cpu = cpu;
+    mem_account_charge(account, MEM_CATEGORY_QUEUE, sizeof(video_source_t));
+
+    profiled_mutex_init(&source->mutex, "video_source");
+    profiled_mutex_init(&source->decode_mutex, "video_decode");
+    profiled_mutex_init(&source->stream_mutex, "video_stream");
+    pthread_cond_init(&source->frame_available, NULL);
+
+    source->decoder_override = -1;
+    source->decoder_index = -1;
+    source->counters.zoom = 1;
+    source->decode_scale = 1;
+    source->counters.decode_scale = 1;
+
+    source->delta = frame_delta_create();
+    if (!source->delta) {
+        canon_log(LOG_ERROR, "Failed to allocate frame delta tracker");
+        video_source_destroy(source);
+        return NULL;
+    }
+
+    // Buffers are reserved once a camera is assigned, so that a budget
+    // refusal names it (see video_source_reserve_buffers())
+    update_decoder_memory_locked(source);
+    mem_account_set_reclaim(account, reclaim_buffers, source);
+
     source->format.width = 1920;
     source->format.height = 1080;
     source->format.fps = 30;
@@ -121,18 +395,29 @@ void video_source_destroy(video_source_t *source)
 
     video_source_stop(source);
 
-    for (int i = 0; i < FRAME_QUEUE_SIZE; i++) {
-        if (source->frame_queue[i].data[0]) {
-            free(source->frame_queue[i].data[0]);
+    // Waits for a reclaim pass that may be inside reclaim_buffers()
+    mem_account_set_reclaim(source->account, NULL, NULL);
+
+    profiled_mutex_lock(&source->mutex);
+    free_buffers_locked(source);
+    profiled_mutex_unlock(&source->mutex);
+
+    frame_delta_destroy(source->delta);
+
+    for (size_t i = 0; i < jpeg_decoder_backend_count(); i++) {
+        const jpeg_decoder_backend_t *backend = jpeg_decoder_backend_get(i);
+        if (source->decoder_ctx[i] && backend->destroy) {
+            backend->destroy(source->decoder_ctx[i]);
         }
     }
 
-    if (source->conversion_buffer) {
-        free(source->conversion_buffer);
-    }
+    mem_account_release(source->account, MEM_CATEGORY_DECODER, source->decoder_memory);
+    mem_account_release(source->account, MEM_CATEGORY_QUEUE, sizeof(video_source_t));
 
     pthread_cond_destroy(&source->frame_available);
-    pthread_mutex_destroy(&source->mutex);
+    profiled_mutex_destroy(&source->stream_mutex);
+    profiled_mutex_destroy(&source->decode_mutex);
+    profiled_mutex_destroy(&source->mutex);
 
     free(source);
 }
@@ -145,10 +430,12 @@ canon_error_t video_source_init(video_source_t *source,
         return CANON_ERROR_INVALID_PARAM;
     }
 
-    pthread_mutex_lock(&source->mutex);
+    profiled_mutex_lock(&source->decode_mutex);
+    profiled_mutex_lock(&source->mutex);
 
     if (source->active) {
-        pthread_mutex_unlock(&source->mutex);
+        profiled_mutex_unlock(&source->mutex);
+        profiled_mutex_unlock(&source->decode_mutex);
         return CANON_ERROR_CAMERA_BUSY;
     }
 
@@ -161,13 +448,18 @@ canon_error_t video_source_init(video_source_t *source,
 
     source->format.frame_size = source->format.width * source->format.height * 3 / 2;
 
-    for (int i = 0; i < FRAME_QUEUE_SIZE; i++) {
-        source->frame_queue[i].linesize[0] = source->format.width;
-        source->frame_queue[i].linesize[1] = source->format.width;
-        source->frame_queue[i].in_use = false;
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        source->frame_pool[i].linesize[0] = source->format.width;
+        source->frame_pool[i].linesize[1] = source->format.width;
+        source->frame_pool[i].in_use = false;
     }
 
-    pthread_mutex_unlock(&source->mutex);
+    source->ready = NULL;
+    frame_delta_reset(source->delta);
+    source->last_decoded = NULL;
+
+    profiled_mutex_unlock(&source->mutex);
+    profiled_mutex_unlock(&source->decode_mutex);
 
     canon_log(LOG_INFO, "Video source initialized: %dx%d@%d",
              source->format.width, source->format.height, source->format.fps);
@@ -175,43 +467,75 @@ canon_error_t video_source_init(video_source_t *source,
     return CANON_SUCCESS;
 }
 
+canon_error_t video_source_reserve_buffers(video_source_t *source)
+{
+    if (!source) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    profiled_mutex_lock(&source->mutex);
+
+    canon_error_t err = ensure_buffers_locked(source);
+    if (err != CANON_SUCCESS && !frames_held_locked(source)) {
+        // Do not hold on to a partial pool another source could use
+        free_buffers_locked(source);
+    }
+
+    profiled_mutex_unlock(&source->mutex);
+    return err;
+}
+
 canon_error_t video_source_start(video_source_t *source)
 {
     if (!source) {
         return CANON_ERROR_INVALID_PARAM;
     }
 
-    pthread_mutex_lock(&source->mutex);
+    profiled_mutex_lock(&source->mutex);
 
     if (source->active) {
-        pthread_mutex_unlock(&source->mutex);
+        profiled_mutex_unlock(&source->mutex);
         return CANON_SUCCESS;
     }
 
     if (!source->camera) {
-        pthread_mutex_unlock(&source->mutex);
+        profiled_mutex_unlock(&source->mutex);
         return CANON_ERROR_NO_DEVICE;
     }
 
-    canon_error_t err = canon_camera_start_live_view(source->camera);
+    // Buffers may have been released to the memory budget while stopped
+    canon_error_t err = ensure_buffers_locked(source);
+    if (err != CANON_SUCCESS) {
+        // Do not hold on to a partial pool another source could use
+        if (!frames_held_locked(source)) {
+            free_buffers_locked(source);
+        }
+        profiled_mutex_unlock(&source->mutex);
+        return err;
+    }
+
+    err = canon_camera_start_live_view(source->camera);
     if (err != CANON_SUCCESS) {
-        pthread_mutex_unlock(&source->mutex);
+        profiled_mutex_unlock(&source->mutex);
         return err;
     }
 
     source->active = true;
+    source->ready = NULL;
+    mem_account_set_active(source->account, true);
     source->thread_running = true;
 
     if (pthread_create(&source->capture_thread, NULL, capture_thread_func, source) != 0) {
         source->active = false;
         source->thread_running = false;
+        mem_account_set_active(source->account, false);
         canon_camera_stop_live_view(source->camera);
-        pthread_mutex_unlock(&source->mutex);
+        profiled_mutex_unlock(&source->mutex);
         canon_log(LOG_ERROR, "Failed to create capture thread");
         return CANON_ERROR_UNKNOWN;
     }
 
-    pthread_mutex_unlock(&source->mutex);
+    profiled_mutex_unlock(&source->mutex);
 
     canon_log(LOG_INFO, "Video source started");
     return CANON_SUCCESS;
@@ -223,16 +547,16 @@ void video_source_stop(video_source_t *source)
         return;
     }
 
-    pthread_mutex_lock(&source->mutex);
+    profiled_mutex_lock(&source->mutex);
 
     if (!source->active) {
-        pthread_mutex_unlock(&source->mutex);
+        profiled_mutex_unlock(&source->mutex);
         return;
     }
 
-    source->active = false;
+    __atomic_store_n(&source->active, false, __ATOMIC_RELEASE);
     pthread_cond_broadcast(&source->frame_available);
-    pthread_mutex_unlock(&source->mutex);
+    profiled_mutex_unlock(&source->mutex);
 
     if (source->thread_running) {
         pthread_join(source->capture_thread, NULL);
@@ -243,6 +567,8 @@ void video_source_stop(video_source_t *source)
         canon_camera_stop_live_view(source->camera);
     }
 
+    mem_account_set_active(source->account, false);
+
     canon_log(LOG_INFO, "Video source stopped");
 }
 
@@ -252,63 +578,197 @@ bool video_source_is_active(video_source_t *source)
         return false;
     }
 
-    pthread_mutex_lock(&source->mutex);
+    profiled_mutex_lock(&source->mutex);
     bool active = source->active;
-    pthread_mutex_unlock(&source->mutex);
+    profiled_mutex_unlock(&source->mutex);
 
     return active;
 }
 
-canon_error_t video_source_get_frame(video_source_t *source,
-                                    struct obs_source_frame *frame)
+/* Called with the source mutex held: the oldest or newest queued JPEG */
+static jpeg_slot_t *queued_jpeg_locked(video_source_t *source, bool newest)
 {
-    if (!source || !frame) {
-        return CANON_ERROR_INVALID_PARAM;
+    jpeg_slot_t *found = NULL;
+
+    for (int i = 0; i < JPEG_QUEUE_SIZE; i++) {
+        jpeg_slot_t *slot = &source->jpeg_queue[i];
+        if (slot->state == JPEG_SLOT_QUEUED &&
+            (!found || (newest ? slot->sequence > found->sequence
+                               : slot->sequence < found->sequence))) {
+            found = slot;
+        }
     }
+    return found;
+}
 
-    pthread_mutex_lock(&source->mutex);
+/*
+ * Called with the source mutex held and frames queued: take the newest JPEG
+ * for decoding. Older queued frames are superseded by it, undecoded.
+ */
+static jpeg_slot_t *take_newest_jpeg_locked(video_source_t *source)
+{
+    jpeg_slot_t *slot = queued_jpeg_locked(source, true);
 
-    if (!source->active) {
-        pthread_mutex_unlock(&source->mutex);
-        return CANON_ERROR_DISCONNECTED;
+    for (int i = 0; i < JPEG_QUEUE_SIZE; i++) {
+        jpeg_slot_t *older = &source->jpeg_queue[i];
+        if (older != slot && older->state == JPEG_SLOT_QUEUED) {
+            older->state = JPEG_SLOT_FREE;
+            count(&source->counters.drops_superseded, 1);
+        }
     }
 
-    while (source->frame_count == 0 && source->active) {
-        struct timespec timeout;
-        clock_gettime(CLOCK_REALTIME, &timeout);
-        timeout.tv_nsec += 100000000;
-        if (timeout.tv_nsec >= 1000000000) {
-            timeout.tv_sec++;
-            timeout.tv_nsec -= 1000000000;
+    slot->state = JPEG_SLOT_DECODING;
+    source->jpeg_count = 0;
+    return slot;
+}
+
+/*
+ * Called with the decode mutex and the source mutex held: a pool buffer to
+ * decode into, keeping the last decoded frame for the band path if possible.
+ */
+static frame_buffer_t *decode_buffer_locked(video_source_t *source)
+{
+    frame_buffer_t *fallback = NULL;
+
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        frame_buffer_t *buffer = &source->frame_pool[i];
+        if (buffer->in_use || !buffer->data[0]) {
+            continue;
+        }
+        if (buffer != source->last_decoded) {
+            return buffer;
         }
+        fallback = buffer;
+    }
+    return fallback;
+}
 
-        int ret = pthread_cond_timedwait(&source->frame_available,
-                                        &source->mutex, &timeout);
-        if (ret == ETIMEDOUT) {
-            pthread_mutex_unlock(&source->mutex);
-            return CANON_ERROR_TIMEOUT;
-        } else if (ret != 0) {
-            // Handle any other error from pthread_cond_timedwait
-            pthread_mutex_unlock(&source->mutex);
-            canon_log(LOG_ERROR, "pthread_cond_timedwait failed with error %d", ret);
-            return CANON_ERROR_UNKNOWN;
+/*
+ * Called with the decode mutex held: drop the band decode reference if it
+ * lies in sink buffers that have been remapped since.
+ */
+static void forget_stale_sink_frame(video_source_t *source)
+{
+    frame_buffer_t *previous = source->last_decoded;
+    if (previous && previous->sink.data &&
+        previous->sink.generation != v4l2_sink_generation(source->sink)) {
+        source->last_decoded = NULL;
+        frame_delta_reset(source->delta);
+    }
+}
+
+/*
+ * Called with the decode mutex held: a v4l2 sink buffer to decode the slot's
+ * JPEG into, or NULL to decode into the pool. Only frames the device takes
+ * as they are qualify; cropped and scaled frames change size at decode.
+ */
+static frame_buffer_t *sink_frame_acquire(video_source_t *source, const jpeg_slot_t *slot)
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    if (!source->sink || source->crop_active ||
+        __atomic_load_n(&source->decode_target, __ATOMIC_RELAXED) != 0 ||
+        !jpeg_decoder_probe(slot->data, slot->size, &width, &height)) {
+        return NULL;
+    }
+
+    frame_buffer_t *frame = NULL;
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        frame_buffer_t *candidate = &source->sink_frames[i];
+        if (!candidate->in_use && (!frame || frame == source->last_decoded)) {
+            frame = candidate;
         }
     }
+    if (!frame) {
+        return NULL;
+    }
 
-    if (!source->active) {
-        pthread_mutex_unlock(&source->mutex);
-        return CANON_ERROR_DISCONNECTED;
+    v4l2_sink_buffer_t device;
+    canon_error_t err = v4l2_sink_dequeue(source->sink, width, height, &device);
+    forget_stale_sink_frame(source);
+    if (err != CANON_SUCCESS) {
+        return NULL;
+    }
+    if (!device.direct) {
+        // Converted after the decode instead
+        v4l2_sink_queue(source->sink, &device, false);
+        return NULL;
     }
 
-    frame_buffer_t *buffer = &source->frame_queue[source->read_index];
+    // Band decoding reads the previous frame, which must not be overwritten
+    if (source->last_decoded && source->last_decoded->sink.data == device.data) {
+        source->last_decoded = NULL;
+        frame_delta_reset(source->delta);
+    }
 
-    // Validate buffer has been properly initialized with frame data
-    if (buffer->width == 0 || buffer->height == 0) {
-        pthread_mutex_unlock(&source->mutex);
-        canon_log(LOG_ERROR, "Buffer has invalid dimensions: %ux%u", buffer->width, buffer->height);
-        return CANON_ERROR_UNKNOWN;
+    frame->data[0] = device.data;
+    frame->sink = device;
+    frame->width = 0;
+    frame->height = 0;
+    return frame;
+}
+
+/* Called with the decode mutex held: write a pool frame to the v4l2 sink */
+static void sink_write_copy(video_source_t *source, const frame_buffer_t *buffer,
+                            uint64_t decode_start)
+{
+    v4l2_sink_buffer_t device;
+    canon_error_t err = v4l2_sink_dequeue(source->sink, buffer->width, buffer->height, &device);
+    forget_stale_sink_frame(source);
+
+    if (err == CANON_SUCCESS) {
+        uint64_t span = trace_begin();
+        err = v4l2_sink_fill(source->sink, &device, buffer->data[0],
+                             buffer->data[0] + buffer->width * buffer->height,
+                             buffer->linesize[0], buffer->width, buffer->height);
+        err = v4l2_sink_queue(source->sink, &device, err == CANON_SUCCESS) == CANON_SUCCESS
+            ? err : CANON_ERROR_UNKNOWN;
+        trace_end(TRACE_SINK, span, (uint64_t)buffer->width * buffer->height);
+    }
+
+    if (err == CANON_SUCCESS) {
+        count(&source->counters.sink_frames, 1);
+        latency_histogram_record_atomic(&source->counters.sink_write,
+                                        os_gettime_ns() - decode_start);
+    } else {
+        count(&source->counters.sink_errors, 1);
+    }
+}
+
+/* Queue a frame decoded into a sink buffer once the consumer is done with it */
+static void sink_frame_release(video_source_t *source, const struct obs_source_frame *frame)
+{
+    profiled_mutex_lock(&source->decode_mutex);
+
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        frame_buffer_t *buffer = &source->sink_frames[i];
+        if (!buffer->in_use || buffer->data[0] != frame->data[0]) {
+            continue;
+        }
+
+        if (v4l2_sink_queue(source->sink, &buffer->sink, true) == CANON_SUCCESS) {
+            count(&source->counters.sink_frames, 1);
+            count(&source->counters.sink_frames_direct, 1);
+            latency_histogram_record_atomic(&source->counters.sink_write,
+                                            os_gettime_ns() - buffer->decode_start);
+        } else {
+            count(&source->counters.sink_errors, 1);
+        }
+
+        profiled_mutex_lock(&source->mutex);
+        buffer->in_use = false;
+        profiled_mutex_unlock(&source->mutex);
+        break;
     }
 
+    profiled_mutex_unlock(&source->decode_mutex);
+}
+
+/* Called with the source mutex held: hand a decoded buffer out as a frame */
+static void deliver_locked(video_source_t *source, frame_buffer_t *buffer,
+                           struct obs_source_frame *frame)
+{
     frame->data[0] = buffer->data[0];
     frame->data[1] = buffer->data[0] + (buffer->width * buffer->height);
     frame->linesize[0] = buffer->linesize[0];
@@ -319,269 +779,1508 @@ canon_error_t video_source_get_frame(video_source_t *source,
     frame->format = source->format.format;
 
     buffer->in_use = true;
-
-    source->read_index = (source->read_index + 1) % FRAME_QUEUE_SIZE;
-    source->frame_count--;
-
-    pthread_mutex_unlock(&source->mutex);
-
-    return CANON_SUCCESS;
+    count(&source->counters.frames_delivered, 1);
+    latency_histogram_record_atomic(&source->counters.latency,
+                                    os_gettime_ns() - buffer->capture_start);
 }
 
-void video_source_release_frame(video_source_t *source,
-                               struct obs_source_frame *frame)
+/**
+ * @brief Decode a taken JPEG into a reserved pool buffer and hand it out
+ *
+ * Called with the decode mutex held and the source mutex not held. The slot
+ * is in JPEG_SLOT_DECODING and the buffer marked in use, so neither the
+ * capture thread nor a memory reclaim touches them meanwhile. Without a
+ * frame, the decoded buffer becomes the ready frame instead.
+ */
+static canon_error_t decode_queued(video_source_t *source, jpeg_slot_t *slot,
+                                   frame_buffer_t *buffer, struct obs_source_frame *frame)
 {
-    if (!source || !frame) {
-        return;
-    }
+    uint64_t start = os_gettime_ns();
+    uint64_t span = trace_begin();
+    canon_error_t err = decode_frame(source, slot->data, slot->size, buffer);
+    trace_end(TRACE_DECODE, span, slot->size);
+    update_decoder_memory_locked(source);
+
+    uint64_t frames_decoded = 0;
+    if (err == CANON_SUCCESS) {
+        latency_histogram_record_atomic(&source->counters.decode, os_gettime_ns() - start);
+
+        // Update linesize to match actual dimensions
+        buffer->linesize[0] = buffer->width;
+        buffer->linesize[1] = buffer->width;
+        buffer->capture_start = slot->capture_start;
+        buffer->timestamp = os_gettime_ns();
+
+        if (buffer->sink.data) {
+            // Queued to the device when the consumer releases it
+            buffer->decode_start = start;
+            if (buffer->width != buffer->sink.width || buffer->height != buffer->sink.height) {
+                v4l2_sink_queue(source->sink, &buffer->sink, false);
+            }
+        } else if (source->sink) {
+            sink_write_copy(source, buffer, start);
+        }
 
-    pthread_mutex_lock(&source->mutex);
+        frames_decoded = __atomic_add_fetch(&source->counters.frames_captured, 1,
+                                            __ATOMIC_RELAXED);
+        if (frames_decoded < 5) {
+            canon_log(LOG_INFO, "Converted frame to NV12: %ux%u (actual JPEG dimensions)",
+                     buffer->width, buffer->height);
+        }
 
-    for (int i = 0; i < FRAME_QUEUE_SIZE; i++) {
-        if (source->frame_queue[i].data[0] == frame->data[0]) {
-            source->frame_queue[i].in_use = false;
-            break;
+        if (source->frames_incremental > 0 && frames_decoded % DELTA_REPORT_INTERVAL == 0) {
+            canon_log(LOG_INFO, "Incremental decode: skipped %.1f%% of MCU rows "
+                     "(%lu of %lu frames band-decoded)",
+                     100.0 * (double)(source->mcu_rows_total - source->mcu_rows_decoded) /
+                     (double)source->mcu_rows_total,
+                     (unsigned long)source->frames_incremental,
+                     (unsigned long)frames_decoded);
         }
+    } else {
+        count(&source->counters.decode_errors, 1);
+        canon_log(LOG_ERROR, "Failed to convert JPEG to NV12: %s", canon_error_string(err));
     }
 
-    pthread_mutex_unlock(&source->mutex);
-}
-
-canon_error_t video_source_update_format(video_source_t *source,
-                                        const video_format_info_t *format)
-{
-    if (!source || !format) {
-        return CANON_ERROR_INVALID_PARAM;
-    }
+    profiled_mutex_lock(&source->mutex);
 
-    pthread_mutex_lock(&source->mutex);
+    slot->state = JPEG_SLOT_FREE;
 
-    if (source->active) {
-        pthread_mutex_unlock(&source->mutex);
-        return CANON_ERROR_CAMERA_BUSY;
+    if (err != CANON_SUCCESS) {
+        if (buffer->sink.data) {
+            v4l2_sink_queue(source->sink, &buffer->sink, false);
+        }
+        buffer->in_use = false;
+        profiled_mutex_unlock(&source->mutex);
+        return err;
     }
 
-    memcpy(&source->format, format, sizeof(video_format_info_t));
-    source->format.frame_size = source->format.width * source->format.height * 3 / 2;
-
-    for (int i = 0; i < FRAME_QUEUE_SIZE; i++) {
-        source->frame_queue[i].linesize[0] = source->format.width;
-        source->frame_queue[i].linesize[1] = source->format.width;
+    if (frame) {
+        deliver_locked(source, buffer, frame);
+    } else {
+        if (source->ready && source->ready != buffer) {
+            // Decoded but never taken
+            count(&source->counters.drops_superseded, 1);
+        }
+        buffer->in_use = false;
+        source->ready = buffer;
     }
 
-    pthread_mutex_unlock(&source->mutex);
+    profiled_mutex_unlock(&source->mutex);
 
     return CANON_SUCCESS;
 }
 
-canon_error_t video_source_get_format(video_source_t *source,
-                                     video_format_info_t *format)
+/*
+ * Called from the capture thread with decode_ahead set: decode the newest
+ * queued JPEG into the pool so the consumer only has to take it. Without a
+ * free buffer the JPEG stays queued for the next fetch to supersede.
+ */
+static void decode_ahead(video_source_t *source)
 {
-    if (!source || !format) {
-        return CANON_ERROR_INVALID_PARAM;
-    }
-
-    pthread_mutex_lock(&source->mutex);
-    memcpy(format, &source->format, sizeof(video_format_info_t));
-    pthread_mutex_unlock(&source->mutex);
-
-    return CANON_SUCCESS;
-}
+    profiled_mutex_lock(&source->decode_mutex);
+    profiled_mutex_lock(&source->mutex);
 
-void video_source_get_stats(video_source_t *source,
-                           uint64_t *frames_captured,
-                           uint64_t *frames_dropped)
-{
-    if (!source) {
+    frame_buffer_t *buffer = source->jpeg_count > 0 ? decode_buffer_locked(source) : NULL;
+    if (!buffer) {
+        profiled_mutex_unlock(&source->mutex);
+        profiled_mutex_unlock(&source->decode_mutex);
         return;
     }
 
-    pthread_mutex_lock(&source->mutex);
-
-    if (frames_captured) {
-        *frames_captured = source->frames_captured;
+    if (buffer == source->ready) {
+        // Decoded over before the consumer took it
+        source->ready = NULL;
+        count(&source->counters.drops_superseded, 1);
     }
+    jpeg_slot_t *slot = take_newest_jpeg_locked(source);
+    buffer->in_use = true;
 
-    if (frames_dropped) {
-        *frames_dropped = source->frames_dropped;
-    }
+    profiled_mutex_unlock(&source->mutex);
 
-    pthread_mutex_unlock(&source->mutex);
+    decode_queued(source, slot, buffer, NULL);
+    profiled_mutex_unlock(&source->decode_mutex);
 }
 
-static void *capture_thread_func(void *data)
+canon_error_t video_source_get_frame(video_source_t *source,
+                                    struct obs_source_frame *frame)
 {
-    video_source_t *source = (video_source_t *)data;
+    if (!source || !frame) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
 
-    canon_log(LOG_INFO, "Capture thread started");
+    profiled_mutex_lock(&source->mutex);
 
-    while (source->thread_running && source->active) {
-        size_t bytes_written = 0;
-        canon_error_t err = canon_camera_capture_frame(
+    if (!source->active) {
+        profiled_mutex_unlock(&source->mutex);
+        return CANON_ERROR_DISCONNECTED;
+    }
+
+    uint64_t span = trace_begin();
+
+    while (source->jpeg_count == 0 && source->active) {
+        struct timespec timeout;
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_nsec += 100000000;
+        if (timeout.tv_nsec >= 1000000000) {
+            timeout.tv_sec++;
+            timeout.tv_nsec -= 1000000000;
+        }
+
+        int ret = profiled_cond_timedwait(&source->frame_available,
+                                         &source->mutex, &timeout);
+        if (ret == ETIMEDOUT) {
+            profiled_mutex_unlock(&source->mutex);
+            trace_end(TRACE_QUEUE_WAIT, span, 0);
+            return CANON_ERROR_TIMEOUT;
+        } else if (ret != 0) {
+            // Handle any other error from pthread_cond_timedwait
+            profiled_mutex_unlock(&source->mutex);
+            canon_log(LOG_ERROR, "pthread_cond_timedwait failed with error %d", ret);
+            return CANON_ERROR_UNKNOWN;
+        }
+    }
+
+    trace_end(TRACE_QUEUE_WAIT, span, (uint64_t)source->jpeg_count);
+
+    if (!source->active) {
+        profiled_mutex_unlock(&source->mutex);
+        return CANON_ERROR_DISCONNECTED;
+    }
+
+    // Taken out of the queue before the decode, so the capture thread keeps
+    // queueing newer frames into the other slots meanwhile
+    jpeg_slot_t *slot = queued_jpeg_locked(source, false);
+    slot->state = JPEG_SLOT_DECODING;
+    source->jpeg_count--;
+
+    profiled_mutex_unlock(&source->mutex);
+
+    profiled_mutex_lock(&source->decode_mutex);
+    frame_buffer_t *sink_frame = sink_frame_acquire(source, slot);
+    profiled_mutex_lock(&source->mutex);
+
+    frame_buffer_t *buffer = sink_frame ? sink_frame : decode_buffer_locked(source);
+    if (!buffer) {
+        // The consumer holds every pool buffer; the frame is lost
+        slot->state = JPEG_SLOT_FREE;
+        count(&source->counters.drops_queue_full, 1);
+        profiled_mutex_unlock(&source->mutex);
+        profiled_mutex_unlock(&source->decode_mutex);
+        return CANON_ERROR_CAMERA_BUSY;
+    }
+    buffer->in_use = true;
+
+    profiled_mutex_unlock(&source->mutex);
+
+    canon_error_t err = decode_queued(source, slot, buffer, frame);
+    profiled_mutex_unlock(&source->decode_mutex);
+
+    return err;
+}
+
+canon_error_t video_source_get_latest_frame(video_source_t *source,
+                                           struct obs_source_frame *frame)
+{
+    if (!source || !frame) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    // Never wait on the graphics thread; the capture thread may be queueing
+    if (profiled_mutex_trylock(&source->mutex) != 0) {
+        return CANON_ERROR_CAMERA_BUSY;
+    }
+
+    canon_error_t err = CANON_SUCCESS;
+    if (!source->active) {
+        err = CANON_ERROR_DISCONNECTED;
+    } else if (!source->ready) {
+        err = CANON_ERROR_TIMEOUT;
+    } else {
+        deliver_locked(source, source->ready, frame);
+        source->ready = NULL;
+    }
+
+    profiled_mutex_unlock(&source->mutex);
+
+    return err;
+}
+
+static canon_error_t decode_into(video_source_t *source, const uint8_t *jpeg_data,
+                                 size_t jpeg_size, nv12_target_t *target, bool incremental,
+                                 uint32_t *width, uint32_t *height);
+
+canon_error_t video_source_decode_latest_into(video_source_t *source, uint8_t *y, uint8_t *uv,
+                                              uint32_t linesize, uint32_t max_width,
+                                              uint32_t max_height, uint32_t scale,
+                                              bool incremental, uint32_t *width,
+                                              uint32_t *height)
+{
+    if (!source || !y || !uv || !width || !height) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    profiled_mutex_lock(&source->decode_mutex);
+    profiled_mutex_lock(&source->mutex);
+
+    canon_error_t err = CANON_SUCCESS;
+    jpeg_slot_t *slot = NULL;
+
+    if (!source->active) {
+        err = CANON_ERROR_DISCONNECTED;
+    } else if (source->jpeg_count == 0) {
+        err = CANON_ERROR_TIMEOUT;
+    } else {
+        slot = take_newest_jpeg_locked(source);
+    }
+
+    profiled_mutex_unlock(&source->mutex);
+
+    if (!slot) {
+        profiled_mutex_unlock(&source->decode_mutex);
+        return err;
+    }
+
+    // The decoders only bound the rows and the linesize, so the width is
+    // checked against the destination up front
+    uint32_t full_width = 0;
+    uint32_t full_height = 0;
+    jpeg_decoder_probe(slot->data, slot->size, &full_width, &full_height);
+    if (scale < 1) {
+        scale = 1;
+    }
+    *width = (full_width + scale - 1) / scale;
+    *height = (full_height + scale - 1) / scale;
+
+    uint64_t start = os_gettime_ns();
+    if (*width > max_width || *height > max_height) {
+        err = CANON_ERROR_INVALID_PARAM;
+    } else {
+        nv12_target_t target = {
+            .y = y,
+            .uv = uv,
+            .linesize = linesize,
+            .max_height = max_height,
+            .scale = scale
+        };
+        uint64_t span = trace_begin();
+        err = decode_into(source, slot->data, slot->size, &target, incremental, width, height);
+        trace_end(TRACE_DECODE, span, slot->size);
+        update_decoder_memory_locked(source);
+
+        if (err == CANON_SUCCESS) {
+            latency_histogram_record_atomic(&source->counters.decode, os_gettime_ns() - start);
+            count(&source->counters.frames_captured, 1);
+            count(&source->counters.pixels_decoded, (uint64_t)*width * *height);
+            count(&source->counters.pixels_native, (uint64_t)full_width * full_height);
+        } else {
+            count(&source->counters.decode_errors, 1);
+            canon_log(LOG_ERROR, "Failed to decode JPEG into NV12 planes: %s",
+                     canon_error_string(err));
+        }
+    }
+
+    profiled_mutex_lock(&source->mutex);
+    slot->state = JPEG_SLOT_FREE;
+    if (err == CANON_SUCCESS) {
+        count(&source->counters.frames_delivered, 1);
+        latency_histogram_record_atomic(&source->counters.latency,
+                                        os_gettime_ns() - slot->capture_start);
+    }
+    profiled_mutex_unlock(&source->mutex);
+
+    profiled_mutex_unlock(&source->decode_mutex);
+    return err;
+}
+
+void video_source_release_frame(video_source_t *source,
+                               struct obs_source_frame *frame)
+{
+    if (!source || !frame) {
+        return;
+    }
+
+    bool released = false;
+    profiled_mutex_lock(&source->mutex);
+
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        if (source->frame_pool[i].data[0] == frame->data[0]) {
+            source->frame_pool[i].in_use = false;
+            released = true;
+            break;
+        }
+    }
+
+    profiled_mutex_unlock(&source->mutex);
+
+    if (!released) {
+        sink_frame_release(source, frame);
+    }
+}
+
+canon_error_t video_source_update_format(video_source_t *source,
+                                        const video_format_info_t *format)
+{
+    if (!source || !format) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    profiled_mutex_lock(&source->decode_mutex);
+    profiled_mutex_lock(&source->mutex);
+
+    if (source->active) {
+        profiled_mutex_unlock(&source->mutex);
+        profiled_mutex_unlock(&source->decode_mutex);
+        return CANON_ERROR_CAMERA_BUSY;
+    }
+
+    memcpy(&source->format, format, sizeof(video_format_info_t));
+    source->format.frame_size = source->format.width * source->format.height * 3 / 2;
+
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        source->frame_pool[i].linesize[0] = source->format.width;
+        source->frame_pool[i].linesize[1] = source->format.width;
+    }
+
+    source->ready = NULL;
+    frame_delta_reset(source->delta);
+    source->last_decoded = NULL;
+
+    profiled_mutex_unlock(&source->mutex);
+    profiled_mutex_unlock(&source->decode_mutex);
+
+    return CANON_SUCCESS;
+}
+
+canon_error_t video_source_get_format(video_source_t *source,
+                                     video_format_info_t *format)
+{
+    if (!source || !format) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    profiled_mutex_lock(&source->mutex);
+    memcpy(format, &source->format, sizeof(video_format_info_t));
+    profiled_mutex_unlock(&source->mutex);
+
+    return CANON_SUCCESS;
+}
+
+void video_source_get_stats(video_source_t *source,
+                           uint64_t *frames_captured,
+                           uint64_t *frames_dropped)
+{
+    if (!source) {
+        return;
+    }
+
+    if (frames_captured) {
+        *frames_captured = __atomic_load_n(&source->counters.frames_captured, __ATOMIC_RELAXED);
+    }
+
+    if (frames_dropped) {
+        *frames_dropped = __atomic_load_n(&source->counters.drops_queue_full, __ATOMIC_RELAXED) +
+                          __atomic_load_n(&source->counters.drops_superseded, __ATOMIC_RELAXED);
+    }
+}
+
+void video_source_get_metrics(video_source_t *source,
+                             video_source_metrics_t *metrics)
+{
+    if (!source || !metrics) {
+        return;
+    }
+
+    video_source_counters_t counters;
+    video_source_read_counters(source, &counters);
+
+    profiled_mutex_lock(&source->decode_mutex);
+    metrics->frames_incremental = source->frames_incremental;
+    metrics->mcu_rows_total = source->mcu_rows_total;
+    metrics->mcu_rows_decoded = source->mcu_rows_decoded;
+    profiled_mutex_unlock(&source->decode_mutex);
+
+    profiled_mutex_lock(&source->mutex);
+
+    metrics->frames_captured = counters.frames_captured;
+    metrics->frames_dropped = counters.drops_queue_full + counters.drops_superseded;
+    metrics->capture_errors = counters.capture_timeouts + counters.capture_disconnects +
+                              counters.capture_failures;
+    metrics->latency = counters.latency;
+    profiled_mutex_get_stats(&source->mutex, &metrics->lock);
+
+    profiled_mutex_unlock(&source->mutex);
+}
+
+void video_source_read_counters(video_source_t *source, video_source_counters_t *counters)
+{
+    if (!source || !counters) {
+        return;
+    }
+
+    const video_source_counters_t *live = &source->counters;
+    counters->frames_captured = __atomic_load_n(&live->frames_captured, __ATOMIC_RELAXED);
+    counters->frames_delivered = __atomic_load_n(&live->frames_delivered, __ATOMIC_RELAXED);
+    counters->drops_queue_full = __atomic_load_n(&live->drops_queue_full, __ATOMIC_RELAXED);
+    counters->drops_superseded = __atomic_load_n(&live->drops_superseded, __ATOMIC_RELAXED);
+    counters->decode_errors = __atomic_load_n(&live->decode_errors, __ATOMIC_RELAXED);
+    counters->capture_timeouts = __atomic_load_n(&live->capture_timeouts, __ATOMIC_RELAXED);
+    counters->capture_disconnects = __atomic_load_n(&live->capture_disconnects, __ATOMIC_RELAXED);
+    counters->capture_failures = __atomic_load_n(&live->capture_failures, __ATOMIC_RELAXED);
+    counters->recoveries = __atomic_load_n(&live->recoveries, __ATOMIC_RELAXED);
+    counters->page_faults_minor = __atomic_load_n(&live->page_faults_minor, __ATOMIC_RELAXED);
+    counters->page_faults_major = __atomic_load_n(&live->page_faults_major, __ATOMIC_RELAXED);
+    counters->fetch_duplicates = __atomic_load_n(&live->fetch_duplicates, __ATOMIC_RELAXED);
+    counters->refresh_period = __atomic_load_n(&live->refresh_period, __ATOMIC_RELAXED);
+    counters->zoom = __atomic_load_n(&live->zoom, __ATOMIC_RELAXED);
+    counters->decode_scale = __atomic_load_n(&live->decode_scale, __ATOMIC_RELAXED);
+    counters->pixels_decoded = __atomic_load_n(&live->pixels_decoded, __ATOMIC_RELAXED);
+    counters->pixels_native = __atomic_load_n(&live->pixels_native, __ATOMIC_RELAXED);
+    // Direct first: the sink bumps the total before it, so total >= direct
+    counters->sink_frames_direct = __atomic_load_n(&live->sink_frames_direct, __ATOMIC_RELAXED);
+    counters->sink_frames = __atomic_load_n(&live->sink_frames, __ATOMIC_RELAXED);
+    counters->sink_errors = __atomic_load_n(&live->sink_errors, __ATOMIC_RELAXED);
+    latency_histogram_load(&counters->fetch, &live->fetch);
+    latency_histogram_load(&counters->decode, &live->decode);
+    latency_histogram_load(&counters->latency, &live->latency);
+    latency_histogram_load(&counters->phase_error, &live->phase_error);
+    latency_histogram_load(&counters->sink_write, &live->sink_write);
+}
+
+canon_error_t video_source_set_decoder(video_source_t *source, const char *name)
+{
+    if (!source) {
+        return CANON_ERROR_INVALID_PARAM;
+    }
+
+    int index = -1;
+    if (name && *name && strcmp(name, "auto") != 0) {
+        index = jpeg_decoder_backend_find(name);
+        if (index < 0) {
+            canon_log(LOG_WARNING, "Unknown JPEG decoder '%s'", name);
+            return CANON_ERROR_NOT_SUPPORTED;
+        }
+    }
+
+    profiled_mutex_lock(&source->decode_mutex);
+    if (source->decoder_override != index) {
+        source->decoder_override = index;
+        source->decoder_index = -1;
+        source->calibration_frames = 0;
+    }
+    profiled_mutex_unlock(&source->decode_mutex);
+
+    return CANON_SUCCESS;
+}
+
+canon_error_t video_source_prefer_decoder(uint32_t width, uint32_t height, const char *name)
+{
+    int index = name ? jpeg_decoder_backend_find(name) : -1;
+    if (index < 0 || width == 0 || height == 0) {
+        return CANON_ERROR_NOT_SUPPORTED;
+    }
+
+    decoder_cache_store(width, height, index);
+    return CANON_SUCCESS;
+}
+
+void video_source_set_sync_group(video_source_t *source, uint32_t group)
+{
+    if (!source) {
+        return;
+    }
+
+    if (group > CAPTURE_SYNC_MAX_GROUP) {
+        canon_log(LOG_WARNING, "Invalid capture sync group %u", group);
+        group = 0;
+    }
+    __atomic_store_n(&source->sync_group, group, __ATOMIC_RELAXED);
+}
+
+void video_source_set_preview_stream(video_source_t *source, mjpeg_server_t *server)
+{
+    if (!source) {
+        return;
+    }
+
+    profiled_mutex_lock(&source->stream_mutex);
+    source->stream = server;
+    profiled_mutex_unlock(&source->stream_mutex);
+}
+
+void video_source_set_v4l2_sink(video_source_t *source, v4l2_sink_t *sink)
+{
+    if (!source) {
+        return;
+    }
+
+    profiled_mutex_lock(&source->decode_mutex);
+
+    if (source->last_decoded && source->last_decoded->sink.data) {
+        source->last_decoded = NULL;
+        frame_delta_reset(source->delta);
+    }
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        memset(&source->sink_frames[i], 0, sizeof(frame_buffer_t));
+    }
+    source->sink = sink;
+
+    profiled_mutex_unlock(&source->decode_mutex);
+}
+
+void video_source_set_phase_lock(video_source_t *source, bool enabled)
+{
+    if (!source) {
+        return;
+    }
+
+    __atomic_store_n(&source->phase_lock, enabled, __ATOMIC_RELAXED);
+}
+
+void video_source_set_decode_ahead(video_source_t *source, bool enabled)
+{
+    if (!source) {
+        return;
+    }
+
+    __atomic_store_n(&source->decode_ahead, enabled, __ATOMIC_RELAXED);
+}
+
+void video_source_set_crop(video_source_t *source, video_crop_mode_t mode,
+                           const canon_roi_t *roi)
+{
+    if (!source) {
+        return;
+    }
+
+    canon_roi_t crop = {0.0f, 0.0f, 1.0f, 1.0f};
+    if (mode != VIDEO_CROP_OFF && roi) {
+        crop.x = roi->x > 0.0f ? (roi->x < 1.0f ? roi->x : 1.0f) : 0.0f;
+        crop.y = roi->y > 0.0f ? (roi->y < 1.0f ? roi->y : 1.0f) : 0.0f;
+        crop.width = roi->width < 1.0f - crop.x ? roi->width : 1.0f - crop.x;
+        crop.height = roi->height < 1.0f - crop.y ? roi->height : 1.0f - crop.y;
+    }
+
+    // An empty or whole-frame region is no crop
+    if (crop.width <= 0.0f || crop.height <= 0.0f ||
+        (crop.width >= 1.0f && crop.height >= 1.0f)) {
+        mode = VIDEO_CROP_OFF;
+        crop = (canon_roi_t){0.0f, 0.0f, 1.0f, 1.0f};
+    }
+
+    profiled_mutex_lock(&source->mutex);
+    if (source->crop_mode != mode || memcmp(&source->crop, &crop, sizeof(crop)) != 0) {
+        source->crop_mode = mode;
+        source->crop = crop;
+        source->crop_generation++;
+    }
+    profiled_mutex_unlock(&source->mutex);
+}
+
+void video_source_set_decode_size(video_source_t *source, uint32_t width, uint32_t height)
+{
+    if (!source) {
+        return;
+    }
+
+    uint64_t target = width && height ? (uint64_t)width << 32 | height : 0;
+    __atomic_store_n(&source->decode_target, target, __ATOMIC_RELAXED);
+}
+
+void video_source_get_frame_full_size(video_source_t *source,
+                                      const struct obs_source_frame *frame,
+                                      uint32_t *width, uint32_t *height)
+{
+    if (!source || !frame || !width || !height) {
+        return;
+    }
+
+    *width = frame->width;
+    *height = frame->height;
+
+    profiled_mutex_lock(&source->mutex);
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        frame_buffer_t *buffer = &source->frame_pool[i];
+        if (buffer->data[0] == frame->data[0] && buffer->full_width && buffer->full_height) {
+            *width = buffer->full_width;
+            *height = buffer->full_height;
+            break;
+        }
+    }
+    profiled_mutex_unlock(&source->mutex);
+}
+
+const char *video_source_get_decoder(video_source_t *source)
+{
+    if (!source) {
+        return NULL;
+    }
+
+    profiled_mutex_lock(&source->decode_mutex);
+    int index = source->decoder_override >= 0 ? source->decoder_override
+                                              : source->decoder_index;
+    profiled_mutex_unlock(&source->decode_mutex);
+
+    if (index < 0) {
+        return NULL;
+    }
+    return jpeg_decoder_backend_get((size_t)index)->name;
+}
+
+/**
+ * @brief Queue the fetched JPEG in the staging buffer for the consumer
+ *
+ * Nothing is decoded here: the consumer decodes the frame it takes, so a
+ * frame dropped from a full queue or superseded by a newer one costs a copy
+ * of the compressed data, not a decode. A full queue drops its oldest frame.
+ */
+static void queue_jpeg(video_source_t *source, size_t size, uint64_t capture_start)
+{
+    profiled_mutex_lock(&source->mutex);
+
+    jpeg_slot_t *slot = NULL;
+    for (int i = 0; i < JPEG_QUEUE_SIZE && !slot; i++) {
+        if (source->jpeg_queue[i].state == JPEG_SLOT_FREE) {
+            slot = &source->jpeg_queue[i];
+        }
+    }
+
+    if (!slot) {
+        slot = queued_jpeg_locked(source, false);
+        count(&source->counters.drops_queue_full, 1);
+        if (!slot) {
+            // Every slot is being decoded
+            profiled_mutex_unlock(&source->mutex);
+            return;
+        }
+        source->jpeg_count--;
+    }
+
+    memcpy(slot->data, source->conversion_buffer, size);
+    slot->size = size;
+    slot->sequence = ++source->jpeg_sequence;
+    slot->capture_start = capture_start;
+    slot->state = JPEG_SLOT_QUEUED;
+    source->jpeg_count++;
+
+    pthread_cond_signal(&source->frame_available);
+    profiled_mutex_unlock(&source->mutex);
+}
+
+static void *capture_thread_func(void *data)
+{
+    video_source_t *source = (video_source_t *)data;
+
+    canon_log(LOG_INFO, "Capture thread started");
+    thread_registry_enter(source->cpu, THREAD_ROLE_CAPTURE);
+
+    uint64_t error_streak = 0;
+    capture_sync_t *sync = NULL;
+    uint32_t sync_group = 0;
+    fetch_scheduler_t *scheduler = NULL;
+    uint64_t last_hash = 0;
+    size_t last_size = 0;
+    uint32_t crop_generation = 0;
+    bool crop_applied = false;
+    bool zoomed = false;
+
+    struct rusage faults;
+    getrusage(RUSAGE_THREAD, &faults);
+
+    while (__atomic_load_n(&source->thread_running, __ATOMIC_ACQUIRE) &&
+           __atomic_load_n(&source->active, __ATOMIC_ACQUIRE)) {
+        // Faults of the previous frame (fetch, decode, queue hand-off)
+        count_page_faults(source, &faults);
+
+        uint32_t group = __atomic_load_n(&source->sync_group, __ATOMIC_RELAXED);
+        if (group != sync_group) {
+            capture_sync_leave(sync);
+            sync = group ? capture_sync_join(group, source->format.fps) : NULL;
+            sync_group = group;
+        }
+
+        // Live view starts unmagnified, so the crop is applied on every start
+        profiled_mutex_lock(&source->mutex);
+        uint32_t generation = source->crop_generation;
+        profiled_mutex_unlock(&source->mutex);
+        if (!crop_applied || generation != crop_generation) {
+            apply_crop(source, &zoomed);
+            crop_generation = generation;
+            crop_applied = true;
+        }
+
+        bool phase_lock = !sync && __atomic_load_n(&source->phase_lock, __ATOMIC_RELAXED);
+        if (phase_lock && !scheduler) {
+            scheduler = fetch_scheduler_create(source->format.fps);
+        } else if (!phase_lock && scheduler) {
+            fetch_scheduler_destroy(scheduler);
+            scheduler = NULL;
+            __atomic_store_n(&source->counters.refresh_period, 0, __ATOMIC_RELAXED);
+        }
+
+        // Synced and phase-locked cameras sleep before the fetch, instead of
+        // a frame interval after it
+        uint64_t tick = sync ? capture_sync_wait(sync) : 0;
+        if (scheduler) {
+            sleep_until(fetch_scheduler_next(scheduler, os_gettime_ns()));
+        }
+
+        size_t bytes_written = 0;
+        uint64_t capture_start = os_gettime_ns();
+        uint64_t span = trace_begin();
+        canon_error_t err = canon_camera_capture_frame(
             source->camera,
             source->conversion_buffer,
             source->conversion_buffer_size,
             &bytes_written);
+        trace_end(TRACE_FETCH, span, bytes_written);
 
         if (err != CANON_SUCCESS) {
-            if (err != CANON_ERROR_TIMEOUT) {
+            if (err == CANON_ERROR_TIMEOUT) {
+                count(&source->counters.capture_timeouts, 1);
+            } else if (err == CANON_ERROR_DISCONNECTED) {
+                count(&source->counters.capture_disconnects, 1);
+            } else {
+                count(&source->counters.capture_failures, 1);
+            }
+
+            // Log the first failure of a streak, not every retry
+            if (err != CANON_ERROR_TIMEOUT && error_streak++ == 0) {
                 canon_log(LOG_ERROR, "Failed to capture frame: %s",
                          canon_error_string(err));
             }
-            usleep(1000000 / source->format.fps);
+            if (!sync) {
+                usleep(1000000 / source->format.fps);
+            }
             continue;
         }
 
-        if (source->frames_captured < 5) {
-            canon_log(LOG_INFO, "Captured JPEG frame: %zu bytes", bytes_written);
+        uint64_t fetched = os_gettime_ns();
+        latency_histogram_record_atomic(&source->counters.fetch, fetched - capture_start);
+        if (sync) {
+            capture_sync_report(sync, tick, capture_start, fetched);
+        }
+
+        // The camera answers with its current live view buffer, which is the
+        // previous frame again if it has not refreshed since the last fetch
+        uint64_t hash = preview_hash(source->conversion_buffer, bytes_written);
+        bool duplicate = bytes_written == last_size && hash == last_hash;
+        last_hash = hash;
+        last_size = bytes_written;
+
+        if (scheduler) {
+            uint64_t phase_error;
+            if (fetch_scheduler_observe(scheduler, capture_start, fetched, duplicate,
+                                        &phase_error)) {
+                latency_histogram_record_atomic(&source->counters.phase_error, phase_error);
+            }
+            __atomic_store_n(&source->counters.refresh_period,
+                             fetch_scheduler_is_locked(scheduler)
+                             ? fetch_scheduler_period(scheduler) : 0, __ATOMIC_RELAXED);
         }
 
-        pthread_mutex_lock(&source->mutex);
+        if (error_streak > 0) {
+            canon_log(LOG_INFO, "Frame capture recovered after %lu failed attempts",
+                     (unsigned long)error_streak);
+            count(&source->counters.recoveries, 1);
+            error_streak = 0;
+        }
 
-        if (source->frame_count >= FRAME_QUEUE_SIZE) {
-            source->frames_dropped++;
-            pthread_mutex_unlock(&source->mutex);
+        if (duplicate) {
+            count(&source->counters.fetch_duplicates, 1);
+            if (!sync && !scheduler) {
+                usleep(1000000 / source->format.fps);
+            }
             continue;
         }
 
-        frame_buffer_t *buffer = &source->frame_queue[source->write_index];
+        uint64_t frames_captured = __atomic_load_n(&source->counters.frames_captured,
+                                                   __ATOMIC_RELAXED);
+        if (frames_captured < 5) {
+            canon_log(LOG_INFO, "Captured JPEG frame: %zu bytes", bytes_written);
+        }
 
-        if (!buffer->in_use) {
-            buffer->width = source->format.width;
-            buffer->height = source->format.height;
+        profiled_mutex_lock(&source->stream_mutex);
+        mjpeg_server_publish(source->stream, source->conversion_buffer, bytes_written);
+        profiled_mutex_unlock(&source->stream_mutex);
+
+        if (bytes_written > JPEG_SLOT_SIZE) {
+            count(&source->counters.decode_errors, 1);
+            canon_log(LOG_ERROR, "Preview JPEG of %zu bytes does not fit a queue slot",
+                     bytes_written);
+        } else {
+            queue_jpeg(source, bytes_written, capture_start);
+            if (__atomic_load_n(&source->decode_ahead, __ATOMIC_RELAXED)) {
+                decode_ahead(source);
+            }
+        }
 
-            err = convert_jpeg_to_nv12(
-                source->conversion_buffer,
-                bytes_written,
-                buffer->data[0],
-                &buffer->width,
-                &buffer->height);
+        if (!sync && !scheduler) {
+            usleep(1000000 / source->format.fps);
+        }
+    }
 
-            if (err == CANON_SUCCESS) {
-                // Update linesize to match actual dimensions
-                buffer->linesize[0] = buffer->width;
-                buffer->linesize[1] = buffer->width;
+    count_page_faults(source, &faults);
+    fetch_scheduler_destroy(scheduler);
+    capture_sync_leave(sync);
+    canon_log(LOG_INFO, "Capture thread stopped");
+    thread_registry_leave();
+    return NULL;
+}
 
-                buffer->timestamp = os_gettime_ns();
-                source->write_index = (source->write_index + 1) % FRAME_QUEUE_SIZE;
-                source->frame_count++;
-                source->frames_captured++;
-                source->last_frame_time = buffer->timestamp;
+static float clamp_fraction(float value)
+{
+    return value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+}
 
-                if (source->frames_captured < 5) {
-                    canon_log(LOG_INFO, "Converted frame to NV12: %ux%u (actual JPEG dimensions)",
-                             buffer->width, buffer->height);
-                }
+/**
+ * Drive the camera zoom for the requested crop and work out what is left to
+ * crop on the host. Runs on the capture thread, between fetches.
+ */
+static void apply_crop(video_source_t *source, bool *zoomed)
+{
+    profiled_mutex_lock(&source->mutex);
+    video_crop_mode_t mode = source->crop_mode;
+    canon_roi_t crop = source->crop;
+    profiled_mutex_unlock(&source->mutex);
+
+    canon_roi_t view = {0.0f, 0.0f, 1.0f, 1.0f};
+    if (mode == VIDEO_CROP_CAMERA) {
+        canon_error_t err = canon_camera_set_zoom(source->camera, &crop, &view);
+        if (err != CANON_SUCCESS) {
+            canon_log(LOG_INFO, "Camera zoom not available for this crop, "
+                     "cropping on the host");
+        }
+        *zoomed = view.width < 1.0f;
+    } else if (*zoomed) {
+        canon_camera_set_zoom(source->camera, NULL, NULL);
+        *zoomed = false;
+    }
 
-                pthread_cond_signal(&source->frame_available);
-            } else {
-                canon_log(LOG_ERROR, "Failed to convert JPEG to NV12: %s",
-                         canon_error_string(err));
+    __atomic_store_n(&source->counters.zoom,
+                     *zoomed ? (uint64_t)(1.0f / view.width + 0.5f) : 1, __ATOMIC_RELAXED);
+
+    // The part of the crop within the magnified view is cut on the host
+    canon_roi_t region = {
+        .x = clamp_fraction((crop.x - view.x) / view.width),
+        .y = clamp_fraction((crop.y - view.y) / view.height),
+        .width = clamp_fraction(crop.width / view.width),
+        .height = clamp_fraction(crop.height / view.height)
+    };
+
+    profiled_mutex_lock(&source->decode_mutex);
+    source->decode_region = region;
+    source->crop_active = mode != VIDEO_CROP_OFF &&
+                          (region.width < 1.0f || region.height < 1.0f);
+    frame_delta_reset(source->delta);
+    source->last_decoded = NULL;
+
+    // Frames fetched before the change show the old view
+    profiled_mutex_lock(&source->mutex);
+    for (int i = 0; i < JPEG_QUEUE_SIZE; i++) {
+        if (source->jpeg_queue[i].state == JPEG_SLOT_QUEUED) {
+            source->jpeg_queue[i].state = JPEG_SLOT_FREE;
+            count(&source->counters.drops_superseded, 1);
+        }
+    }
+    source->jpeg_count = 0;
+    source->ready = NULL;
+    profiled_mutex_unlock(&source->mutex);
+
+    profiled_mutex_unlock(&source->decode_mutex);
+}
+
+static bool get_decoder_ctx(video_source_t *source, int index, void **ctx)
+{
+    const jpeg_decoder_backend_t *backend = jpeg_decoder_backend_get((size_t)index);
+
+    if (!source->decoder_ctx_created[index]) {
+        source->decoder_ctx_created[index] = true;
+        if (backend->create) {
+            source->decoder_ctx[index] = backend->create();
+            if (!source->decoder_ctx[index]) {
+                canon_log(LOG_WARNING, "Failed to create %s decoder", backend->name);
             }
         }
+    }
+
+    if (backend->create && !source->decoder_ctx[index]) {
+        return false;
+    }
+
+    *ctx = source->decoder_ctx[index];
+    return true;
+}
+
+static canon_error_t run_decoder(video_source_t *source, int index,
+                                 const uint8_t *jpeg_data, size_t jpeg_size,
+                                 nv12_target_t *target, uint32_t *width, uint32_t *height)
+{
+    void *ctx = NULL;
+
+    if (!get_decoder_ctx(source, index, &ctx)) {
+        return CANON_ERROR_NOT_SUPPORTED;
+    }
+
+    return jpeg_decoder_backend_get((size_t)index)->decode(ctx, jpeg_data, jpeg_size,
+                                                           target, width, height);
+}
+
+static int decoder_cache_lookup(uint32_t width, uint32_t height)
+{
+    int index = -1;
+
+    pthread_mutex_lock(&g_decoder_cache_mutex);
+    for (int i = 0; i < g_decoder_cache_count; i++) {
+        if (g_decoder_cache[i].width == width && g_decoder_cache[i].height == height) {
+            index = g_decoder_cache[i].index;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_decoder_cache_mutex);
 
-        pthread_mutex_unlock(&source->mutex);
+    return index;
+}
 
-        usleep(1000000 / source->format.fps);
+static void decoder_cache_store(uint32_t width, uint32_t height, int index)
+{
+    pthread_mutex_lock(&g_decoder_cache_mutex);
+
+    int slot = g_decoder_cache_count;
+    for (int i = 0; i < g_decoder_cache_count; i++) {
+        if (g_decoder_cache[i].width == width && g_decoder_cache[i].height == height) {
+            slot = i;
+            break;
+        }
     }
 
-    canon_log(LOG_INFO, "Capture thread stopped");
-    return NULL;
+    if (slot == DECODER_CACHE_SIZE) {
+        slot = DECODER_CACHE_SIZE - 1;
+    } else if (slot == g_decoder_cache_count) {
+        g_decoder_cache_count++;
+    }
+
+    g_decoder_cache[slot].width = width;
+    g_decoder_cache[slot].height = height;
+    g_decoder_cache[slot].index = index;
+
+    pthread_mutex_unlock(&g_decoder_cache_mutex);
 }
 
-static canon_error_t convert_jpeg_to_nv12(const uint8_t *jpeg_data, size_t jpeg_size,
-                                         uint8_t *nv12_data, uint32_t *width, uint32_t *height)
+/**
+ * @brief Pick the decoder for this frame
+ * @return Backend index, or -1 if the frame should be used for calibration
+ */
+static int select_decoder(video_source_t *source, const uint8_t *jpeg_data, size_t jpeg_size,
+                          uint32_t scale)
 {
-    struct jpeg_decompress_struct cinfo;
-    struct jpeg_error_mgr jerr;
+    if (source->decoder_override >= 0) {
+        return source->decoder_override;
+    }
 
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_decompress(&cinfo);
+    if (source->decoder_index >= 0) {
+        return source->decoder_index;
+    }
 
-    jpeg_mem_src(&cinfo, (unsigned char *)jpeg_data, jpeg_size);
+    uint32_t width, height;
+    if (!jpeg_decoder_probe(jpeg_data, jpeg_size, &width, &height)) {
+        return jpeg_decoder_backend_fallback();
+    }
 
-    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
-        jpeg_destroy_decompress(&cinfo);
-        canon_log(LOG_ERROR, "Failed to read JPEG header");
+    // Calibration results are kept per decoded size
+    width = (width + scale - 1) / scale;
+    height = (height + scale - 1) / scale;
+
+    int index = decoder_cache_lookup(width, height);
+    if (index >= 0) {
+        source->decoder_index = index;
+        source->decoder_width = width;
+        source->decoder_height = height;
+        canon_log(LOG_INFO, "Using cached JPEG decoder %s for %ux%u",
+                 jpeg_decoder_backend_get((size_t)index)->name, width, height);
+    }
+
+    return index;
+}
+
+/**
+ * @brief Decode a real frame with every backend and time each one
+ *
+ * The backend order rotates between frames so no backend always pays for
+ * cold caches. All backends decode into the same target, so if the last one
+ * to run fails partway through, the frame is decoded again with the last
+ * backend that succeeded. A failure only counts against that backend's
+ * samples. After DECODER_CALIBRATION_FRAMES frames the backend with the best
+ * single-frame time among those that failed on fewer than half as many
+ * frames wins and is cached for this geometry.
+ */
+static canon_error_t calibrate_decoders(video_source_t *source,
+                                        const uint8_t *jpeg_data, size_t jpeg_size,
+                                        const nv12_target_t *dest,
+                                        uint32_t *width, uint32_t *height)
+{
+    int count = (int)jpeg_decoder_backend_count();
+    canon_error_t result = CANON_ERROR_NOT_SUPPORTED;
+    int last_good = -1;
+    bool dest_dirty = false;
+
+    if (source->calibration_frames == 0) {
+        memset(source->calibration_ns, 0, sizeof(source->calibration_ns));
+        memset(source->calibration_failures, 0, sizeof(source->calibration_failures));
+    }
+
+    for (int n = 0; n < count; n++) {
+        int index = (n + (int)source->calibration_frames) % count;
+        nv12_target_t target = *dest;
+        uint32_t decoded_width, decoded_height;
+
+        uint64_t start = os_gettime_ns();
+        canon_error_t err = run_decoder(source, index, jpeg_data, jpeg_size,
+                                        &target, &decoded_width, &decoded_height);
+        uint64_t elapsed = os_gettime_ns() - start;
+
+        if (err != CANON_SUCCESS) {
+            source->calibration_failures[index]++;
+            dest_dirty = true;
+            if (result != CANON_SUCCESS) {
+                result = err;
+            }
+            continue;
+        }
+
+        if (source->calibration_ns[index] == 0 || elapsed < source->calibration_ns[index]) {
+            source->calibration_ns[index] = elapsed;
+        }
+
+        *width = decoded_width;
+        *height = decoded_height;
+        last_good = index;
+        dest_dirty = false;
+        result = CANON_SUCCESS;
+    }
+
+    if (result != CANON_SUCCESS) {
+        return result;
+    }
+
+    // A failed backend ran after the last good one and left partial rows
+    if (dest_dirty) {
+        nv12_target_t target = *dest;
+        result = run_decoder(source, last_good, jpeg_data, jpeg_size,
+                             &target, width, height);
+        if (result != CANON_SUCCESS) {
+            return result;
+        }
+    }
+
+    if (++source->calibration_frames < DECODER_CALIBRATION_FRAMES) {
+        return CANON_SUCCESS;
+    }
+
+    int best = -1;
+    for (int i = 0; i < count; i++) {
+        uint64_t ns = source->calibration_ns[i];
+        uint32_t failures = source->calibration_failures[i];
+        if (failures > 0) {
+            canon_log(LOG_INFO, "Decoder calibration %ux%u: %s failed on %u frames",
+                     *width, *height, jpeg_decoder_backend_get((size_t)i)->name, failures);
+        }
+        if (ns == 0 || failures * 2 >= DECODER_CALIBRATION_FRAMES) {
+            continue;
+        }
+        canon_log(LOG_INFO, "Decoder calibration %ux%u: %s %.2f ms",
+                 *width, *height,
+                 jpeg_decoder_backend_get((size_t)i)->name, (double)ns / 1000000.0);
+        if (best < 0 || ns < source->calibration_ns[best]) {
+            best = i;
+        }
+    }
+
+    source->calibration_frames = 0;
+    if (best >= 0) {
+        source->decoder_index = best;
+        source->decoder_width = *width;
+        source->decoder_height = *height;
+        decoder_cache_store(*width, *height, best);
+        canon_log(LOG_INFO, "Selected JPEG decoder %s for %ux%u",
+                 jpeg_decoder_backend_get((size_t)best)->name, *width, *height);
+    }
+
+    return CANON_SUCCESS;
+}
+
+/**
+ * @brief Decode the crop region only
+ *
+ * Cropped frames bypass band decoding and decoder calibration, which are
+ * tuned for full frames.
+ */
+static jpeg_region_t crop_region(const video_source_t *source, uint32_t width, uint32_t height)
+{
+    const canon_roi_t *crop = &source->decode_region;
+    jpeg_region_t region = {
+        .x = (uint32_t)(crop->x * (float)width),
+        .y = (uint32_t)(crop->y * (float)height),
+        .width = (uint32_t)(crop->width * (float)width + 0.5f),
+        .height = (uint32_t)(crop->height * (float)height + 0.5f)
+    };
+    return region;
+}
+
+static canon_error_t decode_region(video_source_t *source, const uint8_t *jpeg_data,
+                                   size_t jpeg_size, uint32_t width, uint32_t height,
+                                   uint32_t scale, frame_buffer_t *buffer)
+{
+    if (width == 0 || height == 0) {
         return CANON_ERROR_UNKNOWN;
     }
 
-    cinfo.out_color_space = JCS_RGB;
-    jpeg_start_decompress(&cinfo);
+    jpeg_region_t region = crop_region(source, width, height);
+    nv12_target_t target = {
+        .y = buffer->data[0],
+        .capacity = buffer_capacity(buffer),
+        .scale = scale
+    };
 
-    // Use actual JPEG dimensions, not requested dimensions
-    uint32_t actual_width = cinfo.output_width;
-    uint32_t actual_height = cinfo.output_height;
+    source->last_decoded = NULL;
+    return jpeg_decoder_decode_region(jpeg_data, jpeg_size, &region, &target,
+                                      &buffer->width, &buffer->height);
+}
 
-    static bool logged_mismatch = false;
-    if (!logged_mismatch && (actual_width != *width || actual_height != *height)) {
-        canon_log(LOG_INFO, "JPEG size: got %ux%u, requested %ux%u - using actual JPEG size",
-                 actual_width, actual_height, *width, *height);
-        logged_mismatch = true;
+/**
+ * @brief Pick the DCT scale for a frame shown at the requested on-canvas size
+ *
+ * The smallest decode that still covers the canvas size wins. Scaling down
+ * needs DECODE_SCALE_MARGIN of headroom, scaling back up happens at once, so
+ * a scene item resized around a threshold does not flip between scales.
+ */
+static uint32_t plan_decode_scale(video_source_t *source, uint32_t width, uint32_t height)
+{
+    uint64_t target = __atomic_load_n(&source->decode_target, __ATOMIC_RELAXED);
+    uint64_t target_width = target >> 32;
+    uint64_t target_height = target & UINT32_MAX;
+    uint32_t current = source->decode_scale;
+    uint32_t scale = 1;
+
+    for (uint32_t s = 8; target != 0 && width > 0 && height > 0 && s > 1; s /= 2) {
+        uint64_t margin = s > current ? DECODE_SCALE_MARGIN : 0;
+        uint64_t scaled_width = (uint64_t)((width + s - 1) / s) * (100 - margin);
+        uint64_t scaled_height = (uint64_t)((height + s - 1) / s) * (100 - margin);
+        if (scaled_width >= target_width * 100 && scaled_height >= target_height * 100) {
+            scale = s;
+            break;
+        }
+    }
+
+    if (scale != current) {
+        if (target == 0) {
+            canon_log(LOG_INFO, "Decode scale 1/1: full size");
+        } else {
+            canon_log(LOG_INFO, "Decode scale 1/%u: %ux%u for %llux%llu on canvas",
+                     scale, (width + scale - 1) / scale, (height + scale - 1) / scale,
+                     (unsigned long long)target_width, (unsigned long long)target_height);
+        }
+        source->decode_scale = scale;
+        __atomic_store_n(&source->counters.decode_scale, scale, __ATOMIC_RELAXED);
+    }
+
+    return scale;
+}
+
+static canon_error_t decode_full(video_source_t *source, const uint8_t *jpeg_data,
+                                 size_t jpeg_size, uint32_t scale, frame_buffer_t *buffer);
+
+static canon_error_t decode_frame(video_source_t *source, const uint8_t *jpeg_data,
+                                  size_t jpeg_size, frame_buffer_t *buffer)
+{
+    // A failed probe decodes at full size and lets the decoder report the error
+    uint32_t width = 0;
+    uint32_t height = 0;
+    jpeg_decoder_probe(jpeg_data, jpeg_size, &width, &height);
+
+    // Size of a full-size decode, as jpeg_decoder_decode_region() aligns it
+    uint32_t native_width = width;
+    uint32_t native_height = height;
+    if (source->crop_active) {
+        jpeg_region_t region = crop_region(source, width, height);
+        uint32_t x = region.x & ~1u;
+        uint32_t y = region.y & ~1u;
+        native_width = x < width ? (width - x < region.width ? width - x : region.width) & ~1u : 0;
+        native_height = y < height ? (height - y < region.height ? height - y : region.height) & ~1u : 0;
     }
 
-    *width = actual_width;
-    *height = actual_height;
+    uint32_t scale = plan_decode_scale(source, native_width, native_height);
+    canon_error_t err = source->crop_active
+        ? decode_region(source, jpeg_data, jpeg_size, width, height, scale, buffer)
+        : decode_full(source, jpeg_data, jpeg_size, scale, buffer);
 
-    uint32_t row_stride = cinfo.output_width * cinfo.output_components;
-    JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)
-        ((j_common_ptr)&cinfo, JPOOL_IMAGE, row_stride, 1);
+    if (err == CANON_SUCCESS) {
+        if (native_width == 0 || native_height == 0) {
+            native_width = buffer->width * scale;
+            native_height = buffer->height * scale;
+        }
+        buffer->scale = scale;
+        buffer->full_width = native_width;
+        buffer->full_height = native_height;
+        count(&source->counters.pixels_decoded, (uint64_t)buffer->width * buffer->height);
+        count(&source->counters.pixels_native, (uint64_t)native_width * native_height);
+    }
+    return err;
+}
 
-    // Allocate RGB buffer
-    uint8_t *rgb_data = malloc(actual_width * actual_height * 3);
-    if (!rgb_data) {
-        jpeg_destroy_decompress(&cinfo);
-        return CANON_ERROR_MEMORY;
+static canon_error_t decode_full(video_source_t *source, const uint8_t *jpeg_data,
+                                 size_t jpeg_size, uint32_t scale, frame_buffer_t *buffer)
+{
+    uint8_t *y_plane = buffer->data[0];
+    frame_buffer_t *previous = source->last_decoded;
+    canon_error_t err;
+
+    uint64_t span = trace_begin();
+    frame_delta_mode_t mode = frame_delta_prepare(source->delta, jpeg_data, jpeg_size);
+    uint32_t mcu_rows = frame_delta_mcu_rows(source->delta);
+    trace_end(TRACE_DELTA, span, mcu_rows);
+
+    int decoder = select_decoder(source, jpeg_data, jpeg_size, scale);
+    if (decoder < 0) {
+        nv12_target_t target = {
+            .y = y_plane,
+            .capacity = buffer_capacity(buffer),
+            .scale = scale
+        };
+        err = calibrate_decoders(source, jpeg_data, jpeg_size, &target,
+                                 &buffer->width, &buffer->height);
+        if (err != CANON_SUCCESS) {
+            frame_delta_reset(source->delta);
+            source->last_decoded = NULL;
+            return err;
+        }
+
+        source->mcu_rows_total += mcu_rows;
+        source->mcu_rows_decoded += mcu_rows;
+        source->last_decoded = buffer;
+        frame_delta_commit(source->delta);
+        return CANON_SUCCESS;
+    }
+
+    // Band geometry is in full-size rows, so scaled frames decode whole
+    if (mode == FRAME_DELTA_INCREMENTAL && scale == 1 && previous && previous != buffer &&
+        previous->width > 0 && previous->height > 0 && previous->scale <= 1) {
+        uint32_t width = previous->width;
+        uint32_t height = previous->height;
+        uint8_t *uv_plane = y_plane + width * height;
+        const uint8_t *prev_y = previous->data[0];
+        const uint8_t *prev_uv = prev_y + width * height;
+        uint32_t rows_decoded = 0;
+        frame_band_t band;
+
+        err = CANON_SUCCESS;
+        while (err == CANON_SUCCESS && frame_delta_next_band(source->delta, &band)) {
+            uint32_t uv_y = band.y / 2;
+            uint32_t uv_rows = (band.y + band.height + 1) / 2 - uv_y;
+
+            if (!band.changed) {
+                memcpy(y_plane + band.y * width, prev_y + band.y * width,
+                       band.height * width);
+                memcpy(uv_plane + uv_y * width, prev_uv + uv_y * width,
+                       uv_rows * width);
+                continue;
+            }
+
+            nv12_target_t target = {
+                .y = y_plane + band.y * width,
+                .uv = uv_plane + uv_y * width,
+                .linesize = width,
+                .max_height = band.height
+            };
+            uint32_t band_width, band_height;
+
+            err = run_decoder(source, decoder, band.jpeg, band.jpeg_size,
+                              &target, &band_width, &band_height);
+            if (err == CANON_SUCCESS &&
+                (band_width != width || band_height != band.height)) {
+                err = CANON_ERROR_UNKNOWN;
+            }
+            rows_decoded += band.mcu_rows;
+        }
+
+        if (err == CANON_SUCCESS) {
+            buffer->width = width;
+            buffer->height = height;
+            source->frames_incremental++;
+            source->mcu_rows_total += mcu_rows;
+            source->mcu_rows_decoded += rows_decoded;
+            source->last_decoded = buffer;
+            frame_delta_commit(source->delta);
+            return CANON_SUCCESS;
+        }
+
+        canon_log(LOG_WARNING, "Band decode failed, falling back to full decode");
+    }
+
+    nv12_target_t target = {
+        .y = y_plane,
+        .capacity = buffer_capacity(buffer),
+        .scale = scale
+    };
+    uint32_t width, height;
+
+    err = run_decoder(source, decoder, jpeg_data, jpeg_size, &target, &width, &height);
+    int fallback = jpeg_decoder_backend_fallback();
+    if (err == CANON_ERROR_NOT_SUPPORTED && decoder != fallback) {
+        canon_log(LOG_WARNING, "JPEG decoder %s cannot handle this stream, using %s",
+                 jpeg_decoder_backend_get((size_t)decoder)->name,
+                 jpeg_decoder_backend_get((size_t)fallback)->name);
+        source->decoder_override = -1;
+        source->decoder_index = fallback;
+        err = run_decoder(source, fallback, jpeg_data, jpeg_size, &target, &width, &height);
+    }
+
+    if (err != CANON_SUCCESS) {
+        frame_delta_reset(source->delta);
+        source->last_decoded = NULL;
+        return err;
+    }
+
+    static bool logged_mismatch = false;
+    if (!logged_mismatch && (width != source->format.width || height != source->format.height)) {
+        canon_log(LOG_INFO, "JPEG size: got %ux%u, requested %ux%u - using actual JPEG size",
+                 width, height, source->format.width, source->format.height);
+        logged_mismatch = true;
     }
 
-    // Read JPEG into RGB
-    uint32_t row = 0;
-    while (cinfo.output_scanline < cinfo.output_height) {
-        jpeg_read_scanlines(&cinfo, buffer, 1);
-        memcpy(rgb_data + (row * actual_width * 3), buffer[0], actual_width * 3);
-        row++;
+    /* Re-select on the next frame if the stream geometry changed */
+    if (source->decoder_index >= 0 &&
+        (width != source->decoder_width || height != source->decoder_height)) {
+        source->decoder_index = -1;
     }
 
-    jpeg_finish_decompress(&cinfo);
-    jpeg_destroy_decompress(&cinfo);
+    buffer->width = width;
+    buffer->height = height;
+    source->mcu_rows_total += mcu_rows;
+    source->mcu_rows_decoded += mcu_rows;
+    source->last_decoded = buffer;
+    frame_delta_commit(source->delta);
+    return CANON_SUCCESS;
+}
 
-    // Convert RGB to NV12
-    uint8_t *y_plane = nv12_data;
-    uint8_t *uv_plane = nv12_data + (actual_width * actual_height);
+/**
+ * @brief Decode the changed bands of a frame over the previous one
+ *
+ * Unchanged bands are already in the caller's planes, so unlike the pool
+ * path nothing is copied. Bands are decoded at the target's scale, which
+ * needs every band to start on an even scaled row for the shared chroma
+ * rows; CANON_ERROR_NOT_SUPPORTED otherwise.
+ */
+static canon_error_t decode_bands_into(video_source_t *source, int decoder,
+                                       const nv12_target_t *target, uint32_t width,
+                                       uint32_t *rows_decoded)
+{
+    uint32_t scale = target->scale > 1 ? target->scale : 1;
+    frame_band_t band;
 
-    // Process Y plane
-    for (uint32_t i = 0; i < actual_height; i++) {
-        for (uint32_t j = 0; j < actual_width; j++) {
-            uint32_t rgb_idx = (i * actual_width + j) * 3;
-            uint8_t r = rgb_data[rgb_idx];
-            uint8_t g = rgb_data[rgb_idx + 1];
-            uint8_t b = rgb_data[rgb_idx + 2];
+    while (frame_delta_next_band(source->delta, &band)) {
+        if (!band.changed) {
+            continue;
+        }
+        if (band.y % (2 * scale) != 0) {
+            return CANON_ERROR_NOT_SUPPORTED;
+        }
 
-            // RGB to Y
-            y_plane[i * actual_width + j] = (uint8_t)(0.299 * r + 0.587 * g + 0.114 * b);
+        uint32_t y = band.y / scale;
+        uint32_t rows = (band.height + scale - 1) / scale;
+        nv12_target_t band_target = {
+            .y = target->y + (size_t)y * target->linesize,
+            .uv = target->uv + (size_t)(y / 2) * target->linesize,
+            .linesize = target->linesize,
+            .max_height = rows,
+            .scale = scale
+        };
+        uint32_t band_width, band_height;
+
+        canon_error_t err = run_decoder(source, decoder, band.jpeg, band.jpeg_size,
+                                        &band_target, &band_width, &band_height);
+        if (err != CANON_SUCCESS) {
+            return err;
+        }
+        if (band_width != width || band_height != rows) {
+            return CANON_ERROR_UNKNOWN;
         }
+        *rows_decoded += band.mcu_rows;
     }
 
-    // Process UV plane (subsampled 2x2)
-    // NV12: UV plane is half height, half width, but U and V are interleaved
-    // So each UV row has 'actual_width' bytes (actual_width/2 UV pairs * 2 bytes per pair)
-    for (uint32_t i = 0; i < actual_height; i += 2) {
-        for (uint32_t j = 0; j < actual_width; j += 2) {
-            uint32_t rgb_idx = (i * actual_width + j) * 3;
-            uint8_t r = rgb_data[rgb_idx];
-            uint8_t g = rgb_data[rgb_idx + 1];
-            uint8_t b = rgb_data[rgb_idx + 2];
+    return CANON_SUCCESS;
+}
 
-            // UV plane index: row * actual_width + column * 2 (for interleaved UV)
-            uint32_t uv_row = i / 2;
-            uint32_t uv_col = j / 2;
-            uint32_t uv_idx = uv_row * actual_width + uv_col * 2;
+/**
+ * @brief Decode a frame into caller planes
+ *
+ * Same decoder selection as decode_full(). With incremental set, the planes
+ * hold the previously decoded frame and only its changed bands are decoded.
+ * The expected size comes in through width and height.
+ */
+static canon_error_t decode_into(video_source_t *source, const uint8_t *jpeg_data,
+                                 size_t jpeg_size, nv12_target_t *target, bool incremental,
+                                 uint32_t *width, uint32_t *height)
+{
+    uint64_t span = trace_begin();
+    frame_delta_mode_t mode = frame_delta_prepare(source->delta, jpeg_data, jpeg_size);
+    uint32_t mcu_rows = frame_delta_mcu_rows(source->delta);
+    trace_end(TRACE_DELTA, span, mcu_rows);
+
+    // The delta now tracks frames outside the pool, so the pool path must
+    // not band-decode over its last buffer
+    source->last_decoded = NULL;
+
+    int decoder = select_decoder(source, jpeg_data, jpeg_size, target->scale);
+    if (decoder < 0) {
+        canon_error_t err = calibrate_decoders(source, jpeg_data, jpeg_size, target,
+                                               width, height);
+        if (err == CANON_SUCCESS) {
+            source->mcu_rows_total += mcu_rows;
+            source->mcu_rows_decoded += mcu_rows;
+            frame_delta_commit(source->delta);
+        } else {
+            frame_delta_reset(source->delta);
+        }
+        return err;
+    }
 
-            uv_plane[uv_idx] = (uint8_t)(-0.169 * r - 0.331 * g + 0.5 * b + 128);     // U
-            uv_plane[uv_idx + 1] = (uint8_t)(0.5 * r - 0.419 * g - 0.081 * b + 128);  // V
+    if (incremental && mode == FRAME_DELTA_INCREMENTAL) {
+        uint32_t rows_decoded = 0;
+        if (decode_bands_into(source, decoder, target, *width, &rows_decoded) ==
+            CANON_SUCCESS) {
+            source->frames_incremental++;
+            source->mcu_rows_total += mcu_rows;
+            source->mcu_rows_decoded += rows_decoded;
+            frame_delta_commit(source->delta);
+            return CANON_SUCCESS;
         }
     }
 
-    free(rgb_data);
+    canon_error_t err = run_decoder(source, decoder, jpeg_data, jpeg_size, target,
+                                    width, height);
+    int fallback = jpeg_decoder_backend_fallback();
+    if (err == CANON_ERROR_NOT_SUPPORTED && decoder != fallback) {
+        canon_log(LOG_WARNING, "JPEG decoder %s cannot handle this stream, using %s",
+                 jpeg_decoder_backend_get((size_t)decoder)->name,
+                 jpeg_decoder_backend_get((size_t)fallback)->name);
+        source->decoder_override = -1;
+        source->decoder_index = fallback;
+        err = run_decoder(source, fallback, jpeg_data, jpeg_size, target, width, height);
+    }
+
+    if (err != CANON_SUCCESS) {
+        frame_delta_reset(source->delta);
+        return err;
+    }
+
+    /* Re-select on the next frame if the stream geometry changed */
+    if (source->decoder_index >= 0 &&
+        (*width != source->decoder_width || *height != source->decoder_height)) {
+        source->decoder_index = -1;
+    }
+
+    source->mcu_rows_total += mcu_rows;
+    source->mcu_rows_decoded += mcu_rows;
+    frame_delta_commit(source->delta);
     return CANON_SUCCESS;
-}
\ No newline at end of file
+}
@@ -6,6 +6,12 @@
 #include <obs-module.h>
 #include "canon-errors.h"
 #include "canon-camera.h"
+#include "mjpeg-server.h"
+#include "v4l2-sink.h"
+#include "utils/latency-histogram.h"
+#include "utils/lock-profiler.h"
+#include "utils/mem-accounting.h"
+#include "utils/thread-registry.h"
 
 /**
  * @brief Video source handle
@@ -23,11 +29,73 @@ typedef struct {
     size_t frame_size;
 } video_format_info_t;
 
+/**
+ * @brief How a source delivers part of the camera's view
+ */
+typedef enum {
+    VIDEO_CROP_OFF = 0,         /**< Full preview */
+    VIDEO_CROP_HOST,            /**< Decode only the region of the preview */
+    VIDEO_CROP_CAMERA           /**< Live view zoom onto the region, host crop of the rest */
+} video_crop_mode_t;
+
+/**
+ * @brief Video pipeline metrics
+ */
+typedef struct {
+    uint64_t frames_captured;
+    uint64_t frames_dropped;
+    uint64_t frames_incremental;    /**< Frames decoded band by band */
+    uint64_t mcu_rows_total;        /**< MCU rows of all frames with restart markers */
+    uint64_t mcu_rows_decoded;      /**< MCU rows that actually went through the decoder */
+    uint64_t capture_errors;        /**< Failed preview fetches */
+    latency_histogram_t latency;    /**< Fetch start to frame hand-off, in ns */
+    lock_stats_t lock;              /**< Source mutex contention (CANON_EOS_LOCK_PROFILE=1) */
+} video_source_metrics_t;
+
+/**
+ * @brief Counters updated atomically by the capture and output paths
+ *
+ * Read with video_source_read_counters(), which never takes the source
+ * mutex; values are cumulative since the source was created.
+ */
+typedef struct {
+    uint64_t frames_captured;       /**< Frames decoded for delivery */
+    uint64_t frames_delivered;      /**< Frames handed to OBS */
+    uint64_t drops_queue_full;      /**< Fetched frames discarded undecoded, no free queue slot */
+    uint64_t drops_superseded;      /**< Queued frames skipped undecoded for a newer one */
+    uint64_t decode_errors;         /**< Fetched frames that failed to decode */
+    uint64_t capture_timeouts;      /**< Preview fetches that timed out */
+    uint64_t capture_disconnects;   /**< Preview fetches failed with the camera gone */
+    uint64_t capture_failures;      /**< Other failed fetches (USB I/O, PTP errors) */
+    uint64_t recoveries;            /**< Capture resumed after a run of failures */
+    uint64_t page_faults_minor;     /**< Page faults of the capture thread, no I/O */
+    uint64_t page_faults_major;     /**< Page faults of the capture thread that read from disk */
+    uint64_t fetch_duplicates;      /**< Fetches that returned the previous frame again (not decoded) */
+    uint64_t refresh_period;        /**< Estimated camera refresh period in ns, 0 without phase lock */
+    uint64_t zoom;                  /**< Live view magnification in use, 1 without camera zoom */
+    uint64_t decode_scale;          /**< JPEG decoded at 1/decode_scale of its size */
+    uint64_t pixels_decoded;        /**< Luma pixels written by the decoder */
+    uint64_t pixels_native;         /**< Luma pixels the same frames have at full size */
+    uint64_t sink_frames;           /**< Frames written to the v4l2 sink */
+    uint64_t sink_frames_direct;    /**< Of those, decoded straight into the device buffer */
+    uint64_t sink_errors;           /**< Frames the v4l2 sink could not take */
+    latency_histogram_t fetch;      /**< Preview fetch from the camera, in ns */
+    latency_histogram_t decode;     /**< JPEG decode at delivery, in ns */
+    latency_histogram_t latency;    /**< Fetch start to frame hand-off, in ns */
+    latency_histogram_t phase_error; /**< Predicted vs measured camera refresh, in ns */
+    latency_histogram_t sink_write; /**< JPEG decode start to frame queued on the v4l2 sink, in ns */
+} video_source_counters_t;
+
 /**
  * @brief Create a new video source
+ *
+ * Its frame pool and staging buffer are not reserved yet; see
+ * video_source_reserve_buffers().
+ * @param account Memory account its buffers are charged to (may be NULL)
+ * @param cpu CPU group its capture thread is charged to (may be NULL)
  * @return Video source handle or NULL on failure
  */
-video_source_t *video_source_create(void);
+video_source_t *video_source_create(mem_account_t *account, cpu_group_t *cpu);
 
 /**
  * @brief Destroy video source
@@ -46,6 +114,17 @@ canon_error_t video_source_init(video_source_t *source,
                                canon_camera_t *camera,
                                const video_format_info_t *format);
 
+/**
+ * @brief Reserve the frame pool and staging buffer against the memory budget
+ *
+ * Called once the account is named after the camera, so a refusal names
+ * it. Buffers released to the budget while stopped are reserved again here
+ * or by video_source_start().
+ * @param source Video source handle
+ * @return CANON_SUCCESS, or CANON_ERROR_MEMORY_BUDGET if the budget refused
+ */
+canon_error_t video_source_reserve_buffers(video_source_t *source);
+
 /**
  * @brief Start video capture
  * @param source Video source handle
@@ -68,6 +147,8 @@ bool video_source_is_active(video_source_t *source);
 
 /**
  * @brief Get next available frame
+ *
+ * Waits for a fetched JPEG and decodes it on the calling thread.
  * @param source Video source handle
  * @param frame Output OBS frame structure
  * @return CANON_SUCCESS or error code
@@ -75,6 +156,53 @@ bool video_source_is_active(video_source_t *source);
 canon_error_t video_source_get_frame(video_source_t *source,
                                     struct obs_source_frame *frame);
 
+/**
+ * @brief Take the newest decoded frame without blocking
+ *
+ * Needs video_source_set_decode_ahead(): the capture thread decodes the
+ * newest fetched frame, and this only hands it out, so nothing is decoded
+ * on the calling thread. Intended for the graphics thread, so it returns
+ * CANON_ERROR_CAMERA_BUSY instead of waiting for the capture thread and
+ * CANON_ERROR_TIMEOUT when no new frame has been decoded since the last
+ * call.
+ * @param source Video source handle
+ * @param frame Output OBS frame structure
+ * @return CANON_SUCCESS or error code
+ */
+canon_error_t video_source_get_latest_frame(video_source_t *source,
+                                           struct obs_source_frame *frame);
+
+/**
+ * @brief Decode the newest fetched frame into caller-owned NV12 planes
+ *
+ * Like video_source_get_latest_frame(), older queued frames are discarded
+ * undecoded, but the frame is written straight into the given planes (a
+ * tile of a larger frame, for instance) instead of a pool buffer, and no
+ * v4l2loopback device or crop applies. Waits for a decode in progress.
+ *
+ * With incremental set, the planes must still hold the frame this function
+ * decoded last, at the same position and scale; only the restart-interval
+ * bands that changed since are decoded over it (see frame-delta.h).
+ * @param source Video source handle
+ * @param y Luma plane, at the frame's top-left pixel
+ * @param uv Interleaved chroma plane, at the same position
+ * @param linesize Bytes per row of both planes
+ * @param max_width Widest frame that fits
+ * @param max_height Tallest frame that fits
+ * @param scale 1, 2, 4 or 8: decode at that fraction of the JPEG size
+ * @param incremental Planes hold the previous frame, decode changed bands only
+ * @param width Output decoded width, also set when the frame does not fit
+ * @param height Output decoded height, also set when the frame does not fit
+ * @return CANON_SUCCESS, CANON_ERROR_TIMEOUT when no new frame is available,
+ *         CANON_ERROR_INVALID_PARAM when the frame does not fit (it is
+ *         dropped), or another error code
+ */
+canon_error_t video_source_decode_latest_into(video_source_t *source, uint8_t *y, uint8_t *uv,
+                                              uint32_t linesize, uint32_t max_width,
+                                              uint32_t max_height, uint32_t scale,
+                                              bool incremental, uint32_t *width,
+                                              uint32_t *height);
+
 /**
  * @brief Release frame after use
  * @param source Video source handle
@@ -111,4 +239,141 @@ void video_source_get_stats(video_source_t *source,
                            uint64_t *frames_captured,
                            uint64_t *frames_dropped);
 
+/**
+ * @brief Get detailed pipeline metrics
+ * @param source Video source handle
+ * @param metrics Output metrics
+ */
+void video_source_get_metrics(video_source_t *source,
+                             video_source_metrics_t *metrics);
+
+/**
+ * @brief Read the lock-free counters
+ * @param source Video source handle
+ * @param counters Output counters
+ */
+void video_source_read_counters(video_source_t *source, video_source_counters_t *counters);
+
+/**
+ * @brief Select the JPEG decoder backend
+ * @param source Video source handle
+ * @param name Backend name, or NULL/"auto" to calibrate on first use
+ * @return CANON_SUCCESS or error code
+ */
+canon_error_t video_source_set_decoder(video_source_t *source, const char *name);
+
+/**
+ * @brief Record the decoder to use for a frame geometry (e.g. from a host profile)
+ *
+ * Sources on "auto" that see frames of this size use the backend right away
+ * instead of calibrating on their first frames.
+ * @param width Decoded frame width
+ * @param height Decoded frame height
+ * @param name Backend name
+ * @return CANON_SUCCESS or CANON_ERROR_NOT_SUPPORTED for an unknown backend
+ */
+canon_error_t video_source_prefer_decoder(uint32_t width, uint32_t height, const char *name);
+
+/**
+ * @brief Align preview fetches with other cameras (see capture-sync.h)
+ *
+ * Takes effect at the capture thread's next frame.
+ * @param source Video source handle
+ * @param group Sync group number, or 0 to run on the source's own timer
+ */
+void video_source_set_sync_group(video_source_t *source, uint32_t group);
+
+/**
+ * @brief Also publish each fetched preview JPEG to a stream server
+ *
+ * Frames go out compressed, as fetched, before any decode. Once this
+ * returns, the capture thread no longer uses a previously set server.
+ * @param source Video source handle
+ * @param server Server (see mjpeg-server.h), or NULL to stop publishing
+ */
+void video_source_set_preview_stream(video_source_t *source, mjpeg_server_t *server);
+
+/**
+ * @brief Also write each decoded frame to a v4l2loopback device
+ *
+ * Frames taken with video_source_get_frame() are decoded straight into a
+ * device buffer when the device takes them as they are (NV12 at the frame
+ * size, no crop or decode scaling), and queued to the device when the frame
+ * is released. Other frames, and all frames taken with
+ * video_source_get_latest_frame(), are converted into a device buffer after
+ * the decode. No frame taken before the call may still be held.
+ * @param source Video source handle
+ * @param sink Sink (see v4l2-sink.h), or NULL to stop writing
+ */
+void video_source_set_v4l2_sink(video_source_t *source, v4l2_sink_t *sink);
+
+/**
+ * @brief Time preview fetches to the camera's refresh (see fetch-scheduler.h)
+ *
+ * Without it the capture thread sleeps one frame interval after each frame.
+ * A sync group takes precedence. Takes effect at the capture thread's next
+ * frame.
+ * @param source Video source handle
+ * @param enabled true to phase-lock fetches
+ */
+void video_source_set_phase_lock(video_source_t *source, bool enabled);
+
+/**
+ * @brief Decode on the capture thread for video_source_get_latest_frame()
+ *
+ * After each fetch the capture thread decodes the newest queued frame into
+ * the frame pool, superseding a decoded frame that was not taken yet.
+ * Leave it off for consumers that decode on their own thread
+ * (video_source_get_frame(), video_source_decode_latest_into()).
+ * @param source Video source handle
+ * @param enabled true to decode ahead of the consumer
+ */
+void video_source_set_decode_ahead(video_source_t *source, bool enabled);
+
+/**
+ * @brief Deliver only a region of the camera's view
+ *
+ * VIDEO_CROP_CAMERA magnifies the live view onto the region where the
+ * camera supports it, so the region arrives with more detail at the same
+ * decode cost, and otherwise falls back to VIDEO_CROP_HOST. Takes effect at
+ * the capture thread's next frame.
+ * @param source Video source handle
+ * @param mode Crop mode
+ * @param roi Region of the full view (ignored for VIDEO_CROP_OFF)
+ */
+void video_source_set_crop(video_source_t *source, video_crop_mode_t mode,
+                           const canon_roi_t *roi);
+
+/**
+ * @brief Decode no larger than the frame is shown
+ *
+ * Frames are decoded at 1/2, 1/4 or 1/8 of the preview size (DCT scaling)
+ * when that still covers the given size, so a source shown in a small
+ * scene item does not pay for a full-size decode. Delivered frames are then
+ * smaller than the video format; see video_source_get_frame_full_size().
+ * Takes effect at the next decode.
+ * @param source Video source handle
+ * @param width On-canvas width in pixels, 0 to always decode at full size
+ * @param height On-canvas height in pixels, 0 to always decode at full size
+ */
+void video_source_set_decode_size(video_source_t *source, uint32_t width, uint32_t height);
+
+/**
+ * @brief Get the size a delivered frame has when decoded at full size
+ * @param source Video source handle
+ * @param frame Frame from video_source_get_frame() or video_source_get_latest_frame()
+ * @param width Set to the full-size width (frame->width without decode scaling)
+ * @param height Set to the full-size height
+ */
+void video_source_get_frame_full_size(video_source_t *source,
+                                      const struct obs_source_frame *frame,
+                                      uint32_t *width, uint32_t *height);
+
+/**
+ * @brief Get the JPEG decoder backend in use
+ * @param source Video source handle
+ * @return Backend name, or NULL while calibrating
+ */
+const char *video_source_get_decoder(video_source_t *source);
+
 #endif /* VIDEO_SOURCE_H */
\ No newline at end of file
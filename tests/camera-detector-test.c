@@ -0,0 +1,233 @@
+/*
+ * Camera detector test.
+ *
+ * Replaces libusb with a fixed set of fake devices and checks that cameras
+ * plugged in before the detector was created can be found by serial number:
+ * once when the initial scan can open them, and once when it cannot and the
+ * serial only arrives with the hotplug enumeration in camera_detector_start().
+ *
+ * The libusb functions defined here take precedence over the shared library
+ * for the detector objects linked into this executable.
+ */
+
+#include <libusb-1.0/libusb.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "camera-detector.h"
+
+struct libusb_context {
+    int unused;
+};
+
+struct libusb_device {
+    uint16_t vendor_id;
+    uint16_t product_id;
+    uint8_t bus;
+    uint8_t address;
+    const char *serial;
+};
+
+struct libusb_device_handle {
+    libusb_device *device;
+};
+
+static struct libusb_context g_context;
+static libusb_device g_devices[] = {
+    {0x04A9, 0x32D2, 1, 5, "083021000123"},   // EOS R5
+    {0x046D, 0x085C, 1, 6, "LOGI0001"},       // Not a Canon camera
+    {0x04A9, 0x3280, 2, 3, "193052004321"},   // EOS 90D
+};
+#define DEVICE_COUNT (sizeof(g_devices) / sizeof(g_devices[0]))
+
+static bool g_open_fails = false;
+static libusb_device_handle g_handle;
+
+int libusb_init(libusb_context **ctx)
+{
+    *ctx = &g_context;
+    return 0;
+}
+
+void libusb_exit(libusb_context *ctx)
+{
+    (void)ctx;
+}
+
+ssize_t libusb_get_device_list(libusb_context *ctx, libusb_device ***list)
+{
+    (void)ctx;
+    static libusb_device *devices[DEVICE_COUNT + 1];
+    for (size_t i = 0; i < DEVICE_COUNT; i++) {
+        devices[i] = &g_devices[i];
+    }
+    devices[DEVICE_COUNT] = NULL;
+    *list = devices;
+    return (ssize_t)DEVICE_COUNT;
+}
+
+void libusb_free_device_list(libusb_device **list, int unref_devices)
+{
+    (void)list;
+    (void)unref_devices;
+}
+
+int libusb_get_device_descriptor(libusb_device *dev, struct libusb_device_descriptor *desc)
+{
+    memset(desc, 0, sizeof(*desc));
+    desc->idVendor = dev->vendor_id;
+    desc->idProduct = dev->product_id;
+    desc->iSerialNumber = dev->serial ? 3 : 0;
+    return 0;
+}
+
+uint8_t libusb_get_bus_number(libusb_device *dev)
+{
+    return dev->bus;
+}
+
+uint8_t libusb_get_device_address(libusb_device *dev)
+{
+    return dev->address;
+}
+
+int libusb_open(libusb_device *dev, libusb_device_handle **dev_handle)
+{
+    if (g_open_fails) {
+        return LIBUSB_ERROR_ACCESS;
+    }
+    g_handle.device = dev;
+    *dev_handle = &g_handle;
+    return 0;
+}
+
+void libusb_close(libusb_device_handle *dev_handle)
+{
+    (void)dev_handle;
+}
+
+int libusb_get_string_descriptor_ascii(libusb_device_handle *dev_handle, uint8_t desc_index,
+                                       unsigned char *data, int length)
+{
+    (void)desc_index;
+    return snprintf((char *)data, (size_t)length, "%s", dev_handle->device->serial);
+}
+
+int libusb_hotplug_register_callback(libusb_context *ctx, int events, int flags,
+                                     int vendor_id, int product_id, int dev_class,
+                                     libusb_hotplug_callback_fn cb_fn, void *user_data,
+                                     libusb_hotplug_callback_handle *callback_handle)
+{
+    (void)events;
+    (void)product_id;
+    (void)dev_class;
+    *callback_handle = 1;
+
+    // Like libusb, deliver the devices already present as arrivals
+    if (flags & LIBUSB_HOTPLUG_ENUMERATE) {
+        for (size_t i = 0; i < DEVICE_COUNT; i++) {
+            if (g_devices[i].vendor_id == vendor_id) {
+                cb_fn(ctx, &g_devices[i], LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, user_data);
+            }
+        }
+    }
+    return LIBUSB_SUCCESS;
+}
+
+void libusb_hotplug_deregister_callback(libusb_context *ctx,
+                                        libusb_hotplug_callback_handle callback_handle)
+{
+    (void)ctx;
+    (void)callback_handle;
+}
+
+int libusb_handle_events_timeout_completed(libusb_context *ctx, struct timeval *tv,
+                                           int *completed)
+{
+    (void)ctx;
+    (void)completed;
+    usleep((useconds_t)tv->tv_usec);
+    return 0;
+}
+
+const char *libusb_strerror(int errcode)
+{
+    (void)errcode;
+    return "fake libusb error";
+}
+
+static int g_failures = 0;
+
+static void expect(bool condition, const char *what)
+{
+    if (!condition) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        g_failures++;
+    }
+}
+
+/* Check that every Canon camera is in the snapshot under its serial number */
+static void expect_serials(camera_detector_t *detector, const char *stage)
+{
+    const camera_snapshot_t *snapshot = camera_detector_acquire_snapshot(detector);
+    char what[256];
+
+    snprintf(what, sizeof(what), "%s: two Canon cameras listed", stage);
+    expect(snapshot->count == 2, what);
+
+    for (size_t i = 0; i < DEVICE_COUNT; i++) {
+        const camera_info_t *camera = camera_snapshot_find_serial(snapshot, g_devices[i].serial);
+        if (g_devices[i].vendor_id != 0x04A9) {
+            snprintf(what, sizeof(what), "%s: %s not listed", stage, g_devices[i].serial);
+            expect(camera == NULL, what);
+            continue;
+        }
+
+        char path[32];
+        snprintf(path, sizeof(path), "/dev/bus/usb/%03d/%03d",
+                 g_devices[i].bus, g_devices[i].address);
+        snprintf(what, sizeof(what), "%s: %s found by serial at %s",
+                 stage, g_devices[i].serial, path);
+        expect(camera != NULL && strcmp(camera->device_path, path) == 0, what);
+    }
+
+    camera_detector_release_snapshot(detector, snapshot);
+}
+
+int main(void)
+{
+    // Initial scan can read the serial numbers
+    camera_detector_t *detector = camera_detector_create();
+    expect(detector != NULL, "detector created");
+    if (!detector) {
+        return 1;
+    }
+    expect_serials(detector, "initial scan");
+    expect(camera_detector_start(detector) == CANON_SUCCESS, "detector started");
+    expect_serials(detector, "after start");
+    camera_detector_destroy(detector);
+
+    // Initial scan cannot open the cameras, the enumeration fills in the serials
+    g_open_fails = true;
+    detector = camera_detector_create();
+    expect(detector != NULL, "detector created without access");
+    if (!detector) {
+        return 1;
+    }
+    const camera_snapshot_t *snapshot = camera_detector_acquire_snapshot(detector);
+    expect(camera_snapshot_find_serial(snapshot, g_devices[0].serial) == NULL,
+           "no serial without access");
+    camera_detector_release_snapshot(detector, snapshot);
+
+    g_open_fails = false;
+    expect(camera_detector_start(detector) == CANON_SUCCESS, "detector started with access");
+    expect_serials(detector, "enumeration");
+    camera_detector_destroy(detector);
+
+    if (g_failures > 0) {
+        fprintf(stderr, "%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("camera detector: all checks passed\n");
+    return 0;
+}